@@ -46,6 +46,7 @@
 #include "ResizeableStringFormatter.h"
 #include "StringParser.h"
 #include "SDPUtils.h"
+#include "SDPCache.h"
 
 #include <errno.h>
 
@@ -55,13 +56,17 @@ class FileSession
 {
     public:
     
-        FileSession() : fAdjustedPlayTime(0), fNextPacketLen(0), fLastQualityCheck(0),
+        FileSession(UInt32 inPacketBatchSize, Bool16 inEnableBursts) : fAdjustedPlayTime(0), fNextPacketLen(0), fLastQualityCheck(0),
                         fAllowNegativeTTs(false), fSpeed(1),
                         fStartTime(-1), fStopTime(-1), fStopTrackID(0), fStopPN(0),
-                        fLastRTPTime(0), fLastPauseTime(0),fTotalPauseTime(0), fPaused(false), fAdjustPauseTime(true)
+                        fLastRTPTime(0), fLastPauseTime(0),fTotalPauseTime(0), fPaused(false), fAdjustPauseTime(true),
+                        fPacketBatch(NEW QTRTPFile::RTPPacketInfo[inPacketBatchSize]), fPacketBatchSize(inPacketBatchSize),
+                        fNumBatchedPackets(0), fNextBatchedPacket(0),
+                        fBurstPackets(NEW QTSS_PacketStruct[inPacketBatchSize]), fBurstPacketLens(NEW UInt32[inPacketBatchSize]),
+                        fEnableBursts(inEnableBursts), fNumBurstPackets(0), fBurstStream(NULL), fBurstSeqNum(0)
         {}
         
-        ~FileSession() {}
+        ~FileSession() { delete [] fPacketBatch; delete [] fBurstPackets; delete [] fBurstPacketLens; }
         
         QTRTPFile           fFile;
         SInt64              fAdjustedPlayTime;
@@ -82,6 +87,22 @@ class FileSession
         SInt64              fTotalPauseTime;
         Bool16              fPaused;
         Bool16              fAdjustPauseTime;
+        
+        // Packets fetched from fFile but not sent yet. The one being sent,
+        // if fPacketStruct.packetData is set, is fNextBatchedPacket - 1.
+        QTRTPFile::RTPPacketInfo*   fPacketBatch;
+        UInt32              fPacketBatchSize;
+        UInt32              fNumBatchedPackets;
+        UInt32              fNextBatchedPacket;
+        
+        // With packet bursts on, packets for one stream wait here, pointing into
+        // fPacketBatch, until they can all be written with one QTSS_WritePackets.
+        QTSS_PacketStruct*  fBurstPackets;
+        UInt32*             fBurstPacketLens;
+        Bool16              fEnableBursts;
+        UInt32              fNumBurstPackets;
+        QTSS_Object         fBurstStream;
+        UInt16              fBurstSeqNum;
 };
 
 // ref to the prefs dictionary object
@@ -142,6 +163,13 @@ static UInt32               sPrivateBufferMaxUnits  = 0;
 
 static Float32              sAddClientBufferDelaySecs = 0;
 
+static Bool16               sMapMovieHeaders        = false;
+static UInt32               sMovieCacheSizeInMB     = 32;
+static UInt32               sSDPCacheSizeInKB       = 1024;
+static Bool16               sEnablePacketIndex      = true;
+static UInt32               sPacketBatchSize        = 4;
+static Bool16               sEnablePacketBursts     = true;
+
 static Bool16               sRecordMovieFileSDP = false;
 static Bool16               sEnableMovieFileSDP = false;
 
@@ -173,6 +201,7 @@ static QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParamBlock);
 static QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams);
 static QTSS_Error DestroySession(QTSS_ClientSessionClosing_Params* inParams);
 static void       DeleteFileSession(FileSession* inFileSession);
+static Bool16     WriteBurst(FileSession* inFile, QTSS_RTPSendPackets_Params* inParams, bool* ioIsBeginningOfWriteBurst);
 static UInt32   WriteSDPHeader(FILE* sdpFile, iovec *theSDPVec, SInt16 *ioVectorIndex, StrPtrLen *sdpHeader);
 static void     BuildPrefBasedHeaders();
 
@@ -485,6 +514,32 @@ QTSS_Error RereadPrefs()
     sAddClientBufferDelaySecs = 0;
     QTSSModuleUtils::GetIOAttribute(sPrefs, "add_seconds_to_client_buffer_delay", qtssAttrDataTypeFloat32, &sAddClientBufferDelaySecs, sizeof(sAddClientBufferDelaySecs));
 
+    sMapMovieHeaders = false; // see QTFile::SetMapMovieHeaders
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "map_movie_headers", qtssAttrDataTypeBool16, &sMapMovieHeaders, sizeof(sMapMovieHeaders));
+    QTFile::SetMapMovieHeaders(sMapMovieHeaders);
+
+    sMovieCacheSizeInMB = 32;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "movie_cache_size_mb", qtssAttrDataTypeUInt32, &sMovieCacheSizeInMB, sizeof(sMovieCacheSizeInMB));
+    QTRTPFile::SetFileCacheSize((UInt64)sMovieCacheSizeInMB * 1024 * 1024);
+
+    sSDPCacheSizeInKB = 1024;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "sdp_cache_size_kb", qtssAttrDataTypeUInt32, &sSDPCacheSizeInKB, sizeof(sSDPCacheSizeInKB));
+    SDPCache::SetSize(sSDPCacheSizeInKB * 1024);
+
+    sEnablePacketIndex = true;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "enable_packet_index", qtssAttrDataTypeBool16, &sEnablePacketIndex, sizeof(sEnablePacketIndex));
+    QTRTPFile::SetPacketIndexEnabled(sEnablePacketIndex);
+
+    sPacketBatchSize = 4;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "packet_batch_size", qtssAttrDataTypeUInt32, &sPacketBatchSize, sizeof(sPacketBatchSize));
+    if (sPacketBatchSize == 0)
+        sPacketBatchSize = 1;
+    else if (sPacketBatchSize > 64)
+        sPacketBatchSize = 64;
+
+    sEnablePacketBursts = true;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "enable_packet_bursts", qtssAttrDataTypeBool16, &sEnablePacketBursts, sizeof(sEnablePacketBursts));
+
     sRecordMovieFileSDP = false;
     QTSSModuleUtils::GetIOAttribute(sPrefs, "record_movie_file_sdp", qtssAttrDataTypeBool16, &sRecordMovieFileSDP, sizeof(sRecordMovieFileSDP));
 
@@ -508,6 +563,9 @@ QTSS_Error RereadPrefs()
 
     BuildPrefBasedHeaders();
     
+    // What's in the SDP cache may have been built with the old prefs
+    SDPCache::Clear();
+    
     return QTSS_NoErr;
 }
 
@@ -687,13 +745,34 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
     iovec theSDPVec[sNumSDPVectors];//1 for the RTSP header, 6 for the sdp header, 1 for the sdp body
     ::memset(&theSDPVec[0], 0, sizeof(theSDPVec));
     
+    //
+    // Get the generation before looking in the SDP cache, so that a response
+    // built from prefs that change in the meantime doesn't get cached.
+    UInt32 theCacheGeneration = SDPCache::GetGeneration();
+    SDPCacheEntry theCachedSDP;
+    Bool16 foundCachedSDP = false;
+    
+    StrPtrLen theSDPFileKey(thePath.GetObject());
+    QTSS_TimeVal theSDPFileModDate = -1;
     if (sEnableMovieFileSDP)
     {
         // Check to see if there is an sdp file, if so, return that file instead
-        // of the built-in sdp. ReadEntireFile allocates memory but if all goes well theSDPData will be managed by the File Session
-        (void)QTSSModuleUtils::ReadEntireFile(thePath.GetObject(), &theSDPData);
+        // of the built-in sdp. Asking ReadEntireFile for a file newer than any date
+        // just gets us its mod date, so we can see if we already have it.
+        (void)QTSSModuleUtils::ReadEntireFile(thePath.GetObject(), &theSDPData, kSInt64_Max, &theSDPFileModDate);
+        if (theSDPFileModDate != -1)
+            foundCachedSDP = SDPCache::Find(&theSDPFileKey, theSDPFileModDate, &theCachedSDP);
+        
+        // ReadEntireFile allocates memory, and so does the cache
+        if (foundCachedSDP)
+        {
+            theSDPData = theCachedSDP.fSDP;
+            theCachedSDP.fSDP.Set(NULL, 0);
+        }
+        else if (theSDPFileModDate != -1)
+            (void)QTSSModuleUtils::ReadEntireFile(thePath.GetObject(), &theSDPData);
     }
-    OSCharArrayDeleter sdpDataDeleter(theSDPData.Ptr); // Just in case we fail we know to clean up. But we clear the deleter if we succeed.
+    OSCharArrayDeleter sdpDataDeleter(theSDPData.Ptr); // The FileSession parses a copy of theSDPData
 
 	/****************************************************************
 	*	ȡSDPݳɹ
@@ -701,7 +780,7 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
     if (theSDPData.Len > 0){   
         SDPContainer fileSDPContainer; 
         fileSDPContainer.SetSDPBuffer(&theSDPData);  
-        if (!fileSDPContainer.IsSDPBufferValid()){    
+        if (!foundCachedSDP && !fileSDPContainer.IsSDPBufferValid()){    
 			return QTSSModuleUtils::SendErrorResponseWithMessage(inParamBlock->inRTSPRequest, qtssUnsupportedMediaType, &sSDPNotValidMessage);
         }
     
@@ -727,6 +806,9 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
 
         QTSSModuleUtils::SendDescribeResponse(inParamBlock->inRTSPRequest, inParamBlock->inClientSession,
                                                                 &theSDPVec[0], 3, theSDPData.Len);  
+        
+        if (!foundCachedSDP)
+            SDPCache::Add(&theSDPFileKey, theSDPFileModDate, theCacheGeneration, &theSDPData);
     }
     else
     {
@@ -780,16 +862,6 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
         (void)QTSS_GetValuePtr(inParamBlock->inRTSPSession, qtssRTSPSesLocalAddrStr, 0, (void**)&ipStr.Ptr, &ipStr.Len);
 
 
-//      
-// *** The order of sdp headers is specified and required by rfc 2327
-//
-// -------- version header 
-
-        theFullSDPBuffer.Put(sVersionHeader);
-        theFullSDPBuffer.Put(sEOL);
-        
-// -------- owner header
-
         const SInt16 sLineSize = 256;
         char ownerLine[sLineSize]="";
         ownerLine[sLineSize - 1] = 0;
@@ -803,109 +875,170 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
         Assert(ownerLine[sLineSize - 1] == 0);
 
         StrPtrLen ownerStr(ownerLine);
-        theFullSDPBuffer.Put(ownerStr); 
-        theFullSDPBuffer.Put(sEOL); 
+
+        Float32 adjustMediaBandwidthPercent = 1.0;
+        Bool16 adjustMediaBandwidth = false;
+        if (sPlayerCompatibility )
+            adjustMediaBandwidth = QTSSModuleUtils::HavePlayerProfile(sServerPrefs, inParamBlock,QTSSModuleUtils::kAdjustBandwidth);
+		    		    
+		if (adjustMediaBandwidth)
+		    adjustMediaBandwidthPercent = (Float32) sAdjustMediaBandwidthPercent / 100.0;
+
+        //
+        // Apart from the o= line, the SDP we generate only depends on the movie,
+        // our prefs, the name it was asked for by and the bandwidth adjustment.
+        ResizeableStringFormatter theKeyFormatter(NULL, 0);
+        theKeyFormatter.Put(thePath.GetObject());
+        theKeyFormatter.PutChar('\n');
+        theKeyFormatter.Put(fileNameStr);
+        theKeyFormatter.PutChar('\n');
+        theKeyFormatter.PutChar(adjustMediaBandwidth ? '1' : '0');
+        StrPtrLen theMovieKey(theKeyFormatter.GetBufPtr(), theKeyFormatter.GetBytesWritten());
+        SInt64 theMovieModDate = theFile->fFile.GetQTFile()->GetModDate();
+        
+        if (sdpFile == NULL) // when recording the sdp, make it so it gets written out
+            foundCachedSDP = SDPCache::Find(&theMovieKey, theMovieModDate, &theCachedSDP);
+        OSCharArrayDeleter theGeneratedSDP(NULL);
+        
+        if (foundCachedSDP)
+        {
+            // Send what we sent last time, with this request's o= line
+            Assert(theCachedSDP.fOwnerLine.Len > 0);
+            char* theOwnerLineEnd = theCachedSDP.fOwnerLine.Ptr + theCachedSDP.fOwnerLine.Len;
+            
+            theSDPVec[1].iov_base = theCachedSDP.fSDP.Ptr;
+            theSDPVec[1].iov_len = theCachedSDP.fOwnerLine.Ptr - theCachedSDP.fSDP.Ptr;
+            theSDPVec[2].iov_base = ownerStr.Ptr;
+            theSDPVec[2].iov_len = ownerStr.Len;
+            theSDPVec[3].iov_base = theOwnerLineEnd;
+            theSDPVec[3].iov_len = (theCachedSDP.fSDP.Ptr + theCachedSDP.fSDP.Len) - theOwnerLineEnd;
+            vectorIndex = 4;
+            totalSDPLength = theCachedSDP.fSDP.Len - theCachedSDP.fOwnerLine.Len + ownerStr.Len;
+            
+            theSDPData = theCachedSDP.fSessionSDP;
+        }
+        else
+        {
+//      
+// *** The order of sdp headers is specified and required by rfc 2327
+//
+// -------- version header 
+
+            theFullSDPBuffer.Put(sVersionHeader);
+            theFullSDPBuffer.Put(sEOL);
+        
+// -------- owner header
+
+            theFullSDPBuffer.Put(ownerStr); 
+            theFullSDPBuffer.Put(sEOL); 
         
 // -------- session header
 
-        theFullSDPBuffer.Put(sSessionNameHeader);
-        theFullSDPBuffer.Put(fileNameStr);
-        theFullSDPBuffer.Put(sEOL);
+            theFullSDPBuffer.Put(sSessionNameHeader);
+            theFullSDPBuffer.Put(fileNameStr);
+            theFullSDPBuffer.Put(sEOL);
     
 // -------- uri header
 
-        theFullSDPBuffer.Put(sURLHeader);
-        theFullSDPBuffer.Put(sEOL);
+            theFullSDPBuffer.Put(sURLHeader);
+            theFullSDPBuffer.Put(sEOL);
 
     
 // -------- email header
 
-        theFullSDPBuffer.Put(sEmailHeader);
-        theFullSDPBuffer.Put(sEOL);
+            theFullSDPBuffer.Put(sEmailHeader);
+            theFullSDPBuffer.Put(sEOL);
 
 // -------- connection information header
         
-        theFullSDPBuffer.Put(sConnectionHeader); 
-        theFullSDPBuffer.Put(sEOL);
+            theFullSDPBuffer.Put(sConnectionHeader); 
+            theFullSDPBuffer.Put(sEOL);
 
 // -------- time header
 
-        // t=0 0 is a permanent always available movie (doesn't ever change unless we change the code)
-        theFullSDPBuffer.Put(sPermanentTimeHeader);
-        theFullSDPBuffer.Put(sEOL);
+            // t=0 0 is a permanent always available movie (doesn't ever change unless we change the code)
+            theFullSDPBuffer.Put(sPermanentTimeHeader);
+            theFullSDPBuffer.Put(sEOL);
         
 // -------- control header
 
-        theFullSDPBuffer.Put(sStaticControlHeader);
-        theFullSDPBuffer.Put(sEOL);
+            theFullSDPBuffer.Put(sStaticControlHeader);
+            theFullSDPBuffer.Put(sEOL);
         
                 
 // -------- add buffer delay
 
-        if (sAddClientBufferDelaySecs > 0) // increase the client buffer delay by the preference amount.
-        {
-            Float32 bufferDelay = 3.0; // the client doesn't advertise it's default value so we guess.
+            if (sAddClientBufferDelaySecs > 0) // increase the client buffer delay by the preference amount.
+            {
+                Float32 bufferDelay = 3.0; // the client doesn't advertise it's default value so we guess.
             
-            static StrPtrLen sBuffDelayStr("a=x-bufferdelay:");
+                static StrPtrLen sBuffDelayStr("a=x-bufferdelay:");
         
-            StrPtrLen delayStr;
-            theSDPData.FindString(sBuffDelayStr, &delayStr);
-            if (delayStr.Len > 0)
-            {
-                UInt32 offset = (delayStr.Ptr - theSDPData.Ptr) + delayStr.Len; // step past the string
-                delayStr.Ptr = theSDPData.Ptr + offset;
-                delayStr.Len = theSDPData.Len - offset;
-                StringParser theBufferSecsParser(&delayStr);
-                theBufferSecsParser.ConsumeWhitespace();
-                bufferDelay = theBufferSecsParser.ConsumeFloat();
-            }
+                StrPtrLen delayStr;
+                theSDPData.FindString(sBuffDelayStr, &delayStr);
+                if (delayStr.Len > 0)
+                {
+                    UInt32 offset = (delayStr.Ptr - theSDPData.Ptr) + delayStr.Len; // step past the string
+                    delayStr.Ptr = theSDPData.Ptr + offset;
+                    delayStr.Len = theSDPData.Len - offset;
+                    StringParser theBufferSecsParser(&delayStr);
+                    theBufferSecsParser.ConsumeWhitespace();
+                    bufferDelay = theBufferSecsParser.ConsumeFloat();
+                }
             
-            bufferDelay += sAddClientBufferDelaySecs;
+                bufferDelay += sAddClientBufferDelaySecs;
 
            
-            qtss_sprintf(tempBufferDelay, "a=x-bufferdelay:%.2f",bufferDelay);
-            bufferDelayStr.Set(tempBufferDelay); 
+                qtss_sprintf(tempBufferDelay, "a=x-bufferdelay:%.2f",bufferDelay);
+                bufferDelayStr.Set(tempBufferDelay); 
                 
-            theFullSDPBuffer.Put(bufferDelayStr); 
-            theFullSDPBuffer.Put(sEOL);
-        }
+                theFullSDPBuffer.Put(bufferDelayStr); 
+                theFullSDPBuffer.Put(sEOL);
+            }
         
  // -------- movie file sdp data
 
-        //now append content-determined sdp ( cached in QTRTPFile )
-        int sdpLen = 0;
-        theSDPData.Ptr = theFile->fFile.GetSDPFile(&sdpLen);
-        theSDPData.Len = sdpLen;
+            //now append content-determined sdp ( cached in QTRTPFile )
+            int sdpLen = 0;
+            theSDPData.Ptr = theFile->fFile.GetSDPFile(&sdpLen);
+            theSDPData.Len = sdpLen;
 
 // ----------- Add the movie's sdp headers to our sdp headers
  
-		theFullSDPBuffer.Put(theSDPData); 
-        StrPtrLen fullSDPBuffSPL(theFullSDPBuffer.GetBufPtr(),theFullSDPBuffer.GetBytesWritten());
+            theFullSDPBuffer.Put(theSDPData); 
+            StrPtrLen fullSDPBuffSPL(theFullSDPBuffer.GetBufPtr(),theFullSDPBuffer.GetBytesWritten());
 
 // ------------ Check the headers
-        SDPContainer rawSDPContainer;
-        rawSDPContainer.SetSDPBuffer( &fullSDPBuffSPL );  
-        if (!rawSDPContainer.IsSDPBufferValid())
-        {    return QTSSModuleUtils::SendErrorResponseWithMessage(inParamBlock->inRTSPRequest, qtssUnsupportedMediaType, &sSDPNotValidMessage);
-        }
+            SDPContainer rawSDPContainer;
+            rawSDPContainer.SetSDPBuffer( &fullSDPBuffSPL );  
+            if (!rawSDPContainer.IsSDPBufferValid())
+            {    return QTSSModuleUtils::SendErrorResponseWithMessage(inParamBlock->inRTSPRequest, qtssUnsupportedMediaType, &sSDPNotValidMessage);
+            }
 		
 // ------------ reorder the sdp headers to make them proper.
-        Float32 adjustMediaBandwidthPercent = 1.0;
-        Bool16 adjustMediaBandwidth = false;
-        if (sPlayerCompatibility )
-            adjustMediaBandwidth = QTSSModuleUtils::HavePlayerProfile(sServerPrefs, inParamBlock,QTSSModuleUtils::kAdjustBandwidth);
-		    		    
-		if (adjustMediaBandwidth)
-		    adjustMediaBandwidthPercent = (Float32) sAdjustMediaBandwidthPercent / 100.0;
-		    
-		SDPLineSorter sortedSDP(&rawSDPContainer,adjustMediaBandwidthPercent);
-		StrPtrLen *theSessionHeadersPtr = sortedSDP.GetSessionHeaders();
-		StrPtrLen *theMediaHeadersPtr = sortedSDP.GetMediaHeaders();
+            SDPLineSorter sortedSDP(&rawSDPContainer,adjustMediaBandwidthPercent);
+            StrPtrLen *theSessionHeadersPtr = sortedSDP.GetSessionHeaders();
+            StrPtrLen *theMediaHeadersPtr = sortedSDP.GetMediaHeaders();
 		
 // ----------- write out the sdp
 
-		totalSDPLength += ::WriteSDPHeader(sdpFile, theSDPVec, &vectorIndex, theSessionHeadersPtr);
-        totalSDPLength += ::WriteSDPHeader(sdpFile, theSDPVec, &vectorIndex, theMediaHeadersPtr);
+            totalSDPLength += ::WriteSDPHeader(sdpFile, theSDPVec, &vectorIndex, theSessionHeadersPtr);
+            totalSDPLength += ::WriteSDPHeader(sdpFile, theSDPVec, &vectorIndex, theMediaHeadersPtr);
+
+// -------- keep a copy of it to send and to cache, the sorted headers don't outlive this block
+
+            theGeneratedSDP.SetObject(QTSSModuleUtils::CoalesceVectors(&theSDPVec[1], vectorIndex - 1, totalSDPLength));
+            ::memset(&theSDPVec[1], 0, sizeof(iovec) * (vectorIndex - 1));
+            theSDPVec[1].iov_base = theGeneratedSDP.GetObject();
+            theSDPVec[1].iov_len = totalSDPLength;
+            vectorIndex = 2;
+            
+            StrPtrLen theSDPStr(theGeneratedSDP.GetObject(), totalSDPLength);
+            StrPtrLen theOwnerLine;
+            (void)theSDPStr.FindString(ownerStr, &theOwnerLine);
+            if ((sdpFile == NULL) && (theOwnerLine.Len > 0))
+                SDPCache::Add(&theMovieKey, theMovieModDate, theCacheGeneration, &theSDPStr, &theOwnerLine, &theSDPData);
+        }
 
 // -------- done with SDP processing
          
@@ -914,7 +1047,7 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
             
 
         Assert(theSDPData.Len > 0);
-        Assert(theSDPVec[2].iov_base != NULL);
+        Assert(theSDPVec[1].iov_base != NULL);
         //ok, we have a filled out iovec. Let's send the response!
         
         // Append the Last Modified header to be a good caching proxy citizen before sending the Describe
@@ -943,14 +1076,13 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
     //now parse the movie media sdp data. We need to do this in order to extract payload information.
     //The SDP parser object will not take responsibility of the memory (one exception... see above)
     theFile->fSDPSource.Parse(theSDPData.Ptr, theSDPData.Len);
-    sdpDataDeleter.ClearObject(); // don't delete theSDPData, theFile has it now.
     
     return QTSS_NoErr;
 }
 
 QTSS_Error CreateQTRTPFile(QTSS_StandardRTSP_Params* inParamBlock, char* inPath, FileSession** outFile)
 {   
-    *outFile = NEW FileSession();
+    *outFile = NEW FileSession(sPacketBatchSize, sEnablePacketBursts);
     QTRTPFile::ErrorCode theErr = (*outFile)->fFile.Initialize(inPath);
     if (theErr != QTRTPFile::errNoError)
     {
@@ -1316,6 +1448,14 @@ QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParamBlock)
     
     if (qtFileErr == QTRTPFile::errCallAgain)
     {
+        //
+        // If the seek is waiting for movie data, we get called again once it is in.
+        if ((*theFile)->fFile.ReadWouldBlock())
+        {
+            (*theFile)->fFile.RequestReadEvent();
+            return QTSS_NoErr;
+        }
+        
         //
         // If we are doing RTP-Meta-Info stuff, we might be asked to get called again here.
         // This is simply because seeking might be a long operation and we don't want to
@@ -1332,6 +1472,9 @@ QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParamBlock)
     */                                                    
     //make sure to clear the next packet the server would have sent!
     (*theFile)->fPacketStruct.packetData = NULL;
+    (*theFile)->fNumBatchedPackets = 0;
+    (*theFile)->fNextBatchedPacket = 0;
+    (*theFile)->fNumBurstPackets = 0;
     
     // Set the movie duration and size parameters
     Float64 movieDuration = (*theFile)->fFile.GetMovieDuration();
@@ -1517,10 +1660,17 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
 	bool isBeginningOfWriteBurst = true;
     QTSS_Object theStream = NULL;
 
+    //
+    // Finish the burst we couldn't write last time
+    if (!WriteBurst(*theFile, inParams, &isBeginningOfWriteBurst))
+        return QTSS_NoErr;
+
 	/*****************************************************************
 	*	ȡRTP б
 	*****************************************************************/
-    QTRTPFile::RTPTrackListEntry* theLastPacketTrack = (*theFile)->fFile.GetLastPacketTrack();
+    QTRTPFile::RTPTrackListEntry* theLastPacketTrack = NULL;
+    if ((*theFile)->fPacketStruct.packetData != NULL)
+        theLastPacketTrack = (*theFile)->fPacketBatch[(*theFile)->fNextBatchedPacket - 1].TrackEntry;
 
     while (true){   
 		
@@ -1529,18 +1679,45 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
 		*	»ȡRTP б
     	*****************************************************************/
         if ((*theFile)->fPacketStruct.packetData == NULL){
-            Float64 theTransmitTime = (*theFile)->fFile.GetNextPacket((char**)&(*theFile)->fPacketStruct.packetData, &(*theFile)->fNextPacketLen);
-            if ( QTRTPFile::errNoError != (*theFile)->fFile.Error()){
-                QTSS_CliSesTeardownReason reason = qtssCliSesTearDownUnsupportedMedia;
-                (void)QTSS_SetValue(inParams->inClientSession, qtssCliTeardownReason, 0, &reason, sizeof(reason));
-                (void)QTSS_Teardown(inParams->inClientSession);
-                return QTSS_RequestFailed;
+            //
+            // Fetch the next few packets in one go once we've sent the last ones.
+            if ((*theFile)->fNextBatchedPacket == (*theFile)->fNumBatchedPackets)
+            {
+                //
+                // The burst points into the batch, so it has to go first.
+                if (!WriteBurst(*theFile, inParams, &isBeginningOfWriteBurst))
+                    return QTSS_NoErr;
+                (*theFile)->fNumBatchedPackets = (*theFile)->fFile.GetNextPackets((*theFile)->fPacketBatch, (*theFile)->fPacketBatchSize);
+                (*theFile)->fNextBatchedPacket = 0;
             }
-           theLastPacketTrack = (*theFile)->fFile.GetLastPacketTrack();
-
-			if (theLastPacketTrack == NULL){
-				break;
-			}
+            if ((*theFile)->fNumBatchedPackets == 0)
+            {
+                if ((*theFile)->fFile.ReadWouldBlock())
+                {
+                    //
+                    // The movie data for the next packet is still being read. Don't
+                    // wait for it here, our session gets a read event when it's in.
+                    (*theFile)->fFile.RequestReadEvent();
+                    inParams->outNextPacketTime = qtssDontCallSendPacketsAgain;
+                    return QTSS_NoErr;
+                }
+                if ( QTRTPFile::errNoError != (*theFile)->fFile.Error()){
+                    QTSS_CliSesTeardownReason reason = qtssCliSesTearDownUnsupportedMedia;
+                    (void)QTSS_SetValue(inParams->inClientSession, qtssCliTeardownReason, 0, &reason, sizeof(reason));
+                    (void)QTSS_Teardown(inParams->inClientSession);
+                    return QTSS_RequestFailed;
+                }
+                if ((*theFile)->fFile.GetLastPacketTrack() == NULL){
+                    break;
+                }
+            }
+        }
+        if (((*theFile)->fPacketStruct.packetData == NULL) && ((*theFile)->fNextBatchedPacket < (*theFile)->fNumBatchedPackets)){
+            QTRTPFile::RTPPacketInfo* thePacketInfo = &(*theFile)->fPacketBatch[(*theFile)->fNextBatchedPacket++];
+            (*theFile)->fPacketStruct.packetData = thePacketInfo->Packet;
+            (*theFile)->fNextPacketLen = thePacketInfo->PacketLength;
+            Float64 theTransmitTime = thePacketInfo->TransmitTime;
+            theLastPacketTrack = thePacketInfo->TrackEntry;
 #if 0
 			qtss_printf("*theFile %p theLastPacketTrack %p ",
 								*theFile,
@@ -1561,19 +1738,19 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
 			* һ£ǷҪֹͣ
 			* 
             *****************************************************************/
-            if (((*theFile)->fStopTime != -1) && (theTransmitTime > (*theFile)->fStopTime)){
-                // We should indeed stop playing
-                (void)QTSS_Pause(inParams->inClientSession);
-                inParams->outNextPacketTime = qtssDontCallSendPacketsAgain;
-
-                (**theFile).fPaused = true;
-                (**theFile).fLastPauseTime = OS::Milliseconds();
-
-                return QTSS_NoErr;
-            }
-            if (((*theFile)->fStopTrackID != 0) 
+            if ((((*theFile)->fStopTime != -1) && (theTransmitTime > (*theFile)->fStopTime))
+                || (((*theFile)->fStopTrackID != 0) 
 					&& ((*theFile)->fStopTrackID == theLastPacketTrack->TrackID) 
-					&& (theLastPacketTrack->HTCB->fCurrentPacketNumber > (*theFile)->fStopPN)){
+					&& (thePacketInfo->PacketNumber > (*theFile)->fStopPN))){
+                //
+                // Send what's before this packet first. If that has to wait,
+                // so does this packet.
+                if (!WriteBurst(*theFile, inParams, &isBeginningOfWriteBurst)){
+                    (*theFile)->fPacketStruct.packetData = NULL;
+                    (*theFile)->fNextBatchedPacket--;
+                    return QTSS_NoErr;
+                }
+                    
                 // We should indeed stop playing
                 (void)QTSS_Pause(inParams->inClientSession);
                 inParams->outNextPacketTime = qtssDontCallSendPacketsAgain;
@@ -1657,7 +1834,7 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
 		*	ݰ
 		*****************************************************************/
         // Send the packet!
-        QTSS_WriteFlags theFlags = qtssWriteFlagsIsRTP;
+        QTSS_WriteFlags theFlags = qtssWriteFlagsIsRTP | qtssWriteFlagsBufferData; // RTPSession flushes when we return
         if (isBeginningOfWriteBurst)
             theFlags |= qtssWriteFlagsWriteBurstBegin;
 
@@ -1673,6 +1850,31 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
 						(*theFile)->fNextPacketLen);
 #endif
 
+        //
+        // With packet bursts on, hold on to the packet until the stream changes
+        // or the batch runs out, then write them all with one QTSS_WritePackets.
+        if ((*theFile)->fEnableBursts)
+        {
+            if (((*theFile)->fNumBurstPackets > 0) && ((*theFile)->fBurstStream != theStream)
+                && !WriteBurst(*theFile, inParams, &isBeginningOfWriteBurst))
+            {
+                (*theFile)->fPacketStruct.packetData = NULL;
+                (*theFile)->fNextBatchedPacket--;
+                return QTSS_NoErr;
+            }
+            
+            (void)SetPausetimeTimeStamp(*theFile, theStream, GetPacketTimeStamp((*theFile)->fPacketStruct.packetData));
+            
+            (*theFile)->fBurstStream = theStream;
+            (*theFile)->fBurstSeqNum = GetPacketSequenceNumber(theStream);
+            (*theFile)->fBurstPackets[(*theFile)->fNumBurstPackets] = (*theFile)->fPacketStruct;
+            (*theFile)->fBurstPacketLens[(*theFile)->fNumBurstPackets] = (*theFile)->fNextPacketLen;
+            (*theFile)->fNumBurstPackets++;
+            
+            (*theFile)->fPacketStruct.packetData = NULL;
+            continue;
+        }
+
 		/*****************************************************************
 		*	ʱӳͣʱ
 		*****************************************************************/
@@ -1736,6 +1938,61 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
     return QTSS_NoErr;
 }
 
+Bool16 WriteBurst(FileSession* inFile, QTSS_RTPSendPackets_Params* inParams, bool* ioIsBeginningOfWriteBurst)
+{
+    //
+    // Returns false if the stream couldn't take the whole burst, having set
+    // when to call SendPackets again. What's left is written first then.
+    UInt32 theNumWritten = 0;
+    QTSS_Error theErr = QTSS_NoErr;
+    
+    while (theNumWritten < inFile->fNumBurstPackets)
+    {
+        QTSS_WriteFlags theFlags = qtssWriteFlagsIsRTP | qtssWriteFlagsBufferData; // RTPSession flushes when we return
+        if (*ioIsBeginningOfWriteBurst)
+            theFlags |= qtssWriteFlagsWriteBurstBegin;
+        
+        (void) QTSS_SetValue(inFile->fBurstStream, sRTPStreamLastPacketSeqNumAttrID, 0, &inFile->fBurstSeqNum, sizeof(inFile->fBurstSeqNum));
+        
+        UInt32 theNumPacketsWritten = 0;
+        theErr = QTSS_WritePackets(inFile->fBurstStream, &inFile->fBurstPackets[theNumWritten], &inFile->fBurstPacketLens[theNumWritten],
+                                    inFile->fNumBurstPackets - theNumWritten, &theNumPacketsWritten, theFlags);
+        *ioIsBeginningOfWriteBurst = false;
+        theNumWritten += theNumPacketsWritten;
+        
+        if (theErr == QTSS_WouldBlock)
+            break;
+        
+        //
+        // Like a single QTSS_Write, give up on a packet that failed for any
+        // other reason.
+        if (theErr != QTSS_NoErr)
+            theNumWritten++;
+        (void) QTSS_SetValue(inFile->fBurstStream, sRTPStreamLastSentPacketSeqNumAttrID, 0, &inFile->fBurstSeqNum, sizeof(inFile->fBurstSeqNum));
+    }
+    
+    if (theErr != QTSS_WouldBlock)
+    {
+        inFile->fNumBurstPackets = 0;
+        return true;
+    }
+    
+    inFile->fNumBurstPackets -= theNumWritten;
+    ::memmove(inFile->fBurstPackets, &inFile->fBurstPackets[theNumWritten], inFile->fNumBurstPackets * sizeof(QTSS_PacketStruct));
+    ::memmove(inFile->fBurstPacketLens, &inFile->fBurstPacketLens[theNumWritten], inFile->fNumBurstPackets * sizeof(UInt32));
+    
+    //
+    // Same as when QTSS_Write won't take a packet
+    if (inFile->fBurstPackets[0].suggestedWakeupTime == -1)
+        inParams->outNextPacketTime = sFlowControlProbeInterval;    // for buffering, try me again in # MSec
+    else
+    {
+        Assert(inFile->fBurstPackets[0].suggestedWakeupTime > inParams->inCurrentTime);
+        inParams->outNextPacketTime = inFile->fBurstPackets[0].suggestedWakeupTime - inParams->inCurrentTime;
+    }
+    return false;
+}
+
 QTSS_Error DestroySession(QTSS_ClientSessionClosing_Params* inParams)
 {
     FileSession** theFile = NULL;
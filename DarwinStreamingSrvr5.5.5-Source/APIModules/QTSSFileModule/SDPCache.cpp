@@ -0,0 +1,178 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       SDPCache.cpp
+
+    Contains:   Implements SDPCache
+
+
+*/
+
+#include <string.h>
+
+#include "SDPCache.h"
+#include "OSMemory.h"
+
+OSMutex         SDPCache::sMutex;
+OSQueue         SDPCache::sLRUQueue;
+OSHashTable<SDPCacheEntry, SDPCacheKey> SDPCache::sTable(SDPCache::kTableSize);
+
+UInt32          SDPCache::sMaxBytes = 0;
+UInt64          SDPCache::sBytesUsed = 0;
+UInt32          SDPCache::sGeneration = 0;
+
+UInt64          SDPCache::sNumHits = 0;
+UInt64          SDPCache::sNumMisses = 0;
+
+static void CopyString(StrPtrLen* inString, StrPtrLen* outCopy)
+{
+    // 0 terminated like what ReadEntireFile returns
+    outCopy->Set(NULL, 0);
+    if (inString->Len == 0)
+        return;
+
+    outCopy->Ptr = NEW char[inString->Len + 1];
+    outCopy->Len = inString->Len;
+    ::memcpy(outCopy->Ptr, inString->Ptr, inString->Len);
+    outCopy->Ptr[outCopy->Len] = 0;
+}
+
+UInt32 SDPCacheKey::GetHashKey()
+{
+    // FNV-1a; paths in one directory tend to differ only near the end
+    UInt32 theHash = 2166136261U;
+    for (UInt32 x = 0; x < fKey->Len; x++)
+        theHash = (theHash ^ (UInt8)fKey->Ptr[x]) * 16777619U;
+    return theHash;
+}
+
+void SDPCache::SetSize(UInt32 inMaxBytes)
+{
+    OSMutexLocker locker(&sMutex);
+    sMaxBytes = inMaxBytes;
+
+    OSQueueElem* theElem = NULL;
+    while ((sBytesUsed > sMaxBytes) && ((theElem = sLRUQueue.GetHead()) != NULL))
+        Remove((SDPCacheEntry*)theElem->GetEnclosingObject());
+}
+
+void SDPCache::Clear()
+{
+    OSMutexLocker locker(&sMutex);
+    sGeneration++;
+
+    OSQueueElem* theElem = NULL;
+    while ((theElem = sLRUQueue.GetHead()) != NULL)
+        Remove((SDPCacheEntry*)theElem->GetEnclosingObject());
+
+    Assert(sTable.GetNumEntries() == 0);
+    Assert(sBytesUsed == 0);
+}
+
+Bool16 SDPCache::Find(StrPtrLen* inKey, SInt64 inModDate, SDPCacheEntry* outEntry)
+{
+    OSMutexLocker locker(&sMutex);
+    if (sMaxBytes == 0)
+        return false;
+
+    SDPCacheKey theKey(inKey);
+    SDPCacheEntry* theEntry = sTable.Map(&theKey);
+    if ((theEntry != NULL) && (theEntry->fModDate != inModDate))
+    {
+        // The file changed since this was built
+        Remove(theEntry);
+        theEntry = NULL;
+    }
+
+    if (theEntry == NULL)
+    {
+        sNumMisses++;
+        return false;
+    }
+
+    sNumHits++;
+    sLRUQueue.Remove(&theEntry->fLRUElem);
+    sLRUQueue.EnQueue(&theEntry->fLRUElem); // most recently used
+
+    CopyString(&theEntry->fSDP, &outEntry->fSDP);
+    CopyString(&theEntry->fSessionSDP, &outEntry->fSessionSDP);
+    outEntry->fOwnerLine.Set(NULL, 0);
+    if (theEntry->fOwnerLine.Len > 0)
+        outEntry->fOwnerLine.Set(outEntry->fSDP.Ptr + (theEntry->fOwnerLine.Ptr - theEntry->fSDP.Ptr), theEntry->fOwnerLine.Len);
+
+    return true;
+}
+
+void SDPCache::Add(StrPtrLen* inKey, SInt64 inModDate, UInt32 inGeneration, StrPtrLen* inSDP,
+                    StrPtrLen* inOwnerLine, StrPtrLen* inSessionSDP)
+{
+    StrPtrLen theNoString;
+    if (inOwnerLine == NULL)
+        inOwnerLine = &theNoString;
+    if (inSessionSDP == NULL)
+        inSessionSDP = &theNoString;
+    Assert((inOwnerLine->Len == 0) || ((inOwnerLine->Ptr >= inSDP->Ptr) && (inOwnerLine->Ptr + inOwnerLine->Len <= inSDP->Ptr + inSDP->Len)));
+
+    UInt32 theMemoryUsed = sizeof(SDPCacheEntry) + inKey->Len + inSDP->Len + inSessionSDP->Len + 3;
+
+    OSMutexLocker locker(&sMutex);
+    if ((inGeneration != sGeneration) || (theMemoryUsed > sMaxBytes))
+        return;
+
+    //
+    // Another DESCRIBE may have added it while we were building ours
+    SDPCacheKey theKey(inKey);
+    SDPCacheEntry* theEntry = sTable.Map(&theKey);
+    if (theEntry != NULL)
+        Remove(theEntry);
+
+    OSQueueElem* theElem = NULL;
+    while ((sBytesUsed + theMemoryUsed > sMaxBytes) && ((theElem = sLRUQueue.GetHead()) != NULL))
+        Remove((SDPCacheEntry*)theElem->GetEnclosingObject());
+
+    theEntry = NEW SDPCacheEntry;
+    CopyString(inKey, &theEntry->fKey);
+    CopyString(inSDP, &theEntry->fSDP);
+    CopyString(inSessionSDP, &theEntry->fSessionSDP);
+    if (inOwnerLine->Len > 0)
+        theEntry->fOwnerLine.Set(theEntry->fSDP.Ptr + (inOwnerLine->Ptr - inSDP->Ptr), inOwnerLine->Len);
+    theEntry->fModDate = inModDate;
+    theEntry->fMemoryUsed = theMemoryUsed;
+
+    sTable.Add(theEntry);
+    sLRUQueue.EnQueue(&theEntry->fLRUElem);
+    theEntry->fIsInTable = true;
+    sBytesUsed += theMemoryUsed;
+}
+
+void SDPCache::Remove(SDPCacheEntry* inEntry)
+{
+    Assert(inEntry->fIsInTable);
+
+    sTable.Remove(inEntry);
+    sLRUQueue.Remove(&inEntry->fLRUElem);
+    sBytesUsed -= inEntry->fMemoryUsed;
+    delete inEntry;
+}
@@ -0,0 +1,148 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       SDPCache.h
+
+    Contains:   The DESCRIBE responses QTSSFileModule has built, so that the next
+                DESCRIBE of the same title doesn't have to read the .sdp file or
+                generate the SDP from the movie again.
+
+                An entry is keyed by a string the module makes up from the path and
+                whatever else in the request changes the SDP, and it is only good for
+                the mod date it was built from. Entries are dropped in least recently
+                used order once the cache is over its size, and all of them are
+                dropped by Clear, which the module calls when its prefs change.
+
+
+*/
+
+#ifndef _SDPCACHE_H_
+#define _SDPCACHE_H_
+
+#include "OSHeaders.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+#include "OSHashTable.h"
+#include "StrPtrLen.h"
+
+class SDPCacheKey;
+
+class SDPCacheEntry
+{
+    public:
+
+        //What the module keeps for a DESCRIBE. fSDP is the response body. If
+        //fOwnerLine.Len isn't 0, it is the o= line in the body, which has to be
+        //rewritten for each response. fSessionSDP is the SDP the FileSession
+        //parses, or empty if that's the body itself.
+        StrPtrLen   fSDP;
+        StrPtrLen   fOwnerLine;
+        StrPtrLen   fSessionSDP;
+
+        SDPCacheEntry() : fModDate(0), fMemoryUsed(0), fIsInTable(false), fLRUElem(this), fNextHashEntry(NULL) {}
+        ~SDPCacheEntry() { fKey.Delete(); fSDP.Delete(); fSessionSDP.Delete(); }
+
+    private:
+
+        StrPtrLen       fKey;
+        SInt64          fModDate;
+        UInt32          fMemoryUsed;
+        Bool16          fIsInTable;
+
+        OSQueueElem     fLRUElem;   // head of the LRU queue is the least recently used
+        SDPCacheEntry*  fNextHashEntry;
+
+        friend class SDPCache;
+        friend class SDPCacheKey;
+        friend class OSHashTable<SDPCacheEntry, SDPCacheKey>;
+};
+
+class SDPCacheKey
+{
+    public:
+
+        SDPCacheKey(StrPtrLen* inKey) : fKey(inKey) {}
+        SDPCacheKey(SDPCacheEntry* inEntry) : fKey(&inEntry->fKey) {}
+
+        UInt32  GetHashKey();
+
+        friend int operator ==(const SDPCacheKey& key1, const SDPCacheKey& key2)
+            { return key1.fKey->Equal(*key2.fKey); }
+
+    private:
+
+        StrPtrLen*  fKey;
+};
+
+class SDPCache
+{
+    public:
+
+        //The cache is disabled while its size is 0, which is how it starts.
+        static void     SetSize(UInt32 inMaxBytes);
+
+        //Drops every entry. Responses that were being built when this is called
+        //aren't added, see GetGeneration.
+        static void     Clear();
+
+        //Copies the entry for inKey into outEntry and returns true, if there is
+        //one for inModDate. An entry for any other mod date is dropped.
+        static Bool16   Find(StrPtrLen* inKey, SInt64 inModDate, SDPCacheEntry* outEntry);
+
+        //Call before building a response and pass the result to Add, which
+        //ignores the response if the cache was cleared in between. Add copies
+        //the strings, inOwnerLine has to point into inSDP.
+        static UInt32   GetGeneration()     { return sGeneration; }
+        static void     Add(StrPtrLen* inKey, SInt64 inModDate, UInt32 inGeneration, StrPtrLen* inSDP,
+                            StrPtrLen* inOwnerLine = NULL, StrPtrLen* inSessionSDP = NULL);
+
+        //Statistics
+        static UInt64   GetNumHits()        { return sNumHits; }
+        static UInt64   GetNumMisses()      { return sNumMisses; }
+        static UInt64   GetNumEntries()     { return sTable.GetNumEntries(); }
+        static UInt64   GetBytesUsed()      { return sBytesUsed; }
+
+    private:
+
+        enum
+        {
+            kTableSize = 1024
+        };
+
+        static void     Remove(SDPCacheEntry* inEntry);
+
+        static OSMutex      sMutex;
+        static OSQueue      sLRUQueue;
+        static OSHashTable<SDPCacheEntry, SDPCacheKey>  sTable;
+
+        static UInt32       sMaxBytes;
+        static UInt64       sBytesUsed;
+        static UInt32       sGeneration;
+
+        static UInt64       sNumHits;
+        static UInt64       sNumMisses;
+};
+
+#endif //_SDPCACHE_H_
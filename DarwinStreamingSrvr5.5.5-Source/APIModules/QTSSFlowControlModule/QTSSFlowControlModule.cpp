@@ -38,6 +38,9 @@
 #include "OSHeaders.h"
 #include "QTSSModuleUtils.h"
 #include "MyAssert.h"
+#include "StrPtrLen.h"
+#include "RTCPPacket.h"
+#include "RTCPAckPacket.h"
 
 //Turns on printfs that are useful for debugging
 #define FLOW_CONTROL_DEBUGGING 0
@@ -47,6 +50,8 @@
 static QTSS_AttributeID sNumLossesAboveTolAttr          = qtssIllegalAttrID;
 static QTSS_AttributeID sNumLossesBelowTolAttr          = qtssIllegalAttrID;
 static QTSS_AttributeID sNumWorsesAttr                  = qtssIllegalAttrID;
+static QTSS_AttributeID sMinRTTAttr                     = qtssIllegalAttrID;
+static QTSS_AttributeID sNumNACKedPacketsAttr           = qtssIllegalAttrID;
 
 // STATIC VARIABLES
 
@@ -60,6 +65,8 @@ static UInt32   sDefaultNumLossesToThin         = 3;
 static UInt32   sDefaultLossThickTolerance      = 5;
 static UInt32   sDefaultLossesToThick           = 6;
 static UInt32   sDefaultWorsesToThin            = 2;
+static UInt32   sDefaultRTTThinTolerance        = 250;
+static UInt32   sDefaultRTTThickTolerance       = 50;
 static Bool16   sDefaultModuleEnabled      = true;
 
 // Current values for preferences
@@ -68,6 +75,8 @@ static UInt32   sNumLossesToThin        = 3;
 static UInt32   sLossThickTolerance     = 5;
 static UInt32   sLossesToThick          = 6;
 static UInt32   sWorsesToThin           = 2;
+static UInt32   sRTTThinTolerance       = 250;
+static UInt32   sRTTThickTolerance      = 50;
 static Bool16   sModuleEnabled      = true;
 
 // Server preference we respect
@@ -81,6 +90,10 @@ static QTSS_Error   Register(QTSS_Register_Params* inParams);
 static QTSS_Error   Initialize(QTSS_Initialize_Params* inParams);
 static QTSS_Error   RereadPrefs();
 static QTSS_Error   ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams);
+static QTSS_Error   ProcessReceiverReport(QTSS_RTCPProcess_Params* inParams);
+static void             GetRTCPPacketTypes(QTSS_RTCPProcess_Params* inParams, Bool16* outHasReceiverReport, Bool16* outHasQTSSReport);
+static void             AdjustQualityLevel(QTSS_RTCPProcess_Params* inParams, Bool16 ratchetLess, Bool16 ratchetMore, Bool16 oneLevelAtATime);
+static UInt32           GetStreamUInt32(QTSS_RTPStreamObject inStream, QTSS_AttributeID inAttr);
 static void             InitializeDictionaryItems(QTSS_RTPStreamObject inStream);
 
 
@@ -119,6 +132,8 @@ QTSS_Error Register(QTSS_Register_Params* inParams)
     static char*        sNumLossesAboveToleranceName    =   "QTSSFlowControlModuleLossAboveTol";
     static char*        sNumLossesBelowToleranceName    =   "QTSSFlowControlModuleLossBelowTol";
     static char*        sNumGettingWorsesName           =   "QTSSFlowControlModuleGettingWorses";
+    static char*        sMinRTTName                     =   "QTSSFlowControlModuleMinRTT";
+    static char*        sNumNACKedPacketsName           =   "QTSSFlowControlModuleNACKedPackets";
 
     (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sNumLossesAboveToleranceName, NULL, qtssAttrDataTypeUInt32);
     (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sNumLossesAboveToleranceName, &sNumLossesAboveTolAttr);
@@ -129,6 +144,12 @@ QTSS_Error Register(QTSS_Register_Params* inParams)
     (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sNumGettingWorsesName, NULL, qtssAttrDataTypeUInt32);
     (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sNumGettingWorsesName, &sNumWorsesAttr);
 
+    (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sMinRTTName, NULL, qtssAttrDataTypeUInt32);
+    (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sMinRTTName, &sMinRTTAttr);
+
+    (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sNumNACKedPacketsName, NULL, qtssAttrDataTypeUInt32);
+    (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sNumNACKedPacketsName, &sNumNACKedPacketsAttr);
+
     // Tell the server our name!
     static char* sModuleName = "QTSSFlowControlModule";
     ::strcpy(inParams->outModuleName, sModuleName);
@@ -158,6 +179,10 @@ QTSS_Error RereadPrefs()
                                 &sLossesToThick,        &sDefaultLossesToThick, sizeof(sLossesToThick));
     QTSSModuleUtils::GetAttribute(sPrefs, "num_worses_to_thin", qtssAttrDataTypeUInt32,
                                 &sWorsesToThin,         &sDefaultWorsesToThin, sizeof(sWorsesToThin));
+    QTSSModuleUtils::GetAttribute(sPrefs, "rtt_thin_tolerance", qtssAttrDataTypeUInt32,
+                                &sRTTThinTolerance,     &sDefaultRTTThinTolerance, sizeof(sRTTThinTolerance));
+    QTSSModuleUtils::GetAttribute(sPrefs, "rtt_thick_tolerance",    qtssAttrDataTypeUInt32,
+                                &sRTTThickTolerance,    &sDefaultRTTThickTolerance, sizeof(sRTTThickTolerance));
                                 
     QTSSModuleUtils::GetAttribute(sPrefs, "flow_control_udp_thinning_module_enabled",  qtssAttrDataTypeBool16,
             &sModuleEnabled, &sDefaultModuleEnabled, sizeof(sDefaultModuleEnabled));
@@ -198,6 +223,19 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
     
     if (theTransportType != qtssRTPTransportTypeUDP)
         return QTSS_NoErr;
+    
+    //
+    // The algorithm below goes on the QTSS APP packets QuickTime clients send.
+    // Other clients only send standard receiver reports.
+    Bool16 hasReceiverReport = false;
+    Bool16 hasQTSSReport = false;
+    GetRTCPPacketTypes(inParams, &hasReceiverReport, &hasQTSSReport);
+    if (!hasQTSSReport)
+    {
+        if (hasReceiverReport)
+            return ProcessReceiverReport(inParams);
+        return QTSS_NoErr;
+    }
         
     //ALGORITHM FOR DETERMINING WHEN TO MAKE QUALITY ADJUSTMENTS IN THE STREAM:
     
@@ -346,55 +384,8 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
     //Based on the ratchetMore / ratchetLess variables, adjust the stream
     if (ratchetMore || ratchetLess)
     {
-            
-        UInt32 curQuality = 0;
-        (void)QTSS_GetValuePtr(theStream, qtssRTPStrQualityLevel, 0, (void**)&uint32Ptr, &theLen);
-        if ((uint32Ptr != NULL) && (theLen == sizeof(UInt32)))
-            curQuality = *uint32Ptr;
-
-        UInt32 numQualityLevels = 0;
-        (void)QTSS_GetValuePtr(theStream, qtssRTPStrNumQualityLevels, 0, (void**)&uint32Ptr, &theLen);
-        if ((uint32Ptr != NULL) && (theLen == sizeof(UInt32)))
-            numQualityLevels = *uint32Ptr;
-            
-        if ((ratchetLess) && (curQuality < numQualityLevels))
-        {
-            curQuality++;
-            if (curQuality > 1) // v3.0.1=v2.0.1 make level 2 means key frames in the file or max if reflected.
-                curQuality = numQualityLevels;
-            (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
-        }
-        else if ((ratchetMore) && (curQuality > 0))
-        {
-            curQuality--;
-            if (curQuality > 1)  // v3.0.1=v2.0.1 make level 2 means key frames in the file or max if reflected.
-                curQuality = 1;
-            (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
-        }
+        AdjustQualityLevel(inParams, ratchetLess, ratchetMore, false);
         
-        Bool16 *startedThinningPtr = NULL;
-        SInt32 numThinned = 0;
-        (void)QTSS_GetValuePtr(inParams->inClientSession, qtssCliSesStartedThinning, 0, (void**)&startedThinningPtr, &theLen);
-        if (false == *startedThinningPtr)
-        {    
-            (void) QTSS_LockObject(sServer);
-            *startedThinningPtr = true; 
-             
-             (void)QTSS_GetValue(sServer, qtssSvrNumThinned, 0, (void*)&numThinned, &theLen);
-             numThinned++;
-             (void)QTSS_SetValue(sServer, qtssSvrNumThinned, 0, &numThinned, sizeof(numThinned));
-             (void) QTSS_UnlockObject(sServer);
-        }
-        else if (curQuality == 0)
-         {   
-            (void) QTSS_LockObject(sServer);          
-            *startedThinningPtr = false;
-
-             (void)QTSS_GetValue(theStream, qtssSvrNumThinned, 0, (void*)&numThinned, &theLen);
-             numThinned--;
-             (void)QTSS_SetValue(sServer, qtssSvrNumThinned, 0, &numThinned, sizeof(numThinned));
-             (void) QTSS_UnlockObject(sServer);
-          }
         //When adjusting the quality, ALWAYS clear out ALL our counts of EVERYTHING. Note
         //that this is the ONLY way that the fNumGettingWorses count gets cleared
         (void)QTSS_SetValue(theStream, sNumWorsesAttr, 0, &zero, sizeof(zero));
@@ -424,6 +415,208 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
     return QTSS_NoErr;
 }
 
+QTSS_Error ProcessReceiverReport(QTSS_RTCPProcess_Params* inParams)
+{
+    //ALGORITHM FOR CLIENTS THAT ONLY SEND STANDARD RTCP:
+    
+    //Each receiver report tells us the fraction of packets lost since the last one,
+    //the interarrival jitter and, through LSR and DLSR, the round trip time. Clients
+    //that send generic NACKs tell us about lost packets as they happen, too.
+    
+    //The stream is congested if the loss % (the larger of what the receiver report
+    //and the NACKs say) is above loss_thin_tolerance, or if the round trip time is
+    //more than rtt_thin_tolerance msec above the smallest one we've seen. A growing
+    //round trip time means packets are queueing somewhere, which comes before loss
+    //on most links.
+    
+    //The stream is clear if the loss % is below loss_thick_tolerance and both the
+    //round trip time above the smallest one and the jitter are below rtt_thick_tolerance.
+    
+    //Less bandwidth will be served after num_losses_to_thin congested reports in a row,
+    //more after num_losses_to_thick clear ones, one quality level at a time.
+    
+    InitializeDictionaryItems(inParams->inRTPStream);
+    
+    QTSS_RTPStreamObject theStream = inParams->inRTPStream;
+    
+    UInt32 theNumLossesAboveTol = GetStreamUInt32(theStream, sNumLossesAboveTolAttr);
+    UInt32 theNumLossesBelowTol = GetStreamUInt32(theStream, sNumLossesBelowTolAttr);
+    
+    //The fraction lost is out of 256
+    UInt32 thePercentLoss = (GetStreamUInt32(theStream, qtssRTPStrFractionLostPackets) * 100) / 256;
+    
+    //Packets NACKed since the last report, out of the packets sent since then
+    UInt32 theTotalNACKedPackets = GetStreamUInt32(theStream, qtssRTPStrTotalNACKedPackets);
+    UInt32 theNumNACKedPackets = theTotalNACKedPackets - GetStreamUInt32(theStream, sNumNACKedPacketsAttr);
+    UInt32 thePacketCount = GetStreamUInt32(theStream, qtssRTPStrPacketCountInRTCPInterval);
+    (void)QTSS_SetValue(theStream, sNumNACKedPacketsAttr, 0, &theTotalNACKedPackets, sizeof(theTotalNACKedPackets));
+    if ((thePacketCount > 0) && ((theNumNACKedPackets * 100) / thePacketCount > thePercentLoss))
+        thePercentLoss = (theNumNACKedPackets * 100) / thePacketCount;
+    
+    //Round trip time above the smallest one, which is as close as we can get to the
+    //time packets spend in queues
+    UInt32 theQueueDelay = 0;
+    UInt32 theRTT = GetStreamUInt32(theStream, qtssRTPStrRoundTripTimeInMsec);
+    if (theRTT > 0)
+    {
+        UInt32 theMinRTT = GetStreamUInt32(theStream, sMinRTTAttr);
+        if ((theMinRTT == 0) || (theRTT < theMinRTT))
+        {
+            theMinRTT = theRTT;
+            (void)QTSS_SetValue(theStream, sMinRTTAttr, 0, &theMinRTT, sizeof(theMinRTT));
+        }
+        theQueueDelay = theRTT - theMinRTT;
+    }
+    
+    //The jitter is in RTP timestamp units
+    UInt32 theJitterMsec = 0;
+    UInt32 theTimescale = GetStreamUInt32(theStream, qtssRTPStrTimescale);
+    if (theTimescale > 0)
+        theJitterMsec = (UInt32)(((UInt64)GetStreamUInt32(theStream, qtssRTPStrJitter) * 1000) / theTimescale);
+
+#if FLOW_CONTROL_DEBUGGING
+    qtss_printf("Receiver report: loss %lu%%, %lu NACKed, rtt %lu, queue delay %lu, jitter %lu msec\n",
+                thePercentLoss, theNumNACKedPackets, theRTT, theQueueDelay, theJitterMsec);
+#endif
+
+    Bool16 ratchetMore = false;
+    Bool16 ratchetLess = false;
+    
+    if ((thePercentLoss > sLossThinTolerance) || (theQueueDelay > sRTTThinTolerance))
+    {
+        theNumLossesAboveTol++;
+        theNumLossesBelowTol = 0;
+        if (theNumLossesAboveTol >= sNumLossesToThin)
+            ratchetLess = true;
+    }
+    else if ((thePercentLoss < sLossThickTolerance) && (theQueueDelay < sRTTThickTolerance) && (theJitterMsec < sRTTThickTolerance))
+    {
+        theNumLossesBelowTol++;
+        theNumLossesAboveTol = 0;
+        if (theNumLossesBelowTol >= sLossesToThick)
+            ratchetMore = true;
+    }
+    else
+    {
+        //Somewhere in between. Hold the quality where it is.
+        theNumLossesAboveTol = 0;
+        theNumLossesBelowTol = 0;
+    }
+    
+    if (ratchetMore || ratchetLess)
+    {
+        AdjustQualityLevel(inParams, ratchetLess, ratchetMore, true);
+        theNumLossesAboveTol = 0;
+        theNumLossesBelowTol = 0;
+    }
+    
+    (void)QTSS_SetValue(theStream, sNumLossesAboveTolAttr, 0, &theNumLossesAboveTol, sizeof(theNumLossesAboveTol));
+    (void)QTSS_SetValue(theStream, sNumLossesBelowTolAttr, 0, &theNumLossesBelowTol, sizeof(theNumLossesBelowTol));
+    return QTSS_NoErr;
+}
+
+void GetRTCPPacketTypes(QTSS_RTCPProcess_Params* inParams, Bool16* outHasReceiverReport, Bool16* outHasQTSSReport)
+{
+    //
+    // Walk the compound RTCP packet. Any APP packet that isn't a reliable UDP ack
+    // is a QTSS APP packet, just as RTPStream::ProcessIncomingRTCPPacket treats it.
+    StrPtrLen thePacketData((char*)inParams->inRTCPPacketData, inParams->inRTCPPacketDataLen);
+    while (thePacketData.Len > 0)
+    {
+        RTCPPacket thePacket;
+        if (!thePacket.ParsePacket((UInt8*)thePacketData.Ptr, thePacketData.Len))
+            return;
+            
+        UInt32 thePacketLen = (thePacket.GetPacketLength() * 4) + RTCPPacket::kRTCPHeaderSizeInBytes;
+        if (thePacket.GetPacketType() == RTCPPacket::kReceiverPacketType)
+            *outHasReceiverReport = true;
+        else if (thePacket.GetPacketType() == RTCPPacket::kAPPPacketType)
+        {
+            RTCPAckPacket theAckPacket;
+            if (!theAckPacket.ParseAckPacket((UInt8*)thePacketData.Ptr, thePacketLen))
+                *outHasQTSSReport = true;
+        }
+        
+        thePacketData.Ptr += thePacketLen;
+        thePacketData.Len -= thePacketLen;
+    }
+}
+
+void AdjustQualityLevel(QTSS_RTCPProcess_Params* inParams, Bool16 ratchetLess, Bool16 ratchetMore, Bool16 oneLevelAtATime)
+{
+    QTSS_RTPStreamObject theStream = inParams->inRTPStream;
+    UInt32 theLen = 0;
+    
+    UInt32 curQuality = GetStreamUInt32(theStream, qtssRTPStrQualityLevel);
+    UInt32 numQualityLevels = GetStreamUInt32(theStream, qtssRTPStrNumQualityLevels);
+    
+    if (oneLevelAtATime)
+    {
+        //Levels run from 0, everything, to numQualityLevels - 1, key frames in the file
+        //or audio only if reflected.
+        if ((ratchetLess) && (curQuality + 1 < numQualityLevels))
+        {
+            curQuality++;
+            (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
+        }
+        else if ((ratchetMore) && (curQuality > 0))
+        {
+            curQuality--;
+            (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
+        }
+    }
+    else if ((ratchetLess) && (curQuality < numQualityLevels))
+    {
+        curQuality++;
+        if (curQuality > 1) // v3.0.1=v2.0.1 make level 2 means key frames in the file or max if reflected.
+            curQuality = numQualityLevels;
+        (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
+    }
+    else if ((ratchetMore) && (curQuality > 0))
+    {
+        curQuality--;
+        if (curQuality > 1)  // v3.0.1=v2.0.1 make level 2 means key frames in the file or max if reflected.
+            curQuality = 1;
+        (void)QTSS_SetValue(theStream, qtssRTPStrQualityLevel, 0, &curQuality, sizeof(curQuality));
+    }
+    
+    Bool16 *startedThinningPtr = NULL;
+    SInt32 numThinned = 0;
+    (void)QTSS_GetValuePtr(inParams->inClientSession, qtssCliSesStartedThinning, 0, (void**)&startedThinningPtr, &theLen);
+    if (false == *startedThinningPtr)
+    {    
+        (void) QTSS_LockObject(sServer);
+        *startedThinningPtr = true; 
+         
+         theLen = sizeof(numThinned);
+         (void)QTSS_GetValue(sServer, qtssSvrNumThinned, 0, (void*)&numThinned, &theLen);
+         numThinned++;
+         (void)QTSS_SetValue(sServer, qtssSvrNumThinned, 0, &numThinned, sizeof(numThinned));
+         (void) QTSS_UnlockObject(sServer);
+    }
+    else if (curQuality == 0)
+     {   
+        (void) QTSS_LockObject(sServer);          
+        *startedThinningPtr = false;
+
+         theLen = sizeof(numThinned);
+         (void)QTSS_GetValue(sServer, qtssSvrNumThinned, 0, (void*)&numThinned, &theLen);
+         numThinned--;
+         (void)QTSS_SetValue(sServer, qtssSvrNumThinned, 0, &numThinned, sizeof(numThinned));
+         (void) QTSS_UnlockObject(sServer);
+      }
+}
+
+UInt32 GetStreamUInt32(QTSS_RTPStreamObject inStream, QTSS_AttributeID inAttr)
+{
+    UInt32* uint32Ptr = NULL;
+    UInt32 theLen = 0;
+    (void)QTSS_GetValuePtr(inStream, inAttr, 0, (void**)&uint32Ptr, &theLen);
+    if ((uint32Ptr != NULL) && (theLen == sizeof(UInt32)))
+        return *uint32Ptr;
+    return 0;
+}
+
 void    InitializeDictionaryItems(QTSS_RTPStreamObject inStream)
 {
     UInt32* theValue = NULL;
@@ -437,5 +630,7 @@ void    InitializeDictionaryItems(QTSS_RTPStreamObject inStream)
         (void)QTSS_SetValue(inStream, sNumLossesAboveTolAttr, 0, &theValueLen, sizeof(theValueLen));
         (void)QTSS_SetValue(inStream, sNumLossesBelowTolAttr, 0, &theValueLen, sizeof(theValueLen));
         (void)QTSS_SetValue(inStream, sNumWorsesAttr, 0, &theValueLen, sizeof(theValueLen));
+        (void)QTSS_SetValue(inStream, sMinRTTAttr, 0, &theValueLen, sizeof(theValueLen));
+        (void)QTSS_SetValue(inStream, sNumNACKedPacketsAttr, 0, &theValueLen, sizeof(theValueLen));
     }
 }
@@ -38,11 +38,13 @@
 
 #include "OSMemory.h"
 #include "OSFileSource.h"
+#include "OSAsyncFileReader.h"
 #include "Socket.h"
 
 // ATTRIBUTES
 static QTSS_AttributeID         sOSFileSourceAttr = qtssIllegalAttrID;
 static QTSS_AttributeID         sEventContextAttr = qtssIllegalAttrID;
+static QTSS_AttributeID         sAsyncReaderAttr = qtssIllegalAttrID;
 
 // FUNCTION PROTOTYPES
 
@@ -102,6 +104,10 @@ QTSS_Error Register(QTSS_Register_Params* inParams)
     static char*        sEventContextName   = "QTSSPosixFileSysModuleEventContext";
     (void)QTSS_AddStaticAttribute(qtssFileObjectType, sEventContextName, NULL, qtssAttrDataTypeVoidPointer);
     (void)QTSS_IDForAttr(qtssFileObjectType, sEventContextName, &sEventContextAttr);
+
+    static char*        sAsyncReaderName    = "QTSSPosixFileSysModuleAsyncReader";
+    (void)QTSS_AddStaticAttribute(qtssFileObjectType, sAsyncReaderName, NULL, qtssAttrDataTypeVoidPointer);
+    (void)QTSS_IDForAttr(qtssFileObjectType, sAsyncReaderName, &sAsyncReaderAttr);
     
     // Tell the server our name!
     static char* sModuleName = "QTSSPosixFileSysModule";
@@ -147,8 +153,22 @@ QTSS_Error  OpenFile(QTSS_OpenFile_Params* inParams)
     }
 
     //
-    // If caller wants async I/O, at this point we should set up the EventContext
-    if (inParams->inFlags & qtssOpenFileAsync)
+    // If caller wants async I/O and there are file reading threads, reads of this
+    // file happen on them. A disk file always polls readable, so without them all
+    // we can do is set up an EventContext.
+    if ((inParams->inFlags & qtssOpenFileAsync) && OSAsyncFileReader::IsEnabled())
+    {
+        OSAsyncFileReader* theReader = NEW OSAsyncFileReader(theFileSource);
+        
+        theErr = QTSS_SetValue(inParams->inFileObject, sAsyncReaderAttr, 0, &theReader, sizeof(theReader));
+        if (theErr != QTSS_NoErr)
+        {
+            delete theReader;
+            delete theFileSource;
+            return QTSS_RequestFailed;
+        }
+    }
+    else if (inParams->inFlags & qtssOpenFileAsync)
     {
         EventContext* theEventContext = NEW EventContext(EventContext::kInvalidFileDesc, Socket::GetEventThread());
         theEventContext->InitNonBlocking(theFileSource->GetFD());
@@ -189,7 +209,13 @@ QTSS_Error  ReadFile(QTSS_ReadFile_Params* inParams)
     
     (void)QTSS_GetValuePtr(inParams->inFileObject, sOSFileSourceAttr, 0, (void**)&theFile, &theLen);
     Assert(theLen == sizeof(OSFileSource*));
-    OS_Error osErr = (*theFile)->Read(inParams->inFilePosition, inParams->ioBuffer, inParams->inBufLen, inParams->outLenRead);
+    
+    OS_Error osErr = OS_NoErr;
+    OSAsyncFileReader** theReader = NULL;
+    if (QTSS_GetValuePtr(inParams->inFileObject, sAsyncReaderAttr, 0, (void**)&theReader, &theLen) == QTSS_NoErr)
+        osErr = (*theReader)->Read(inParams->inFilePosition, inParams->ioBuffer, inParams->inBufLen, inParams->outLenRead);
+    else
+        osErr = (*theFile)->Read(inParams->inFilePosition, inParams->ioBuffer, inParams->inBufLen, inParams->outLenRead);
 
     if (osErr == EAGAIN)
         return QTSS_WouldBlock;
@@ -203,10 +229,18 @@ QTSS_Error  CloseFile(QTSS_CloseFile_Params* inParams)
 {
     OSFileSource** theFile = NULL;
     EventContext** theContext = NULL;
+    OSAsyncFileReader** theReader = NULL;
     UInt32 theLen = 0;
     
     QTSS_Error theErr = QTSS_GetValuePtr(inParams->inFileObject, sOSFileSourceAttr, 0, (void**)&theFile, &theLen);
     Assert(theErr == QTSS_NoErr);
+    
+    //
+    // The reader has to go first, it waits for any read of the OSFileSource in progress
+    theErr = QTSS_GetValuePtr(inParams->inFileObject, sAsyncReaderAttr, 0, (void**)&theReader, &theLen);
+    if (theErr == QTSS_NoErr)
+        delete *theReader;
+        
     theErr = QTSS_GetValuePtr(inParams->inFileObject, sEventContextAttr, 0, (void**)&theContext, &theLen);
     
     if (theErr == QTSS_NoErr)
@@ -231,9 +265,17 @@ QTSS_Error  RequestEventFile(QTSS_RequestEventFile_Params* inParams)
     Assert(theState->curTask != NULL);
     
     EventContext** theContext = NULL;
+    OSAsyncFileReader** theReader = NULL;
     UInt32 theLen = 0;
     
-    QTSS_Error theErr = QTSS_GetValuePtr(inParams->inFileObject, sEventContextAttr, 0, (void**)&theContext, &theLen);
+    QTSS_Error theErr = QTSS_GetValuePtr(inParams->inFileObject, sAsyncReaderAttr, 0, (void**)&theReader, &theLen);
+    if (theErr == QTSS_NoErr)
+    {
+        (*theReader)->SetTask(theState->curTask);
+        return QTSS_NoErr;
+    }
+    
+    theErr = QTSS_GetValuePtr(inParams->inFileObject, sEventContextAttr, 0, (void**)&theContext, &theLen);
     if (theErr == QTSS_NoErr)
     {
         //
@@ -614,6 +614,18 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
     return writeErr;
 }
 
+void RTPSessionOutput::FlushPackets(void* inStreamCookie)
+{
+    QTSS_RTPStreamObject *theStreamPtr = NULL;
+    UInt32 theLen = 0;
+    
+    for (UInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+    {
+        if (this->PacketMatchesStream(inStreamCookie, theStreamPtr))
+            (void)QTSS_Flush(*theStreamPtr);
+    }
+}
+
 UInt16 RTPSessionOutput::GetPacketSeqNumber(StrPtrLen* inPacket)
 {
     if (inPacket->Len < 4)
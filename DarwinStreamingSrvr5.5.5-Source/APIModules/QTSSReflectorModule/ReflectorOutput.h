@@ -80,7 +80,14 @@ inline  Bool16          SetBookMarkPacket(OSQueueElem* thePacketElemPtr);
         // be set to # of msec in which the packet can be sent, or -1 if unknown
         virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSec ) = 0;
     
+        // FlushPackets
+        //
+        // WritePacket may hold on to packets written with qtssWriteFlagsBufferData.
+        // This sends whatever is being held for the stream with this cookie.
+        virtual void        FlushPackets(void* /*inStreamCookie*/) {}
+    
         virtual void        TearDown() = 0;
+
         virtual Bool16      IsUDP() = 0;
         virtual Bool16      IsPlaying() = 0;
         
@@ -39,6 +39,11 @@
 #include "RTCPPacket.h"
 #include "ReflectorSession.h"
 
+#if _REFLECTORSTREAM_TESTING_
+#include "OSHistogram.h"
+#include "SafeStdLib.h"
+#endif
+
 
 #if DEBUG
 #define REFLECTOR_STREAM_DEBUGGING 0
@@ -61,6 +66,7 @@ static UInt32                   sDefaultBucketDelayInMsec           = 73;
 static Bool16                   sDefaultUsePacketReceiveTime        = false; 
 static UInt32                   sDefaultMaxFuturePacketTimeSec      = 60;
 static UInt32                   sDefaultFirstPacketOffsetMsec       = 500;
+static UInt32                   sDefaultBucketsPerTask              = 0;
 
 UInt32                          ReflectorStream::sBucketSize  = 16;
 UInt32                          ReflectorStream::sOverBufferInMsec = 10000; // more or less what the client over buffer will be
@@ -72,6 +78,7 @@ UInt32                          ReflectorStream::sOverBufferInSec = 10;
 UInt32                          ReflectorStream::sBucketDelayInMsec = 73;
 Bool16                          ReflectorStream::sUsePacketReceiveTime = false;
 UInt32                          ReflectorStream::sFirstPacketOffsetMsec = 500;
+UInt32                          ReflectorStream::sBucketsPerTask = 0;
 
 void ReflectorStream::Register()
 {
@@ -104,6 +111,10 @@ void ReflectorStream::Initialize(QTSS_ModulePrefsObject inPrefs)
     QTSSModuleUtils::GetAttribute(inPrefs, "reflector_rtp_info_offset_msec", qtssAttrDataTypeUInt32,
                               &ReflectorStream::sFirstPacketOffsetMsec, &sDefaultFirstPacketOffsetMsec, sizeof(sDefaultFirstPacketOffsetMsec));
 
+    // 0 reflects every bucket of a stream from the socket's own task
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_buckets_per_task", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sBucketsPerTask, &sDefaultBucketsPerTask, sizeof(sDefaultBucketsPerTask));
+
     ReflectorStream::sOverBufferInMsec = sOverBufferInSec * 1000;
     ReflectorStream::sMaxFuturePacketMSec = sMaxFuturePacketSec * 1000;
     ReflectorStream::sMaxPacketAgeMSec = sOverBufferInMsec;
@@ -125,6 +136,7 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
     fOutputArray(NULL),
     fNumBuckets(kMinNumBuckets),
     fNumElements(0),
+    fBucketLocks(NULL),
     fBucketMutex(),
     
     fDestRTCPAddr(0),
@@ -230,10 +242,12 @@ ReflectorStream::~ReflectorStream()
     for (UInt32 y = 0; y < fNumBuckets; y++)
         delete [] fOutputArray[y];
     delete [] fOutputArray;
+    delete [] fBucketLocks;
 }
 
 void ReflectorStream::AllocateBucketArray(UInt32 inNumBuckets)
 {
+    //Caller must hold fBucketArrayMutex for writing, unless this is the constructor
     Bucket* oldArray = fOutputArray;
     //allocate the 2-dimensional array
     fOutputArray = NEW Bucket[inNumBuckets];
@@ -254,19 +268,27 @@ void ReflectorStream::AllocateBucketArray(UInt32 inNumBuckets)
         }
         delete [] oldArray;
     }
+    
+    //The locks don't need copying: nobody holds them while the array is write locked
+    delete [] fBucketLocks;
+    fBucketLocks = NEW OSMutex[inNumBuckets];
     fNumBuckets = inNumBuckets;
 }
 
 
 SInt32 ReflectorStream::AddOutput(ReflectorOutput* inOutput, SInt32 putInThisBucket)
 {
-    OSMutexLocker locker(&fBucketMutex);
-    
 #if DEBUG
-    // We should never be adding an output twice to a stream
-    for (UInt32 dOne = 0; dOne < fNumBuckets; dOne++)
-        for (UInt32 dTwo = 0; dTwo < sBucketSize; dTwo++)
-            Assert(fOutputArray[dOne][dTwo] != inOutput);
+    {
+        // We should never be adding an output twice to a stream
+        OSMutexReadLocker arrayLocker(&fBucketArrayMutex);
+        for (UInt32 dOne = 0; dOne < fNumBuckets; dOne++)
+        {
+            OSMutexLocker bucketLocker(&fBucketLocks[dOne]);
+            for (UInt32 dTwo = 0; dTwo < sBucketSize; dTwo++)
+                Assert(fOutputArray[dOne][dTwo] != inOutput);
+        }
+    }
 #endif
 
     // If caller didn't specify a bucket, find a bucket
@@ -275,19 +297,35 @@ SInt32 ReflectorStream::AddOutput(ReflectorOutput* inOutput, SInt32 putInThisBuc
         
     Assert(putInThisBucket >= 0);
     
-    if (fNumBuckets <= (UInt32)putInThisBucket)
-        this->AllocateBucketArray(putInThisBucket * 2);
+    while (true)
+    {
+        {
+            OSMutexReadLocker arrayLocker(&fBucketArrayMutex);
+            if ((UInt32)putInThisBucket < fNumBuckets)
+                return this->AddOutputToBucket(inOutput, (UInt32)putInThisBucket);
+        }
+        
+        // The bucket doesn't exist yet, so grow the array. Someone may have beaten us to it.
+        OSMutexWriteLocker arrayLocker(&fBucketArrayMutex);
+        if (fNumBuckets <= (UInt32)putInThisBucket)
+            this->AllocateBucketArray(putInThisBucket * 2);
+    }
+}
 
+SInt32 ReflectorStream::AddOutputToBucket(ReflectorOutput* inOutput, UInt32 inBucket)
+{
+    //Caller must hold fBucketArrayMutex
+    OSMutexLocker bucketLocker(&fBucketLocks[inBucket]);
     for(UInt32 y = 0; y < sBucketSize; y++)
     {
-        if (fOutputArray[putInThisBucket][y] == NULL)
+        if (fOutputArray[inBucket][y] == NULL)
         {
-            fOutputArray[putInThisBucket][y] = inOutput;
+            fOutputArray[inBucket][y] = inOutput;
 #if REFLECTOR_STREAM_DEBUGGING 
-            qtss_printf("Adding new output (0x%lx) to bucket %ld, index %ld,\nnum buckets %li bucketSize: %li \n",(long)inOutput, putInThisBucket, y, (long)fNumBuckets, (long)sBucketSize);
+            qtss_printf("Adding new output (0x%lx) to bucket %ld, index %ld,\nnum buckets %li bucketSize: %li \n",(long)inOutput, inBucket, y, (long)fNumBuckets, (long)sBucketSize);
 #endif
-            fNumElements++;
-            return putInThisBucket;
+            (void)atomic_add(&fNumElements, 1);
+            return inBucket;
         }
     }
     // There was no empty spot in the specified bucket. Return an error
@@ -296,29 +334,32 @@ SInt32 ReflectorStream::AddOutput(ReflectorOutput* inOutput, SInt32 putInThisBuc
 
 SInt32 ReflectorStream::FindBucket()
 {
-    // If we need more buckets, allocate them.
-    if (fNumElements == (sBucketSize * fNumBuckets))
-        this->AllocateBucketArray(fNumBuckets * 2);
+    OSMutexReadLocker arrayLocker(&fBucketArrayMutex);
     
-    //find the first open spot in the array
+    //find the first open spot in the array. Another output may take it before the
+    //caller does, in which case AddOutput fails and ReflectorSession tries the next bucket.
     for (SInt32 putInThisBucket = 0; (UInt32)putInThisBucket < fNumBuckets; putInThisBucket++)
     {
+        OSMutexLocker bucketLocker(&fBucketLocks[putInThisBucket]);
         for(UInt32 y = 0; y < sBucketSize; y++)
             if (fOutputArray[putInThisBucket][y] == NULL)
                 return putInThisBucket;
     }
-    Assert(0);
-    return 0;
+    
+    // Every bucket is full. AddOutput will allocate more.
+    return fNumBuckets;
 }
 
 void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 {
-    OSMutexLocker locker(&fBucketMutex);
+    OSMutexReadLocker arrayLocker(&fBucketArrayMutex);
     Assert(fNumElements > 0);
     
     //look at all the indexes in the array
     for (UInt32 x = 0; x < fNumBuckets; x++)
     {
+        //Once we have the bucket lock, no sender is using this output
+        OSMutexLocker bucketLocker(&fBucketLocks[x]);
         for (UInt32 y = 0; y < sBucketSize; y++)
         {
             //The array may have blank spaces!
@@ -329,7 +370,7 @@ void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 #if REFLECTOR_STREAM_DEBUGGING  
                 qtss_printf("Removing output %x from bucket %ld, index %ld\n",inOutput,x,y);
 #endif
-                fNumElements--;
+                (void)atomic_sub(&fNumElements, 1);
                 return;             
             }
         }
@@ -340,11 +381,12 @@ void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 void  ReflectorStream::TearDownAllOutputs()
 {
 
-    OSMutexLocker locker(&fBucketMutex);
+    OSMutexReadLocker arrayLocker(&fBucketArrayMutex);
     
     //look at all the indexes in the array
     for (UInt32 x = 0; x < fNumBuckets; x++)
     {
+        OSMutexLocker bucketLocker(&fBucketLocks[x]);
         for (UInt32 y = 0; y < sBucketSize; y++)
         {   ReflectorOutput* theOutputPtr= fOutputArray[x][y];
             //The array may have blank spaces!
@@ -544,13 +586,33 @@ ReflectorSender::ReflectorSender(ReflectorStream* inStream, UInt32 inWriteFlag)
     fHasNewPackets(false),
     fNextTimeToRun(0),
     fLastRRTime(0),
-    fSocketQueueElem()
+    fSocketQueueElem(),
+    fPassNumBuckets(0),
+    fNumGroups(0),
+    fNextGroup(0),
+    fNumGroupsDone(0),
+    fPassTime(0),
+    fPassNextTimeToRun(0)
 {   
     fSocketQueueElem.SetEnclosingObject(this); 
+    ::memset(fBucketTasks, 0, sizeof(fBucketTasks));
 }
 
 ReflectorSender::~ReflectorSender()
 {
+    //We aren't in the middle of a pass, but a bucket task may still be looking for work.
+    //Once it lets go of us, it only waits for the kill event.
+    for (UInt32 x = 0; x < kMaxBucketTasks; x++)
+    {
+        if (fBucketTasks[x] == NULL)
+            continue;
+        {
+            OSMutexLocker locker(&fBucketTasks[x]->fMutex);
+            fBucketTasks[x]->fSender = NULL;
+        }
+        fBucketTasks[x]->Signal(Task::kKillEvent);
+    }
+    
     //dequeue and delete every buffer
     while (fPacketQueue.GetLength() > 0)
     {
@@ -774,8 +836,10 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 		fStream->fLastBitRateSample = currentTime;
 	}
 
+	OSMutexReadLocker arrayLocker(&fStream->fBucketArrayMutex);
 	for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
 	{	
+		OSMutexLocker bucketLocker(&fStream->fBucketLocks[bucketIndex]);
 		for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
 		{	 
 			ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
@@ -872,7 +936,7 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 						#endif
 						
 						SInt64 timeToSendPacket = -1;
-						err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket, NULL, NULL);
+						err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag | qtssWriteFlagsSharedData, packetLateness, &timeToSendPacket, NULL, NULL);
 					
 						if ( err == QTSS_WouldBlock )
 						{	
@@ -1016,34 +1080,13 @@ void ReflectorSender::ReflectPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue)
 	* 飬ݰ
 	*
 	****************************************************************************************/
-    for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++){   
-        for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++){    
-            ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
-            if (theOutput != NULL){                 
-                if ( false == theOutput->IsPlaying() ) 
-                    continue;
-                    
-                OSQueueElem*    packetElem = theOutput->GetBookMarkedPacket(&fPacketQueue); 
-                if ( packetElem  == NULL ){ // should only be a new output
-                                  
-                    packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
-                    theOutput->fNewOutput = false;     
-                }
-
-                SInt64  bucketDelay = ReflectorStream::sBucketDelayInMsec * (SInt64)bucketIndex;
-				/*********************************************************************************
-				*
-				* 
-				*
-				**********************************************************************************/
-                packetElem = this->SendPacketsToOutput(theOutput, packetElem,currentTime, bucketDelay);
-                if (packetElem){
-                    ReflectorPacket*    thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
-                    thePacket->fNeededByOutput = true; // flag to prevent removal in RemoveOldPackets
-                    (void) theOutput->SetBookMarkPacket(packetElem); // store a reference to the packet
-                }
-            } 
-        }
+    OSMutexReadLocker arrayLocker(&fStream->fBucketArrayMutex);
+    if ((ReflectorStream::sBucketsPerTask > 0) && (fStream->fNumBuckets > ReflectorStream::sBucketsPerTask))
+        this->ReflectBucketGroups(currentTime);
+    else
+    {
+        for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
+            this->SendPacketsToBucket(bucketIndex, currentTime, &fNextTimeToRun);
     }
 
     this->RemoveOldPackets(inFreeQueue);
@@ -1059,13 +1102,138 @@ void ReflectorSender::ReflectPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue)
     
 }
 
-OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay)
+void ReflectorSender::SendPacketsToBucket(UInt32 inBucketIndex, SInt64 inCurrentTime, SInt64* ioNextTimeToRun)
+{
+    OSMutexLocker bucketLocker(&fStream->fBucketLocks[inBucketIndex]);
+    for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++){    
+        ReflectorOutput* theOutput = fStream->fOutputArray[inBucketIndex][bucketMemberIndex];
+        if (theOutput != NULL){                 
+            if ( false == theOutput->IsPlaying() ) 
+                continue;
+                
+            OSQueueElem*    packetElem = theOutput->GetBookMarkedPacket(&fPacketQueue); 
+            if ( packetElem  == NULL ){ // should only be a new output
+                              
+                packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
+                theOutput->fNewOutput = false;     
+            }
+
+            SInt64  bucketDelay = ReflectorStream::sBucketDelayInMsec * (SInt64)inBucketIndex;
+			/*********************************************************************************
+			*
+			* 
+			*
+			**********************************************************************************/
+            packetElem = this->SendPacketsToOutput(theOutput, packetElem, inCurrentTime, bucketDelay, ioNextTimeToRun);
+            if (packetElem){
+                ReflectorPacket*    thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+                thePacket->fNeededByOutput = true; // flag to prevent removal in RemoveOldPackets
+                (void) theOutput->SetBookMarkPacket(packetElem); // store a reference to the packet
+            }
+        } 
+    }
+}
+
+void ReflectorSender::ReflectBucketGroups(SInt64 inCurrentTime)
+{
+    UInt32 theNumBuckets = fStream->fNumBuckets;
+    UInt32 theNumGroups = (theNumBuckets + ReflectorStream::sBucketsPerTask - 1) / ReflectorStream::sBucketsPerTask;
+    
+    {
+        OSMutexLocker locker(&fPassMutex);
+        fPassNumBuckets = theNumBuckets;
+        fPassTime = inCurrentTime;
+        fPassNextTimeToRun = fNextTimeToRun;
+        fNumGroups = theNumGroups;
+        fNextGroup = 0;
+        fNumGroupsDone = 0;
+    }
+    
+    // One group is always ours
+    UInt32 theNumTasks = theNumGroups - 1;
+    if (theNumTasks > kMaxBucketTasks)
+        theNumTasks = kMaxBucketTasks;
+        
+    for (UInt32 x = 0; x < theNumTasks; x++)
+    {
+        if (fBucketTasks[x] == NULL)
+            fBucketTasks[x] = NEW ReflectorBucketTask(this);
+        fBucketTasks[x]->Signal(Task::kUpdateEvent);
+    }
+    
+    //Rather than block this thread until the tasks get to run, help them out. Once
+    //there is nothing left to claim, we only wait on groups that are being sent, so
+    //this pass finishes even if every other TaskThread is busy.
+    this->SendPacketsToBucketGroups();
+    
+    OSMutexLocker locker(&fPassMutex);
+    while (fNumGroupsDone < fNumGroups)
+        fPassCond.Wait(&fPassMutex);
+        
+    fNextTimeToRun = fPassNextTimeToRun;
+}
+
+void ReflectorSender::SendPacketsToBucketGroups()
+{
+    //A task that runs late finds nothing left to claim. One that runs during the next
+    //pass just helps with that one; the claim and the pass state share fPassMutex.
+    OSMutexLocker locker(&fPassMutex);
+    while (fNextGroup < fNumGroups)
+    {
+        UInt32 theFirstBucket = fNextGroup * ReflectorStream::sBucketsPerTask;
+        UInt32 theLastBucket = theFirstBucket + ReflectorStream::sBucketsPerTask;
+        if (theLastBucket > fPassNumBuckets)
+            theLastBucket = fPassNumBuckets;
+        fNextGroup++;
+        
+        SInt64 theCurrentTime = fPassTime;
+        SInt64 theNextTimeToRun = fPassNextTimeToRun;
+        locker.Unlock();
+        
+        //Each output lives in exactly one bucket, and each bucket goes to one task per
+        //pass, so an output still gets its packets in order from its bookmark.
+        for (UInt32 bucketIndex = theFirstBucket; bucketIndex < theLastBucket; bucketIndex++)
+            this->SendPacketsToBucket(bucketIndex, theCurrentTime, &theNextTimeToRun);
+        
+        locker.Lock();
+        if (theNextTimeToRun < fPassNextTimeToRun)
+            fPassNextTimeToRun = theNextTimeToRun;
+        
+        fNumGroupsDone++;
+        if (fNumGroupsDone == fNumGroups)
+            fPassCond.Signal();
+    }
+}
+
+SInt64 ReflectorBucketTask::Run()
+{
+    EventFlags theEvents = this->GetEvents();
+    if (theEvents & Task::kKillEvent)
+        return -1;
+    
+    OSMutexLocker locker(&fMutex);
+    if (fSender != NULL)
+        fSender->SendPacketsToBucketGroups();
+    return 0;
+}
+
+OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, SInt64* ioNextTimeToRun)
 {
     OSQueueElem* lastPacket = currentPacket;
     OSQueueIter qIter(&fPacketQueue, currentPacket);  // starts from beginning if currentPacket == NULL, else from currentPacket                
     
     UInt32 count = 0;
     QTSS_Error err = QTSS_NoErr;
+    
+    // Let the output queue up RTP packets and send them all at once when we're done.
+    // Every output is handed the same ReflectorPacket, and no packet leaves fPacketQueue
+    // before the flush below, so the outputs needn't make their own copies. Nor need
+    // the ones that keep packets longer, since the packet data is never overwritten
+    // while they hold it.
+    UInt32 theWriteFlags = fWriteFlag | qtssWriteFlagsSharedData;
+    if (fWriteFlag == qtssWriteFlagsIsRTP)
+        theWriteFlags |= qtssWriteFlagsBufferData | qtssWriteFlagsNoCopy;
+        
     while ( !qIter.IsDone() )
     {                   
         currentPacket = qIter.GetCurrent();
@@ -1077,32 +1245,32 @@ OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput,
               
         //printf("packetLateness %qd, seq# %li\n", packetLateness, (long) DGetPacketSeqNumber( &thePacket->fPacketPtr ) );          
                                          
-        err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket,&thePacket->fStreamCountID,&thePacket->fTimeArrived );                
+        err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, theWriteFlags, packetLateness, &timeToSendPacket,&thePacket->fStreamCountID,&thePacket->fTimeArrived );                
 
         if (err == QTSS_WouldBlock)
         { // call us again in # ms to retry on an EAGAIN
             
-            if ((timeToSendPacket > 0) && ( (fNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
-                fNextTimeToRun = timeToSendPacket - currentTime;
+            if ((timeToSendPacket > 0) && ( (*ioNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
+                *ioNextTimeToRun = timeToSendPacket - currentTime;
             
             if (theOutput->fLastIntervalMilliSec < 5 )
                 theOutput->fLastIntervalMilliSec = 5;
 
             if ( timeToSendPacket < 0 ) // blocked and we are behind
-                fNextTimeToRun = theOutput->fLastIntervalMilliSec; // Use the last packet interval 
+                *ioNextTimeToRun = theOutput->fLastIntervalMilliSec; // Use the last packet interval 
                
-            if (fNextTimeToRun > 1000) //don't wait that long
-                fNextTimeToRun = 1000;
+            if (*ioNextTimeToRun > 1000) //don't wait that long
+                *ioNextTimeToRun = 1000;
 
-            if (fNextTimeToRun < 5) //wait longer
-                fNextTimeToRun = 5;
+            if (*ioNextTimeToRun < 5) //wait longer
+                *ioNextTimeToRun = 5;
 
             if (theOutput->fLastIntervalMilliSec >= 1000) // allow up to 1 second max -- allow some time for the socket to clear and don't go into a tight loop if the client is gone.
                 theOutput->fLastIntervalMilliSec = 1000;
             else
                 theOutput->fLastIntervalMilliSec *= 2; // scale upwards over time
 
-            //qtss_printf ( "Blocked ReflectorSender::SendPacketsToOutput timeToSendPacket=%qd fLastIntervalMilliSec=%qd fNextTimeToRun=%qd \n", timeToSendPacket, theOutput->fLastIntervalMilliSec, fNextTimeToRun);
+            //qtss_printf ( "Blocked ReflectorSender::SendPacketsToOutput timeToSendPacket=%qd fLastIntervalMilliSec=%qd fNextTimeToRun=%qd \n", timeToSendPacket, theOutput->fLastIntervalMilliSec, *ioNextTimeToRun);
            
            break;
         }
@@ -1111,8 +1279,12 @@ OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput,
         qIter.Next();
     
     }
+    
+    if (theWriteFlags & qtssWriteFlagsBufferData)
+        theOutput->FlushPackets(fStream);
 
     return lastPacket;
+
 }
 
 OSQueueElem*    ReflectorSender::GetClientBufferStartPacketOffset(SInt64 offsetMsec)
@@ -1577,20 +1749,45 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
 void ReflectorSocket::GetIncomingData(const SInt64& inMilliseconds)
 {
     OSMutexLocker locker(this->GetDemuxer()->GetMutex());
-    UInt32 theRemoteAddr = 0;
-    UInt16 theRemotePort = 0;
-    //get all the outstanding packets for this socket
+    ReflectorPacket* thePackets[kNumPacketsPerRecv];
+    void*   theBuffers[kNumPacketsPerRecv];
+    UInt32  theRemoteAddrs[kNumPacketsPerRecv];
+    UInt16  theRemotePorts[kNumPacketsPerRecv];
+    UInt32  theRecvLens[kNumPacketsPerRecv];
+    
+    //get all the outstanding packets for this socket. They are read straight into
+    //ReflectorPacket storage, as many at a time as RecvMultipleFrom will take.
     while (true)
     {
-        //get a packet off the free queue.
-        ReflectorPacket* thePacket = this->GetPacket();
-
-        thePacket->fPacketPtr.Len = 0;
-        (void)this->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket->fPacketPtr.Ptr,
-                            ReflectorPacket::kMaxReflectorPacketSize, &thePacket->fPacketPtr.Len);
-        qtss_printf("We GetIncomingData \n");              
-        if (this->ProcessPacket(inMilliseconds,thePacket,theRemoteAddr, theRemotePort))
+        //get packets off the free queue.
+        for (UInt32 x = 0; x < kNumPacketsPerRecv; x++)
+        {
+            thePackets[x] = this->GetPacket();
+            thePackets[x]->fPacketPtr.Len = 0;
+            theBuffers[x] = thePackets[x]->fPacketPtr.Ptr;
+        }
+        
+        UInt32 theNumPackets = 0;
+        (void)this->RecvMultipleFrom(theRemoteAddrs, theRemotePorts, theBuffers, ReflectorPacket::kMaxReflectorPacketSize,
+                                    theRecvLens, kNumPacketsPerRecv, &theNumPackets);
+        
+        for (UInt32 y = 0; y < kNumPacketsPerRecv; y++)
+        {
+            if ((y < theNumPackets) && (theRecvLens[y] > 0))
+            {
+                thePackets[y]->fPacketPtr.Len = theRecvLens[y];
+                (void)this->ProcessPacket(inMilliseconds, thePackets[y], theRemoteAddrs[y], theRemotePorts[y]);
+            }
+            else //unused, or an empty datagram
+                fFreeQueue.EnQueue(&thePackets[y]->fQueueElem);
+        }
+        
+        //if we got fewer packets than we asked for, there are no more on this socket!
+        if (theNumPackets < kNumPacketsPerRecv)
+        {
+            this->RequestEvent(EV_RE);
             break;
+        }
             
         //printf("ReflectorSocket::GetIncomingData \n");
     }
@@ -1606,6 +1803,202 @@ ReflectorPacket* ReflectorSocket::GetPacket()
     if (fFreeQueue.GetLength() == 0)
         //if the port number of this socket is odd, this packet is an RTCP packet.
         return NEW ReflectorPacket();
-    else
-        return (ReflectorPacket*)fFreeQueue.DeQueue()->GetEnclosingObject();
+
+    ReflectorPacket* thePacket = (ReflectorPacket*)fFreeQueue.DeQueue()->GetEnclosingObject();
+    thePacket->MakeWritable();
+    return thePacket;
+}
+
+#if _REFLECTORSTREAM_TESTING_
+
+//Takes whatever it is given, once per packet, the way RTPSessionOutput does
+class ReflectorTestOutput : public ReflectorOutput
+{
+    public:
+    
+        ReflectorTestOutput() : fLastPacketID(0), fNumPacketsWritten(0), fChecksum(0) { this->InititializeBookmarks(1); }
+        virtual ~ReflectorTestOutput() {}
+        
+        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* /*inStreamCookie*/, UInt32 /*inFlags*/, SInt64 /*packetLatenessInMSec*/, SInt64* /*timeToSendThisPacketAgain*/, UInt64* packetIDPtr, SInt64* /*arrivalTimeMSec*/)
+        {
+            //The bookmarked packet comes round again on the next pass
+            if (*packetIDPtr <= fLastPacketID)
+                return QTSS_NoErr;
+            fLastPacketID = *packetIDPtr;
+            
+            //Stand in for the work of sending it
+            for (UInt32 x = 0; x < inPacket->Len; x++)
+                fChecksum += (UInt8)inPacket->Ptr[x];
+            fNumPacketsWritten++;
+            return QTSS_NoErr;
+        }
+        virtual void        TearDown() {}
+        virtual Bool16      IsUDP() { return true; }
+        virtual Bool16      IsPlaying() { return true; }
+        
+        UInt64  fLastPacketID;
+        UInt32  fNumPacketsWritten;
+        UInt32  fChecksum;
+};
+
+//Viewers coming and going: every millisecond, removes an output and adds it back
+class ReflectorChurnThread : public OSThread
+{
+    public:
+    
+        ReflectorChurnThread(ReflectorStream* inStream, ReflectorTestOutput** inOutputs, UInt32 inNumOutputs, OSMutex* inMutex)
+        :   fStream(inStream), fOutputs(inOutputs), fNumOutputs(inNumOutputs), fMutex(inMutex), fNumChurns(0) {}
+        virtual ~ReflectorChurnThread() {}
+        
+        virtual void Entry()
+        {
+            UInt32 theIndex = 0;
+            while (!this->IsStopRequested())
+            {
+                ReflectorTestOutput* theOutput = fOutputs[theIndex];
+                theIndex = (theIndex + 17) % fNumOutputs;
+                
+                SInt64 theStartTime = OS::Microseconds();
+                {
+                    OSMutexLocker locker(fMutex);
+                    fStream->RemoveOutput(theOutput);
+                }
+                fChurnTimes.Record((UInt32)(OS::Microseconds() - theStartTime));
+                
+                theStartTime = OS::Microseconds();
+                {
+                    OSMutexLocker locker(fMutex);
+                    (void)fStream->AddOutput(theOutput, -1);
+                }
+                fChurnTimes.Record((UInt32)(OS::Microseconds() - theStartTime));
+                
+                fNumChurns++;
+                OSThread::Sleep(1);
+            }
+        }
+        
+        ReflectorStream*        fStream;
+        ReflectorTestOutput**   fOutputs;
+        UInt32                  fNumOutputs;
+        OSMutex*                fMutex;     // held around each add and remove, if not NULL
+        UInt32                  fNumChurns;
+        OSHistogram             fChurnTimes;// usec per add or remove
+};
+
+Bool16 ReflectorStream::Test()
+{
+    enum
+    {
+        kNumOutputs = 1000,
+        kPacketSize = 1316,
+        kPacketsPerPass = 4,
+        kRunMilliSecs = 3000,
+        kMaxPacketAgeMSec = 50  //keeps the queue short
+    };
+    
+    UInt32 theSavedMaxPacketAge = sMaxPacketAgeMSec;
+    sMaxPacketAgeMSec = kMaxPacketAgeMSec;
+    
+    char thePayload[kPacketSize];
+    ::memset(thePayload, 0, sizeof(thePayload));
+    thePayload[0] = (char)0x80;
+    
+    ReflectorTestOutput* theOutputs[kNumOutputs];
+    for (UInt32 x = 0; x < kNumOutputs; x++)
+        theOutputs[x] = NEW ReflectorTestOutput();
+    
+    OSQueue theFreeQueue;
+    Bool16 theResult = true;
+    
+    //First the way it was, with every add and remove waiting for a whole pass
+    for (UInt32 theMode = 0; (theMode < 2) && theResult; theMode++)
+    {
+        SourceInfo::StreamInfo theInfo;
+        ReflectorStream* theStream = NEW ReflectorStream(&theInfo);
+        theStream->SetEnableBuffer(true);
+        ReflectorSender* theSender = theStream->GetRTPSender();
+        
+        for (UInt32 x = 0; x < kNumOutputs; x++)
+        {
+            theOutputs[x]->fLastPacketID = 0;
+            theOutputs[x]->fNumPacketsWritten = 0;
+            if (theStream->AddOutput(theOutputs[x], -1) < 0)
+                theResult = false;
+        }
+        
+        ReflectorChurnThread theChurnThread(theStream, theOutputs, kNumOutputs, (theMode == 0) ? theStream->GetMutex() : NULL);
+        theChurnThread.Start();
+        
+        OSHistogram thePassTimes;   // usec
+        UInt32 theNumPasses = 0;
+        SInt64 theStartTime = OS::Milliseconds();
+        while (OS::Milliseconds() < theStartTime + kRunMilliSecs)
+        {
+            //Queue up new packets like ReflectorSocket::ProcessPacket does
+            for (UInt32 y = 0; y < kPacketsPerPass; y++)
+            {
+                ReflectorPacket* thePacket = NULL;
+                if (theFreeQueue.GetLength() > 0)
+                    thePacket = (ReflectorPacket*)theFreeQueue.DeQueue()->GetEnclosingObject();
+                else
+                    thePacket = NEW ReflectorPacket();
+                thePacket->MakeWritable();
+                thePacket->SetPacketData(thePayload, kPacketSize);
+                thePacket->fStreamCountID = ++(theStream->fPacketCount);
+                thePacket->fTimeArrived = OS::Milliseconds();
+                theSender->fPacketQueue.EnQueue(&thePacket->fQueueElem);
+                if (theSender->fFirstNewPacketInQueue == NULL)
+                    theSender->fFirstNewPacketInQueue = &thePacket->fQueueElem;
+                theSender->fHasNewPackets = true;
+            }
+            
+            SInt64 thePassStart = OS::Microseconds();
+            SInt64 theWakeupTime = 0;
+            theSender->ReflectPackets(&theWakeupTime, &theFreeQueue);
+            thePassTimes.Record((UInt32)(OS::Microseconds() - thePassStart));
+            theNumPasses++;
+        }
+        SInt64 theRunTime = OS::Milliseconds() - theStartTime;
+        theChurnThread.StopAndWaitForThread();
+        
+        //Every output is still there, exactly once
+        if (theStream->fNumElements != kNumOutputs)
+            theResult = false;
+        UInt32 theNumPacketsWritten = 0;
+        for (UInt32 x = 0; x < kNumOutputs; x++)
+        {
+            UInt32 theNumFound = 0;
+            for (UInt32 y = 0; y < theStream->fNumBuckets; y++)
+                for (UInt32 z = 0; z < sBucketSize; z++)
+                    if (theStream->fOutputArray[y][z] == theOutputs[x])
+                        theNumFound++;
+            if (theNumFound != 1)
+                theResult = false;
+            theNumPacketsWritten += theOutputs[x]->fNumPacketsWritten;
+            theStream->RemoveOutput(theOutputs[x]);
+        }
+        if ((theNumPasses == 0) || (theNumPacketsWritten == 0))
+            theResult = false;
+        
+        char theSummary[OSHistogram::kSummaryBufferSize];
+        qtss_printf("ReflectorStream: %s: %lu passes, %.0f packets written/s, %.0f adds+removes/s\n",
+                    (theMode == 0) ? "stream mutex" : "bucket locks", theNumPasses,
+                    (Float64)theNumPacketsWritten * 1000 / (Float64)(theRunTime ? theRunTime : 1),
+                    (Float64)theChurnThread.fNumChurns * 1000 / (Float64)(theRunTime ? theRunTime : 1));
+        (void)thePassTimes.GetSummary(theSummary);
+        qtss_printf("ReflectorStream:   pass usec %s\n", theSummary);
+        (void)theChurnThread.fChurnTimes.GetSummary(theSummary);
+        qtss_printf("ReflectorStream:   add or remove usec %s\n", theSummary);
+        
+        delete theStream;   // deletes the packets still queued
+    }
+    
+    while (theFreeQueue.GetLength() > 0)
+        delete (ReflectorPacket*)theFreeQueue.DeQueue()->GetEnclosingObject();
+    for (UInt32 x = 0; x < kNumOutputs; x++)
+        delete theOutputs[x];
+    sMaxPacketAgeMSec = theSavedMaxPacketAge;
+    return theResult;
 }
+
+#endif
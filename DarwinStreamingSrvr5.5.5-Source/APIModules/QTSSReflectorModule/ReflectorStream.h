@@ -37,6 +37,8 @@
 #ifndef _REFLECTOR_STREAM_H_
 #define _REFLECTOR_STREAM_H_
 
+#define _REFLECTORSTREAM_TESTING_ 0
+
 #include "QTSS.h"
 
 #include "IdleTask.h"
@@ -49,8 +51,10 @@
 #include "SequenceNumberMap.h"
 
 #include "OSMutex.h"
+#include "OSMutexRW.h"
 #include "OSQueue.h"
 #include "OSRef.h"
+#include "OSSharedBuffer.h"
 
 #include "RTCPSRPacket.h"
 #include "ReflectorOutput.h"
@@ -71,18 +75,27 @@ class ReflectorPacket
 {
     public:
     
-        ReflectorPacket() : fQueueElem() { fQueueElem.SetEnclosingObject(this); this->Reset();}
+        ReflectorPacket() : fQueueElem(), fPacketData(OSSharedBuffer::New(kMaxReflectorPacketSize)) { fQueueElem.SetEnclosingObject(this); this->Reset();}
         void Reset()    { // make packet ready to reuse fQueueElem is always in use
                             fBucketsSeenThisPacket = 0; 
                             fTimeArrived = 0; 
                             //fQueueElem -- should be set to this
-                            fPacketPtr.Set(fPacketData, 0); 
+                            fPacketPtr.Set(fPacketData->GetData(), 0); 
                             fIsRTCP = false;
                             fStreamCountID = 0;
                             fNeededByOutput = false; 
                         }
 
-        ~ReflectorPacket() {}
+        ~ReflectorPacket() { fPacketData->Release(); }
+        
+        // Outputs may still hold the data of a packet that has gone back to the
+        // free queue, so it gets new storage rather than writing over theirs.
+        void    MakeWritable()  {   if (!fPacketData->IsShared())
+                                        return;
+                                    fPacketData->Release();
+                                    fPacketData = OSSharedBuffer::New(kMaxReflectorPacketSize);
+                                    fPacketPtr.Ptr = fPacketData->GetData();
+                                }
         
         void    SetPacketData(char *data, UInt32 len) { Assert(kMaxReflectorPacketSize > len); if (len > 0) memcpy(this->fPacketPtr.Ptr,data,len); this->fPacketPtr.Len = len;}
         Bool16  IsRTCP() { return fIsRTCP; }
@@ -101,7 +114,7 @@ inline  SInt64  GetPacketNTPTime();
         UInt32      fBucketsSeenThisPacket;
         SInt64      fTimeArrived;
         OSQueueElem fQueueElem;
-        char        fPacketData[kMaxReflectorPacketSize];
+        OSSharedBuffer* fPacketData;    // passed to outputs with qtssWriteFlagsSharedData
         StrPtrLen   fPacketPtr;
         Bool16      fIsRTCP;
         Bool16      fNeededByOutput; // is this packet still needed for output?
@@ -110,6 +123,9 @@ inline  SInt64  GetPacketNTPTime();
         friend class ReflectorSender;
         friend class ReflectorSocket;
         friend class RTPSessionOutput;
+#if _REFLECTORSTREAM_TESTING_
+        friend class ReflectorStream;
+#endif
         
    
 };
@@ -208,6 +224,7 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         enum
         {
             kNumPreallocatedPackets = 20,   //UInt32
+            kNumPacketsPerRecv = 16,        //UInt32. No more than UDPSocket::kMaxRecvPackets
             kRefreshBroadcastSessionIntervalMilliSecs = 10000,
             kSSRCTimeOut = 30000 // milliseconds before clearing the SSRC if no new ssrcs have come in
         };
@@ -242,6 +259,27 @@ class ReflectorSocketPool : public UDPSocketPool
         virtual UDPSocketPair*  ConstructUDPSocketPair();
         virtual void            DestructUDPSocketPair(UDPSocketPair *inPair);
 };
+
+//When reflector_buckets_per_task is set, a ReflectorSender splits each pass over
+//its buckets into groups and hands them to these tasks, so that the outputs of one
+//busy stream are written from all the TaskThreads instead of the socket's thread.
+class ReflectorBucketTask : public Task
+{
+    public:
+    
+        ReflectorBucketTask(ReflectorSender* inSender) : Task(), fSender(inSender) { this->SetTaskName("ReflectorBucketTask"); }
+        virtual ~ReflectorBucketTask() {}
+        
+    private:
+    
+        virtual SInt64 Run();
+        
+        OSMutex             fMutex; // held while using fSender
+        ReflectorSender*    fSender;
+        
+        friend class ReflectorSender;
+};
+
 /***************************************************
 *
 * UDP(Task)
@@ -272,7 +310,16 @@ class ReflectorSender : public UDPDemuxerTask
     //this is the old way of doing reflect packets. It is only here until the relay code can be cleaned up.
     void        ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue);
     
-    OSQueueElem*    SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay);
+    OSQueueElem*    SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, SInt64* ioNextTimeToRun);
+    
+    //Sends to every playing output in the bucket, picking up at its bookmark.
+    //The caller must hold the bucket array read lock.
+    void        SendPacketsToBucket(UInt32 inBucketIndex, SInt64 inCurrentTime, SInt64* ioNextTimeToRun);
+    
+    //Parallel reflection. ReflectBucketGroups signals the ReflectorBucketTasks, sends
+    //groups itself until none are left to claim, then waits for the ones in progress.
+    void        ReflectBucketGroups(SInt64 inCurrentTime);
+    void        SendPacketsToBucketGroups();
 
     UInt32      GetOldestPacketRTPTime(Bool16 *foundPtr);          
     UInt16      GetFirstPacketRTPSeqNum(Bool16 *foundPtr);             
@@ -306,7 +353,25 @@ class ReflectorSender : public UDPDemuxerTask
     SInt64      fLastRRTime;
     OSQueueElem fSocketQueueElem;
     
+    enum
+    {
+        kMaxBucketTasks = 16    //UInt32
+    };
+    
+    ReflectorBucketTask*    fBucketTasks[kMaxBucketTasks];
+    
+    //State of the current parallel pass, protected by fPassMutex
+    OSMutex     fPassMutex;
+    OSCond      fPassCond;
+    UInt32      fPassNumBuckets;
+    UInt32      fNumGroups;
+    UInt32      fNextGroup;
+    UInt32      fNumGroupsDone;
+    SInt64      fPassTime;
+    SInt64      fPassNextTimeToRun;
+    
     friend class ReflectorSocket;
+
     friend class ReflectorStream;
 };
 
@@ -403,9 +468,20 @@ class ReflectorStream
 inline  void                    UpdateBitRate(SInt64 currentTime);
         static UInt32           sOverBufferInMsec;
         
-        void                    IncEyeCount()                           { OSMutexLocker locker(&fBucketMutex); fEyeCount ++; }
-        void                    DecEyeCount()                           { OSMutexLocker locker(&fBucketMutex); fEyeCount --; }
-        UInt32                  GetEyeCount()                           { OSMutexLocker locker(&fBucketMutex); return fEyeCount; }
+        void                    IncEyeCount()                           { (void)atomic_add(&fEyeCount, 1); }
+        void                    DecEyeCount()                           { (void)atomic_sub(&fEyeCount, 1); }
+        UInt32                  GetEyeCount()                           { return fEyeCount; }
+
+#if _REFLECTORSTREAM_TESTING_
+        //
+        // Reflects to 1,000 outputs while another thread keeps removing them and
+        // adding them back. It runs once with the adds and removes holding
+        // fBucketMutex, as they used to, and once with just the bucket locks,
+        // printing packets written per second and how long a pass and an add
+        // or remove took for each.
+        //returns true if it passed the test, false otherwise
+        static Bool16 Test();
+#endif
 
     private:
     
@@ -413,6 +489,7 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         void    SendReceiverReport();
         void    AllocateBucketArray(UInt32 inNumBuckets);
         SInt32  FindBucket();
+        SInt32  AddOutputToBucket(ReflectorOutput* inOutput, UInt32 inBucket);
         // Unique ID & OSRef. ReflectorStreams can be mapped & shared
         OSRef               fRef;
         char                fSourceIDBuf[kStreamIDSize];
@@ -447,10 +524,17 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         typedef ReflectorOutput** Bucket;
         Bucket*     fOutputArray;
 
-        UInt32      fNumBuckets;        //Number of buckets currently
-        UInt32      fNumElements;       //Number of reflector outputs in the array
+        UInt32          fNumBuckets;        //Number of buckets currently
+        unsigned int    fNumElements;       //Number of reflector outputs in the array. atomic_add'ed
+        
+        //A bucket can't be modified while we are sending packets to it. Each has its
+        //own lock so outputs coming and going only hold up the senders for that bucket.
+        //The array itself is only write locked when it grows.
+        OSMutex*    fBucketLocks;
+        OSMutexRW   fBucketArrayMutex;
         
-        //Bucket array can't be modified while we are sending packets.
+        //Held by the senders while they reflect. It keeps the packet queues still,
+        //and it is also taken by callers that need to stop this stream from reflecting.
         OSMutex     fBucketMutex;
         
         // RTCP RR information
@@ -478,7 +562,7 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         Bool16              fHasFirstRTPPacket;
         
         Bool16              fEnableBuffer;
-        UInt32              fEyeCount;
+        unsigned int        fEyeCount; // atomic_add'ed
         
         UInt32              fFirst_RTCP_RTP_Time;
         SInt64              fFirst_RTCP_Arrival_Time;
@@ -492,8 +576,10 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         static UInt32       sBucketDelayInMsec;
         static Bool16       sUsePacketReceiveTime;
         static UInt32       sFirstPacketOffsetMsec;
+        static UInt32       sBucketsPerTask;
         
         friend class ReflectorSocket;
+
         friend class ReflectorSender;
 };
 
@@ -101,8 +101,12 @@ enum
     qtssWriteFlagsIsRTP             = 0x00000001,
     qtssWriteFlagsIsRTCP            = 0x00000002,   
     qtssWriteFlagsWriteBurstBegin   = 0x00000004,
-    qtssWriteFlagsBufferData        = 0x00000008
+    qtssWriteFlagsBufferData        = 0x00000008,   // for RTP over UDP, the packet may be held until QTSS_Flush on the stream
+    qtssWriteFlagsNoCopy            = 0x00000010,   // with qtssWriteFlagsBufferData: packetData stays unchanged until QTSS_Flush, so it is held without copying
+    qtssWriteFlagsSharedData        = 0x00000020    // packetData is the data of an OSSharedBuffer; an RTP packet kept for resending holds a reference to it instead of a copy
+
 };
+
 typedef UInt32 QTSS_WriteFlags;
 
 // Flags for QTSS_SendStandardRTSPResponse
@@ -430,7 +434,16 @@ enum
     qtssRTPStrClientRTPPort         = 37,   //read      //UInt16            // Port the server is sending RTP packets to for this stream
     qtssRTPStrNetworkMode           = 38,   //read      //QTSS_RTPNetworkMode // unicast or multicast
 
-    qtssRTPStrNumParams             = 39
+    qtssRTPStrRoundTripTimeInMsec   = 39,   //read      //UInt32            // Round trip time to the client, from the LSR and DLSR of its latest RTCP receiver report. 0 until the client has reported on one of our sender reports.
+    qtssRTPStrTotalNACKedPackets    = 40,   //read      //UInt32            // Number of packets the client has reported lost in RTCP generic NACKs (RFC 4585).
+
+    // Distributions since the stream was set up, as "count=n p50=v p90=v p99=v p99.9=v max=v"
+    qtssRTPStrSendLatenessHistogram = 41,   //read      //char array        // Milliseconds each RTP packet went out after its transmit time (0 if on time or early)
+    qtssRTPStrJitterHistogram       = 42,   //read      //char array        // Interarrival jitter in milliseconds, from each RTCP receiver report
+    qtssRTPStrRoundTripTimeHistogram= 43,   //read      //char array        // Round trip time in milliseconds, each time a receiver report gives one
+    qtssRTPStrPacketLossHistogram   = 44,   //read      //char array        // Percent of packets lost, from each RTCP receiver report
+
+    qtssRTPStrNumParams             = 45
 
 };
 typedef UInt32 QTSS_RTPStreamAttributes;
@@ -482,7 +495,11 @@ enum
     qtssCliSesRTCPPacketsRecv       = 34,   //read      //UInt32    //Number of RTCP packets received so far on this session.
     qtssCliSesRTCPBytesRecv         = 35,   //read      //UInt32    //Number of RTCP bytes received so far on this session.
     qtssCliSesStartedThinning       = 36,   //read      //Bool16    // At least one of the streams in the session is thinned
-    qtssCliSesNumParams             = 37
+    qtssCliSesSendLatenessHistogram = 37,   //read      //char array // The qtssRTPStrSendLatenessHistogram of all the streams in this session together
+    qtssCliSesJitterHistogram       = 38,   //read      //char array // Ditto qtssRTPStrJitterHistogram
+    qtssCliSesRoundTripTimeHistogram= 39,   //read      //char array // Ditto qtssRTPStrRoundTripTimeHistogram
+    qtssCliSesPacketLossHistogram   = 40,   //read      //char array // Ditto qtssRTPStrPacketLossHistogram
+    qtssCliSesNumParams             = 41
     
 };
 typedef UInt32 QTSS_ClientSessionAttributes;
@@ -634,7 +651,29 @@ enum
     qtssSvrServerPlatform           = 39,   //read      //char array //Platform (OS) of the server
     qtssSvrRTSPServerComment        = 40,   //read      //char array //RTSP comment for the server header    
     qtssSvrNumThinned               = 41,    //r/w      //SInt32    //Number of thinned sessions
-    qtssSvrNumParams                = 42
+    qtssSvrEventThreadEventsPerSec  = 42,   //read      //UInt32    //Indexed parameter: events dispatched per second by each event thread
+    qtssSvrUDPSendBatchAvgSize      = 43,   //read      //Float32   //Average number of UDP packets sent per batched send system call
+    qtssSvrUDPSendSyscallsSaved     = 44,   //read      //UInt64    //Number of send system calls avoided by batching UDP packets since startup
+    qtssSvrFileBlockCacheHitRatio   = 45,   //read      //Float32   //Fraction of file block cache lookups since startup that found the block already read
+    qtssSvrFileBlockCacheBytes      = 46,   //read      //UInt64    //Bytes of file data currently held by the file block cache
+    qtssSvrFileBlockCacheEvictions  = 47,   //read      //UInt64    //Number of blocks dropped from the file block cache to make room since startup
+    qtssSvrMovieCacheHits           = 48,   //read      //UInt64    //Number of movie opens since startup that found the movie already parsed
+    qtssSvrMovieCacheMisses         = 49,   //read      //UInt64    //Number of movie opens since startup that had to parse the movie
+    qtssSvrMovieCacheEvictions      = 50,   //read      //UInt64    //Number of idle parsed movies dropped from the movie cache to make room since startup
+    qtssSvrMovieCacheBytes          = 51,   //read      //UInt64    //Approximate memory used by the parsed movies in the movie cache
+    qtssSvrMovieCacheEntries        = 52,   //read      //char array //Indexed parameter: "bytes users path" for each movie in the movie cache
+    qtssSvrSDPCacheHits             = 53,   //read      //UInt64    //Number of DESCRIBEs of files since startup answered from the SDP cache
+    qtssSvrSDPCacheMisses           = 54,   //read      //UInt64    //Number of DESCRIBEs of files since startup that had to read or generate the SDP
+    qtssSvrSDPCacheHitRatio         = 55,   //read      //Float32   //Fraction of SDP cache lookups since startup that were hits
+    qtssSvrSDPCacheBytes            = 56,   //read      //UInt64    //Approximate memory used by the SDP cache
+    qtssSvrReliableUDPBufferBytes   = 57,   //read      //UInt64    //Bytes allocated for reliable UDP retransmit buffers
+    qtssSvrReliableUDPBufferCacheHitRatio = 58, //read  //Float32   //Fraction of retransmit buffer gets and puts since startup handled by the calling thread's own cache
+    qtssSvrReliableUDPBufferContention = 59, //read     //UInt64    //Number of retransmit buffer free list updates since startup that were retried because another thread got there first
+    qtssSvrRTPSendLatenessHistogram = 60,   //read      //char array //The qtssRTPStrSendLatenessHistogram of every stream since startup together
+    qtssSvrRTPJitterHistogram       = 61,   //read      //char array //Ditto qtssRTPStrJitterHistogram
+    qtssSvrRTPRoundTripTimeHistogram= 62,   //read      //char array //Ditto qtssRTPStrRoundTripTimeHistogram
+    qtssSvrRTPPacketLossHistogram   = 63,   //read      //char array //Ditto qtssRTPStrPacketLossHistogram
+    qtssSvrNumParams                = 64
 };
 typedef UInt32 QTSS_ServerAttributes;
 
@@ -734,7 +773,13 @@ enum
     qtssPrefsPlayersReqRTPHeader            = 70,   // "player_requires_rtp_header_info" //Char array //name of player to match against the player's user agent header
     qtssPrefsPlayersReqBandAdjust           = 71,   // "player_requires_bandwidth_adjustment //Char array //name of player to match against the player's user agent header
     qtssPrefsPlayersReqNoPauseTimeAdjust    = 72,   // "player_requires_no_pause_time_adjustment //Char array //name of player to match against the player's user agent header
-    qtssPrefsNumParams                      = 73
+    qtssPrefsRunNumEventThreads             = 73,   //"run_num_event_threads" //UInt32 // if value is non-zero, will create that many event threads; otherwise an event thread will be created for each processor. Sockets opened before the event threads are made (the RTSP listeners) stay on the first one
+    qtssPrefsRunTaskThreadWorkStealing      = 74,   //"run_task_thread_work_stealing" //Bool16 // if true, idle task threads will run tasks queued on busy task threads
+    qtssPrefsRunTaskTimingWheel             = 75,   //"run_task_timing_wheel" //Bool16 // if true, task threads keep their timers in a timing wheel rather than a heap
+    qtssPrefsFileBlockCacheSizeInMB         = 76,   //"file_block_cache_size_mb" //UInt32 // if non-zero, movie file reads share a block cache of this many megabytes
+    qtssPrefsNumAsyncFileReadThreads        = 77,   //"async_file_read_threads" //UInt32 // if non-zero, asynchronous file reads happen on this many file reading threads
+    qtssPrefsReliableUDPCongestionControl   = 78,   //"reliable_udp_congestion_control" //Char array // "reno" or "bbr". Congestion control for reliable UDP sessions that start after it is set
+    qtssPrefsNumParams                      = 79
 };
 
 typedef UInt32 QTSS_PrefsAttributes;
@@ -1505,6 +1550,22 @@ QTSS_Error  QTSS_Write(QTSS_StreamRef inRef, const void* inBuffer, UInt32 inLen,
 //              QTSS_BadArgument:   NULL argument.
 QTSS_Error  QTSS_WriteV(QTSS_StreamRef inRef, iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength, UInt32* outLenWritten);
 
+/********************************************************************/
+//  QTSS_WritePackets
+//
+//  Writes inNumPackets QTSS_PacketStructs to a QTSS_RTPStreamObject, the same as
+//  calling QTSS_Write on each in turn with inFlags (qtssWriteFlagsWriteBurstBegin
+//  applies to the first), but cheaper. Stops at the first packet that QTSS_Write
+//  would have refused: that packet gets the suggestedWakeupTime, and
+//  *outNumPacketsWritten says how many packets went before it.
+//
+//  Returns:    QTSS_NoErr
+//              QTSS_WouldBlock: The stream cannot accept any more packets at this time.
+//              QTSS_NotConnected: The stream receiver is no longer connected.
+//              QTSS_BadArgument:   NULL argument, or qtssWriteFlagsIsRTP not set.
+//              QTSS_Unimplemented: The stream isn't an RTP stream.
+QTSS_Error  QTSS_WritePackets(QTSS_StreamRef inRef, QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets, UInt32* outNumPacketsWritten, QTSS_WriteFlags inFlags);
+
 /********************************************************************/
 //  QTSS_Flush
 //
@@ -218,6 +218,11 @@ QTSS_Error  QTSS_WriteV(QTSS_StreamRef inStream, iovec* inVec, UInt32 inNumVecto
     return (sCallbacks->addr [kWriteVCallback]) (inStream, inVec, inNumVectors, inTotalLength, outLenWritten);  
 }
 
+QTSS_Error  QTSS_WritePackets(QTSS_StreamRef inStream, QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets, UInt32* outNumPacketsWritten, UInt32 inFlags)
+{
+    return (sCallbacks->addr [kWritePacketsCallback]) (inStream, inPackets, inPacketLens, inNumPackets, outNumPacketsWritten, inFlags);  
+}
+
 QTSS_Error  QTSS_Flush(QTSS_StreamRef inStream)
 {
     return (sCallbacks->addr [kFlushCallback]) (inStream);  
@@ -139,6 +139,10 @@ SOURCE=.\OSBufferPool.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\OSAsyncFileReader.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\OSCodeFragment.cpp
 # End Source File
 # Begin Source File
@@ -147,6 +151,10 @@ SOURCE=.\OSCond.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\OSFileBlockCache.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\OSFileSource.cpp
 # End Source File
 # Begin Source File
@@ -155,6 +163,10 @@ SOURCE=.\OSHeap.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\OSHistogram.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\OSMutex.cpp
 # End Source File
 # Begin Source File
@@ -171,10 +183,18 @@ SOURCE=.\OSRef.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\OSSizeClassBufferPool.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\OSThread.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\OSTimingWheel.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\ResizeableStringFormatter.cpp
 # End Source File
 # Begin Source File
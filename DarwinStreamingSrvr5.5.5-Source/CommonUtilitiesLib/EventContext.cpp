@@ -52,6 +52,16 @@
 #include "OS.h"
 #endif
 
+#if _EVENTCONTEXT_TESTING_
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include "OS.h"
+#include "OSMemory.h"
+#include "SafeStdLib.h"
+#endif
+
 #ifdef __Win32__
 unsigned int EventContext::sUniqueID = WM_USER; // See commentary in RequestEvent
 #else
@@ -104,7 +114,7 @@ void EventContext::Cleanup()
             fEventThread->fRefTable.UnRegister(&fRef);
 
 #if !MACOSXEVENTQUEUE
-            select_removeevent(fFileDesc);//The eventqueue / select shim requires this
+            select_queue_removeevent(fEventThread->fEventQueue, fFileDesc);//The eventqueue / select shim requires this
 #ifdef __Win32__
             err = ::closesocket(fFileDesc);
 #endif
@@ -151,6 +161,10 @@ void EventContext::SnarfEventContext( EventContext &fromContext )
     
     fromContext.fFileDesc = kInvalidFileDesc;
     
+    // The OSRef lives in the ref table of the thread the old context registered with,
+    // and the fd is armed in that thread's event queue, so we have to stay on it.
+    fEventThread = fromContext.fEventThread;
+    
     fWatchEventCalled = fromContext.fWatchEventCalled; 
     fUniqueID = fromContext.fUniqueID;
     fUniqueIDStr.Set((char*)&fUniqueID, sizeof(fUniqueID)),
@@ -181,7 +195,7 @@ void EventContext::RequestEvent(int theMask)
 #if MACOSXEVENTQUEUE
         if (modwatch(&fEventReq, theMask) != 0)
 #else
-        if (select_modwatch(&fEventReq, theMask) != 0)
+        if (select_queue_modwatch(fEventThread->fEventQueue, &fEventReq, theMask) != 0)
 #endif  
             AssertV(false, OSThread::GetErrno());
     }
@@ -260,7 +274,7 @@ void EventContext::RequestEvent(int theMask)
 #if MACOSXEVENTQUEUE
         if (watchevent(&fEventReq, theMask) != 0)
 #else
-        if (select_watchevent(&fEventReq, theMask) != 0)
+        if (select_queue_watchevent(fEventThread->fEventQueue, &fEventReq, theMask) != 0)
 #endif  
             //this should never fail, but if it does, cleanup.
             AssertV(false, OSThread::GetErrno());
@@ -290,7 +304,7 @@ void EventThread::Entry()
 #if MACOSXEVENTQUEUE
             int theReturnValue = waitevent(&theCurrentEvent, NULL);
 #else
-            int theReturnValue = select_waitevent(&theCurrentEvent, NULL);
+            int theReturnValue = select_queue_waitevent(fEventQueue, &theCurrentEvent);
 #endif  
             //Sort of a hack. In the POSIX version of the server, waitevent can return
             //an actual POSIX errorcode.
@@ -341,6 +355,7 @@ void EventThread::Entry()
 				*
 				*****************************************/
                 theContext->ProcessEvent(theCurrentEvent.er_eventbits);
+                fNumEventsDispatched++; // only written by this thread
 
 				/****************************************
 				*
@@ -359,3 +374,238 @@ void EventThread::Entry()
         this->ThreadYield();
     }
 }
+
+#if _EVENTCONTEXT_TESTING_
+
+enum
+{
+    kTestNumRounds = 2000   //UInt32
+};
+
+static int OpenTestSocket(struct sockaddr_in* outAddr)
+{
+    int theFD = ::socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (theFD == -1)
+        return -1;
+        
+    ::memset(outAddr, 0, sizeof(struct sockaddr_in));
+    outAddr->sin_family = AF_INET;
+    outAddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t theLen = sizeof(struct sockaddr_in);
+    if ((::bind(theFD, (struct sockaddr*)outAddr, theLen) != 0) ||
+        (::getsockname(theFD, (struct sockaddr*)outAddr, &theLen) != 0))
+    {
+        ::close(theFD);
+        return -1;
+    }
+    ::fcntl(theFD, F_SETFL, ::fcntl(theFD, F_GETFL, 0) | O_NONBLOCK);
+    return theFD;
+}
+
+//
+// The select shim in ev.cpp, stripped to what one round of events costs it:
+// copy the read set, select(), scan the returned set up to the highest fd,
+// and write to the wakeup pipe for every modwatch.
+static Bool16 RunSelectRounds(int* inFDs, struct sockaddr_in* inAddrs, UInt32 inNumIdle, UInt32 inNumActive,
+                                int inSendFD, SInt64* outMicroseconds)
+{
+    int thePipes[2];
+    if (::pipe(thePipes) != 0)
+        return false;
+    
+    UInt32 theNumFDs = inNumIdle + inNumActive;
+    int theFDToIndex[FD_SETSIZE];
+    fd_set theReadSet;
+    fd_set theReturnedReadSet;
+    FD_ZERO(&theReadSet);
+    FD_SET(thePipes[0], &theReadSet);
+    int theMaxFD = thePipes[0];
+    for (UInt32 x = 0; x < theNumFDs; x++)
+    {
+        FD_SET(inFDs[x], &theReadSet);
+        theFDToIndex[inFDs[x]] = x;
+        if (inFDs[x] > theMaxFD)
+            theMaxFD = inFDs[x];
+    }
+    
+    char theBuffer[16];
+    char thePipeBuffer[4096];
+    Bool16 theResult = true;
+    SInt64 theStartTime = OS::Microseconds();
+    for (UInt32 theRound = 0; (theRound < kTestNumRounds) && theResult; theRound++)
+    {
+        for (UInt32 y = inNumIdle; y < theNumFDs; y++)
+            (void)::sendto(inSendFD, "x", 1, 0, (struct sockaddr*)&inAddrs[y], sizeof(struct sockaddr_in));
+        
+        UInt32 theNumEvents = 0;
+        while (theNumEvents < inNumActive)
+        {
+            ::memcpy(&theReturnedReadSet, &theReadSet, sizeof(fd_set));
+            int theNumReady = ::select(theMaxFD + 1, &theReturnedReadSet, NULL, NULL, NULL);
+            if (theNumReady < 0)
+            {
+                theResult = false;
+                break;
+            }
+            if (FD_ISSET(thePipes[0], &theReturnedReadSet))
+            {
+                (void)::read(thePipes[0], thePipeBuffer, sizeof(thePipeBuffer));
+                FD_CLR(thePipes[0], &theReturnedReadSet);
+            }
+            for (int theFD = 0; theFD <= theMaxFD; theFD++)
+            {
+                if (!FD_ISSET(theFD, &theReturnedReadSet))
+                    continue;
+                if (theFDToIndex[theFD] < inNumIdle)
+                    theResult = false; // nothing was sent to this one
+                    
+                FD_CLR(theFD, &theReadSet);
+                (void)::recv(theFD, theBuffer, sizeof(theBuffer), 0);
+                FD_SET(theFD, &theReadSet);
+                (void)::write(thePipes[1], "p", 1);
+                theNumEvents++;
+            }
+        }
+        if (theNumEvents != inNumActive)
+            theResult = false;
+    }
+    *outMicroseconds = OS::Microseconds() - theStartTime;
+    
+    ::close(thePipes[0]);
+    ::close(thePipes[1]);
+    return theResult;
+}
+
+static Bool16 RunEpollRounds(struct eventqueue* inQueue, int* inFDs, struct sockaddr_in* inAddrs, UInt32 inNumIdle,
+                                UInt32 inNumActive, int inSendFD, SInt64* outMicroseconds)
+{
+    UInt32 theNumFDs = inNumIdle + inNumActive;
+    struct eventreq* theReqs = NEW struct eventreq[theNumFDs];
+    UInt32* theLastRound = NEW UInt32[theNumFDs];
+    for (UInt32 x = 0; x < theNumFDs; x++)
+    {
+        ::memset(&theReqs[x], 0, sizeof(struct eventreq));
+        theReqs[x].er_type = EV_FD;
+        theReqs[x].er_handle = inFDs[x];
+        theReqs[x].er_data = &theReqs[x]; // must not be NULL
+        theLastRound[x] = kTestNumRounds;
+        (void)select_queue_watchevent(inQueue, &theReqs[x], EV_RE);
+    }
+    
+    char theBuffer[16];
+    Bool16 theResult = true;
+    SInt64 theStartTime = OS::Microseconds();
+    for (UInt32 theRound = 0; (theRound < kTestNumRounds) && theResult; theRound++)
+    {
+        for (UInt32 y = inNumIdle; y < theNumFDs; y++)
+            (void)::sendto(inSendFD, "x", 1, 0, (struct sockaddr*)&inAddrs[y], sizeof(struct sockaddr_in));
+        
+        UInt32 theNumEvents = 0;
+        while (theNumEvents < inNumActive)
+        {
+            struct eventreq theEvent;
+            int theErr = select_queue_waitevent(inQueue, &theEvent);
+            if (theErr == EINTR)
+                continue;
+            
+            struct eventreq* theReq = (struct eventreq*)theEvent.er_data;
+            if ((theErr != 0) || (theReq < &theReqs[inNumIdle]) || (theReq >= &theReqs[theNumFDs]))
+            {
+                theResult = false; // an error or an idle socket
+                break;
+            }
+            UInt32 theIndex = (UInt32)(theReq - theReqs);
+            if (theLastRound[theIndex] == theRound)
+            {
+                theResult = false; // the same socket twice in a round
+                break;
+            }
+            theLastRound[theIndex] = theRound;
+            
+            (void)::recv(inFDs[theIndex], theBuffer, sizeof(theBuffer), 0);
+            (void)select_queue_modwatch(inQueue, &theReqs[theIndex], EV_RE);
+            theNumEvents++;
+        }
+    }
+    *outMicroseconds = OS::Microseconds() - theStartTime;
+    
+    // This closes them, too
+    for (UInt32 z = 0; z < theNumFDs; z++)
+        (void)select_queue_removeevent(inQueue, inFDs[z]);
+        
+    delete [] theReqs;
+    delete [] theLastRound;
+    return theResult;
+}
+
+static void CloseTestSockets(int* inFDs, UInt32 inNumFDs)
+{
+    for (UInt32 x = 0; x < inNumFDs; x++)
+        ::close(inFDs[x]);
+}
+
+Bool16 EventThread::Test()
+{
+    static const UInt32 kNumIdle[] = { 10, 100, 800 };
+    static const UInt32 kNumActive[] = { 1, 10, 100 };
+
+    select_startevents();
+    struct eventqueue* theQueue = select_newqueue();
+    if (theQueue == NULL)
+    {
+        qtss_printf("EventThread: this platform's event queue is select, nothing to compare it with\n");
+        return false;
+    }
+    
+    struct sockaddr_in theSendAddr;
+    int theSendFD = OpenTestSocket(&theSendAddr);
+    if (theSendFD == -1)
+        return false;
+
+    for (UInt32 x = 0; x < sizeof(kNumIdle) / sizeof(UInt32); x++)
+    {
+        for (UInt32 y = 0; y < sizeof(kNumActive) / sizeof(UInt32); y++)
+        {
+            // The active sockets are opened last, so select has to scan past all the idle ones
+            UInt32 theNumFDs = kNumIdle[x] + kNumActive[y];
+            int* theFDs = NEW int[theNumFDs];
+            struct sockaddr_in* theAddrs = NEW struct sockaddr_in[theNumFDs];
+            Bool16 theResult = true;
+            UInt32 theNumOpen = 0;
+            while (theResult && (theNumOpen < theNumFDs))
+            {
+                theFDs[theNumOpen] = OpenTestSocket(&theAddrs[theNumOpen]);
+                if (theFDs[theNumOpen] == -1)
+                    theResult = false;
+                else if (theFDs[theNumOpen++] >= FD_SETSIZE)
+                    theResult = false;
+            }
+            
+            SInt64 theSelectTime = 0;
+            SInt64 theEpollTime = 0;
+            if (theResult)
+                theResult = RunSelectRounds(theFDs, theAddrs, kNumIdle[x], kNumActive[y], theSendFD, &theSelectTime);
+            if (theResult)
+                theResult = RunEpollRounds(theQueue, theFDs, theAddrs, kNumIdle[x], kNumActive[y], theSendFD, &theEpollTime); // closes the sockets
+            else
+                CloseTestSockets(theFDs, theNumOpen);
+            
+            if (theResult)
+                qtss_printf("EventThread: %4lu idle %3lu active: select %6.1f usec/round, epoll %6.1f usec/round\n",
+                            kNumIdle[x], kNumActive[y], (Float32)theSelectTime / kTestNumRounds, (Float32)theEpollTime / kTestNumRounds);
+            
+            delete [] theFDs;
+            delete [] theAddrs;
+            if (!theResult)
+            {
+                ::close(theSendFD);
+                return false;
+            }
+        }
+    }
+    
+    ::close(theSendFD);
+    return true;
+}
+
+#endif
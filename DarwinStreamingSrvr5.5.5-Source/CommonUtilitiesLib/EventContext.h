@@ -42,6 +42,8 @@
 #include "OSRef.h"
 #include "ev.h"
 
+#define _EVENTCONTEXT_TESTING_ 0
+
 //enable to trace event context execution and the task associated with the context
 class EventThread;
 
@@ -117,6 +119,9 @@ class EventContext
         **************************************************************/
         int             GetSocketFD()       { return fFileDesc; }
         
+        // Which EventThread this context's events are dispatched from
+        EventThread*    GetEventThread()    { return fEventThread; }
+        
         enum
         {
             kInvalidFileDesc = -1   //int
@@ -156,6 +161,12 @@ class EventContext
 		********************************************/
         int             fFileDesc;
 
+        //
+        // Moves this context onto another EventThread. Only valid before
+        // the first RequestEvent, because that registers it with the thread.
+        void            SetEventThread(EventThread* inThread)
+            { Assert(!fWatchEventCalled); fEventThread = inThread; }
+
     private:
 
         struct eventreq fEventReq;
@@ -187,10 +198,27 @@ class EventThread : public OSThread
 {
     public:
     
-        EventThread() : OSThread() {}
+        //
+        // Pass in the event queue this thread should wait on. NULL is the
+        // process-wide queue set up by select_startevents.
+        EventThread(struct eventqueue* inQueue = NULL)
+            : OSThread(), fEventQueue(inQueue), fNumEventsDispatched(0) {}
         virtual ~EventThread() {}
+        
+        // Total number of events this thread has handed to an EventContext
+        UInt32          GetNumEventsDispatched()    { return fNumEventsDispatched; }
+
+#if _EVENTCONTEXT_TESTING_
+        //
+        // Times this platform's event queue against a select loop like the one
+        // in ev.cpp, with idle and active UDP sockets on the loopback. Starts the
+        // event queue itself, so call it from a test program, not a server.
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
     
     private:
+
         /******************************** 
         *     
         * ߳ں
@@ -205,7 +233,11 @@ class EventThread : public OSThread
         *********************************/
         OSRefTable      fRefTable;
         
+        struct eventqueue*  fEventQueue;
+        UInt32              fNumEventsDispatched;
+        
         friend class EventContext;
+
 };
 
 #endif //__EVENT_CONTEXT_H__
@@ -0,0 +1,382 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSAsyncFileReader.cpp
+
+    Contains:   Implements OSAsyncFileReader
+
+
+*/
+
+#include <string.h>
+#include <errno.h>
+
+#include "OSAsyncFileReader.h"
+#include "OSFileSource.h"
+#include "OSMemory.h"
+
+OSMutex*            OSAsyncFileReader::sMutex = NULL;
+OSCond*             OSAsyncFileReader::sQueueCond = NULL;
+OSCond*             OSAsyncFileReader::sReadDoneCond = NULL;
+OSQueue             OSAsyncFileReader::sReadQueue;
+OSFileReadThread**  OSAsyncFileReader::sThreads = NULL;
+UInt32              OSAsyncFileReader::sNumThreads = 0;
+UInt64              OSAsyncFileReader::sNumReadsDeferred = 0;
+
+#if _OSASYNCFILEREADER_TESTING_
+UInt32              OSAsyncFileReader::sReadDelayInMsec = 0;
+#endif
+
+void OSFileReadThread::Entry()
+{
+    while (true)
+    {
+        OSAsyncFileReader* theReader = NULL;
+        {
+            OSMutexLocker locker(OSAsyncFileReader::sMutex);
+
+            OSQueueElem* theElem = OSAsyncFileReader::sReadQueue.DeQueue();
+            while (theElem == NULL)
+            {
+                OSAsyncFileReader::sQueueCond->Wait(OSAsyncFileReader::sMutex);
+                theElem = OSAsyncFileReader::sReadQueue.DeQueue();
+            }
+
+            theReader = (OSAsyncFileReader*)theElem->GetEnclosingObject();
+            theReader->fIsReading = true;
+        }
+        theReader->DoRead();
+    }
+}
+
+void OSAsyncFileReader::Initialize(UInt32 inNumThreads)
+{
+    Assert(sThreads == NULL);
+    if (inNumThreads == 0)
+        return;
+
+    sMutex = NEW OSMutex();
+    sQueueCond = NEW OSCond();
+    sReadDoneCond = NEW OSCond();
+
+    sThreads = NEW OSFileReadThread*[inNumThreads];
+    for (UInt32 x = 0; x < inNumThreads; x++)
+    {
+        sThreads[x] = NEW OSFileReadThread();
+        sThreads[x]->Start();
+    }
+    sNumThreads = inNumThreads;
+}
+
+OSAsyncFileReader::OSAsyncFileReader(OSFileSource* inSource)
+:   fSource(inSource),
+    fReadChunk(NULL),
+    fIsReading(false),
+    fReadErr(OS_NoErr),
+    fTask(NULL),
+    fQueueElem(this)
+{
+    ::memset(fChunks, 0, sizeof(fChunks));
+}
+
+OSAsyncFileReader::~OSAsyncFileReader()
+{
+    {
+        OSMutexLocker locker(sMutex);
+
+        //Take our read off the queue if no thread has started it yet,
+        //otherwise wait for it, because that thread is using fSource.
+        if (fQueueElem.IsMember(sReadQueue))
+        {
+            sReadQueue.Remove(&fQueueElem);
+            fReadChunk = NULL;
+        }
+        while (fIsReading)
+            sReadDoneCond->Wait(sMutex);
+    }
+
+    delete [] fChunks[0].fData;
+    delete [] fChunks[1].fData;
+}
+
+OS_Error OSAsyncFileReader::Read(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen)
+{
+    Assert(outRcvLen != NULL);
+    *outRcvLen = 0;
+
+    OSMutexLocker locker(sMutex);
+
+    //The data may be split across the end of one chunk and the start of the other
+    char* theBuffer = (char*)inBuffer;
+    UInt32 theCopied = 0;
+    Chunk* theLastChunk = NULL;
+    Bool16 isAtEOF = false;
+    while ((theCopied < inLength) && !isAtEOF)
+    {
+        UInt64 thePosition = inPosition + theCopied;
+        Chunk* theChunk = NULL;
+        for (UInt32 x = 0; x < 2; x++)
+        {
+            Chunk* theCandidate = &fChunks[x];
+            if ((theCandidate == fReadChunk) || !theCandidate->fIsValid || (thePosition < theCandidate->fPosition))
+                continue;
+
+            //A short chunk ends at the end of the file, so it holds the empty range at its end
+            UInt64 theEnd = theCandidate->fPosition + theCandidate->fLength;
+            Bool16 isShort = theCandidate->fLength < theCandidate->fSize;
+            if ((thePosition < theEnd) || (isShort && (thePosition == theEnd)))
+            {
+                theChunk = theCandidate;
+                break;
+            }
+        }
+        if (theChunk == NULL)
+            break;
+
+        UInt64 theOffset = thePosition - theChunk->fPosition;
+        UInt32 theAmount = theChunk->fLength - (UInt32)theOffset;
+        if (theAmount > inLength - theCopied)
+            theAmount = inLength - theCopied;
+
+        ::memcpy(theBuffer + theCopied, theChunk->fData + theOffset, theAmount);
+        theCopied += theAmount;
+        theLastChunk = theChunk;
+        isAtEOF = (theChunk->fLength < theChunk->fSize) && (theOffset + theAmount == theChunk->fLength);
+    }
+
+    if ((theCopied == inLength) || isAtEOF)
+    {
+        *outRcvLen = theCopied;
+
+        //Once the caller is past the middle of a chunk, read the one after it
+        Chunk* theOtherChunk = (theLastChunk == &fChunks[0]) ? &fChunks[1] : &fChunks[0];
+        if ((theLastChunk != NULL) && !isAtEOF && (fReadChunk == NULL) && (fReadErr == OS_NoErr))
+        {
+            UInt64 theNextPosition = theLastChunk->fPosition + theLastChunk->fLength;
+            Bool16 haveNext = theOtherChunk->fIsValid && (theOtherChunk->fPosition == theNextPosition);
+            if (!haveNext && ((inPosition + inLength) > (theLastChunk->fPosition + (theLastChunk->fLength / 2))))
+                this->StartRead(theOtherChunk, theNextPosition, theLastChunk->fSize);
+        }
+        return OS_NoErr;
+    }
+
+    sNumReadsDeferred++;
+
+    //Wait for the read in progress. It is most likely the one we want.
+    if (fReadChunk != NULL)
+        return EAGAIN;
+
+    if (fReadErr != OS_NoErr)
+    {
+        OS_Error theErr = fReadErr;
+        fReadErr = OS_NoErr;
+        return theErr;
+    }
+
+    //Keep the chunk with the start of the data if there is one, and read the
+    //rest into the other. Otherwise replace the chunk further back in the file.
+    Chunk* theChunk = NULL;
+    if (theLastChunk != NULL)
+        theChunk = (theLastChunk == &fChunks[0]) ? &fChunks[1] : &fChunks[0];
+    else if (!fChunks[0].fIsValid || (fChunks[1].fIsValid && (fChunks[0].fPosition < fChunks[1].fPosition)))
+        theChunk = &fChunks[0];
+    else
+        theChunk = &fChunks[1];
+
+    UInt32 theLength = inLength - theCopied;
+    if (theLength < kChunkSize)
+        theLength = kChunkSize;
+    this->StartRead(theChunk, inPosition + theCopied, theLength);
+    return EAGAIN;
+}
+
+void OSAsyncFileReader::SetTask(Task* inTask)
+{
+    OSMutexLocker locker(sMutex);
+
+    //The read may have finished since the caller got EAGAIN
+    if (fReadChunk == NULL)
+        inTask->Signal(Task::kReadEvent);
+    else
+        fTask = inTask;
+}
+
+void OSAsyncFileReader::StartRead(Chunk* inChunk, UInt64 inPosition, UInt32 inLength)
+{
+    Assert(fReadChunk == NULL);
+
+    if (inLength > inChunk->fSize)
+    {
+        delete [] inChunk->fData;
+        inChunk->fData = NEW char[inLength];
+        inChunk->fSize = inLength;
+    }
+    inChunk->fPosition = inPosition;
+    inChunk->fLength = 0;
+    inChunk->fIsValid = false;
+
+    fReadChunk = inChunk;
+    sReadQueue.EnQueue(&fQueueElem);
+    sQueueCond->Signal();
+}
+
+void OSAsyncFileReader::DoRead()
+{
+    //Nothing else touches fReadChunk or fSource while fIsReading is set
+    Chunk* theChunk = fReadChunk;
+    Assert(theChunk != NULL);
+
+#if _OSASYNCFILEREADER_TESTING_
+    if (sReadDelayInMsec > 0)
+        OSThread::Sleep(sReadDelayInMsec);
+#endif
+
+    UInt32 theLength = 0;
+    OS_Error theErr = fSource->Read(theChunk->fPosition, theChunk->fData, theChunk->fSize, &theLength);
+
+    OSMutexLocker locker(sMutex);
+    theChunk->fLength = theLength;
+    theChunk->fIsValid = (theErr == OS_NoErr);
+    fReadErr = theErr;
+    fReadChunk = NULL;
+    fIsReading = false;
+
+    if (fTask != NULL)
+    {
+        fTask->Signal(Task::kReadEvent);
+        fTask = NULL;
+    }
+    sReadDoneCond->Broadcast();
+}
+
+#if _OSASYNCFILEREADER_TESTING_
+
+static Bool16 sTestIsDone = false;
+
+class TestPacerTask : public Task
+{
+    public:
+        enum { kInterval = 10 };
+
+        TestPacerTask() : Task(), fNextTime(OS::Milliseconds() + kInterval), fMaxLateness(0), fIsDone(false)
+            { this->SetTaskName("TestPacerTask"); this->Signal(Task::kStartEvent); }
+        virtual SInt64 Run()
+        {
+            if (this->GetEvents() & Task::kKillEvent)
+                return -1;
+            SInt64 theNow = OS::Milliseconds();
+            if (theNow - fNextTime > fMaxLateness)
+                fMaxLateness = theNow - fNextTime;
+            if (sTestIsDone)
+            {
+                fIsDone = true;
+                return 0;
+            }
+            fNextTime = theNow + kInterval;
+            return kInterval;
+        }
+
+        SInt64          fNextTime;
+        SInt64          fMaxLateness;
+        volatile Bool16 fIsDone;
+};
+
+class TestFileReaderTask : public Task
+{
+    public:
+        enum { kReadSize = 1400, kMaxReads = 200 };
+
+        TestFileReaderTask(char* inPath, Bool16 inAsync, UInt32 inDelayInMsec)
+            :   Task(), fSource(inPath), fReader(NULL), fDelayInMsec(inDelayInMsec), fPosition(0), fNumReads(0)
+            {   this->SetTaskName("TestFileReaderTask");
+                if (inAsync)
+                    fReader = NEW OSAsyncFileReader(&fSource);
+                this->Signal(Task::kStartEvent);
+            }
+        virtual ~TestFileReaderTask() { delete fReader; }
+        virtual SInt64 Run()
+        {
+            (void)this->GetEvents();
+            UInt32 theLen = 0;
+            OS_Error theErr = OS_NoErr;
+            if (fReader != NULL)
+                theErr = fReader->Read(fPosition, fBuffer, kReadSize, &theLen);
+            else
+            {
+                //Pay for a chunk read each time we cross into a new chunk, like the reader does
+                if ((fPosition >> OSAsyncFileReader::kChunkSizeExp) != ((fPosition + kReadSize) >> OSAsyncFileReader::kChunkSizeExp))
+                    OSThread::Sleep(fDelayInMsec);
+                theErr = fSource.Read(fPosition, fBuffer, kReadSize, &theLen);
+            }
+
+            if (theErr == EAGAIN)
+            {
+                fReader->SetTask(this);
+                return 0;
+            }
+            fPosition += theLen;
+            fNumReads++;
+            if ((theErr != OS_NoErr) || (theLen == 0) || (fNumReads == kMaxReads))
+            {
+                sTestIsDone = true;
+                return -1;
+            }
+            return 1;
+        }
+
+        OSFileSource        fSource;
+        OSAsyncFileReader*  fReader;
+        UInt32              fDelayInMsec;
+        UInt64              fPosition;
+        UInt32              fNumReads;
+        char                fBuffer[kReadSize];
+};
+
+static SInt64 RunPacer(char* inPath, Bool16 inAsync, UInt32 inDelayInMsec)
+{
+    sTestIsDone = false;
+    TestPacerTask* thePacer = NEW TestPacerTask();
+    (void)NEW TestFileReaderTask(inPath, inAsync, inDelayInMsec);
+    while (!thePacer->fIsDone)
+        OSThread::Sleep(10);
+
+    SInt64 theMaxLateness = thePacer->fMaxLateness;
+    thePacer->Signal(Task::kKillEvent);
+    return theMaxLateness;
+}
+
+void OSAsyncFileReader::Test(char* inPath, UInt32 inDelayInMsec)
+{
+    //Run this with a single TaskThread and OSAsyncFileReader::Initialize already called
+    sReadDelayInMsec = inDelayInMsec;
+    SInt64 theSyncLateness = RunPacer(inPath, false, inDelayInMsec);
+    SInt64 theAsyncLateness = RunPacer(inPath, true, inDelayInMsec);
+    sReadDelayInMsec = 0;
+
+    qtss_printf("OSAsyncFileReader::Test %lu msec per read: worst lateness of a 10 msec task %qd msec synchronous, %qd msec asynchronous (%qu reads deferred)\n",
+                inDelayInMsec, theSyncLateness, theAsyncLateness, sNumReadsDeferred);
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSAsyncFileReader.h
+
+    Contains:   Reads an OSFileSource on a pool of dedicated file reading threads, so
+                that a TaskThread never waits for the disk.
+
+                Read() either copies the data out of a chunk that has already been
+                read, or queues a read of the chunk at that position and returns EAGAIN.
+                The task passed to SetTask is signalled with a kReadEvent when that read
+                finishes, and should then call Read() again. Sequential readers also get
+                the following chunk read ahead of time, so they rarely see EAGAIN at all.
+
+                Only one read per reader is outstanding at a time.
+*/
+
+#ifndef _OSASYNCFILEREADER_H_
+#define _OSASYNCFILEREADER_H_
+
+#define _OSASYNCFILEREADER_TESTING_ 0
+
+#include "OSHeaders.h"
+#include "OSThread.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+#include "OSCond.h"
+#include "Task.h"
+
+class OSFileSource;
+
+//merely a private implementation detail of OSAsyncFileReader
+class OSFileReadThread : private OSThread
+{
+    private:
+
+        OSFileReadThread() : OSThread() {}
+        virtual ~OSFileReadThread() {}
+
+        virtual void Entry();
+
+        friend class OSAsyncFileReader;
+};
+
+class OSAsyncFileReader
+{
+    public:
+
+        enum
+        {
+            kChunkSizeExp   = 16,                   // base 2 exponent
+            kChunkSize      = 1 << kChunkSizeExp    // 64Kbytes
+        };
+
+        //Starts inNumThreads file reading threads. Call once at startup; until
+        //then (or if inNumThreads is 0) IsEnabled returns false.
+        static void     Initialize(UInt32 inNumThreads);
+        static Bool16   IsEnabled()     { return sNumThreads > 0; }
+
+        //The reader doesn't own inSource, but must be deleted before it is.
+        //Deleting the reader waits for a read in progress to finish.
+        OSAsyncFileReader(OSFileSource* inSource);
+        ~OSAsyncFileReader();
+
+        //Returns OS_NoErr and the data if it has already been read, EAGAIN if
+        //not (the read is queued), or the error a failed read got.
+        OS_Error        Read(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen);
+
+        //Signals inTask with a kReadEvent when the outstanding read finishes,
+        //or right away if there isn't one.
+        void            SetTask(Task* inTask);
+
+        //Total number of Read calls that returned EAGAIN
+        static UInt64   GetNumReadsDeferred()   { return sNumReadsDeferred; }
+
+#if _OSASYNCFILEREADER_TESTING_
+        //Runs a task that wants to run every 10 msec on a single TaskThread alongside
+        //a task that reads inPath through a file that takes inDelayInMsec per read,
+        //first synchronously and then through a reader, and prints how late the first
+        //task got to run in each case.
+        static void     Test(char* inPath, UInt32 inDelayInMsec);
+#endif
+
+    private:
+
+        struct Chunk
+        {
+            char*   fData;
+            UInt32  fSize;      // allocated size of fData
+            UInt64  fPosition;
+            UInt32  fLength;    // short if the chunk hit the end of the file
+            Bool16  fIsValid;
+        };
+
+        void            StartRead(Chunk* inChunk, UInt64 inPosition, UInt32 inLength);
+        void            DoRead();   // called by an OSFileReadThread, without sMutex held
+
+        OSFileSource*   fSource;
+        Chunk           fChunks[2];
+
+        Chunk*          fReadChunk;     // chunk being read, or NULL
+        Bool16          fIsReading;     // true once a thread has taken the read off the queue
+        OS_Error        fReadErr;       // error from the last read, returned by the next Read
+        Task*           fTask;
+
+        OSQueueElem     fQueueElem;
+
+        //All readers share one lock. It is only held long enough to hand out reads
+        //and copy data, never for the read itself. These are created by Initialize
+        //and never destroyed, because the threads waiting on them never exit.
+        static OSMutex*             sMutex;
+        static OSCond*              sQueueCond;     // signalled when a read is queued
+        static OSCond*              sReadDoneCond;  // broadcast when a read finishes
+        static OSQueue              sReadQueue;
+        static OSFileReadThread**   sThreads;
+        static UInt32               sNumThreads;
+
+        static UInt64               sNumReadsDeferred;
+
+#if _OSASYNCFILEREADER_TESTING_
+        static UInt32               sReadDelayInMsec;
+#endif
+
+        friend class OSFileReadThread;
+};
+
+#endif //_OSASYNCFILEREADER_H_
@@ -0,0 +1,253 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSFileBlockCache.cpp
+
+    Contains:   Implements OSFileBlockCache
+
+
+*/
+
+#include <string.h>
+
+#include "OSFileBlockCache.h"
+#include "OSMemory.h"
+
+#if _OSFILEBLOCKCACHE_TESTING_
+#include "OSFileSource.h"
+#include "OS.h"
+#endif
+
+OSFileBlockCache*   OSFileBlockCache::sCache = NULL;
+
+static UInt32 HashTableSize(UInt64 inMaxBytes)
+{
+    // About one bucket per block, rounded up to a power of 2 so OSHashTable can mask
+    UInt64 theNumBlocks = inMaxBytes >> OSFileBlockCache::kBlockSizeExp;
+    UInt32 theSize = 64;
+    while ((theSize < theNumBlocks) && (theSize < 0x100000))
+        theSize <<= 1;
+    return theSize;
+}
+
+void OSFileBlockCache::Initialize(UInt64 inMaxBytes)
+{
+    Assert(sCache == NULL);
+    if (inMaxBytes < kBlockSize)
+        return;
+
+    sCache = NEW OSFileBlockCache(inMaxBytes);
+}
+
+OSFileBlockCache::OSFileBlockCache(UInt64 inMaxBytes)
+:   fMaxBytes(inMaxBytes),
+    fBytesResident(0),
+    fTable(HashTableSize(inMaxBytes)),
+    fNumHits(0),
+    fNumMisses(0),
+    fNumEvictions(0)
+{
+}
+
+OSFileBlockCache::~OSFileBlockCache()
+{
+    //There must be no pinned blocks left
+    OSQueueElem* theElem = fLRUQueue.DeQueue();
+    while (theElem != NULL)
+    {
+        OSFileBlock* theBlock = (OSFileBlock*)theElem->GetEnclosingObject();
+        fTable.Remove(theBlock);
+        delete theBlock;
+        theElem = fLRUQueue.DeQueue();
+    }
+    Assert(fTable.GetNumEntries() == 0);
+}
+
+OSFileBlock* OSFileBlockCache::GetBlock(const OSFileBlock::FileID& inFileID, UInt64 inBlockIndex, Bool16* outMustFill)
+{
+    Assert(outMustFill != NULL);
+    *outMustFill = false;
+
+    OSMutexLocker locker(&fMutex);
+
+    OSFileBlockKey theKey(inFileID, inBlockIndex);
+    OSFileBlock* theBlock = fTable.Map(&theKey);
+    if (theBlock != NULL)
+    {
+        if (theBlock->fRefCount == 0)
+            fLRUQueue.Remove(&theBlock->fLRUElem);
+        theBlock->fRefCount++;
+
+        //Someone else is reading this block from the file, wait for them instead of
+        //reading it again.
+        while (!theBlock->fIsFilled)
+            fFillCond.Wait(&fMutex);
+
+        if (!theBlock->fIsInTable)
+        {
+            //Their read failed. Let the caller go to the file itself.
+            this->Release(theBlock);
+            return NULL;
+        }
+
+        fNumHits++;
+        return theBlock;
+    }
+
+    fNumMisses++;
+
+    if (fBytesResident + kBlockSize > fMaxBytes)
+    {
+        //Reuse the least recently used block. If they are all pinned, don't cache this one.
+        OSQueueElem* theElem = fLRUQueue.DeQueue();
+        if (theElem == NULL)
+            return NULL;
+
+        theBlock = (OSFileBlock*)theElem->GetEnclosingObject();
+        Assert(theBlock->fRefCount == 0);
+        fTable.Remove(theBlock);
+        fNumEvictions++;
+    }
+    else
+    {
+        theBlock = NEW OSFileBlock();
+        theBlock->fData = NEW char[kBlockSize];
+        fBytesResident += kBlockSize;
+    }
+
+    theBlock->fFileID = inFileID;
+    theBlock->fBlockIndex = inBlockIndex;
+    theBlock->fLength = 0;
+    theBlock->fRefCount = 1;
+    theBlock->fIsFilled = false;
+    theBlock->fIsInTable = true;
+    fTable.Add(theBlock);
+
+    *outMustFill = true;
+    return theBlock;
+}
+
+void OSFileBlockCache::FillDone(OSFileBlock* inBlock, UInt32 inFillLen, Bool16 inSuccess)
+{
+    OSMutexLocker locker(&fMutex);
+    Assert(!inBlock->fIsFilled);
+
+    inBlock->fLength = inFillLen;
+    inBlock->fIsFilled = true;
+    if (!inSuccess)
+    {
+        //Don't leave a bad block around. It is freed when the last reader releases it.
+        fTable.Remove(inBlock);
+        inBlock->fIsInTable = false;
+    }
+
+    fFillCond.Broadcast();
+}
+
+void OSFileBlockCache::Release(OSFileBlock* inBlock)
+{
+    OSMutexLocker locker(&fMutex);
+    Assert(inBlock->fRefCount > 0);
+
+    inBlock->fRefCount--;
+    if (inBlock->fRefCount > 0)
+        return;
+
+    if (inBlock->fIsInTable)
+        fLRUQueue.EnQueue(&inBlock->fLRUElem); // most recently used
+    else
+    {
+        fBytesResident -= kBlockSize;
+        delete inBlock;
+    }
+}
+
+#if _OSFILEBLOCKCACHE_TESTING_
+
+static SInt64 PlayFile(char* inPath, UInt32 inNumSessions, UInt32* outChecksum)
+{
+    enum { kReadSize = 1400 };  // about one RTP packet per read, like the file module
+    char theBuffer[kReadSize];
+
+    OSFileSource** theSessions = NEW OSFileSource*[inNumSessions];
+    for (UInt32 x = 0; x < inNumSessions; x++)
+        theSessions[x] = NEW OSFileSource(inPath);
+
+    SInt64 theStartTime = OS::Milliseconds();
+    UInt64 thePosition = 0;
+    UInt32 theChecksum = 0;
+    Bool16 isDone = false;
+
+    //Every session moves through the file together, as if they had all started
+    //playing the same movie at about the same time.
+    while (!isDone)
+    {
+        for (UInt32 y = 0; y < inNumSessions; y++)
+        {
+            UInt32 theLen = 0;
+            (void)theSessions[y]->Read(thePosition, theBuffer, kReadSize, &theLen);
+            if (theLen == 0)
+            {
+                isDone = true;
+                continue;
+            }
+            for (UInt32 z = 0; z < theLen; z++)
+                theChecksum = (theChecksum * 31) + (UInt8)theBuffer[z];
+        }
+        thePosition += kReadSize;
+    }
+
+    SInt64 theDuration = OS::Milliseconds() - theStartTime;
+
+    for (UInt32 x = 0; x < inNumSessions; x++)
+        delete theSessions[x];
+    delete [] theSessions;
+
+    *outChecksum = theChecksum;
+    return theDuration;
+}
+
+Bool16 OSFileBlockCache::Test(char* inPath, UInt32 inNumSessions)
+{
+    OSFileBlockCache* theCache = sCache;
+
+    UInt32 theUncachedChecksum = 0;
+    sCache = NULL;
+    SInt64 theUncachedTime = PlayFile(inPath, inNumSessions, &theUncachedChecksum);
+
+    UInt32 theCachedChecksum = 0;
+    sCache = NEW OSFileBlockCache(64 * 1024 * 1024);
+    SInt64 theCachedTime = PlayFile(inPath, inNumSessions, &theCachedChecksum);
+
+    qtss_printf("OSFileBlockCache::Test %lu sessions: uncached %qd ms, cached %qd ms\n", inNumSessions, theUncachedTime, theCachedTime);
+    qtss_printf("OSFileBlockCache::Test hits %qu misses %qu evictions %qu bytes resident %qu\n",
+                sCache->fNumHits, sCache->fNumMisses, sCache->fNumEvictions, sCache->fBytesResident);
+
+    delete sCache;
+    sCache = theCache;
+    return theUncachedChecksum == theCachedChecksum;
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSFileBlockCache.h
+
+    Contains:   A process-wide cache of file blocks, shared by every OSFileSource that
+                has the same file open. Blocks are keyed by the file's device, inode,
+                mod date and length, so a file that is replaced on disk gets new blocks.
+
+                A block is pinned (refcounted) while someone copies out of it or fills
+                it. Unpinned blocks are kept in least recently used order, and the oldest
+                one is reused when the cache is at its size limit.
+
+
+*/
+
+#ifndef _OSFILEBLOCKCACHE_H_
+#define _OSFILEBLOCKCACHE_H_
+
+#define _OSFILEBLOCKCACHE_TESTING_ 0
+
+#include "OSHeaders.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+#include "OSCond.h"
+#include "OSHashTable.h"
+
+class OSFileBlockKey;
+
+class OSFileBlock
+{
+    public:
+
+        struct FileID
+        {
+            UInt64  fDevice;
+            UInt64  fInode;
+            SInt64  fModDate;
+            UInt64  fLength;
+        };
+
+        char*   GetData()       { return fData; }
+        UInt32  GetLength()     { return fLength; }
+
+    private:
+
+        OSFileBlock() : fBlockIndex(0), fData(NULL), fLength(0), fRefCount(0),
+                        fIsFilled(false), fIsInTable(false), fLRUElem(this), fNextHashEntry(NULL)
+                        { ::memset(&fFileID, 0, sizeof(fFileID)); }
+        ~OSFileBlock()  { delete [] fData; }
+
+        FileID          fFileID;
+        UInt64          fBlockIndex;
+
+        char*           fData;
+        UInt32          fLength;        // may be short for the last block of a file
+        UInt32          fRefCount;
+        Bool16          fIsFilled;
+        Bool16          fIsInTable;
+
+        OSQueueElem     fLRUElem;       // on the cache's LRU queue while fRefCount is 0
+        OSFileBlock*    fNextHashEntry;
+
+        friend class OSFileBlockCache;
+        friend class OSFileBlockKey;
+        friend class OSHashTable<OSFileBlock, OSFileBlockKey>;
+};
+
+class OSFileBlockKey
+{
+    public:
+
+        OSFileBlockKey(const OSFileBlock::FileID& inFileID, UInt64 inBlockIndex)
+            : fFileID(inFileID), fBlockIndex(inBlockIndex) {}
+        OSFileBlockKey(OSFileBlock* inBlock)
+            : fFileID(inBlock->fFileID), fBlockIndex(inBlock->fBlockIndex) {}
+
+        UInt32  GetHashKey()
+            { return (UInt32)(fFileID.fInode * 2654435761U) ^ (UInt32)fFileID.fDevice ^ (UInt32)(fBlockIndex * 40503U); }
+
+        friend int operator ==(const OSFileBlockKey& key1, const OSFileBlockKey& key2)
+        {
+            return  (key1.fBlockIndex == key2.fBlockIndex) &&
+                    (key1.fFileID.fInode == key2.fFileID.fInode) &&
+                    (key1.fFileID.fDevice == key2.fFileID.fDevice) &&
+                    (key1.fFileID.fModDate == key2.fFileID.fModDate) &&
+                    (key1.fFileID.fLength == key2.fFileID.fLength);
+        }
+
+    private:
+
+        OSFileBlock::FileID fFileID;
+        UInt64              fBlockIndex;
+};
+
+class OSFileBlockCache
+{
+    public:
+
+        enum
+        {
+            kBlockSizeExp   = 15,                   // base 2 exponent
+            kBlockSize      = 1 << kBlockSizeExp    // 32Kbytes
+        };
+
+        //Call once at startup, before any file is read. The cache stays disabled
+        //if inMaxBytes is less than one block.
+        static void                 Initialize(UInt64 inMaxBytes);
+        static OSFileBlockCache*    GetCache()  { return sCache; }
+
+        //Returns the block pinned, or NULL if every block is pinned and the cache
+        //is full, in which case the caller should read the file directly.
+        //If *outMustFill is true, the caller must read kBlockSize bytes from the
+        //block's offset into GetData() and then call FillDone. Otherwise the block
+        //has already been filled, possibly after waiting for another reader to do it.
+        OSFileBlock*    GetBlock(const OSFileBlock::FileID& inFileID, UInt64 inBlockIndex, Bool16* outMustFill);
+        void            FillDone(OSFileBlock* inBlock, UInt32 inFillLen, Bool16 inSuccess);
+        void            Release(OSFileBlock* inBlock);
+
+        //Statistics. These are all 0 if the cache isn't enabled.
+        static UInt64   GetNumHits()        { return (sCache != NULL) ? sCache->fNumHits : 0; }
+        static UInt64   GetNumMisses()      { return (sCache != NULL) ? sCache->fNumMisses : 0; }
+        static UInt64   GetNumEvictions()   { return (sCache != NULL) ? sCache->fNumEvictions : 0; }
+        static UInt64   GetBytesResident()  { return (sCache != NULL) ? sCache->fBytesResident : 0; }
+
+#if _OSFILEBLOCKCACHE_TESTING_
+        //Plays inPath to inNumSessions simulated sessions that each read the whole file
+        //sequentially in small chunks, once with the cache and once without, and prints
+        //how long each takes. Returns true if every session read the same data.
+        static Bool16   Test(char* inPath, UInt32 inNumSessions);
+#endif
+
+    private:
+
+        OSFileBlockCache(UInt64 inMaxBytes);
+        ~OSFileBlockCache();
+
+        UInt64          fMaxBytes;
+        UInt64          fBytesResident;
+
+        OSMutex         fMutex;
+        OSCond          fFillCond;  // signalled whenever a block is filled
+        OSQueue         fLRUQueue;  // head is the least recently used unpinned block
+        OSHashTable<OSFileBlock, OSFileBlockKey>    fTable;
+
+        UInt64          fNumHits;
+        UInt64          fNumMisses;
+        UInt64          fNumEvictions;
+
+        static OSFileBlockCache*    sCache;
+};
+
+#endif //_OSFILEBLOCKCACHE_H_
@@ -365,6 +365,13 @@ void OSFileSource::Set(const char *inPath)
             fModDate = buf.st_mtime;
             if (fModDate < 0)
                 fModDate = 0;
+#ifndef __Win32__
+            fFileID.fDevice = buf.st_dev;
+            fFileID.fInode = buf.st_ino;
+            fFileID.fModDate = fModDate;
+            fFileID.fLength = fLength;
+            fHasFileID = true;
+#endif
             /* ȡļǷļ */
 #ifdef __Win32__
             fIsDir = buf.st_mode & _S_IFDIR;
@@ -407,6 +414,8 @@ static SInt32 sBuffCount = 1;
 
 OS_Error    OSFileSource::Read(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen)
 { 
+    if (fHasFileID && (OSFileBlockCache::GetCache() != NULL))
+        return this->ReadFromBlockCache(inPosition, inBuffer, inLength, outRcvLen);
         
     if  (   ( !fFileMap.Initialized() )
             || ( !fCacheEnabled )
@@ -588,6 +597,69 @@ OS_Error    OSFileSource::ReadFromCache(UInt64 inPosition, void* inBuffer, UInt3
     return OS_NoErr;
 }
 
+OS_Error    OSFileSource::ReadFromBlockCache(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen)
+{
+    OSMutexLocker locker(&fMutex);
+    
+    OSFileBlockCache* theCache = OSFileBlockCache::GetCache();
+    Assert(theCache != NULL);
+    
+    char* buffOut = (char*)inBuffer;
+    UInt32 theRcvLen = 0;
+    OS_Error theErr = OS_NoErr;
+    
+    while ((theRcvLen < inLength) && (inPosition + theRcvLen < fLength))
+    {
+        UInt64 thePosition = inPosition + theRcvLen;
+        UInt64 theBlockIndex = thePosition >> OSFileBlockCache::kBlockSizeExp;
+        UInt32 theBlockOffset = (UInt32)(thePosition & (OSFileBlockCache::kBlockSize - 1));
+        
+        Bool16 mustFill = false;
+        OSFileBlock* theBlock = theCache->GetBlock(fFileID, theBlockIndex, &mustFill);
+        if (theBlock == NULL)
+        {
+            // no room in the cache right now, read the rest from the file
+            UInt32 theDiskLen = 0;
+            theErr = this->ReadFromPos(thePosition, &buffOut[theRcvLen], inLength - theRcvLen, &theDiskLen);
+            theRcvLen += theDiskLen;
+            break;
+        }
+        
+        if (mustFill)
+        {
+            UInt32 theFillLen = 0;
+            theErr = this->ReadFromPos(theBlockIndex << OSFileBlockCache::kBlockSizeExp, theBlock->GetData(), OSFileBlockCache::kBlockSize, &theFillLen);
+            theCache->FillDone(theBlock, theFillLen, theErr == OS_NoErr);
+            if (theErr != OS_NoErr)
+            {
+                theCache->Release(theBlock);
+                break;
+            }
+        }
+        
+        if (theBlockOffset >= theBlock->GetLength()) // the file is shorter than it was
+        {
+            theCache->Release(theBlock);
+            break;
+        }
+        
+        UInt32 theCopyLen = theBlock->GetLength() - theBlockOffset;
+        if (theCopyLen > inLength - theRcvLen)
+            theCopyLen = inLength - theRcvLen;
+            
+        ::memcpy(&buffOut[theRcvLen], theBlock->GetData() + theBlockOffset, theCopyLen);
+        theCache->Release(theBlock);
+        theRcvLen += theCopyLen;
+    }
+    
+    if (outRcvLen != NULL)
+        *outRcvLen = theRcvLen;
+        
+    fPosition = inPosition + theRcvLen;
+    fReadPos = fPosition;
+    return theErr;
+}
+
 OS_Error    OSFileSource::ReadFromDisk(void* inBuffer, UInt32 inLength, UInt32* outRcvLen)
 {
     #if FILE_SOURCE_BUFFTEST
@@ -685,6 +757,7 @@ void    OSFileSource::Close()
     
     fFile = -1;
     fModDate = 0;
+    fHasFileID = false;
     fLength = 0;
     fPosition = 0;
     fReadPos = 0;
@@ -40,6 +40,7 @@
 #include "OSHeaders.h"
 #include "StrPtrLen.h"
 #include "OSQueue.h"
+#include "OSFileBlockCache.h"
 
 #define READ_LOG 0
 
@@ -146,7 +147,7 @@ class OSFileSource
 {
     public:
     
-        OSFileSource() :    fFile(-1), fLength(0), fPosition(0), fReadPos(0), fShouldClose(true), fIsDir(false), fCacheEnabled(false)                       
+        OSFileSource() :    fFile(-1), fLength(0), fPosition(0), fReadPos(0), fShouldClose(true), fIsDir(false), fHasFileID(false), fCacheEnabled(false)                       
         {
         
         #if READ_LOG 
@@ -157,7 +158,7 @@ class OSFileSource
         
         }
                 
-        OSFileSource(const char *inPath) :  fFile(-1), fLength(0), fPosition(0), fReadPos(0), fShouldClose(true), fIsDir(false),fCacheEnabled(false)
+        OSFileSource(const char *inPath) :  fFile(-1), fLength(0), fPosition(0), fReadPos(0), fShouldClose(true), fIsDir(false), fHasFileID(false), fCacheEnabled(false)
         {
          Set(inPath); 
          
@@ -197,6 +198,11 @@ class OSFileSource
 
 		/* ָλöȡ */
 		OS_Error    ReadFromPos(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen = NULL);
+
+		//Reads through the server-wide OSFileBlockCache. Read uses this ahead of the
+		//per-file cache whenever the block cache is enabled.
+		OS_Error    ReadFromBlockCache(UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32* outRcvLen = NULL);
+
 		/* ӻȡݹ */
 		void        EnableFileCache(Bool16 enabled) {OSMutexLocker locker(&fMutex); fCacheEnabled = enabled; }
 		/* ȡʹ */
@@ -248,6 +254,9 @@ class OSFileSource
         Bool16  fIsDir;
         time_t  fModDate;
         
+        //Identifies the file in the OSFileBlockCache
+        OSFileBlock::FileID fFileID;
+        Bool16              fHasFileID;
         
         OSMutex fMutex;
         FileMap fFileMap;
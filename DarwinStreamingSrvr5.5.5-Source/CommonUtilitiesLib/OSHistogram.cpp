@@ -0,0 +1,237 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSHistogram.cpp
+
+    Contains:   Log-linear histograms, and per-thread sets of them.
+
+
+*/
+
+#include <string.h>
+
+#include "OSHistogram.h"
+#include "OSThread.h"
+#include "OSMemory.h"
+#include "SafeStdLib.h"
+#include "MyAssert.h"
+
+#if _OSHISTOGRAM_TESTING_
+#include "OS.h"
+#endif
+
+UInt32 OSHistogram::GetBucket(UInt32 inValue)
+{
+    if (inValue < kSubBucketCount)
+        return inValue;
+
+    //
+    // theGroup is how many powers of two inValue is above the exact buckets.
+    // Within a group, the kSubBucketBits below the top bit pick the bucket.
+    UInt32 theGroup = 0;
+    for (UInt32 theValue = inValue >> kSubBucketBits; theValue != 0; theValue >>= 1)
+        theGroup++;
+
+    return (theGroup * kSubBucketCount) + ((inValue >> (theGroup - 1)) - kSubBucketCount);
+}
+
+UInt32 OSHistogram::GetBucketTopValue(UInt32 inBucket)
+{
+    if (inBucket < kSubBucketCount)
+        return inBucket;
+
+    UInt32 theGroup = inBucket / kSubBucketCount;
+    UInt32 theBottom = (kSubBucketCount + (inBucket % kSubBucketCount)) << (theGroup - 1);
+    return theBottom + (1 << (theGroup - 1)) - 1;
+}
+
+void OSHistogram::Reset()
+{
+    ::memset(fCounts, 0, sizeof(fCounts));
+    fMaxValue = 0;
+}
+
+void OSHistogram::Add(OSHistogram* inHistogram)
+{
+    for (UInt32 x = 0; x < kNumBuckets; x++)
+        fCounts[x] += inHistogram->fCounts[x];
+    if (inHistogram->fMaxValue > fMaxValue)
+        fMaxValue = inHistogram->fMaxValue;
+}
+
+UInt32 OSHistogram::GetTotalCount()
+{
+    UInt32 theTotal = 0;
+    for (UInt32 x = 0; x < kNumBuckets; x++)
+        theTotal += fCounts[x];
+    return theTotal;
+}
+
+UInt32 OSHistogram::GetValueAtPerMille(UInt32 inPerMille)
+{
+    UInt64 theTotal = this->GetTotalCount();
+    if (theTotal == 0)
+        return 0;
+    if (inPerMille > 1000)
+        inPerMille = 1000;
+
+    // The sample we want, counting from 1
+    UInt64 theRank = ((theTotal * inPerMille) + 999) / 1000;
+    if (theRank == 0)
+        theRank = 1;
+
+    UInt64 theCount = 0;
+    for (UInt32 x = 0; x < kNumBuckets; x++)
+    {
+        theCount += fCounts[x];
+        if (theCount >= theRank)
+        {
+            UInt32 theValue = GetBucketTopValue(x);
+            return (theValue < fMaxValue) ? theValue : fMaxValue;
+        }
+    }
+    return fMaxValue;
+}
+
+UInt32 OSHistogram::GetSummary(char* outBuffer)
+{
+    qtss_sprintf(outBuffer, "count=%lu p50=%lu p90=%lu p99=%lu p99.9=%lu max=%lu",
+                    this->GetTotalCount(), this->GetValueAtPerMille(500), this->GetValueAtPerMille(900),
+                    this->GetValueAtPerMille(990), this->GetValueAtPerMille(999), fMaxValue);
+    return ::strlen(outBuffer);
+}
+
+OSShardedHistogram::OSShardedHistogram()
+{
+    ::memset(fShards, 0, sizeof(fShards));
+}
+
+OSHistogram* OSShardedHistogram::GetShard()
+{
+    OSThread* theThread = OSThread::GetCurrent();
+    if (theThread == NULL)
+        return NULL;
+
+    UInt32 theIndex = theThread->GetThreadIndex();
+    if (theIndex >= kMaxThreads)
+        return NULL;
+
+    //
+    // Only this thread ever sets its own entry, so there's no race here.
+    if (fShards[theIndex] == NULL)
+        fShards[theIndex] = NEW OSHistogram;
+    return fShards[theIndex];
+}
+
+void OSShardedHistogram::Record(UInt32 inValue)
+{
+    OSHistogram* theShard = this->GetShard();
+    if (theShard != NULL)
+    {
+        theShard->Record(inValue);
+        return;
+    }
+
+    OSMutexLocker locker(&fSharedShardMutex);
+    fSharedShard.Record(inValue);
+}
+
+void OSShardedHistogram::GetHistogram(OSHistogram* outHistogram)
+{
+    outHistogram->Reset();
+    outHistogram->Add(&fSharedShard);
+    for (UInt32 x = 0; x < kMaxThreads; x++)
+    {
+        OSHistogram* theShard = fShards[x];
+        if (theShard != NULL)
+            outHistogram->Add(theShard);
+    }
+}
+
+#if _OSHISTOGRAM_TESTING_
+
+Bool16 OSHistogram::Test()
+{
+    //
+    // Every value maps to a bucket whose range holds it, and the buckets
+    // are in order with no gaps
+    UInt32 theLastBucket = 0;
+    for (UInt32 theValue = 0; theValue <= kMaxValue; theValue++)
+    {
+        UInt32 theBucket = GetBucket(theValue);
+        if ((theBucket >= kNumBuckets) || (theBucket < theLastBucket) || (theBucket > theLastBucket + 1))
+            return false;
+        if (GetBucketTopValue(theBucket) < theValue)
+            return false;
+        if ((theBucket > 0) && (GetBucketTopValue(theBucket - 1) >= theValue))
+            return false;
+        // No more than 1/16th too high
+        if ((GetBucketTopValue(theBucket) - theValue) * kSubBucketCount > theValue)
+            return false;
+        theLastBucket = theBucket;
+    }
+    if (theLastBucket != kNumBuckets - 1)
+        return false;
+
+    OSHistogram theHistogram;
+    if ((theHistogram.GetValueAtPerMille(990) != 0) || (theHistogram.GetTotalCount() != 0))
+        return false;
+
+    // 1..1000, plus one outlier past the end of the range
+    for (UInt32 x = 1; x <= 1000; x++)
+        theHistogram.Record(x);
+    theHistogram.Record(100000);
+    if ((theHistogram.GetTotalCount() != 1001) || (theHistogram.GetMaxValue() != kMaxValue))
+        return false;
+
+    UInt32 theMedian = theHistogram.GetValueAtPerMille(500);
+    if ((theMedian < 501) || (theMedian > 501 + (501 / kSubBucketCount)))
+        return false;
+    UInt32 theP99 = theHistogram.GetValueAtPerMille(990);
+    if ((theP99 < 991) || (theP99 > 991 + (991 / kSubBucketCount)))
+        return false;
+    if (theHistogram.GetValueAtPerMille(1000) != kMaxValue)
+        return false;
+
+    OSHistogram theSum;
+    theSum.Add(&theHistogram);
+    theSum.Add(&theHistogram);
+    if ((theSum.GetTotalCount() != 2002) || (theSum.GetValueAtPerMille(500) != theMedian))
+        return false;
+
+    char theSummary[kSummaryBufferSize];
+    theSum.GetSummary(theSummary);
+    qtss_printf("OSHistogram: %s\n", theSummary);
+
+    // What a sample costs
+    SInt64 theStartTime = OS::Microseconds();
+    for (UInt32 y = 0; y < 10000000; y++)
+        theHistogram.Record(y & 0xFFF);
+    qtss_printf("OSHistogram: 10M samples in %"_64BITARG_"d usec\n", OS::Microseconds() - theStartTime);
+
+    return true;
+}
+
+#endif
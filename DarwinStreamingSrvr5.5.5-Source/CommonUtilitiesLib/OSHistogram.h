@@ -0,0 +1,145 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSHistogram.h
+
+    Contains:   Fixed size histograms of small unsigned values (milliseconds,
+                percentages), with log-linear buckets in the style of
+                HdrHistogram: values below 16 get a bucket each, and every
+                power of two above that is split into 16 buckets, so a
+                percentile is never off by more than 1/16th. Recording a
+                value is a few instructions and never allocates.
+
+                OSHistogram has one writer at a time. OSShardedHistogram gives
+                each OSThread a histogram of its own, so any number of threads
+                can record without locking; reading it adds them all up.
+
+*/
+
+#ifndef __OS_HISTOGRAM_H__
+#define __OS_HISTOGRAM_H__
+
+#define _OSHISTOGRAM_TESTING_ 0
+
+#include "OSHeaders.h"
+#include "OSMutex.h"
+
+class OSHistogram
+{
+    public:
+
+        enum
+        {
+            kSubBucketBits      = 4,
+            kSubBucketCount     = 1 << kSubBucketBits,
+            kMaxValueBits       = 16,
+            kMaxValue           = (1 << kMaxValueBits) - 1,    // bigger values are counted as this
+            kNumBuckets         = kSubBucketCount * (kMaxValueBits - kSubBucketBits + 1),
+
+            kSummaryBufferSize  = 96    // big enough for GetSummary
+        };
+
+        OSHistogram() { this->Reset(); }
+        ~OSHistogram() {}
+
+        //
+        // Not thread-safe. Others may read while it is written; they may
+        // just not see the latest values.
+        void    Record(UInt32 inValue)
+                    {
+                        if (inValue > kMaxValue)
+                            inValue = kMaxValue;
+                        fCounts[GetBucket(inValue)]++;
+                        if (inValue > fMaxValue)
+                            fMaxValue = inValue;
+                    }
+        void    Add(OSHistogram* inHistogram);
+        void    Reset();
+
+        //
+        // ACCESSORS
+        UInt32  GetTotalCount();
+        UInt32  GetMaxValue()   { return fMaxValue; }
+
+        //
+        // The largest value that could be in the bucket holding the sample
+        // inPerMille / 1000 of the way up, but no more than the largest
+        // value recorded. 0 if nothing has been recorded.
+        UInt32  GetValueAtPerMille(UInt32 inPerMille);
+
+        //
+        // Writes "count=n p50=v p90=v p99=v p99.9=v max=v" into outBuffer,
+        // which must be kSummaryBufferSize long. Returns the length.
+        UInt32  GetSummary(char* outBuffer);
+
+        static UInt32   GetBucket(UInt32 inValue);
+        static UInt32   GetBucketTopValue(UInt32 inBucket);
+
+#if _OSHISTOGRAM_TESTING_
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
+
+    private:
+
+        UInt32  fCounts[kNumBuckets];
+        UInt32  fMaxValue;
+};
+
+class OSShardedHistogram
+{
+    public:
+
+        enum
+        {
+            kMaxThreads = 256   // threads with a higher OSThread index share a locked histogram
+        };
+
+        OSShardedHistogram();
+
+        //
+        // This object currently *does not* clean up for itself when
+        // you destruct it!
+        ~OSShardedHistogram() {}
+
+        //
+        // Thread-safe. Records into the calling thread's own histogram.
+        void    Record(UInt32 inValue);
+
+        //
+        // Adds up every thread's histogram into outHistogram. The threads keep
+        // recording while this runs, so the newest samples may be missing.
+        void    GetHistogram(OSHistogram* outHistogram);
+
+    private:
+
+        OSHistogram*    GetShard();
+
+        OSHistogram*    fShards[kMaxThreads];   // each is only written by its own thread
+        OSHistogram     fSharedShard;           // for threads that aren't OSThreads
+        OSMutex         fSharedShardMutex;
+};
+
+#endif //__OS_HISTOGRAM_H__
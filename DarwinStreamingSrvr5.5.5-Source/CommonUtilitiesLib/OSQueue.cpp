@@ -147,6 +147,26 @@ OSQueueElem*    OSQueue_Blocking::DeQueue()
 }
 
 
+OSQueueElem*    OSQueue_Blocking::TryDeQueue(Bool16 (*inCanDeQueue)(OSQueueElem* inElem))
+{
+    if (!fMutex.TryLock())
+        return NULL;
+        
+    OSQueueElem* retval = NULL;
+    for (OSQueueIter theIter(&fQueue); !theIter.IsDone(); theIter.Next())
+    {
+        if (inCanDeQueue(theIter.GetCurrent()))
+        {
+            retval = theIter.GetCurrent();
+            fQueue.Remove(retval);
+            break;
+        }
+    }
+    fMutex.Unlock();
+    return retval;
+}
+
+
 void OSQueue_Blocking::EnQueue(OSQueueElem* obj)
 {
     {
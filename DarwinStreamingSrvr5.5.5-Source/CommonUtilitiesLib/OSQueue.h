@@ -132,6 +132,10 @@ class OSQueue_Blocking
         OSQueueElem*    DeQueue();//will not block
         void            EnQueue(OSQueueElem* obj);
         
+        // Will not even block on the queue mutex: returns NULL right away if another
+        // thread holds it. Returns the oldest element for which inCanDeQueue is true.
+        OSQueueElem*    TryDeQueue(Bool16 (*inCanDeQueue)(OSQueueElem* inElem));
+        
         OSCond*         GetCond()   { return &fCond; }
         OSQueue*        GetQueue()  { return &fQueue; }
         
@@ -0,0 +1,82 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSSharedBuffer.h
+
+    Contains:   A buffer with a reference count, for data that several objects
+                hold on to, each for as long as it needs it. The count is kept
+                just in front of the data, so the buffer can be found from a
+                pointer to its data.
+
+                Whoever holds the only reference may write to the data. Once it
+                is shared, nobody may.
+
+*/
+
+#ifndef __OS_SHARED_BUFFER_H__
+#define __OS_SHARED_BUFFER_H__
+
+#include "OSHeaders.h"
+#include "OSMemory.h"
+#include "atomic.h"
+
+class OSSharedBuffer
+{
+    public:
+
+        //
+        // Makes a buffer of inSize bytes. The caller holds the one reference to it.
+        static OSSharedBuffer*  New(UInt32 inSize);
+
+        //
+        // inData must be the pointer GetData returned.
+        static OSSharedBuffer*  FromData(void* inData)  { return (OSSharedBuffer*)inData - 1; }
+
+        char*   GetData()       { return (char*)(this + 1); }
+        UInt32  GetSize()       { return fSize; }
+
+        //
+        // These are thread-safe. The buffer is deleted when the last reference
+        // to it is released.
+        void    Retain()        { (void)atomic_add(&fRefCount, 1); }
+        void    Release()       { if (atomic_sub(&fRefCount, 1) == 0) delete [] (char*)this; }
+
+        Bool16  IsShared()      { return fRefCount > 1; }
+
+    private:
+
+        unsigned int    fRefCount;
+        UInt32          fSize;
+};
+
+inline OSSharedBuffer* OSSharedBuffer::New(UInt32 inSize)
+{
+    OSSharedBuffer* theBuffer = (OSSharedBuffer*)NEW char[sizeof(OSSharedBuffer) + inSize];
+    theBuffer->fRefCount = 1;
+    theBuffer->fSize = inSize;
+    return theBuffer;
+}
+
+#endif //__OS_SHARED_BUFFER_H__
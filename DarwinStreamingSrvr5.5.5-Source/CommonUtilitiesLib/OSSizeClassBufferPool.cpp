@@ -0,0 +1,314 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSSizeClassBufferPool.cpp
+
+    Contains:   Buffers in a few fixed sizes, cached per thread.
+
+
+*/
+
+#include <string.h>
+
+#include "OSSizeClassBufferPool.h"
+#include "OSThread.h"
+#include "OSMemory.h"
+#include "MyAssert.h"
+#include "atomic.h"
+
+//
+// The free list heads are swapped with a 64 bit compare and store. Where the
+// compiler can't do that, they are swapped under a mutex instead, which is no
+// worse than OSBufferPool.
+#if !defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+static OSMutex sFreeListMutex;
+#endif
+
+static Bool16 CompareAndStore64(UInt64 inOldValue, UInt64 inNewValue, UInt64* ioArea)
+{
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+    return __sync_bool_compare_and_swap(ioArea, inOldValue, inNewValue);
+#else
+    OSMutexLocker locker(&sFreeListMutex);
+    if (*ioArea != inOldValue)
+        return false;
+    *ioArea = inNewValue;
+    return true;
+#endif
+}
+
+static inline UInt64 MakeFreeListHead(UInt64 inOldHead, UInt32 inIndex)
+{
+    return ((((inOldHead >> 32) + 1) & 0xFFFFFFFF) << 32) | (inIndex & 0xFFFFFFFF);
+}
+
+OSSizeClassBufferPool::OSSizeClassBufferPool(const UInt32* inClassSizes, UInt32 inNumClasses)
+:   fNumClasses(inNumClasses),
+    fNumRetries(0),
+    fNumUncachedOps(0)
+{
+    Assert(inNumClasses > 0);
+    Assert(inNumClasses <= kMaxSizeClasses);
+    if (fNumClasses > kMaxSizeClasses)
+        fNumClasses = kMaxSizeClasses;
+
+    ::memset(fClasses, 0, sizeof(fClasses));
+    for (UInt32 x = 0; x < fNumClasses; x++)
+    {
+        Assert((x == 0) || (inClassSizes[x] > inClassSizes[x - 1]));
+        // Round up so that the next buffer's header stays aligned
+        fClasses[x].fBufferSize = (inClassSizes[x] + 7) & ~7;
+    }
+
+    ::memset(fThreadCaches, 0, sizeof(fThreadCaches));
+}
+
+OSSizeClassBufferPool::ThreadCache* OSSizeClassBufferPool::GetThreadCache()
+{
+    OSThread* theThread = OSThread::GetCurrent();
+    if (theThread == NULL)
+        return NULL;
+
+    UInt32 theIndex = theThread->GetThreadIndex();
+    if (theIndex >= kMaxThreads)
+        return NULL;
+
+    //
+    // Only this thread ever sets its own entry, so there's no race here.
+    if (fThreadCaches[theIndex] == NULL)
+    {
+        ThreadCache* theCache = NEW ThreadCache;
+        ::memset(theCache, 0, sizeof(ThreadCache));
+        fThreadCaches[theIndex] = theCache;
+    }
+    return fThreadCaches[theIndex];
+}
+
+OSSizeClassBufferPool::BufferHeader* OSSizeClassBufferPool::GetHeader(SizeClass* inClass, UInt32 inIndex)
+{
+    //
+    // The index may come from a free list head that another thread was changing
+    // as we read it; the compare and store will fail, but don't go off the end first.
+    if ((inIndex == 0) || (inIndex > inClass->fNumBuffers))
+        return NULL;
+
+    UInt32 theSlot = inIndex - 1;
+    char* theSlab = inClass->fSlabs[theSlot / kBuffersPerSlab];
+    return (BufferHeader*)(theSlab + ((theSlot % kBuffersPerSlab) * (sizeof(BufferHeader) + inClass->fBufferSize)));
+}
+
+OSSizeClassBufferPool::BufferHeader* OSSizeClassBufferPool::PopFreeList(SizeClass* inClass)
+{
+    while (true)
+    {
+        UInt64 theHead = *(volatile UInt64*)&inClass->fFreeListHead;
+        UInt32 theIndex = (UInt32)(theHead & 0xFFFFFFFF);
+        if (theIndex == 0)
+            return NULL;
+
+        BufferHeader* theFirst = this->GetHeader(inClass, theIndex);
+        if (theFirst != NULL)
+        {
+            //
+            // If another thread takes theFirst off the list and puts it back with a
+            // different fNext in the meantime, the generation will have changed too.
+            if (CompareAndStore64(theHead, MakeFreeListHead(theHead, theFirst->fNext), &inClass->fFreeListHead))
+                return theFirst;
+        }
+        (void)atomic_add(&fNumRetries, 1);
+    }
+}
+
+void OSSizeClassBufferPool::PushFreeList(SizeClass* inClass, BufferHeader* inFirst, BufferHeader* inLast)
+{
+    //
+    // inFirst through inLast must already be linked through their fNext fields.
+    while (true)
+    {
+        UInt64 theHead = *(volatile UInt64*)&inClass->fFreeListHead;
+        inLast->fNext = (UInt32)(theHead & 0xFFFFFFFF);
+        if (CompareAndStore64(theHead, MakeFreeListHead(theHead, inFirst->fIndex), &inClass->fFreeListHead))
+            return;
+        (void)atomic_add(&fNumRetries, 1);
+    }
+}
+
+OSSizeClassBufferPool::BufferHeader* OSSizeClassBufferPool::AllocateBuffers(UInt32 inSizeClass)
+{
+    SizeClass* theClass = &fClasses[inSizeClass];
+    UInt32 theBufferLen = sizeof(BufferHeader) + theClass->fBufferSize;
+
+    OSMutexLocker locker(&fSlabMutex);
+
+    UInt32 theSlabIndex = theClass->fNumBuffers / kBuffersPerSlab;
+    if (theSlabIndex == kMaxSlabs)
+    {
+        BufferHeader* theHeader = (BufferHeader*)NEW char[theBufferLen];
+        theHeader->fIndex = 0;
+        theHeader->fNext = 0;
+        theHeader->fSizeClass = inSizeClass;
+        theHeader->fBufferSize = theClass->fBufferSize;
+        (void)atomic_add(&theClass->fNumLooseBuffers, 1);
+        return theHeader;
+    }
+
+    //
+    // Number the buffers in the new slab and link them up in order.
+    char* theSlab = NEW char[kBuffersPerSlab * theBufferLen];
+    for (UInt32 x = 0; x < kBuffersPerSlab; x++)
+    {
+        BufferHeader* theHeader = (BufferHeader*)(theSlab + (x * theBufferLen));
+        theHeader->fIndex = theClass->fNumBuffers + x + 1;
+        theHeader->fNext = theHeader->fIndex + 1;
+        theHeader->fSizeClass = inSizeClass;
+        theHeader->fBufferSize = theClass->fBufferSize;
+    }
+    theClass->fSlabs[theSlabIndex] = theSlab;
+    theClass->fNumBuffers += kBuffersPerSlab;
+
+    //
+    // Keep the first buffer, and put the rest on the free list in one go.
+    this->PushFreeList(theClass, (BufferHeader*)(theSlab + theBufferLen), (BufferHeader*)(theSlab + ((kBuffersPerSlab - 1) * theBufferLen)));
+    return (BufferHeader*)theSlab;
+}
+
+void* OSSizeClassBufferPool::Get(UInt32 inSize)
+{
+    UInt32 theSizeClass = 0;
+    while ((theSizeClass < fNumClasses) && (fClasses[theSizeClass].fBufferSize < inSize))
+        theSizeClass++;
+    if (theSizeClass == fNumClasses)
+        return NULL;
+
+    BufferHeader* theHeader = NULL;
+    ThreadCache* theCache = this->GetThreadCache();
+    if ((theCache != NULL) && (theCache->fNumBuffers[theSizeClass] > 0))
+    {
+        theCache->fNumHits++;
+        theHeader = theCache->fBuffers[theSizeClass][--theCache->fNumBuffers[theSizeClass]];
+    }
+    else
+    {
+        if (theCache != NULL)
+            theCache->fNumMisses++;
+        else
+            (void)atomic_add(&fNumUncachedOps, 1);
+
+        theHeader = this->PopFreeList(&fClasses[theSizeClass]);
+        if (theHeader == NULL)
+            theHeader = this->AllocateBuffers(theSizeClass);
+    }
+
+    return theHeader + 1;
+}
+
+void OSSizeClassBufferPool::Put(void* inBuffer)
+{
+    BufferHeader* theHeader = (BufferHeader*)inBuffer - 1;
+    UInt32 theSizeClass = theHeader->fSizeClass;
+    SizeClass* theClass = &fClasses[theSizeClass];
+    Assert(theSizeClass < fNumClasses);
+
+    if (theHeader->fIndex == 0)
+    {
+        (void)atomic_sub(&theClass->fNumLooseBuffers, 1);
+        delete [] (char*)theHeader;
+        return;
+    }
+
+    ThreadCache* theCache = this->GetThreadCache();
+    if (theCache == NULL)
+    {
+        (void)atomic_add(&fNumUncachedOps, 1);
+        this->PushFreeList(theClass, theHeader, theHeader);
+        return;
+    }
+
+    BufferHeader** theBuffers = theCache->fBuffers[theSizeClass];
+    if (theCache->fNumBuffers[theSizeClass] == kThreadCacheSize)
+    {
+        //
+        // The cache is full. Give the older half back to the free list, so that
+        // a thread that mostly frees buffers another thread got doesn't hoard them.
+        const UInt32 kHalf = kThreadCacheSize / 2;
+        for (UInt32 x = 0; x < kHalf - 1; x++)
+            theBuffers[x]->fNext = theBuffers[x + 1]->fIndex;
+        this->PushFreeList(theClass, theBuffers[0], theBuffers[kHalf - 1]);
+
+        ::memmove(theBuffers, theBuffers + kHalf, kHalf * sizeof(BufferHeader*));
+        theCache->fNumBuffers[theSizeClass] = kHalf;
+        theCache->fNumMisses++;
+    }
+    else
+        theCache->fNumHits++;
+
+    theBuffers[theCache->fNumBuffers[theSizeClass]++] = theHeader;
+}
+
+UInt32 OSSizeClassBufferPool::GetBufferSize(void* inBuffer)
+{
+    BufferHeader* theHeader = (BufferHeader*)inBuffer - 1;
+    return theHeader->fBufferSize;
+}
+
+UInt32 OSSizeClassBufferPool::GetTotalNumBuffers()
+{
+    UInt32 theTotal = 0;
+    for (UInt32 x = 0; x < fNumClasses; x++)
+        theTotal += fClasses[x].fNumBuffers + fClasses[x].fNumLooseBuffers;
+    return theTotal;
+}
+
+UInt64 OSSizeClassBufferPool::GetTotalBufferBytes()
+{
+    UInt64 theTotal = 0;
+    for (UInt32 x = 0; x < fNumClasses; x++)
+        theTotal += (UInt64)(fClasses[x].fNumBuffers + fClasses[x].fNumLooseBuffers) * fClasses[x].fBufferSize;
+    return theTotal;
+}
+
+UInt64 OSSizeClassBufferPool::GetNumCacheHits()
+{
+    UInt64 theTotal = 0;
+    for (UInt32 x = 0; x < kMaxThreads; x++)
+    {
+        ThreadCache* theCache = fThreadCaches[x];
+        if (theCache != NULL)
+            theTotal += theCache->fNumHits;
+    }
+    return theTotal;
+}
+
+UInt64 OSSizeClassBufferPool::GetNumCacheMisses()
+{
+    UInt64 theTotal = fNumUncachedOps;
+    for (UInt32 x = 0; x < kMaxThreads; x++)
+    {
+        ThreadCache* theCache = fThreadCaches[x];
+        if (theCache != NULL)
+            theTotal += theCache->fNumMisses;
+    }
+    return theTotal;
+}
@@ -0,0 +1,144 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSSizeClassBufferPool.h
+
+    Contains:   Buffers in a few fixed sizes, for callers that want many short lived
+                buffers of different sizes from many threads.
+
+                A Get returns a buffer of the smallest size class that fits. Each
+                OSThread keeps a small stack of free buffers of each class that only it
+                touches, so most Gets and Puts take no lock and share no cache lines.
+                When a thread's stack is empty or full it goes to the pool's free list
+                for that class, which is a lock-free list whose head carries a
+                generation count along with the index of the first buffer.
+
+                Buffers are never freed, like OSBufferPool's, except for the ones a
+                class makes one at a time once it has kMaxSlabs slabs. Threads that
+                aren't OSThreads use the free lists directly.
+
+*/
+
+#ifndef __OS_SIZE_CLASS_BUFFER_POOL_H__
+#define __OS_SIZE_CLASS_BUFFER_POOL_H__
+
+#include "OSHeaders.h"
+#include "OSMutex.h"
+
+class OSSizeClassBufferPool
+{
+    public:
+
+        enum
+        {
+            kMaxSizeClasses     = 8,
+            kMaxThreads         = 256,  // threads with a higher OSThread index don't get a cache
+            kThreadCacheSize    = 32,   // free buffers of each class a thread keeps to itself
+            kBuffersPerSlab     = 64,   // buffers are allocated this many at a time
+            kMaxSlabs           = 1024  // per class; past that, buffers are allocated one at a time
+        };
+
+        //
+        // inClassSizes must be in increasing order; there can be at most kMaxSizeClasses.
+        OSSizeClassBufferPool(const UInt32* inClassSizes, UInt32 inNumClasses);
+
+        //
+        // This object currently *does not* clean up for itself when
+        // you destruct it!
+        ~OSSizeClassBufferPool() {}
+
+        //
+        // All these functions are thread-safe
+
+        //
+        // Gets a buffer of at least inSize bytes, or NULL if inSize is bigger than the
+        // largest size class. It must be returned by calling Put.
+        void*   Get(UInt32 inSize);
+        void    Put(void* inBuffer);
+
+        //
+        // The size of the class a buffer from Get came from.
+        static UInt32 GetBufferSize(void* inBuffer);
+
+        //
+        // ACCESSORS. The counts are gathered from every thread's cache without
+        // locking, so they may be slightly behind.
+        UInt32  GetTotalNumBuffers();
+        UInt64  GetTotalBufferBytes();
+
+        // Gets and Puts done in the calling thread's own cache, and ones that
+        // went to the free lists.
+        UInt64  GetNumCacheHits();
+        UInt64  GetNumCacheMisses();
+
+        // Free list updates that had to be retried because another thread changed
+        // the list first.
+        UInt64  GetNumContendedUpdates() { return fNumRetries; }
+
+    private:
+
+        struct BufferHeader
+        {
+            UInt32  fIndex;         // in its class, counting from 1; 0 if not in a slab
+            UInt32  fNext;          // index of the next buffer on the free list
+            UInt32  fSizeClass;
+            UInt32  fBufferSize;    // of its class; also keeps the buffer 8 byte aligned
+        };
+
+        struct SizeClass
+        {
+            UInt32  fBufferSize;
+            UInt32  fNumBuffers;    // in slabs
+            unsigned int fNumLooseBuffers;
+            UInt64  fFreeListHead;  // generation << 32 | index of the first free buffer
+            char*   fSlabs[kMaxSlabs];
+        };
+
+        struct ThreadCache
+        {
+            BufferHeader*   fBuffers[kMaxSizeClasses][kThreadCacheSize];
+            UInt32          fNumBuffers[kMaxSizeClasses];
+            UInt64          fNumHits;
+            UInt64          fNumMisses;
+        };
+
+        ThreadCache*    GetThreadCache();
+        BufferHeader*   GetHeader(SizeClass* inClass, UInt32 inIndex);
+
+        BufferHeader*   PopFreeList(SizeClass* inClass);
+        void            PushFreeList(SizeClass* inClass, BufferHeader* inFirst, BufferHeader* inLast);
+        BufferHeader*   AllocateBuffers(UInt32 inSizeClass);
+
+        SizeClass       fClasses[kMaxSizeClasses];
+        UInt32          fNumClasses;
+
+        ThreadCache*    fThreadCaches[kMaxThreads];     // each is only written by its own thread
+        OSMutex         fSlabMutex;                     // held while adding a slab
+
+        unsigned int    fNumRetries;
+        unsigned int    fNumUncachedOps;    // by threads without a cache
+};
+
+#endif //__OS_SIZE_CLASS_BUFFER_POOL_H__
@@ -54,6 +54,7 @@
 
 #include "OSThread.h"
 #include "MyAssert.h"
+#include "atomic.h"
 
 #ifdef __sgi__ 
 #include <time.h>
@@ -64,6 +65,7 @@
 // OSThread.cp
 //
 void*   OSThread::sMainThreadData = NULL;
+unsigned int OSThread::sNumThreads = 0;
 
 #ifdef __Win32__
 DWORD   OSThread::sThreadStorageIndex = 0;
@@ -111,6 +113,7 @@ void OSThread::Initialize()
 OSThread::OSThread()
 :   fStopRequested(false),
     fJoined(false),
+    fThreadIndex(atomic_add(&sNumThreads, 1) - 1),
     fThreadData(NULL)
 {
 }
@@ -84,6 +84,10 @@ public:
                 
                 static void*    GetMainThreadData()     { return sMainThreadData; }
                 static void     SetMainThreadData(void* inData) { sMainThreadData = inData; }
+
+                // Each OSThread gets a different index, counting up from 0, so that
+                // code can keep something for each thread in an array.
+                UInt32          GetThreadIndex()        { return fThreadIndex; }
                 static void     SetUser(char *user) {::strncpy(sUser,user, sizeof(sUser) -1); sUser[sizeof(sUser) -1]=0;} 
                 static void     SetGroup(char *group) {::strncpy(sGroup,group, sizeof(sGroup) -1); sGroup[sizeof(sGroup) -1]=0;} 
                 static void     SetPersonality(char *user, char* group) { SetUser(user); SetGroup(group); };
@@ -128,6 +132,8 @@ private:
 
     Bool16 fStopRequested;
     Bool16 fJoined;
+    UInt32 fThreadIndex;
+    static unsigned int sNumThreads;
 
 #ifdef __Win32__
     HANDLE          fThreadID;
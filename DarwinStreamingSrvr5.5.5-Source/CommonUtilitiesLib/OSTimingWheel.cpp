@@ -0,0 +1,326 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSTimingWheel.cpp
+
+    Contains:   Implements a hierarchical timing wheel
+                    
+    
+    
+*/
+
+#include "OSTimingWheel.h"
+#include "OSMemory.h"
+
+#if _OSTIMINGWHEEL_TESTING_
+#include <stdlib.h>
+#include "OSHeap.h"
+#include "OS.h"
+#endif
+
+OSTimingWheel::OSTimingWheel(SInt64 inStartTime)
+: fCurrentTime(inStartTime), fNumElems(0), fNumInRoot(0)
+{}
+
+void OSTimingWheel::Insert(OSTimingWheelElem* inElem)
+{
+    Assert(inElem != NULL);
+    Assert(inElem->fCurrentWheel == NULL);
+    
+    inElem->fCurrentWheel = this;
+    fNumElems++;
+    this->Place(inElem);
+}
+
+OSTimingWheelElem* OSTimingWheel::Remove(OSTimingWheelElem* inElem)
+{
+    if ((inElem == NULL) || (inElem->fCurrentWheel != this))
+        return NULL;
+    
+    OSQueue* theSlot = inElem->fQueueElem.InQueue();
+    Assert(theSlot != NULL);
+    if ((theSlot >= &fRoot[0]) && (theSlot < &fRoot[kRootSize]))
+        fNumInRoot--;
+        
+    theSlot->Remove(&inElem->fQueueElem);
+    inElem->fCurrentWheel = NULL;
+    fNumElems--;
+    return inElem;
+}
+
+OSTimingWheelElem* OSTimingWheel::PeekExpired(SInt64 inCurrentTime)
+{
+    this->Advance(inCurrentTime);
+    
+    OSQueueElem* theElem = fExpired.GetHead();
+    if (theElem == NULL)
+        return NULL;
+    return (OSTimingWheelElem*)theElem->GetEnclosingObject();
+}
+
+OSTimingWheelElem* OSTimingWheel::ExtractExpired(SInt64 inCurrentTime)
+{
+    return this->Remove(this->PeekExpired(inCurrentTime));
+}
+
+SInt64 OSTimingWheel::GetNextExpiration()
+{
+    if (fNumElems == 0)
+        return -1;
+    if (fExpired.GetLength() > 0)
+        return fCurrentTime - 1;
+        
+    //if fCurrentTime is on a root boundary, the cascade for it hasn't happened yet
+    if ((fCurrentTime & (kRootSize - 1)) == 0)
+        return fCurrentTime;
+        
+    //look for something in the root wheel that is due before it next cascades.
+    //Anything after that we can't know about without cascading.
+    SInt64 theCascadeTime = (fCurrentTime | (kRootSize - 1)) + 1;
+    if (fNumInRoot > 0)
+    {
+        for (SInt64 theTime = fCurrentTime; theTime < theCascadeTime; theTime++)
+        {
+            if (fRoot[theTime & (kRootSize - 1)].GetLength() > 0)
+                return theTime;
+        }
+    }
+    return theCascadeTime;
+}
+
+void OSTimingWheel::Place(OSTimingWheelElem* inElem)
+{
+    SInt64 theValue = inElem->fValue;
+    SInt64 theDelta = theValue - fCurrentTime;
+    
+    if (theDelta < 0)
+    {
+        fExpired.EnQueue(&inElem->fQueueElem);
+        return;
+    }
+    if (theDelta < kRootSize)
+    {
+        fRoot[theValue & (kRootSize - 1)].EnQueue(&inElem->fQueueElem);
+        fNumInRoot++;
+        return;
+    }
+    
+    //find the coarsest level needed. Anything further out than the last level
+    //covers gets parked at its far end, and will be placed again when it cascades.
+    UInt32 theLevel = 0;
+    while ((theLevel < kNumLevels - 1) && (theDelta >= ((SInt64)1 << (kRootBits + ((theLevel + 1) * kLevelBits)))))
+        theLevel++;
+        
+    SInt64 theMaxDelta = ((SInt64)1 << (kRootBits + (kNumLevels * kLevelBits))) - 1;
+    if (theDelta > theMaxDelta)
+        theValue = fCurrentTime + theMaxDelta;
+        
+    UInt32 theIndex = (UInt32)(theValue >> (kRootBits + (theLevel * kLevelBits))) & (kLevelSize - 1);
+    fLevels[theLevel][theIndex].EnQueue(&inElem->fQueueElem);
+}
+
+UInt32 OSTimingWheel::Cascade(UInt32 inLevel)
+{
+    //move everything in the current slot of this level down into the finer wheels
+    UInt32 theIndex = (UInt32)(fCurrentTime >> (kRootBits + (inLevel * kLevelBits))) & (kLevelSize - 1);
+    OSQueue* theSlot = &fLevels[inLevel][theIndex];
+    
+    for (OSQueueElem* theElem = theSlot->DeQueue(); theElem != NULL; theElem = theSlot->DeQueue())
+        this->Place((OSTimingWheelElem*)theElem->GetEnclosingObject());
+        
+    return theIndex;
+}
+
+void OSTimingWheel::Advance(SInt64 inCurrentTime)
+{
+    while (fCurrentTime <= inCurrentTime)
+    {
+        //nothing left to expire, so skip straight to the present
+        if (fNumElems == fExpired.GetLength())
+        {
+            fCurrentTime = inCurrentTime + 1;
+            break;
+        }
+        
+        UInt32 theIndex = (UInt32)fCurrentTime & (kRootSize - 1);
+        if (theIndex == 0)
+        {
+            //each level only cascades when the finer level below it wraps around
+            for (UInt32 theLevel = 0; theLevel < kNumLevels; theLevel++)
+            {
+                if (this->Cascade(theLevel) != 0)
+                    break;
+            }
+        }
+        else if (fNumInRoot == 0)
+        {
+            //nothing in the root wheel, so nothing happens until the next cascade
+            SInt64 theCascadeTime = (fCurrentTime | (kRootSize - 1)) + 1;
+            fCurrentTime = (theCascadeTime <= inCurrentTime) ? theCascadeTime : inCurrentTime + 1;
+            continue;
+        }
+        
+        OSQueue* theSlot = &fRoot[theIndex];
+        for (OSQueueElem* theElem = theSlot->DeQueue(); theElem != NULL; theElem = theSlot->DeQueue())
+        {
+            fExpired.EnQueue(theElem);
+            fNumInRoot--;
+        }
+        fCurrentTime++;
+    }
+}
+
+
+#if _OSTIMINGWHEEL_TESTING_
+
+static void BenchmarkHeapAndWheel(UInt32 inNumTimers)
+{
+    SInt64 theStartTime = OS::Milliseconds();
+    OSHeap theHeap;
+    OSTimingWheel theWheel(theStartTime);
+    OSHeapElem* theHeapElems = NEW OSHeapElem[inNumTimers];
+    OSTimingWheelElem* theWheelElems = NEW OSTimingWheelElem[inNumTimers];
+    UInt32 theNumToCancel = inNumTimers / 10;
+    
+    //timers are spread over the next minute, like RTP sessions and idle timeouts
+    for (UInt32 x = 0; x < inNumTimers; x++)
+    {
+        SInt64 theValue = theStartTime + (::rand() % 60000);
+        theHeapElems[x].SetValue(theValue);
+        theWheelElems[x].SetValue(theValue);
+    }
+    
+    SInt64 theTime = OS::Microseconds();
+    for (UInt32 a = 0; a < inNumTimers; a++)
+        theHeap.Insert(&theHeapElems[a]);
+    SInt64 theHeapInsert = OS::Microseconds() - theTime;
+    
+    theTime = OS::Microseconds();
+    for (UInt32 b = 0; b < theNumToCancel; b++)
+        theHeap.Remove(&theHeapElems[b * 10]);
+    SInt64 theHeapCancel = OS::Microseconds() - theTime;
+    
+    theTime = OS::Microseconds();
+    while (theHeap.ExtractMin() != NULL)
+        {}
+    SInt64 theHeapExpire = OS::Microseconds() - theTime;
+    
+    theTime = OS::Microseconds();
+    for (UInt32 c = 0; c < inNumTimers; c++)
+        theWheel.Insert(&theWheelElems[c]);
+    SInt64 theWheelInsert = OS::Microseconds() - theTime;
+    
+    theTime = OS::Microseconds();
+    for (UInt32 d = 0; d < theNumToCancel; d++)
+        theWheel.Remove(&theWheelElems[d * 10]);
+    SInt64 theWheelCancel = OS::Microseconds() - theTime;
+    
+    theTime = OS::Microseconds();
+    while (theWheel.ExtractExpired(theStartTime + 60000) != NULL)
+        {}
+    SInt64 theWheelExpire = OS::Microseconds() - theTime;
+    
+    qtss_printf("%lu timers (usec)   insert  cancel  expire\n", inNumTimers);
+    qtss_printf("    OSHeap          %6"_64BITARG_"d  %6"_64BITARG_"d  %6"_64BITARG_"d\n", theHeapInsert, theHeapCancel, theHeapExpire);
+    qtss_printf("    OSTimingWheel   %6"_64BITARG_"d  %6"_64BITARG_"d  %6"_64BITARG_"d\n", theWheelInsert, theWheelCancel, theWheelExpire);
+    
+    delete [] theHeapElems;
+    delete [] theWheelElems;
+}
+
+Bool16 OSTimingWheel::Test()
+{
+    SInt64 theStartTime = 1000000;
+    OSTimingWheel victim(theStartTime);
+    OSTimingWheelElem elem1;
+    OSTimingWheelElem elem2;
+    OSTimingWheelElem elem3;
+    OSTimingWheelElem elem4;
+    OSTimingWheelElem elem5;
+
+    if (victim.GetNextExpiration() != -1)
+        return false;
+    if (victim.ExtractExpired(theStartTime) != NULL)
+        return false;
+        
+    //one in the root wheel, one on each level, one past the end, and one already expired
+    elem1.SetValue(theStartTime + 100);
+    elem2.SetValue(theStartTime + 1000);
+    elem3.SetValue(theStartTime + 100000);
+    elem4.SetValue(theStartTime + ((SInt64)1 << 33));
+    elem5.SetValue(theStartTime - 5);
+
+    victim.Insert(&elem1);
+    victim.Insert(&elem2);
+    victim.Insert(&elem3);
+    victim.Insert(&elem4);
+    victim.Insert(&elem5);
+    
+    if (victim.GetNumElems() != 5)
+        return false;
+    if (victim.ExtractExpired(theStartTime) != &elem5)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 99) != NULL)
+        return false;
+    if (victim.GetNextExpiration() != theStartTime + 100)
+        return false;
+    if (victim.PeekExpired(theStartTime + 100) != &elem1)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 100) != &elem1)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 999) != NULL)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 1000) != &elem2)
+        return false;
+        
+    if (victim.Remove(&elem3) != &elem3)
+        return false;
+    if (victim.Remove(&elem3) != NULL)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 200000) != NULL)
+        return false;
+        
+    elem3.SetValue(theStartTime + 200500);
+    victim.Insert(&elem3);
+    if (victim.ExtractExpired(theStartTime + 200499) != NULL)
+        return false;
+    if (victim.ExtractExpired(theStartTime + 200500) != &elem3)
+        return false;
+        
+    //elem4 is beyond what the wheel covers, make sure it survives going around
+    if (victim.ExtractExpired(theStartTime + ((SInt64)1 << 32)) != NULL)
+        return false;
+    if (victim.ExtractExpired(theStartTime + ((SInt64)1 << 33)) != &elem4)
+        return false;
+    if (victim.GetNumElems() != 0)
+        return false;
+    
+    BenchmarkHeapAndWheel(1000);
+    BenchmarkHeapAndWheel(10000);
+    BenchmarkHeapAndWheel(100000);
+    return true;
+}
+
+#endif
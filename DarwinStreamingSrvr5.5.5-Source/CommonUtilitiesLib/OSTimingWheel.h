@@ -0,0 +1,130 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSTimingWheel.h
+
+    Contains:   Implements a hierarchical timing wheel with millisecond resolution.
+                Insert and Remove are O(1); an element is moved down to a finer wheel
+                at most once per level on its way to expiring. Unlike OSHeap, the
+                wheel only knows approximately when the next element expires
+                (see GetNextExpiration).
+                    
+
+*/
+
+#ifndef _OSTIMINGWHEEL_H_
+#define _OSTIMINGWHEEL_H_
+
+#define _OSTIMINGWHEEL_TESTING_ 0
+
+#include "OSQueue.h"
+
+class OSTimingWheelElem;
+
+class OSTimingWheel
+{
+    public:
+    
+        enum
+        {
+            kRootBits   = 8,                    //UInt32
+            kRootSize   = 1 << kRootBits,       //UInt32 (1 slot per millisecond)
+            kLevelBits  = 6,                    //UInt32
+            kLevelSize  = 1 << kLevelBits,      //UInt32
+            kNumLevels  = 4                     //UInt32 (covers 2^32 milliseconds, about 49 days)
+        };
+        
+        //inStartTime is the current time in milliseconds
+        OSTimingWheel(SInt64 inStartTime);
+        ~OSTimingWheel() {}
+        
+        //ACCESSORS
+        UInt32      GetNumElems() { return fNumElems; }
+        
+        //Returns a time (in milliseconds) at or before which the next element
+        //expires, or -1 if the wheel is empty. This is exact for anything due
+        //within the next few hundred milliseconds, otherwise it is the time at
+        //which the wheel next has to cascade, so callers should just check again then.
+        SInt64      GetNextExpiration();
+        
+        //MODIFIERS
+        
+        //Element expires at its value (in milliseconds). Elements with a value in the
+        //past expire right away.
+        void                Insert(OSTimingWheelElem* inElem);
+        //removes specified element from the wheel, returns NULL if it isn't in this wheel
+        OSTimingWheelElem*  Remove(OSTimingWheelElem* inElem);
+        
+        //Returns the element that has been expired the longest as of inCurrentTime, or NULL.
+        //PeekExpired leaves it in the wheel.
+        OSTimingWheelElem*  PeekExpired(SInt64 inCurrentTime);
+        OSTimingWheelElem*  ExtractExpired(SInt64 inCurrentTime);
+        
+#if _OSTIMINGWHEEL_TESTING_
+        //returns true if it passed the test, false otherwise.
+        //Also prints how long OSHeap and OSTimingWheel take to insert, remove and expire timers.
+        static Bool16       Test();
+#endif
+
+    private:
+    
+        void            Advance(SInt64 inCurrentTime);
+        void            Place(OSTimingWheelElem* inElem);
+        UInt32          Cascade(UInt32 inLevel);
+        
+        //every element due before this time has been moved to fExpired
+        SInt64          fCurrentTime;
+        UInt32          fNumElems;
+        UInt32          fNumInRoot;
+        
+        OSQueue         fExpired;
+        OSQueue         fRoot[kRootSize];
+        OSQueue         fLevels[kNumLevels][kLevelSize];
+};
+
+class OSTimingWheelElem
+{
+    public:
+        OSTimingWheelElem(void* enclosingObject = NULL)
+            : fValue(0), fEnclosingObject(enclosingObject), fQueueElem(), fCurrentWheel(NULL)
+            { fQueueElem.SetEnclosingObject(this); }
+        ~OSTimingWheelElem() {}
+        
+        void    SetValue(SInt64 newValue) { fValue = newValue; }
+        SInt64  GetValue()              { return fValue; }
+        void*   GetEnclosingObject()    { return fEnclosingObject; }
+        void    SetEnclosingObject(void* obj) { fEnclosingObject = obj; }
+        Bool16  IsMemberOfAnyWheel()    { return fCurrentWheel != NULL; }
+        
+    private:
+    
+        SInt64          fValue;
+        void*           fEnclosingObject;
+        OSQueueElem     fQueueElem;     //links this element into one of the wheel's slots
+        OSTimingWheel*  fCurrentWheel;
+        
+        friend class OSTimingWheel;
+};
+#endif //_OSTIMINGWHEEL_H_
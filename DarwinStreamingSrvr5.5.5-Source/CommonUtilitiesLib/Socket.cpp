@@ -58,10 +58,33 @@
 #endif
 
 
-EventThread* Socket::sEventThread = NULL;
+EventThread* Socket::sEventThreads[kMaxNumEventThreads] = { NULL };
+UInt32       Socket::sNumEventThreads = 0;
+
+UInt32 Socket::AddEventThreads(UInt32 inNumToAdd)
+{
+    Assert(sNumEventThreads > 0); // Initialize must be called first
+    
+    for (UInt32 x = 0; (x < inNumToAdd) && (sNumEventThreads < kMaxNumEventThreads); x++)
+    {
+        struct eventqueue* theQueue = select_newqueue();
+        if (theQueue == NULL)
+            break; // This event queue implementation only supports one queue
+        
+        sEventThreads[sNumEventThreads] = new EventThread(theQueue);
+        sNumEventThreads++;
+    }
+    return sNumEventThreads;
+}
+
+void Socket::StartThread()
+{
+    for (UInt32 x = 0; x < sNumEventThreads; x++)
+        sEventThreads[x]->Start();
+}
 
 Socket::Socket(Task *notifytask, UInt32 inSocketType)
-:   EventContext(EventContext::kInvalidFileDesc, sEventThread),
+:   EventContext(EventContext::kInvalidFileDesc, sEventThreads[0]),
     fState(inSocketType),
     fLocalAddrStrPtr(NULL),
     fLocalDNSStrPtr(NULL),
@@ -87,7 +110,10 @@ OS_Error Socket::Open(int theType)
     fFileDesc = ::socket(PF_INET, theType, 0);
     if (fFileDesc == EventContext::kInvalidFileDesc)
         return (OS_Error)OSThread::GetErrno();
+    
+    this->SetEventThread(Socket::GetEventThread(fFileDesc));
             
+
     //
     // Setup this socket's event context
     if (fState & kNonBlockingSocketType)
@@ -57,9 +57,24 @@ class Socket : public EventContext
         };
 
         // This class provides a global event thread.
-        static void Initialize() { sEventThread = new EventThread(); }
-        static void StartThread() { sEventThread->Start(); }
-        static EventThread* GetEventThread() { return sEventThread; }
+        static void Initialize() { sEventThreads[0] = new EventThread(); sNumEventThreads = 1; }
+        static void StartThread();
+        static EventThread* GetEventThread() { return sEventThreads[0]; }
+        
+        //
+        // Additional event threads, each waiting on an event queue of its own, so that
+        // event demultiplexing isn't limited to one processor. Must be called after
+        // select_startevents and before StartThread. Only sockets opened after this
+        // call are spread across the new threads. Returns the total number of event threads,
+        // which stays 1 on platforms that can't have more than one event queue.
+        static UInt32       AddEventThreads(UInt32 inNumToAdd);
+        static UInt32       GetNumEventThreads() { return sNumEventThreads; }
+        static EventThread* GetEventThreadByIndex(UInt32 inIndex) { Assert(inIndex < sNumEventThreads); return sEventThreads[inIndex]; }
+        
+        // Event thread that owns the given descriptor. Descriptors are sharded by fd.
+        static EventThread* GetEventThread(int inFileDesc)
+            { return (inFileDesc < 0) ? sEventThreads[0] : sEventThreads[(UInt32)inFileDesc % sNumEventThreads]; }
+
         
         //Binds the socket to the following address.
         //Returns: QTSS_FileNotOpen, QTSS_NoErr, or POSIX errorcode.
@@ -103,7 +118,8 @@ class Socket : public EventContext
       
         enum
         {
-            kMaxNumSockets = 4096   //UInt32
+            kMaxNumSockets = 4096,      //UInt32
+            kMaxNumEventThreads = 64    //UInt32
         };
 
     protected:
@@ -151,7 +167,8 @@ class Socket : public EventContext
             kConnected  = 0x0008
         };
         
-        static EventThread* sEventThread;
+        static EventThread* sEventThreads[kMaxNumEventThreads];
+        static UInt32       sNumEventThreads;
         
 };
 
@@ -73,6 +73,9 @@ void TCPSocket::Set(int inSocket, struct sockaddr_in* remoteaddr)
     
     if ( inSocket != EventContext::kInvalidFileDesc ) 
     {
+        this->SetEventThread(Socket::GetEventThread(inSocket));
+        
+
         //make sure to find out what IP address this connection is actually occuring on. That
         //way, we can report correct information to clients asking what the connection's IP is
 #if __Win32__ || __osf__ || __sgi__ || __hpux__	
@@ -36,18 +36,27 @@
 #include "atomic.h"
 #include "OSMutexRW.h"
 
+#if _TASK_TESTING_
+#include "OSHistogram.h"
+#include "SafeStdLib.h"
+#endif
+
 
 unsigned int    Task::sThreadPicker = 0;
 OSMutexRW       TaskThreadPool::sMutexRW;
+Bool16          TaskThreadPool::sWorkStealing = false;
+Bool16          TaskThreadPool::sUseTimingWheel = false;
+unsigned int    TaskThreadPool::sNumTasksStolen = 0;
 static char* sTaskStateStr="live_"; //Alive
 
 Task::Task()
-:   fEvents(0), fUseThisThread(NULL), fWriteLock(false), fTimerHeapElem(), fTaskQueueElem()
+:   fEvents(0), fUseThisThread(NULL), fWriteLock(false), fTimerHeapElem(), fTimerWheelElem(), fTaskQueueElem()
 {
     this->SetTaskName("unknown");
 
 	fTaskQueueElem.SetEnclosingObject(this);
 	fTimerHeapElem.SetEnclosingObject(this);
+	fTimerWheelElem.SetEnclosingObject(this);
 
 }
 
@@ -154,6 +163,8 @@ void Task::Signal(EventFlags events)
 		************************************************/
         if (fUseThisThread != NULL){ // Task needs to be placed on a particular thread.
             fUseThisThread->fTaskQueue.EnQueue(&fTaskQueueElem);
+            if (TaskThreadPool::sWorkStealing)
+                fUseThisThread->WakeIdlePeerIfBusy();
         }
 			
 		/***********************************************
@@ -166,6 +177,8 @@ void Task::Signal(EventFlags events)
             unsigned int theThread = atomic_add(&sThreadPicker, 1);
             theThread %= TaskThreadPool::sNumTaskThreads;
             TaskThreadPool::sTaskThreadArray[theThread]->fTaskQueue.EnQueue(&fTaskQueueElem);
+            if (TaskThreadPool::sWorkStealing)
+                TaskThreadPool::sTaskThreadArray[theThread]->WakeIdlePeerIfBusy();
         }
     }
 }
@@ -297,8 +310,10 @@ void TaskThread::Entry()
             else{
                 //note that if we get here, we don't reset theTask, so it will get passed into
                 //WaitForTask
-                theTask->fTimerHeapElem.SetValue(OS::Milliseconds() + theTimeout);
-                fHeap.Insert(&theTask->fTimerHeapElem);
+                {
+                    OSMutexLocker locker(&fTimerMutex);
+                    this->InsertTimer(theTask, OS::Milliseconds() + theTimeout);
+                }
                 (void)atomic_or(&theTask->fEvents, Task::kIdleEvent);
                 doneProcessingEvent = true;
             }
@@ -322,20 +337,27 @@ Task* TaskThread::WaitForTask()
     	*
     	*******************************************************/
         SInt64 theCurrentTime = OS::Milliseconds();
+        SInt64 theTimeout = 0;
+        {
+            OSMutexLocker locker(&fTimerMutex);
 
     	/******************************************************
     	*
     	* 先探测下，不实际调用任务对象
     	*
     	*******************************************************/
-        if ((fHeap.PeekMin() != NULL) && (fHeap.PeekMin()->GetValue() <= theCurrentTime)){    
+        Task* theTimerTask = this->ExtractExpiredTimer(theCurrentTime, false);
+        if (theTimerTask != NULL){    
+            // More timers are due than this thread can run right now
+            if (TaskThreadPool::sWorkStealing && (this->GetTimerTimeout(theCurrentTime) == 1))
+                TaskThreadPool::WakeIdleThread(this);
 
 			/******************************************************
     		*
     		* 有超时任务，抽取实际任务对象并返回
     		*
     		*******************************************************/
-			return (Task*)fHeap.ExtractMin()->GetEnclosingObject();
+			return theTimerTask;
         }
 		
      	/******************************************************
@@ -344,11 +366,28 @@ Task* TaskThread::WaitForTask()
     	*
     	*******************************************************/
         //if there is an element waiting for a timeout, figure out how long we should wait.
-        SInt64 theTimeout = 0;
-        if (fHeap.PeekMin() != NULL){
-            theTimeout = fHeap.PeekMin()->GetValue() - theCurrentTime;
-		}
+        theTimeout = this->GetTimerTimeout(theCurrentTime);
         Assert(theTimeout >= 0);
+        }
+        
+        if (TaskThreadPool::sWorkStealing)
+        {
+            // Nothing of our own to run: help out a busy peer. If none of them has
+            // anything, sleep until our own queue, a timer, or a backed up peer wakes us.
+            // A peer that signals us just before we wait is missed, but it signals again
+            // as long as it stays backed up.
+            this->WakeIdlePeerIfBusy();
+            if (fTaskQueue.GetQueue()->GetLength() == 0)
+            {
+                (void)atomic_or(&fIsIdle, 1);
+                Task* theStolenTask = TaskThreadPool::StealTask(this);
+                if (theStolenTask != NULL)
+                {
+                    (void)compare_and_store(1, 0, &fIsIdle);
+                    return theStolenTask;
+                }
+            }
+        }
         
         //
         // Make sure we can't go to sleep for some ridiculously short
@@ -373,6 +412,7 @@ Task* TaskThread::WaitForTask()
 		******************************************************************************/
         //wait...
         OSQueueElem* theElem = fTaskQueue.DeQueueBlocking(this, (SInt32) theTimeout);
+        (void)compare_and_store(1, 0, &fIsIdle);
         if (theElem != NULL){    
 			
 			/******************************************************
@@ -455,3 +495,238 @@ void TaskThreadPool::RemoveThreads()
     
     sNumTaskThreads = 0;
 }
+
+void TaskThread::InsertTimer(Task* inTask, SInt64 inExpirationTime)
+{
+    if (TaskThreadPool::sUseTimingWheel)
+    {
+        inTask->fTimerWheelElem.SetValue(inExpirationTime);
+        fWheel.Insert(&inTask->fTimerWheelElem);
+    }
+    else
+    {
+        inTask->fTimerHeapElem.SetValue(inExpirationTime);
+        fHeap.Insert(&inTask->fTimerHeapElem);
+    }
+}
+
+Task* TaskThread::ExtractExpiredTimer(SInt64 inCurrentTime, Bool16 inStealableOnly)
+{
+    if (TaskThreadPool::sUseTimingWheel)
+    {
+        OSTimingWheelElem* theElem = fWheel.PeekExpired(inCurrentTime);
+        if ((theElem == NULL) || (inStealableOnly && !((Task*)theElem->GetEnclosingObject())->IsStealable()))
+            return NULL;
+        return (Task*)fWheel.Remove(theElem)->GetEnclosingObject();
+    }
+    
+    OSHeapElem* theElem = fHeap.PeekMin();
+    if ((theElem == NULL) || (theElem->GetValue() > inCurrentTime))
+        return NULL;
+    if (inStealableOnly && !((Task*)theElem->GetEnclosingObject())->IsStealable())
+        return NULL;
+    return (Task*)fHeap.ExtractMin()->GetEnclosingObject();
+}
+
+SInt64 TaskThread::GetTimerTimeout(SInt64 inCurrentTime)
+{
+    SInt64 theNextTime = -1;
+    if (TaskThreadPool::sUseTimingWheel)
+        theNextTime = fWheel.GetNextExpiration();
+    else if (fHeap.PeekMin() != NULL)
+        theNextTime = fHeap.PeekMin()->GetValue();
+        
+    //0 means there is no timer to wait for
+    if (theNextTime < 0)
+        return 0;
+    if (theNextTime <= inCurrentTime)
+        return 1;
+    return theNextTime - inCurrentTime;
+}
+
+void TaskThread::WakeIdlePeerIfBusy()
+{
+    // Not locked, so only a hint
+    if (fTaskQueue.GetQueue()->GetLength() >= kWakePeerQueueLength)
+        TaskThreadPool::WakeIdleThread(this);
+}
+
+Bool16 TaskThreadPool::IsStealable(OSQueueElem* inElem)
+{
+    return ((Task*)inElem->GetEnclosingObject())->IsStealable();
+}
+
+Task* TaskThreadPool::StealTask(TaskThread* inThief)
+{
+    //
+    // Look at each of the other threads in turn, starting with the one after the
+    // thief so idle threads don't all gang up on thread 0. Never block on a peer's
+    // locks here: if a peer is busy with its own queue or heap, just move on.
+    UInt32 theNumThreads = sNumTaskThreads;
+    UInt32 theThiefIndex = 0;
+    for ( ; theThiefIndex < theNumThreads; theThiefIndex++)
+    {
+        if (sTaskThreadArray[theThiefIndex] == inThief)
+            break;
+    }
+    
+    for (UInt32 x = 1; x < theNumThreads; x++)
+    {
+        TaskThread* theVictim = sTaskThreadArray[(theThiefIndex + x) % theNumThreads];
+        if (theVictim == inThief)
+            continue;
+        
+        Task* theTask = NULL;
+        OSQueueElem* theElem = theVictim->fTaskQueue.TryDeQueue(TaskThreadPool::IsStealable);
+        if (theElem != NULL)
+            theTask = (Task*)theElem->GetEnclosingObject();
+        else if (theVictim->fTimerMutex.TryLock())
+        {
+            theTask = theVictim->ExtractExpiredTimer(OS::Milliseconds(), true);
+            theVictim->fTimerMutex.Unlock();
+        }
+        
+        if (theTask != NULL)
+        {
+            (void)atomic_add(&sNumTasksStolen, 1);
+            return theTask;
+        }
+    }
+    return NULL;
+}
+
+void TaskThreadPool::WakeIdleThread(TaskThread* inBusyThread)
+{
+    UInt32 theNumThreads = sNumTaskThreads;
+    for (UInt32 x = 0; x < theNumThreads; x++)
+    {
+        TaskThread* thePeer = sTaskThreadArray[x];
+        // Clearing the flag claims the peer, so the next wakeup goes to another one
+        if ((thePeer != inBusyThread) && compare_and_store(1, 0, &thePeer->fIsIdle))
+        {
+            thePeer->fTaskQueue.GetCond()->Signal();
+            return;
+        }
+    }
+}
+
+#if _TASK_TESTING_
+
+//
+// Records how long it was from Signal to Run, then blocks for fBlockTime
+// milliseconds, like a task waiting on a slow disk would.
+class TaskTestTask : public Task
+{
+    public:
+    
+        TaskTestTask(OSShardedHistogram* inHistogram, UInt32 inBlockTime)
+            : Task(), fHistogram(inHistogram), fBlockTime(inBlockTime), fSignalTime(0), fPending(false)
+            { this->SetTaskName("TaskTestTask"); }
+        virtual ~TaskTestTask() {}
+        
+        void    SignalNow()
+            {
+                fSignalTime = OS::Microseconds();
+                fPending = true;
+                this->Signal(Task::kStartEvent);
+            }
+        Bool16  IsPending() { return fPending; }
+        
+        virtual SInt64 Run()
+            {
+                (void)this->GetEvents();
+                if (fHistogram != NULL)
+                    fHistogram->Record((UInt32)(OS::Microseconds() - fSignalTime));
+                if (fBlockTime > 0)
+                    OSThread::Sleep(fBlockTime);
+                fPending = false;
+                return 0;
+            }
+            
+    private:
+    
+        OSShardedHistogram* fHistogram;
+        UInt32              fBlockTime;
+        SInt64              fSignalTime;
+        volatile Bool16     fPending;
+};
+
+Bool16 TaskThreadPool::Test()
+{
+    enum
+    {
+        kNumThreads = 4,
+        kNumProbes = 16,
+        kNumBlockers = 2,
+        kBlockTimeInMilSecs = 5,
+        kNumRounds = 1000
+    };
+    
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        TaskThreadPool::SetWorkStealing(theMode == 1);
+        TaskThreadPool::AddThreads(kNumThreads);
+        UInt32 theNumStolen = sNumTasksStolen;
+        
+        OSShardedHistogram theHistogram;
+        TaskTestTask* theProbes[kNumProbes];
+        TaskTestTask* theBlockers[kNumBlockers];
+        for (UInt32 x = 0; x < kNumProbes; x++)
+            theProbes[x] = NEW TaskTestTask(&theHistogram, 0);
+        for (UInt32 y = 0; y < kNumBlockers; y++)
+            theBlockers[y] = NEW TaskTestTask(NULL, kBlockTimeInMilSecs);
+        
+        UInt32 theNumSignalled = 0;
+        for (UInt32 theRound = 0; theRound < kNumRounds; theRound++)
+        {
+            for (UInt32 y = 0; y < kNumBlockers; y++)
+            {
+                if (!theBlockers[y]->IsPending())
+                    theBlockers[y]->SignalNow();
+            }
+            for (UInt32 x = 0; x < kNumProbes; x++)
+            {
+                if (!theProbes[x]->IsPending())
+                {
+                    theProbes[x]->SignalNow();
+                    theNumSignalled++;
+                }
+            }
+            OSThread::Sleep(1);
+        }
+        
+        // Let everything finish before the threads go away
+        Bool16 isPending = true;
+        for (UInt32 theWait = 0; isPending && (theWait < 1000); theWait++)
+        {
+            isPending = false;
+            for (UInt32 x = 0; x < kNumProbes; x++)
+                isPending |= theProbes[x]->IsPending();
+            for (UInt32 y = 0; y < kNumBlockers; y++)
+                isPending |= theBlockers[y]->IsPending();
+            if (isPending)
+                OSThread::Sleep(10);
+        }
+        
+        TaskThreadPool::RemoveThreads();
+        delete [] sTaskThreadArray;
+        sTaskThreadArray = NULL;
+        
+        for (UInt32 x = 0; x < kNumProbes; x++)
+            delete theProbes[x];
+        for (UInt32 y = 0; y < kNumBlockers; y++)
+            delete theBlockers[y];
+        
+        OSHistogram theTotal;
+        theHistogram.GetHistogram(&theTotal);
+        qtss_printf("TaskThreadPool: work stealing %s: %lu runs, p50 %lu usec, p99 %lu usec, max %lu usec, %lu stolen\n",
+                    (theMode == 1) ? "on " : "off", theTotal.GetTotalCount(), theTotal.GetValueAtPerMille(500),
+                    theTotal.GetValueAtPerMille(990), theTotal.GetMaxValue(), sNumTasksStolen - theNumStolen);
+        
+        if (isPending || (theTotal.GetTotalCount() != theNumSignalled))
+            return false;
+    }
+    return true;
+}
+
+#endif
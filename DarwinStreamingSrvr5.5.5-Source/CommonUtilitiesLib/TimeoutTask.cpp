@@ -47,63 +47,91 @@ void TimeoutTask::Initialize()
 
 
 TimeoutTask::TimeoutTask(Task* inTask, SInt64 inTimeoutInMilSecs)
-: fTask(inTask), fQueueElem()
+: fTask(inTask), fTimeoutAtThisTime(0), fTimeoutInMilSecs(0), fWheelElem()
 {
-	fQueueElem.SetEnclosingObject(this);
-    this->SetTimeout(inTimeoutInMilSecs);
+	fWheelElem.SetEnclosingObject(this);
     if (NULL == inTask)
 		fTask = (Task *) this;
     Assert(sThread != NULL); // this can happen if RunServer intializes tasks in the wrong order
 
-    OSMutexLocker locker(&sThread->fMutex); 
-    sThread->fQueue.EnQueue(&fQueueElem);
+    this->SetTimeout(inTimeoutInMilSecs);
 }
 
 TimeoutTask::~TimeoutTask()
 {
     OSMutexLocker locker(&sThread->fMutex);
-    sThread->fQueue.Remove(&fQueueElem);
+    sThread->fWheel.Remove(&fWheelElem);
 }
 
 void TimeoutTask::SetTimeout(SInt64 inTimeoutInMilSecs)
 {
+    OSMutexLocker locker(&sThread->fMutex);
     fTimeoutInMilSecs = inTimeoutInMilSecs;
     if (inTimeoutInMilSecs == 0)
+    {
         fTimeoutAtThisTime = 0;
-    else
-        fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs;
+        sThread->fWheel.Remove(&fWheelElem);
+        return;
+    }
+    
+    fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs;
+    this->ScheduleInWheel();
+}
+
+void TimeoutTask::ScheduleInWheel()
+{
+    //RefreshTimeout checks without the lock, so check again
+    OSMutexLocker locker(&sThread->fMutex);
+    if (fTimeoutInMilSecs == 0)
+        return;
+        
+    //if we're already scheduled to be looked at sooner than that, the timeout
+    //thread will reschedule us then
+    if (fWheelElem.IsMemberOfAnyWheel() && (fWheelElem.GetValue() <= fTimeoutAtThisTime))
+        return;
+        
+    sThread->fWheel.Remove(&fWheelElem);
+    fWheelElem.SetValue(fTimeoutAtThisTime);
+    sThread->fWheel.Insert(&fWheelElem);
 }
 
 SInt64 TimeoutTaskThread::Run()
 {
-    //ok, check for timeouts now. Go through the whole queue
+    //ok, check for timeouts now. Only the timeouts that have come due are in the wheel's
+    //expired list; some of those will have been refreshed since, so just reschedule them
     OSMutexLocker locker(&fMutex);
     SInt64 curTime = OS::Milliseconds();
 	SInt64 intervalMilli = kIntervalSeconds * 1000;//always default to 60 seconds but adjust to smallest interval > 0
-	SInt64 taskInterval = intervalMilli;
 	
-    for (OSQueueIter iter(&fQueue); !iter.IsDone(); iter.Next())
+    for (OSTimingWheelElem* theElem = fWheel.ExtractExpired(curTime); theElem != NULL; theElem = fWheel.ExtractExpired(curTime))
     {
-        TimeoutTask* theTimeoutTask = (TimeoutTask*)iter.GetCurrent()->GetEnclosingObject();
+        TimeoutTask* theTimeoutTask = (TimeoutTask*)theElem->GetEnclosingObject();
         
         //if it's time to time this task out, signal it
-        if ((theTimeoutTask->fTimeoutAtThisTime > 0) && (curTime >= theTimeoutTask->fTimeoutAtThisTime))
+        if (curTime >= theTimeoutTask->fTimeoutAtThisTime)
         {
 #if TIMEOUT_DEBUGGING
             qtss_printf("TimeoutTask %ld timed out. Curtime = %"_64BITARG_"d, timeout time = %"_64BITARG_"d\n",(SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
 #endif
+            //keep signalling it every interval until it is refreshed or goes away
+            theElem->SetValue(curTime + intervalMilli);
+            fWheel.Insert(theElem);
 			theTimeoutTask->fTask->Signal(Task::kTimeoutEvent);
 		}
 		else
 		{
-			taskInterval = theTimeoutTask->fTimeoutAtThisTime - curTime;
-			if ( (taskInterval > 0) && (theTimeoutTask->fTimeoutInMilSecs > 0) && (intervalMilli > taskInterval) )
-				intervalMilli = taskInterval + 1000; // set timeout to 1 second past this task's timeout
+            theElem->SetValue(theTimeoutTask->fTimeoutAtThisTime);
+            fWheel.Insert(theElem);
 #if TIMEOUT_DEBUGGING
 			qtss_printf("TimeoutTask %ld not being timed out. Curtime = %"_64BITARG_"d. timeout time = %"_64BITARG_"d\n", (SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
 #endif
 		}
 	}
+	
+	SInt64 theNextTimeout = fWheel.GetNextExpiration();
+	if ((theNextTimeout >= 0) && (intervalMilli > theNextTimeout - curTime))
+		intervalMilli = (theNextTimeout - curTime) + 1000; // set timeout to 1 second past the next timeout
+		
 	(void)this->GetEvents();//we must clear the event mask!
 	
 	OSThread::ThreadYield();
@@ -114,3 +142,90 @@ SInt64 TimeoutTaskThread::Run()
     
     return intervalMilli;//don't delete me!
 }
+
+#if _TIMEOUTTASK_TESTING_
+
+class TimeoutTestTask : public Task
+{
+    public:
+        TimeoutTestTask() : Task() { this->SetTaskName("TimeoutTestTask"); }
+        virtual SInt64 Run() { return 0; }
+        
+        // With no task threads, Signal just leaves the events here
+        Bool16  TimedOut() { return (this->GetEvents() & Task::kTimeoutEvent) != 0; }
+};
+
+Bool16 TimeoutTask::Test()
+{
+    TimeoutTask::Initialize();
+    TimeoutTestTask theTask;
+    TimeoutTask theTimeout(&theTask, 20);
+    if (!theTimeout.fWheelElem.IsMemberOfAnyWheel())
+        return false;
+        
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (!theTask.TimedOut())
+        return false;
+        
+    // Once timed out it waits a whole interval to be signalled again, but
+    // refreshing it goes by the timeout again
+    theTimeout.RefreshTimeout();
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (!theTask.TimedOut())
+        return false;
+    
+    // Refreshing it in time keeps it from timing out
+    theTimeout.SetTimeout(40);
+    for (UInt32 x = 0; x < 5; x++)
+    {
+        OSThread::Sleep(20);
+        theTimeout.RefreshTimeout();
+        (void)sThread->Run();
+        if (theTask.TimedOut())
+            return false;
+    }
+    
+    // A timeout of 0 never times out
+    theTimeout.SetTimeout(0);
+    if (theTimeout.fWheelElem.IsMemberOfAnyWheel())
+        return false;
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (theTask.TimedOut())
+        return false;
+        
+    theTimeout.RefreshTimeout();
+    if (theTimeout.fWheelElem.IsMemberOfAnyWheel())
+        return false;
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (theTask.TimedOut())
+        return false;
+    
+    // A new timeout goes back in the wheel
+    theTimeout.SetTimeout(20);
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (!theTask.TimedOut())
+        return false;
+    
+    // Refreshing a timeout that is out of the wheel puts it back
+    theTimeout.SetTimeout(20);
+    {
+        OSMutexLocker locker(&sThread->fMutex);
+        (void)sThread->fWheel.Remove(&theTimeout.fWheelElem);
+    }
+    theTimeout.RefreshTimeout();
+    if (!theTimeout.fWheelElem.IsMemberOfAnyWheel())
+        return false;
+    OSThread::Sleep(30);
+    (void)sThread->Run();
+    if (!theTask.TimedOut())
+        return false;
+        
+    return true;
+}
+
+#endif
@@ -30,6 +30,11 @@
                 overhead for maintaining the timing information, this is a low overhead,
                 low priority timing mechanism. Timeouts may not happen exactly when
                 they are supposed to, but who cares?
+                
+                Pending timeouts are kept in a timing wheel, so the timeout thread only
+                looks at the ones that may have expired. RefreshTimeout only touches the
+                wheel if the timeout isn't in it, or is in it for later than the new
+                timeout; otherwise a refreshed timeout is just rescheduled when it comes due.
                     
     
     
@@ -45,17 +50,20 @@
 
 #include "OSThread.h"
 #include "OSQueue.h"
+#include "OSTimingWheel.h"
 #include "OSMutex.h"
 #include "OS.h"
 
 #define TIMEOUT_DEBUGGING 0 //messages to help debugging timeouts
 
+#define _TIMEOUTTASK_TESTING_ 0
+
 class TimeoutTaskThread : public IdleTask
 {
     public:
     
         //All timeout tasks get timed out from this thread
-                    TimeoutTaskThread() : IdleTask(), fMutex() {this->SetTaskName("TimeoutTask");}
+                    TimeoutTaskThread() : IdleTask(), fMutex(), fWheel(OS::Milliseconds()) {this->SetTaskName("TimeoutTask");}
         virtual     ~TimeoutTaskThread(){}
 
     private:
@@ -68,7 +76,7 @@ class TimeoutTaskThread : public IdleTask
 
         virtual SInt64          Run();
         OSMutex                 fMutex;
-        OSQueue                 fQueue;
+        OSTimingWheel           fWheel;
         
         friend class TimeoutTask;
 };
@@ -94,16 +102,34 @@ class TimeoutTask
         
         // Specified task will get a Task::kTimeoutEvent if this
         // function isn't called within the timeout period
-        void        RefreshTimeout() { fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs; Assert(fTimeoutAtThisTime > 0); }
+        void        RefreshTimeout()
+                        {
+                            fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs; Assert(fTimeoutAtThisTime > 0);
+                            if ((fTimeoutInMilSecs != 0) && (!fWheelElem.IsMemberOfAnyWheel() || (fWheelElem.GetValue() > fTimeoutAtThisTime)))
+                                this->ScheduleInWheel();
+                        }
         
         void        SetTask(Task* inTask) { fTask = inTask; }
+        
+#if _TIMEOUTTASK_TESTING_
+        //
+        // Runs the timeout thread's Run by hand, so no task threads are needed.
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
+
     private:
     
+        // Makes sure a non-zero timeout is in the wheel no later than fTimeoutAtThisTime.
+        // It may be out because the timeout thread has it out right now, or SetTimeout(0)
+        // took it out, or be in for later because it timed out and is waiting to be signalled again.
+        void        ScheduleInWheel();
+    
         Task*       fTask;
         SInt64      fTimeoutAtThisTime;
         SInt64      fTimeoutInMilSecs;
-        //for putting on our global queue of timeout tasks
-        OSQueueElem fQueueElem;
+        //for putting on our global wheel of timeout tasks
+        OSTimingWheelElem fWheelElem;
         
         static TimeoutTaskThread*   sThread;
         
@@ -49,15 +49,62 @@
 #endif
 
 #include <errno.h>
+#include <string.h>
 #include "UDPSocket.h"
 #include "OSMemory.h"
+#include "atomic.h"
+
+#if _UDPSOCKET_TESTING_
+#include <stdio.h>
+#include "OS.h"
+#include "SafeStdLib.h"
+#endif
 
 #ifdef USE_NETLOG
 #include <netlog.h>
 #endif
 
+unsigned int UDPSocket::sNumBatchedPackets = 0;
+unsigned int UDPSocket::sNumBatchedSends = 0;
+
+struct UDPSocket::SendQueue
+{
+    enum
+    {
+        kMaxPackets     = 16,   //UInt32
+        kMaxPacketSize  = 2048  //UInt32. Bigger packets bypass the queue
+    };
+    
+    SendQueue();
+    
+    UInt32              fNumPackets;
+#if MMSG_SYSCALLS
+    struct mmsghdr      fMsgs[kMaxPackets];
+    struct iovec        fIOVecs[kMaxPackets][kMaxQueuedIOVecs];
+    struct sockaddr_in  fAddrs[kMaxPackets];
+#endif
+    char                fBuffers[kMaxPackets][kMaxPacketSize];
+};
+
+UDPSocket::SendQueue::SendQueue()
+: fNumPackets(0)
+{
+#if MMSG_SYSCALLS
+    ::memset(fMsgs, 0, sizeof(fMsgs));
+    ::memset(fAddrs, 0, sizeof(fAddrs));
+    for (UInt32 x = 0; x < kMaxPackets; x++)
+    {
+        fAddrs[x].sin_family = AF_INET;
+        fMsgs[x].msg_hdr.msg_name = &fAddrs[x];
+        fMsgs[x].msg_hdr.msg_namelen = sizeof(fAddrs[x]);
+        fMsgs[x].msg_hdr.msg_iov = fIOVecs[x];
+        fMsgs[x].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
 UDPSocket::UDPSocket(Task* inTask, UInt32 inSocketType)
-: Socket(inTask, inSocketType), fDemuxer(NULL)
+: Socket(inTask, inSocketType), fDemuxer(NULL), fSendQueue(NULL)
 {
     if (inSocketType & kWantsDemuxer)
         fDemuxer = NEW UDPDemuxer();
@@ -66,6 +113,14 @@ UDPSocket::UDPSocket(Task* inTask, UInt32 inSocketType)
     ::memset(&fMsgAddr, 0, sizeof(fMsgAddr));
 }
 
+UDPSocket::~UDPSocket()
+{
+    if (fDemuxer != NULL)
+        delete fDemuxer;
+    if (fSendQueue != NULL)
+        delete fSendQueue;
+}
+
 
 OS_Error
 UDPSocket::SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt32 inLength)
@@ -89,6 +144,123 @@ UDPSocket::SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt
     return OS_NoErr;
 }
 
+OS_Error UDPSocket::QueueTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt32 inLength)
+{
+#if MMSG_SYSCALLS
+    Assert(inBuffer != NULL);
+    
+    if (inLength > SendQueue::kMaxPacketSize)
+    {
+        //keep the packets in order
+        (void)this->FlushQueue();
+        return this->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+    }
+    
+    OSMutexLocker locker(&fSendQueueMutex);
+    if (fSendQueue == NULL)
+        fSendQueue = NEW SendQueue();
+        
+    OS_Error theErr = OS_NoErr;
+    if (fSendQueue->fNumPackets == SendQueue::kMaxPackets)
+        theErr = this->FlushQueueLocked();
+    
+    UInt32 theIndex = fSendQueue->fNumPackets++;
+    fSendQueue->fAddrs[theIndex].sin_port = htons(inRemotePort);
+    fSendQueue->fAddrs[theIndex].sin_addr.s_addr = htonl(inRemoteAddr);
+    fSendQueue->fIOVecs[theIndex][0].iov_base = fSendQueue->fBuffers[theIndex];
+    fSendQueue->fIOVecs[theIndex][0].iov_len = inLength;
+    fSendQueue->fMsgs[theIndex].msg_hdr.msg_iovlen = 1;
+    ::memcpy(fSendQueue->fBuffers[theIndex], inBuffer, inLength);
+    return theErr;
+#else
+    return this->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+#endif
+}
+
+OS_Error UDPSocket::QueueVTo(UInt32 inRemoteAddr, UInt16 inRemotePort, const struct iovec* inVec, UInt32 inNumVecs)
+{
+    Assert(inVec != NULL);
+    Assert(inNumVecs <= kMaxQueuedIOVecs);
+    if ((inNumVecs == 0) || (inNumVecs > kMaxQueuedIOVecs))
+        return EINVAL;
+        
+#if MMSG_SYSCALLS
+    OSMutexLocker locker(&fSendQueueMutex);
+    if (fSendQueue == NULL)
+        fSendQueue = NEW SendQueue();
+        
+    OS_Error theErr = OS_NoErr;
+    if (fSendQueue->fNumPackets == SendQueue::kMaxPackets)
+        theErr = this->FlushQueueLocked();
+    
+    UInt32 theIndex = fSendQueue->fNumPackets++;
+    fSendQueue->fAddrs[theIndex].sin_port = htons(inRemotePort);
+    fSendQueue->fAddrs[theIndex].sin_addr.s_addr = htonl(inRemoteAddr);
+    for (UInt32 x = 0; x < inNumVecs; x++)
+        fSendQueue->fIOVecs[theIndex][x] = inVec[x];
+    fSendQueue->fMsgs[theIndex].msg_hdr.msg_iovlen = inNumVecs;
+    return theErr;
+#else
+    if (inNumVecs == 1)
+        return this->SendTo(inRemoteAddr, inRemotePort, inVec[0].iov_base, inVec[0].iov_len);
+        
+    //No sendmsg on every platform, so gather the pieces up here
+    char theBuffer[SendQueue::kMaxPacketSize];
+    UInt32 theLength = 0;
+    for (UInt32 x = 0; x < inNumVecs; x++)
+    {
+        if ((theLength + inVec[x].iov_len) > sizeof(theBuffer))
+            return EINVAL;
+        ::memcpy(&theBuffer[theLength], inVec[x].iov_base, inVec[x].iov_len);
+        theLength += inVec[x].iov_len;
+    }
+    return this->SendTo(inRemoteAddr, inRemotePort, theBuffer, theLength);
+#endif
+}
+
+OS_Error UDPSocket::FlushQueue()
+{
+    if (fSendQueue == NULL)
+        return OS_NoErr;
+        
+    OSMutexLocker locker(&fSendQueueMutex);
+    return this->FlushQueueLocked();
+}
+
+OS_Error UDPSocket::FlushQueueLocked()
+{
+    OS_Error theErr = OS_NoErr;
+#if MMSG_SYSCALLS
+    UInt32 theNumPackets = fSendQueue->fNumPackets;
+    UInt32 theNumSent = 0;
+    while (theNumSent < theNumPackets)
+    {
+        int theResult = ::sendmmsg(fFileDesc, &fSendQueue->fMsgs[theNumSent], theNumPackets - theNumSent, 0);
+        if (theResult == -1)
+        {
+            //Just like SendTo, a packet that can't be sent is dropped.
+            theErr = (OS_Error)OSThread::GetErrno();
+            if (theErr == EINTR)
+                continue;
+            //The socket buffer is full, so the rest of the batch would fail the
+            //same way. Drop it rather than trying again packet by packet.
+            if ((theErr == EAGAIN) || (theErr == EWOULDBLOCK) || (theErr == ENOBUFS))
+                break;
+            //Otherwise it's this one packet (its destination, say). Skip it
+            //and carry on with the rest.
+            theNumSent++;
+            continue;
+        }
+        
+        (void)atomic_add(&sNumBatchedPackets, theResult);
+        (void)atomic_add(&sNumBatchedSends, 1);
+        theNumSent += theResult;
+    }
+    fSendQueue->fNumPackets = 0;
+#endif
+    return theErr;
+}
+
 OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
                             void* ioBuffer, UInt32 inBufLen, UInt32* outRecvLen)
 {
@@ -119,6 +291,58 @@ OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
     return OS_NoErr;        
 }
 
+OS_Error UDPSocket::RecvMultipleFrom(UInt32* outRemoteAddrs, UInt16* outRemotePorts,
+                            void** ioBuffers, UInt32 inBufLen, UInt32* outRecvLens,
+                            UInt32 inNumBuffers, UInt32* outNumPackets)
+{
+    Assert(outNumPackets != NULL);
+    Assert(ioBuffers != NULL);
+    *outNumPackets = 0;
+    
+#if MMSG_SYSCALLS
+    if (inNumBuffers > kMaxRecvPackets)
+        inNumBuffers = kMaxRecvPackets;
+        
+    struct mmsghdr      theMsgs[kMaxRecvPackets];
+    struct iovec        theIOVecs[kMaxRecvPackets];
+    struct sockaddr_in  theAddrs[kMaxRecvPackets];
+    
+    ::memset(theMsgs, 0, sizeof(struct mmsghdr) * inNumBuffers);
+    for (UInt32 x = 0; x < inNumBuffers; x++)
+    {
+        theIOVecs[x].iov_base = ioBuffers[x];
+        theIOVecs[x].iov_len = inBufLen;
+        theMsgs[x].msg_hdr.msg_name = &theAddrs[x];
+        theMsgs[x].msg_hdr.msg_namelen = sizeof(theAddrs[x]);
+        theMsgs[x].msg_hdr.msg_iov = &theIOVecs[x];
+        theMsgs[x].msg_hdr.msg_iovlen = 1;
+    }
+    
+    //The socket is non-blocking, so this returns as soon as the socket is empty
+    int theResult = ::recvmmsg(fFileDesc, theMsgs, inNumBuffers, 0, NULL);
+    if (theResult == -1)
+        return (OS_Error)OSThread::GetErrno();
+        
+    for (int y = 0; y < theResult; y++)
+    {
+        outRemoteAddrs[y] = ntohl(theAddrs[y].sin_addr.s_addr);
+        outRemotePorts[y] = ntohs(theAddrs[y].sin_port);
+        outRecvLens[y] = theMsgs[y].msg_len;
+    }
+    *outNumPackets = (UInt32)theResult;
+    return OS_NoErr;
+#else
+    if (inNumBuffers == 0)
+        return OS_NoErr;
+        
+    outRecvLens[0] = 0;
+    OS_Error theErr = this->RecvFrom(&outRemoteAddrs[0], &outRemotePorts[0], ioBuffers[0], inBufLen, &outRecvLens[0]);
+    if (theErr == OS_NoErr)
+        *outNumPackets = 1;
+    return theErr;
+#endif
+}
+
 OS_Error UDPSocket::JoinMulticast(UInt32 inRemoteAddr)
 {
     struct ip_mreq  theMulti;
@@ -174,3 +398,225 @@ OS_Error UDPSocket::LeaveMulticast(UInt32 inRemoteAddr)
     else
         return OS_NoErr;    
 }
+
+#if _UDPSOCKET_TESTING_
+
+//Resident set size of this process in KB, or 0 where we can't tell
+static UInt32 GetResidentKBytes()
+{
+    UInt32 theKBytes = 0;
+#if __linux__
+    FILE* theFile = ::fopen("/proc/self/status", "r");
+    if (theFile == NULL)
+        return 0;
+    char theLine[128];
+    while (::fgets(theLine, sizeof(theLine), theFile) != NULL)
+    {
+        if (::sscanf(theLine, "VmRSS: %lu", &theKBytes) == 1)
+            break;
+    }
+    ::fclose(theFile);
+#endif
+    return theKBytes;
+}
+
+//Reflects inNumPackets packets to inNumViewers viewers through one socket, the way
+//ReflectorSender does: with QueueTo, which copies every packet once per viewer, or
+//with QueueVTo, which sends the one shared copy. Prints the bytes copied, how much
+//the resident size grew and how long queueing and flushing took.
+static Bool16 TestFanOut(Bool16 inNoCopy, char** inPackets, UInt32 inNumPackets, UInt32 inPacketSize, UInt32 inNumViewers)
+{
+    enum
+    {
+        kViewersPerDrain = 64   //few enough that the receive buffer holds them
+    };
+    
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    UDPSocket theReceiver(NULL, Socket::kNonBlockingSocketType);
+    if ((theSender.Open() != OS_NoErr) || (theReceiver.Open() != OS_NoErr))
+        return false;
+    if ((theSender.Bind(INADDR_LOOPBACK, 0) != OS_NoErr) || (theReceiver.Bind(INADDR_LOOPBACK, 0) != OS_NoErr))
+        return false;
+    (void)theReceiver.SetSocketRcvBufSize(1024 * 1024);
+    
+    char* theRecvBuffers[UDPSocket::kMaxRecvPackets];
+    for (UInt32 x = 0; x < UDPSocket::kMaxRecvPackets; x++)
+        theRecvBuffers[x] = NEW char[inPacketSize];
+    UInt32 theAddrs[UDPSocket::kMaxRecvPackets];
+    UInt16 thePorts[UDPSocket::kMaxRecvPackets];
+    UInt32 theLens[UDPSocket::kMaxRecvPackets];
+    
+    UInt64 theBytesCopied = 0;
+    UInt32 theNumSent = 0;
+    UInt32 theNumReceived = 0;
+    SInt64 theSendTime = 0;
+    Bool16 theResult = true;
+    
+    UInt32 theStartKBytes = GetResidentKBytes();
+    for (UInt32 thePacket = 0; thePacket < inNumPackets; thePacket++)
+    {
+        for (UInt32 theViewer = 0; theViewer < inNumViewers; )
+        {
+            SInt64 theStartTime = OS::Microseconds();
+            for (UInt32 z = 0; (z < kViewersPerDrain) && (theViewer < inNumViewers); z++, theViewer++)
+            {
+                if (inNoCopy)
+                {
+                    struct iovec theVec;
+                    theVec.iov_base = inPackets[thePacket];
+                    theVec.iov_len = inPacketSize;
+                    (void)theSender.QueueVTo(INADDR_LOOPBACK, theReceiver.GetLocalPort(), &theVec, 1);
+                }
+                else
+                {
+                    (void)theSender.QueueTo(INADDR_LOOPBACK, theReceiver.GetLocalPort(), inPackets[thePacket], inPacketSize);
+                    theBytesCopied += inPacketSize;
+                }
+                theNumSent++;
+            }
+            (void)theSender.FlushQueue();
+            theSendTime += OS::Microseconds() - theStartTime;
+            
+            while (true)
+            {
+                UInt32 theNumRead = 0;
+                OS_Error theErr = theReceiver.RecvMultipleFrom(theAddrs, thePorts, (void**)theRecvBuffers,
+                                                                inPacketSize, theLens, UDPSocket::kMaxRecvPackets, &theNumRead);
+                for (UInt32 w = 0; w < theNumRead; w++)
+                {
+                    if ((theLens[w] != inPacketSize) || (::memcmp(theRecvBuffers[w], inPackets[thePacket], inPacketSize) != 0))
+                        theResult = false;
+                }
+                theNumReceived += theNumRead;
+                if ((theErr != OS_NoErr) || (theNumRead == 0))
+                    break;
+            }
+        }
+    }
+    
+    UInt32 theEndKBytes = GetResidentKBytes();
+    qtss_printf("UDPSocket: %s %lu viewers: %lu/%lu packets, %"_64BITARG_"u bytes copied, RSS +%lu KB, %.2f usec/packet/viewer\n",
+                inNoCopy ? "QueueVTo" : "QueueTo ", inNumViewers, theNumReceived, theNumSent, theBytesCopied,
+                (theEndKBytes > theStartKBytes) ? theEndKBytes - theStartKBytes : 0,
+                (Float64)theSendTime / (Float64)(theNumSent ? theNumSent : 1));
+    
+    for (UInt32 x = 0; x < UDPSocket::kMaxRecvPackets; x++)
+        delete [] theRecvBuffers[x];
+    if (theNumReceived != theNumSent)
+        return false; // lost some on the loopback
+    return theResult;
+}
+
+Bool16 UDPSocket::Test()
+{
+    enum
+    {
+        kPacketSize = 1316,     // 7 MPEG-TS packets, as a live feed would send them
+        kBurstSize = 64,
+        kNumBursts = 2000
+    };
+    static const UInt32 kBatchSizes[] = { 1, 4, 16, 32 };
+    
+    if (Socket::GetNumEventThreads() == 0)
+        Socket::Initialize();
+        
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    UDPSocket theReceiver(NULL, Socket::kNonBlockingSocketType);
+    if ((theSender.Open() != OS_NoErr) || (theReceiver.Open() != OS_NoErr))
+        return false;
+    if ((theSender.Bind(INADDR_LOOPBACK, 0) != OS_NoErr) || (theReceiver.Bind(INADDR_LOOPBACK, 0) != OS_NoErr))
+        return false;
+    (void)theReceiver.SetSocketRcvBufSize(1024 * 1024);
+    
+    char theSendBuffer[kPacketSize];
+    ::memset(theSendBuffer, 'x', sizeof(theSendBuffer));
+    char* theRecvBuffers[kMaxRecvPackets];
+    for (UInt32 x = 0; x < kMaxRecvPackets; x++)
+        theRecvBuffers[x] = NEW char[kPacketSize];
+    
+    UInt32 theAddrs[kMaxRecvPackets];
+    UInt16 thePorts[kMaxRecvPackets];
+    UInt32 theLens[kMaxRecvPackets];
+    Bool16 theResult = true;
+    
+    for (UInt32 y = 0; (y < sizeof(kBatchSizes) / sizeof(UInt32)) && theResult; y++)
+    {
+        UInt32 theNumPackets = 0;
+        UInt32 theNumCalls = 0;
+        SInt64 theRecvTime = 0;
+        for (UInt32 theBurst = 0; theBurst < kNumBursts; theBurst++)
+        {
+            for (UInt32 z = 0; z < kBurstSize; z++)
+                (void)theSender.SendTo(INADDR_LOOPBACK, theReceiver.GetLocalPort(), theSendBuffer, kPacketSize);
+            
+            //Drain it the way ReflectorSocket::GetIncomingData does: until a read comes back short
+            SInt64 theStartTime = OS::Microseconds();
+            UInt32 theNumInBurst = 0;
+            while (true)
+            {
+                UInt32 theNumRead = 0;
+                OS_Error theErr = OS_NoErr;
+                if (kBatchSizes[y] == 1)
+                {
+                    theErr = theReceiver.RecvFrom(&theAddrs[0], &thePorts[0], theRecvBuffers[0], kPacketSize, &theLens[0]);
+                    if (theErr == OS_NoErr)
+                        theNumRead = 1;
+                }
+                else
+                    theErr = theReceiver.RecvMultipleFrom(theAddrs, thePorts, (void**)theRecvBuffers, kPacketSize, theLens, kBatchSizes[y], &theNumRead);
+                theNumCalls++;
+                
+                for (UInt32 w = 0; w < theNumRead; w++)
+                {
+                    if ((theLens[w] != kPacketSize) || (thePorts[w] != theSender.GetLocalPort()))
+                        theResult = false;
+                }
+                theNumInBurst += theNumRead;
+                if ((theErr != OS_NoErr) || (theNumRead < kBatchSizes[y]))
+                    break;
+            }
+            theRecvTime += OS::Microseconds() - theStartTime;
+            theNumPackets += theNumInBurst;
+            
+            if (theNumInBurst != kBurstSize)
+                theResult = false; // lost some on the loopback
+        }
+        
+        qtss_printf("UDPSocket: %2lu per call: %lu packets, %.0f packets/s, %.3f calls/packet\n",
+                    kBatchSizes[y], theNumPackets, (Float64)theNumPackets * 1000000 / (Float64)(theRecvTime ? theRecvTime : 1),
+                    (Float64)theNumCalls / (Float64)(theNumPackets ? theNumPackets : 1));
+    }
+    
+    for (UInt32 x = 0; x < kMaxRecvPackets; x++)
+        delete [] theRecvBuffers[x];
+    
+    //
+    // The reflector's fan out: the same packets to 1,000 viewers, shared and
+    // then copied per viewer. A run to one viewer first pays for whatever the
+    // first run would otherwise count (the receive path, stdio). The no-copy
+    // run goes before the copying one so it can't reuse pages that one made
+    // resident.
+    enum
+    {
+        kNumViewers = 1000,
+        kNumReflectedPackets = 200
+    };
+    char* thePackets[kNumReflectedPackets];
+    for (UInt32 x = 0; x < kNumReflectedPackets; x++)
+    {
+        thePackets[x] = NEW char[kPacketSize];
+        ::memset(thePackets[x], (int)x, kPacketSize);
+    }
+    if (theResult)
+        theResult = TestFanOut(true, thePackets, 1, kPacketSize, 1);
+    if (theResult)
+        theResult = TestFanOut(true, thePackets, kNumReflectedPackets, kPacketSize, kNumViewers);
+    if (theResult)
+        theResult = TestFanOut(false, thePackets, kNumReflectedPackets, kPacketSize, kNumViewers);
+    for (UInt32 x = 0; x < kNumReflectedPackets; x++)
+        delete [] thePackets[x];
+    
+    return theResult;
+}
+
+#endif
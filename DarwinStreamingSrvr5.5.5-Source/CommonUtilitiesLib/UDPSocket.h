@@ -43,6 +43,9 @@
 
 #include "Socket.h"
 #include "UDPDemuxer.h"
+#include "OSMutex.h"
+
+#define _UDPSOCKET_TESTING_ 0
 
 
 class   UDPSocket : public Socket
@@ -57,7 +60,7 @@ class   UDPSocket : public Socket
         };
     
         UDPSocket(Task* inTask, UInt32 inSocketType);
-        virtual ~UDPSocket() { if (fDemuxer != NULL) delete fDemuxer; }
+        virtual ~UDPSocket();
 
         //Open
         OS_Error    Open() { return Socket::Open(SOCK_DGRAM); }
@@ -79,15 +82,80 @@ class   UDPSocket : public Socket
                                         UInt32 inBufLen, 
                                         UInt32* outRecvLen);
         
+        //Bulk receive. Reads up to inNumBuffers datagrams waiting on the socket, one into
+        //each of ioBuffers (each inBufLen bytes long), with a single recvmmsg where
+        //MMSG_SYSCALLS is set (otherwise this is just RecvFrom). The source address, port
+        //and length of each datagram go in the matching entry of the out arrays.
+        //*outNumPackets is 0 if there was nothing to read.
+        enum
+        {
+            kMaxRecvPackets = 32 //UInt32. Most buffers RecvMultipleFrom will fill at once
+        };
+        OS_Error        RecvMultipleFrom(UInt32* outRemoteAddrs,
+                                        UInt16* outRemotePorts,
+                                        void** ioBuffers,
+                                        UInt32 inBufLen,
+                                        UInt32* outRecvLens,
+                                        UInt32 inNumBuffers,
+                                        UInt32* outNumPackets);
+        
+        //Batched sending. QueueTo copies the packet onto this socket's send queue, and
+        //FlushQueue sends everything queued in as few system calls as possible (sendmmsg
+        //where MMSG_SYSCALLS is set, otherwise QueueTo just calls SendTo). The queue is
+        //also flushed whenever it fills up. Both may be called from any thread.
+        OS_Error        QueueTo(UInt32 inRemoteAddr, 
+                                    UInt16 inRemotePort,
+                                    void* inBuffer, 
+                                    UInt32 inLength);
+        OS_Error        FlushQueue();
+        
+        //Same as QueueTo, but gathers the datagram from an iovec (for instance a
+        //header followed by a payload shared with other sockets) and doesn't copy it.
+        //The buffers must stay unchanged until the next FlushQueue.
+        enum
+        {
+            kMaxQueuedIOVecs = 2 //UInt32
+        };
+        OS_Error        QueueVTo(UInt32 inRemoteAddr,
+                                    UInt16 inRemotePort,
+                                    const struct iovec* inVec,
+                                    UInt32 inNumVecs);
+        
+        //Totals for all UDP sockets: datagrams sent by FlushQueue, and the number of
+        //system calls that took. These wrap around.
+        static UInt32   GetNumBatchedPackets()  { return sNumBatchedPackets; }
+        static UInt32   GetNumBatchedSends()    { return sNumBatchedSends; }
+        
         //A UDP socket may or may not have a demuxer associated with it. The demuxer
         //is a data structure so the socket can associate incoming data with the proper
         //task to process that data (based on source IP addr & port)
         UDPDemuxer*         GetDemuxer()    { return fDemuxer; }
         
+#if _UDPSOCKET_TESTING_
+        //
+        // Sends bursts of datagrams to a socket on the loopback and drains them
+        // with RecvFrom and with RecvMultipleFrom, printing packets per second
+        // and system calls per packet for each. Then fans packets out to 1,000
+        // viewers with QueueTo and with QueueVTo, printing the bytes copied and
+        // how much the resident size grew for each.
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
+
     private:
     
         UDPDemuxer* fDemuxer;
         struct sockaddr_in  fMsgAddr;
+        
+        struct SendQueue;
+        OS_Error    FlushQueueLocked();
+        
+        SendQueue*  fSendQueue; // allocated by the first QueueTo
+        OSMutex     fSendQueueMutex;
+        
+        static unsigned int sNumBatchedPackets;
+        static unsigned int sNumBatchedSends;
+
 };
 #endif // __UDPSOCKET_H__
 
@@ -128,6 +128,7 @@ UDPSocketPair*  UDPSocketPool::CreateUDPSocketPair(UInt32 inAddr, UInt16 inPort)
 
             if (theErr == OS_NoErr)
             {   //qtss_printf("fSocketB->Bind ok on port%u\n", socketBPort);
+                this->ActivateUDPSocketPair(theElem);
                 foundPair = true;
                 fUDPQueue.EnQueue(&theElem->fElem);
                 theElem->fRefCount++;
@@ -77,6 +77,9 @@ class UDPSocketPool
         virtual void            DestructUDPSocketPair(UDPSocketPair* inPair) = 0;
         
         virtual void            SetUDPSocketOptions(UDPSocketPair* /*inPair*/) {}
+        
+        //Called once both sockets of a new pair are bound, before anyone else gets it
+        virtual void            ActivateUDPSocketPair(UDPSocketPair* /*inPair*/) {}
     
     private:
     
@@ -26,14 +26,29 @@
 #include "atomic.h"
 #include "OSMutex.h"
 
+//
+// Use the compiler's atomic builtins where it has them; elsewhere, every one
+// of these takes the same mutex.
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+#define USE_ATOMIC_BUILTINS 1
+#else
+#define USE_ATOMIC_BUILTINS 0
+#endif
+
+#if !USE_ATOMIC_BUILTINS
 static OSMutex sAtomicMutex;
+#endif
 
 
 unsigned int atomic_add(unsigned int *area, int val)
 {
+#if USE_ATOMIC_BUILTINS
+    return __sync_add_and_fetch(area, (unsigned int)val);
+#else
     OSMutexLocker locker(&sAtomicMutex);
     *area += val;
     return *area;
+#endif
 }
 
 unsigned int atomic_sub(unsigned int *area,int val)
@@ -43,12 +58,16 @@ unsigned int atomic_sub(unsigned int *area,int val)
 
 unsigned int atomic_or(unsigned int *area, unsigned int val)
 {
+#if USE_ATOMIC_BUILTINS
+    return __sync_fetch_and_or(area, val);
+#else
     unsigned int oldval;
 
     OSMutexLocker locker(&sAtomicMutex);
     oldval=*area;
     *area = oldval | val;
     return oldval;
+#endif
 }
 /************************************
 *
@@ -57,6 +76,9 @@ unsigned int atomic_or(unsigned int *area, unsigned int val)
 ************************************/
 unsigned int compare_and_store(unsigned int oval, unsigned int nval, unsigned int *area)
 {
+#if USE_ATOMIC_BUILTINS
+    return __sync_bool_compare_and_swap(area, oval, nval) ? 1 : 0;
+#else
    	int rv;
     OSMutexLocker locker(&sAtomicMutex);
 	
@@ -68,4 +90,5 @@ unsigned int compare_and_store(unsigned int oval, unsigned int nval, unsigned in
 	}
 	
     return rv;
+#endif
 }
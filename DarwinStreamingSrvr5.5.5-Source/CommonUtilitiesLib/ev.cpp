@@ -26,6 +26,8 @@
     File:       ev.cpp
 
     Contains:   POSIX select implementation of MacOS X event queue functions.
+                On Linux (EPOLLEVENTQUEUE) the same functions are backed by epoll,
+                falling back to select if epoll is not available at runtime.
 
 
     
@@ -55,6 +57,10 @@
 #include "OSThread.h"
 #include "OSMutex.h"
 
+#if EPOLLEVENTQUEUE
+    #include <sys/epoll.h>
+#endif
+
 static fd_set   sReadSet;
 static fd_set   sWriteSet;
 static fd_set   sReturnedReadSet;
@@ -104,9 +110,196 @@ static OSMutex sMaxFDPosMutex;
 static bool selecthasdata();
 static int constructeventreq(struct eventreq* req, int fd, int event);
 
+#if EPOLLEVENTQUEUE
+
+//
+// epoll implementation of the event queue.
+//
+// The semantics of the select shim are kept: an fd only generates one event
+// per modwatch call, which is exactly what EPOLLONESHOT gives us. The cookie
+// travels in the epoll_event itself, so there is no cookie array, no FD_SETSIZE
+// limit, and each wakeup costs O(ready fds) instead of O(max fd).
+//
+// There is no need for the wakeup pipe either: epoll_ctl takes effect
+// immediately, even while another thread is blocked in epoll_wait.
+//
+// Each eventqueue is only ever waited on by one EventThread, so the returned
+// event array needs no locking.
+
+enum
+{
+    kMaxEpollEventsPerWait = 1024   //UInt32
+};
+
+struct eventqueue
+{
+    int                 eq_epollfd;
+    struct epoll_event* eq_events;
+    int                 eq_numevents;
+    int                 eq_currentevent;
+};
+
+static struct eventqueue* sDefaultQueue = NULL;
+
+#if EPOLL_EDGE_TRIGGERED
+static const UInt32 kEpollTriggerFlags = EPOLLONESHOT | EPOLLET;
+#else
+static const UInt32 kEpollTriggerFlags = EPOLLONESHOT;
+#endif
+
+static struct eventqueue* epoll_newqueue()
+{
+    // The size argument is only a hint (and ignored by recent kernels), but must be > 0
+    int theEpollFD = ::epoll_create(kMaxEpollEventsPerWait);
+    if (theEpollFD == -1)
+        return NULL; // ENOSYS on very old kernels. Use select instead.
+        
+    struct eventqueue* theQueue = new struct eventqueue;
+    theQueue->eq_epollfd = theEpollFD;
+    theQueue->eq_events = new struct epoll_event[kMaxEpollEventsPerWait];
+    ::memset(theQueue->eq_events, 0, sizeof(struct epoll_event) * kMaxEpollEventsPerWait);
+    theQueue->eq_numevents = 0;
+    theQueue->eq_currentevent = 0;
+    return theQueue;
+}
+
+static int epoll_modwatch(struct eventqueue* inQueue, struct eventreq *req, int which, int inOperation)
+{
+    Assert(req->er_data != NULL);
+    
+    struct epoll_event theEvent;
+    ::memset(&theEvent, 0, sizeof(theEvent));
+    theEvent.events = kEpollTriggerFlags;
+    if (which & EV_RE)
+        theEvent.events |= EPOLLIN;
+    if (which & EV_WR)
+        theEvent.events |= EPOLLOUT;
+    theEvent.data.ptr = req->er_data;
+
+    int theErr = ::epoll_ctl(inQueue->eq_epollfd, inOperation, req->er_handle, &theEvent);
+    if (theErr == -1)
+    {
+        // The fd may have been added or removed behind our back (for instance
+        // a context that was snarfed by another one). Retry with the other operation.
+        int theErrno = OSThread::GetErrno();
+        if ((inOperation == EPOLL_CTL_ADD) && (theErrno == EEXIST))
+            theErr = ::epoll_ctl(inQueue->eq_epollfd, EPOLL_CTL_MOD, req->er_handle, &theEvent);
+        else if ((inOperation == EPOLL_CTL_MOD) && (theErrno == ENOENT))
+            theErr = ::epoll_ctl(inQueue->eq_epollfd, EPOLL_CTL_ADD, req->er_handle, &theEvent);
+    }
+    return theErr;
+}
+
+static int epoll_removeevent(struct eventqueue* inQueue, int which)
+{
+    // Unlike select, the descriptor can be closed right away once it has been
+    // removed from the epoll set. Events that were already returned by epoll_wait
+    // carry the unique ID of the context, which won't resolve anymore.
+    struct epoll_event theEvent; // Linux < 2.6.9 requires a non-NULL event for EPOLL_CTL_DEL
+    ::memset(&theEvent, 0, sizeof(theEvent));
+    (void)::epoll_ctl(inQueue->eq_epollfd, EPOLL_CTL_DEL, which, &theEvent);
+    (void)::close(which);
+    return 0;
+}
+
+static int epoll_waitevent(struct eventqueue* inQueue, struct eventreq *req)
+{
+    if (inQueue->eq_currentevent < inQueue->eq_numevents)
+    {
+        struct epoll_event* theEvent = &inQueue->eq_events[inQueue->eq_currentevent++];
+        
+        int theEventBits = 0;
+        if (theEvent->events & EPOLLIN)
+            theEventBits |= EV_RE;
+        if (theEvent->events & EPOLLOUT)
+            theEventBits |= EV_WR;
+        // select reports errors and hangups as readability, so the task finds out on its next read
+        if ((theEventBits == 0) && (theEvent->events & (EPOLLERR | EPOLLHUP)))
+            theEventBits = EV_RE;
+        
+        req->er_handle = -1; // not known without a lookup, and the cookie is all the caller uses
+        req->er_eventbits = theEventBits;
+        req->er_data = theEvent->data.ptr;
+        return 0;
+    }
+    
+    // We've just cycled through one epoll_wait result.
+    inQueue->eq_numevents = 0;
+    inQueue->eq_currentevent = 0;
+
+#if THREADING_IS_COOPERATIVE
+    int theTimeoutInMsec = 5;
+#else
+    int theTimeoutInMsec = 15 * 1000; //Periodically time out just in case we are deaf for some reason
+#endif
+
+    OSThread::ThreadYield();
+    int theNumEvents = ::epoll_wait(inQueue->eq_epollfd, inQueue->eq_events, kMaxEpollEventsPerWait, theTimeoutInMsec);
+    if (theNumEvents > 0)
+        inQueue->eq_numevents = theNumEvents;
+    else if ((theNumEvents < 0) && (OSThread::GetErrno() != EINTR))
+        return theNumEvents;
+        
+    return EINTR;   //either we've timed out or gotten some events. Either way, force caller
+                    //to call waitevent again.
+}
+
+#endif //EPOLLEVENTQUEUE
+
+struct eventqueue* select_newqueue()
+{
+#if EPOLLEVENTQUEUE
+    // If the process-wide queue fell back to select, so do we: there is only one select queue.
+    if (sDefaultQueue != NULL)
+        return epoll_newqueue();
+#endif
+    return NULL;
+}
+
+int select_queue_watchevent(struct eventqueue* inQueue, struct eventreq *req, int which)
+{
+#if EPOLLEVENTQUEUE
+    if (inQueue != NULL)
+        return epoll_modwatch(inQueue, req, which, EPOLL_CTL_ADD);
+#endif
+    return select_watchevent(req, which);
+}
+
+int select_queue_modwatch(struct eventqueue* inQueue, struct eventreq *req, int which)
+{
+#if EPOLLEVENTQUEUE
+    if (inQueue != NULL)
+        return epoll_modwatch(inQueue, req, which, EPOLL_CTL_MOD);
+#endif
+    return select_modwatch(req, which);
+}
+
+int select_queue_waitevent(struct eventqueue* inQueue, struct eventreq *req)
+{
+#if EPOLLEVENTQUEUE
+    if (inQueue != NULL)
+        return epoll_waitevent(inQueue, req);
+#endif
+    return select_waitevent(req, NULL);
+}
+
+int select_queue_removeevent(struct eventqueue* inQueue, int which)
+{
+#if EPOLLEVENTQUEUE
+    if (inQueue != NULL)
+        return epoll_removeevent(inQueue, which);
+#endif
+    return select_removeevent(which);
+}
 
 void select_startevents()
 {	
+#if EPOLLEVENTQUEUE
+    sDefaultQueue = epoll_newqueue();
+    if (sDefaultQueue != NULL)
+        return;
+#endif
+
 	/******************************************
 	*
 	* 清空文件描述符集合
@@ -153,6 +346,10 @@ void select_startevents()
 
 int select_removeevent(int which)
 {
+#if EPOLLEVENTQUEUE
+    if (sDefaultQueue != NULL)
+        return epoll_removeevent(sDefaultQueue, which);
+#endif
 
     {
         //Manipulating sMaxFDPos is not pre-emptive safe, so we have to wrap it in a mutex
@@ -200,11 +397,20 @@ int select_removeevent(int which)
 
 int select_watchevent(struct eventreq *req, int which)
 {
+#if EPOLLEVENTQUEUE
+    if (sDefaultQueue != NULL)
+        return epoll_modwatch(sDefaultQueue, req, which, EPOLL_CTL_ADD);
+#endif
     return select_modwatch(req, which);
 }
 
 int select_modwatch(struct eventreq *req, int which)
 {
+#if EPOLLEVENTQUEUE
+    if (sDefaultQueue != NULL)
+        return epoll_modwatch(sDefaultQueue, req, which, EPOLL_CTL_MOD);
+#endif
+
     {
         //Manipulating sMaxFDPos is not pre-emptive safe, so we have to wrap it in a mutex
         //I believe this is the only variable that is not preemptive safe....
@@ -309,6 +515,12 @@ int constructeventreq(struct eventreq* req, int fd, int event)
 
 int select_waitevent(struct eventreq *req, void* /*onlyForMacOSX*/)
 {
+#if EPOLLEVENTQUEUE
+    if (sDefaultQueue != NULL)
+        return epoll_waitevent(sDefaultQueue, req);
+#endif
+
+
     //Check to see if we still have some select descriptors to process
     int theFDsProcessed = (int)sNumFDsProcessed;
     bool isSet = false;
@@ -112,6 +112,23 @@ int select_waitevent(struct eventreq *req, void* onlyForMOSX);
 *************************************************/
 int select_removeevent(int which);
 
+/************************************************
+*
+* Per-thread event queues. With epoll every EventThread
+* can own a queue of its own; a NULL queue is the
+* process-wide queue set up by select_startevents.
+* select_newqueue returns NULL when only the process-wide
+* queue is available (select fallback).
+*
+*************************************************/
+struct eventqueue;
+
+struct eventqueue* select_newqueue();
+int select_queue_watchevent(struct eventqueue* inQueue, struct eventreq *req, int which);
+int select_queue_modwatch(struct eventqueue* inQueue, struct eventreq *req, int which);
+int select_queue_waitevent(struct eventqueue* inQueue, struct eventreq *req);
+int select_queue_removeevent(struct eventqueue* inQueue, int which);
+
 #endif
 
 #endif /* _SYS_EV_H_ */
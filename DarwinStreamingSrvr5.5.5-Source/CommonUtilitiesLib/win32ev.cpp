@@ -177,6 +177,33 @@ int select_waitevent(struct eventreq *req, void* /*onlyForMacOSX*/)
 }
 
 
+//
+// There is only one WSA message window, so there is only one event queue.
+struct eventqueue* select_newqueue()
+{
+    return NULL;
+}
+
+int select_queue_watchevent(struct eventqueue* /*inQueue*/, struct eventreq *req, int which)
+{
+    return select_watchevent(req, which);
+}
+
+int select_queue_modwatch(struct eventqueue* /*inQueue*/, struct eventreq *req, int which)
+{
+    return select_modwatch(req, which);
+}
+
+int select_queue_waitevent(struct eventqueue* /*inQueue*/, struct eventreq *req)
+{
+    return select_waitevent(req, NULL);
+}
+
+int select_queue_removeevent(struct eventqueue* /*inQueue*/, int which)
+{
+    return select_removeevent(which);
+}
+
 LRESULT CALLBACK select_wndproc(HWND /*inWIndow*/, UINT inMsg, WPARAM /*inParam*/, LPARAM /*inOtherParam*/)
 {
     // If we don't return true for this message, window creation will not proceed
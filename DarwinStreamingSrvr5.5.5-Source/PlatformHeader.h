@@ -92,6 +92,9 @@
 
 #define USE_ATOMICLIB 0
 #define MACOSXEVENTQUEUE 0
+#define EPOLLEVENTQUEUE 1 //use epoll() instead of select() for the event queue, select is the fallback
+#define EPOLL_EDGE_TRIGGERED 0 //arm epoll descriptors with EPOLLET in addition to EPOLLONESHOT
+#define MMSG_SYSCALLS 1 //sendmmsg() and recvmmsg() are available for batching UDP datagrams
 #define __PTHREADS__    1
 #define __PTHREADS_MUTEXES__    1
 #define ALLOW_NON_WORD_ALIGN_ACCESS 1
@@ -217,3 +220,12 @@
 #define EXPORT
 
 #endif
+
+#ifndef EPOLLEVENTQUEUE
+#define EPOLLEVENTQUEUE 0
+#endif
+
+#ifndef MMSG_SYSCALLS
+#define MMSG_SYSCALLS 0
+#endif
+
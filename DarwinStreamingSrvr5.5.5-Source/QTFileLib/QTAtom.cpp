@@ -94,17 +94,8 @@ char *QTAtom::MemMap(UInt64 Offset, UInt32 Length)
         return NULL;
 
     //
-    // Read and return this data.
-    return fFile->MapFileToMem(fTOCEntry.AtomDataPos + Offset, Length);
-}
-
-
-Bool16 QTAtom::UnMap(char *memPtr, UInt32 Length)
-{
-    if (-1 == fFile->UnmapMem(memPtr, Length))
-        return false;
-        
-     return true;
+    // Return the data in place.
+    return fFile->GetMappedData(fTOCEntry.AtomDataPos + Offset, Length);
 }
 
 
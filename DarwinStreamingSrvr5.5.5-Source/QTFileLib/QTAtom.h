@@ -32,6 +32,10 @@
 
 //
 // Includes
+#include <string.h>
+#ifndef __Win32__
+#include <netinet/in.h>
+#endif
 #include "OSHeaders.h"
 
 #include "QTFile.h"
@@ -65,6 +69,14 @@ public:
     #endif
     }
 
+    //
+    // Table entries are left in network byte order, and needn't be aligned
+    // when the table is used in place from the mapped file.
+    static UInt32   TableInt32(const char * Table, UInt32 Index)
+                        { UInt32 tempDatum; ::memcpy(&tempDatum, Table + (Index * 4), 4); return ntohl(tempDatum); }
+    static UInt64   TableInt64(const char * Table, UInt32 Index)
+                        { SInt64 tempDatum; ::memcpy(&tempDatum, Table + (Index * 8), 8); return (UInt64)NTOH64(tempDatum); }
+
     //
     // Read functions.
             Bool16      ReadBytes(UInt64 Offset, char * Buffer, UInt32 Length);
@@ -81,8 +93,11 @@ public:
             Bool16      ReadSubAtomInt32(const char * AtomPath, UInt32 * Datum);
             Bool16      ReadSubAtomInt64(const char * AtomPath, UInt64 * Datum);
             
+    //
+    // Returns a pointer to this atom's data in the file's mapped 'moov' atom,
+    // or NULL if it isn't mapped. The data is in network byte order, and stays
+    // valid as long as the QTFile does.
             char*       MemMap(UInt64 Offset, UInt32 Length);
-            Bool16      UnMap(char *memPtr, UInt32 Length);
     //
     // Debugging functions.
     virtual void        DumpAtom(void) {}
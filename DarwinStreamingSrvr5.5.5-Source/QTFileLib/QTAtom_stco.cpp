@@ -99,17 +99,17 @@ Bool16 QTAtom_stco::Initialize(void)
         return false;
 
     //
-    // Read in the chunk offset table.
+    // Use the chunk offset table in place if it is mapped, otherwise read it in.
+    fTable = this->MemMap(stcoPos_SampleTable, fNumEntries * fOffSetSize);
+    if( fTable != NULL )
+        return true;
+    
     fChunkOffsetTable = NEW char[(fNumEntries * fOffSetSize) + 1];
     if( fChunkOffsetTable == NULL )
         return false;
     
-    if( ((PointerSizedInt)fChunkOffsetTable & (PointerSizedInt)0x3) == 0)
-        fTable = (void *)fChunkOffsetTable;
-    else
-        fTable = (void *)(((PointerSizedInt)fChunkOffsetTable + 4) & ~((PointerSizedInt)0x3));
-        
-    ReadBytes(stcoPos_SampleTable, (char *)fTable, fNumEntries * fOffSetSize);
+    fTable = fChunkOffsetTable;
+    ReadBytes(stcoPos_SampleTable, fTable, fNumEntries * fOffSetSize);
 
     //
     // This atom has been successfully read in.
@@ -63,9 +63,9 @@ public:
                             if (Offset && ChunkNumber && (ChunkNumber<=fNumEntries)) 
                             {
                                 if (4 == fOffSetSize)
-                                    *Offset = (UInt64) ntohl( ( (UInt32 *) fTable)[ChunkNumber-1]);
+                                    *Offset = (UInt64) QTAtom::TableInt32(fTable, ChunkNumber-1);
                                 else
-                                    *Offset = (UInt64) QTAtom::NTOH64( ( (UInt64 *) fTable)[ChunkNumber-1]);
+                                    *Offset = QTAtom::TableInt64(fTable, ChunkNumber-1);
                                         
                                 return true;
                             } 
@@ -89,7 +89,7 @@ protected:
     UInt32      fNumEntries;
     UInt16      fOffSetSize;
     char        *fChunkOffsetTable;
-    void        *fTable; // longword-aligned version of the above
+    char        *fTable; // the mapped table, or the above
 };
 
 #endif // QTAtom_stco_H
@@ -127,7 +127,7 @@ void QTAtom_stsc_SampleTableControlBlock::Reset(void)
 //
 QTAtom_stsc::QTAtom_stsc(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fSampleToChunkTable(NULL), fTableSize(0)
+      fNumEntries(0), fSampleToChunkTable(NULL), fTableIsMapped(false)
 {
 }
 
@@ -135,14 +135,8 @@ QTAtom_stsc::~QTAtom_stsc(void)
 {
     //
     // Free our variables.
-#if __MacOSX__
-    if( fSampleToChunkTable != NULL )
-        this->UnMap(fSampleToChunkTable, fTableSize);
-#else
-    if( fSampleToChunkTable != NULL )
+    if( (fSampleToChunkTable != NULL) && !fTableIsMapped )
         delete[] fSampleToChunkTable;
-#endif
-
 }
 
 
@@ -169,18 +163,18 @@ Bool16 QTAtom_stsc::Initialize(void)
         return false;
 
     //
-    // Read in the sample-to-chunk table.
-#if __MacOSX__
-    fTableSize = fNumEntries * 12;
-    fSampleToChunkTable = this->MemMap(stscPos_SampleTable, fTableSize);
-    if( fSampleToChunkTable == NULL )
-        return false;
-#else
+    // Use the sample-to-chunk table in place if it is mapped, otherwise
+    // read it in.
+    fSampleToChunkTable = this->MemMap(stscPos_SampleTable, fNumEntries * 12);
+    if( fSampleToChunkTable != NULL ) {
+        fTableIsMapped = true;
+        return true;
+    }
+    
     fSampleToChunkTable = NEW char[fNumEntries * 12];
     if( fSampleToChunkTable == NULL )
         return false;
     ReadBytes(stscPos_SampleTable, fSampleToChunkTable, fNumEntries * 12);
-#endif
     
     //
     // This atom has been successfully read in.
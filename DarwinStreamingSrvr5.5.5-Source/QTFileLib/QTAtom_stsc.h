@@ -144,7 +144,7 @@ protected:
 
     UInt32      fNumEntries;
     char        *fSampleToChunkTable;
-    UInt32      fTableSize;
+    Bool16      fTableIsMapped;
 };
 
 #endif // QTAtom_stsc_H
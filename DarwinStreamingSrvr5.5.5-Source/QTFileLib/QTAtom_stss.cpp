@@ -68,7 +68,7 @@ const int       stssPos_SampleTable         =  8;
 //
 QTAtom_stss::QTAtom_stss(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fSyncSampleTable(NULL), fTable(NULL), fTableSize(0)
+      fNumEntries(0), fSyncSampleTable(NULL), fTable(NULL)
 {
 }
 
@@ -76,13 +76,8 @@ QTAtom_stss::~QTAtom_stss(void)
 {
     //
     // Free our variables.
-#if __MacOSX__
-    if( fSyncSampleTable != NULL )
-        this->UnMap(fSyncSampleTable, fTableSize);
-#else
     if( fSyncSampleTable != NULL )
         delete[] fSyncSampleTable;
-#endif
 }
 
 
@@ -111,50 +106,20 @@ Bool16 QTAtom_stss::Initialize(void)
         if( (unsigned long)(fNumEntries * 4) != (fTOCEntry.AtomDataLength - 8) )
             return false;
 
-        
-#if 0 //__MacOSX__ MMAP_TABLES needs fixing. It should be page aligned and maybe on a 64bit system the whole file should be mapped.
-    fTableSize = (fNumEntries * 4);
-    fSyncSampleTable = this->MemMap(stssPos_SampleTable, fTableSize);
-    fTable = (UInt32 *) fSyncSampleTable;
-    if (fSyncSampleTable == NULL)
-        return false;
- 
-#else
         //
-        // Read in the sync sample table.
+        // Use the sync sample table in place if it is mapped, otherwise read it
+        // in. Either way the sample numbers stay in network byte order and are
+        // flipped as they are looked at.
+        fTable = this->MemMap(stssPos_SampleTable, fNumEntries * 4);
+        if( fTable != NULL )
+            return true;
+        
         fSyncSampleTable = NEW char[(fNumEntries * 4) + 1];
         if( fSyncSampleTable == NULL )
             return false;
         
-        if( ((PointerSizedInt)fSyncSampleTable & (PointerSizedInt)0x3) == 0)
-            fTable = (UInt32 *)fSyncSampleTable;
-        else
-            fTable = (UInt32 *)(((PointerSizedInt)fSyncSampleTable + 4) & ~((PointerSizedInt)0x3));
-        
-        initSucceeds = ReadBytes(stssPos_SampleTable, (char *)fTable, fNumEntries * 4);
-
-#endif        
-        if ( initSucceeds )
-        {
-            // This atom has been successfully read in.
-            // sample offsets are in network byte order on disk, convert them to host order
-            UInt32      sampleIndex = 0;
-            
-            // convert each sample to host order
-            // NOTE - most other Atoms handle byte order conversions in
-            // the accessor function.  For efficiency reasons it's converted
-            // to host order here for sync samples.
-            
-            for ( sampleIndex = 0; sampleIndex < fNumEntries; sampleIndex++ )
-            {
-                fTable[sampleIndex] = ntohl( fTable[sampleIndex] );
-            
-            }
-        
-        }
-
-
-
+        fTable = fSyncSampleTable;
+        initSucceeds = ReadBytes(stssPos_SampleTable, fTable, fNumEntries * 4);
     }
     
     return initSucceeds;
@@ -177,8 +142,8 @@ void QTAtom_stss::PreviousSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumb
     for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
         //
         // Take this entry if it is before (or equal to) our current entry.
-        if( fTable[CurEntry] <= SampleNumber )
-            *SyncSampleNumber = fTable[CurEntry];
+        if( QTAtom::TableInt32(fTable, CurEntry) <= SampleNumber )
+            *SyncSampleNumber = QTAtom::TableInt32(fTable, CurEntry);
     }
 }
 
@@ -194,8 +159,8 @@ void QTAtom_stss::NextSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumber)
     for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
         //
         // Take this entry if it is greater than our current entry.
-        if( fTable[CurEntry] > SampleNumber ) {
-            *SyncSampleNumber = fTable[CurEntry];
+        if( QTAtom::TableInt32(fTable, CurEntry) > SampleNumber ) {
+            *SyncSampleNumber = QTAtom::TableInt32(fTable, CurEntry);
             break;
         }
     }
@@ -225,6 +190,6 @@ void QTAtom_stss::DumpTable(void)
     for( UInt32 CurEntry = 1; CurEntry <= fNumEntries; CurEntry++ ) {
         //
         // Print out a listing.
-        qtss_printf("  %10lu : %10lu\n", CurEntry, fTable[CurEntry-1]);
+        qtss_printf("  %10lu : %10lu\n", CurEntry, QTAtom::TableInt32(fTable, CurEntry-1));
     }
 }
@@ -58,14 +58,17 @@ public:
     // Accessors.
             void        PreviousSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumber);
             void        NextSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumber);
+    inline  UInt32      GetNumEntries() { return fNumEntries; }
+    inline  UInt32      GetSyncSample(UInt32 Entry) { return QTAtom::TableInt32(fTable, Entry); }
             inline Bool16       IsSyncSample(UInt32 SampleNumber, UInt32 inCursor)
             {
                 Assert(inCursor <= fNumEntries);
                 for (UInt32 curEntry = inCursor; curEntry < fNumEntries; curEntry++)
                 {
-                    if (fTable[curEntry] == SampleNumber)
+                    UInt32 syncSample = QTAtom::TableInt32(fTable, curEntry);
+                    if (syncSample == SampleNumber)
                         return true;
-                    else if (fTable[curEntry] > SampleNumber)
+                    else if (syncSample > SampleNumber)
                         return false;
                 }
                 return false;
@@ -86,8 +89,7 @@ protected:
 
     UInt32      fNumEntries;
     char        *fSyncSampleTable;
-    UInt32      *fTable; // longword-aligned version of the above
-    UInt32      fTableSize;
+    char        *fTable; // the mapped table, or the above
 };
 
 #endif // QTAtom_stss_H
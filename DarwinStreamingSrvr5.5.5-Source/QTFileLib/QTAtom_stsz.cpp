@@ -100,6 +100,7 @@ Bool16 QTAtom_stsz::Initialize(void)
     fFlags = tempInt32 & 0x00ffffff;
 
     ReadInt32(stszPos_SampleSize, &fCommonSampleSize);
+    ReadInt32(stszPos_NumEntries, &fNumEntries);
     
     //
     // We don't need to read in the table (it doesn't exist anyway) if the
@@ -110,25 +111,22 @@ Bool16 QTAtom_stsz::Initialize(void)
 
     //
     // Build the table..
-    ReadInt32(stszPos_NumEntries, &fNumEntries);
-
-    //
     // Validate the size of the sample table.
     if( (unsigned long)(fNumEntries * 4) != (fTOCEntry.AtomDataLength - 12) )
         return false;
 
     //
-    // Read in the sample size table.
+    // Use the sample size table in place if it is mapped, otherwise read it in.
+    fTable = this->MemMap(stszPos_SampleTable, fNumEntries * 4);
+    if( fTable != NULL )
+        return true;
+    
     fSampleSizeTable = NEW char[(fNumEntries * 4) + 1];
     if( fSampleSizeTable == NULL )
         return false;
     
-    if( ((PointerSizedInt)fSampleSizeTable & (PointerSizedInt)0x3) == 0)
-        fTable = (UInt32 *)fSampleSizeTable;
-    else
-        fTable = (UInt32 *)(((PointerSizedInt)fSampleSizeTable + 4) & ~((PointerSizedInt)0x3));
-    
-    ReadBytes(stszPos_SampleTable, (char *)fTable, fNumEntries * 4);
+    fTable = fSampleSizeTable;
+    ReadBytes(stszPos_SampleTable, fTable, fNumEntries * 4);
 
     //
     // This atom has been successfully read in.
@@ -164,7 +162,7 @@ Bool16 QTAtom_stsz::SampleRangeSize(UInt32 firstSampleNumber, UInt32 lastSampleN
             {   *sizePtr = 0;
                 
                 for (UInt32 sampleNumber = firstSampleNumber; sampleNumber <= lastSampleNumber; sampleNumber++ ) 
-                    *sizePtr += ntohl(fTable[sampleNumber-1]);
+                    *sizePtr += QTAtom::TableInt32(fTable, sampleNumber-1);
                 
             }
             result =  true; 
@@ -200,6 +198,6 @@ void QTAtom_stsz::DumpTable(void)
     for( UInt32 CurEntry = 1; CurEntry <= fNumEntries; CurEntry++ ) {
         //
         // Print out a listing.
-        qtss_printf("  %10lu : %10lu\n", CurEntry, fTable[CurEntry-1]);
+        qtss_printf("  %10lu : %10lu\n", CurEntry, fCommonSampleSize ? fCommonSampleSize : QTAtom::TableInt32(fTable, CurEntry-1));
     }
 }
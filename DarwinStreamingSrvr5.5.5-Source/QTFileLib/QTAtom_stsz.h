@@ -62,7 +62,7 @@ public:
                                     return true; \
                                 } else if(SampleNumber && (SampleNumber<=fNumEntries)) { \
                                     if( Size != NULL ) \
-                                        *Size = ntohl(fTable[SampleNumber-1]); \
+                                        *Size = QTAtom::TableInt32(fTable, SampleNumber-1); \
                                     return true; \
                                 } else \
                                     return false; \
@@ -86,7 +86,7 @@ protected:
     UInt32      fCommonSampleSize;
     UInt32      fNumEntries;
     char        *fSampleSizeTable;
-    UInt32      *fTable; // longword-aligned version of the above
+    char        *fTable; // the mapped table, or the above
 };
 
 #endif // QTAtom_stsz_H
@@ -98,7 +98,7 @@ void QTAtom_stts_SampleTableControlBlock::Reset(void)
 //
 QTAtom_stts::QTAtom_stts(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fTimeToSampleTable(NULL), fTableSize(0)
+      fNumEntries(0), fTimeToSampleTable(NULL), fTableIsMapped(false)
 {
 }
 
@@ -106,15 +106,8 @@ QTAtom_stts::~QTAtom_stts(void)
 {
     //
     // Free our variables.
-#if __MacOSX__
-    if( fTimeToSampleTable != NULL )
-        this->UnMap(fTimeToSampleTable, fTableSize);
-#else
-    if( fTimeToSampleTable != NULL )
+    if( (fTimeToSampleTable != NULL) && !fTableIsMapped )
         delete[] fTimeToSampleTable;
-#endif
-
-
 }
 
 
@@ -142,20 +135,19 @@ Bool16 QTAtom_stts::Initialize(void)
         return false;
 
     //
-    // Read in the time-to-sample table.
+    // Use the time-to-sample table in place if it is mapped, otherwise
+    // read it in.
+    fTimeToSampleTable = this->MemMap(sttsPos_SampleTable, fNumEntries * 8);
+    if( fTimeToSampleTable != NULL ) {
+        fTableIsMapped = true;
+        return true;
+    }
 
-#if __MacOSX__
-    fTableSize = (fNumEntries * 8);
-    fTimeToSampleTable = this->MemMap(sttsPos_SampleTable, fTableSize);
-    if( fTimeToSampleTable == NULL )
-        return false;
-#else
     fTimeToSampleTable = NEW char[fNumEntries * 8];
     if( fTimeToSampleTable == NULL )
         return false;
     
     ReadBytes(sttsPos_SampleTable, fTimeToSampleTable, fNumEntries * 8);
-#endif
 
     //
     // This atom has been successfully read in.
@@ -372,7 +364,7 @@ void QTAtom_ctts_SampleTableControlBlock::Reset(void)
 //
 QTAtom_ctts::QTAtom_ctts(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fTimeToSampleTable(NULL)
+      fNumEntries(0), fTimeToSampleTable(NULL), fTableIsMapped(false)
 {
 }
 
@@ -380,7 +372,7 @@ QTAtom_ctts::~QTAtom_ctts(void)
 {
     //
     // Free our variables.
-    if( fTimeToSampleTable != NULL )
+    if( (fTimeToSampleTable != NULL) && !fTableIsMapped )
         delete[] fTimeToSampleTable;
 }
 
@@ -409,7 +401,14 @@ Bool16 QTAtom_ctts::Initialize(void)
         return false;
 
     //
-    // Read in the time-to-sample table.
+    // Use the composition offset table in place if it is mapped, otherwise
+    // read it in.
+    fTimeToSampleTable = this->MemMap(cttsPos_SampleTable, fNumEntries * 8);
+    if( fTimeToSampleTable != NULL ) {
+        fTableIsMapped = true;
+        return true;
+    }
+
     fTimeToSampleTable = NEW char[fNumEntries * 8];
     if( fTimeToSampleTable == NULL )
         return false;
@@ -519,8 +518,9 @@ Bool16 QTAtom_ctts::SampleNumberToMediaTimeOffset(UInt32 SampleNumber, UInt32 *
         SampleOffset = ntohl(SampleOffset);
 
         //
-        // Can we skip over this entry?
-        if( STCB->fSNtMT_CurSample + SampleCount < SampleNumber ) {
+        // Can we skip over this entry? Unlike a time, an offset belongs to
+        // the samples of its entry only.
+        if( STCB->fSNtMT_CurSample + SampleCount <= SampleNumber ) {
             STCB->fSNtMT_CurMediaTime += SampleCount * SampleOffset;
             STCB->fSNtMT_CurSample += SampleCount;
             continue;
@@ -104,7 +104,7 @@ protected:
 
     UInt32      fNumEntries;
     char        *fTimeToSampleTable;
-    UInt32      fTableSize;
+    Bool16      fTableIsMapped;
     
 };
 
@@ -175,7 +175,7 @@ protected:
 
     UInt32      fNumEntries;
     char        *fTimeToSampleTable;
-    
+    Bool16      fTableIsMapped;
 };
 
 #endif // QTAtom_stts_H
@@ -53,9 +53,14 @@
 
 #include "QTTrack.h"
 #include "QTHintTrack.h"
+#include "QTPacketizerTrack.h"
+#include "QTFragmentIndex.h"
 #include "OSMemory.h"
-#if __MacOSX__
+#ifndef __Win32__
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #if DSS_USE_API_CALLBACKS
@@ -71,6 +76,13 @@
 
 
 
+// -------------------------------------
+// Class state
+//
+Bool16 QTFile::sMapMovieHeaders = false;
+
+
+
 // -------------------------------------
 // Constructors and destructors
 //
@@ -85,8 +97,9 @@ QTFile::QTFile(Bool16 Debug, Bool16 DeepDebug)
     fTOC(NULL), fTOCOrdHead(NULL), fTOCOrdTail(NULL),
     fNumTracks(0),
     fFirstTrack(NULL), fLastTrack(NULL),
-    fMovieHeaderAtom(NULL), 
-    fFile(-1)
+    fMovieHeaderAtom(NULL),
+    fFirstFragmentPos(0), fFragmentIndex(NULL),
+    fMapBase(NULL), fMapPos(0), fMapLength(0)
 {
 }
 
@@ -112,6 +125,8 @@ QTFile::~QTFile(void)
     // Free our variables.
     if( fMovieHeaderAtom != NULL )
         delete fMovieHeaderAtom;
+    if( fFragmentIndex != NULL )
+        delete fFragmentIndex;
     
     //
     // Free our table of contents
@@ -141,8 +156,9 @@ QTFile::~QTFile(void)
 #if DSS_USE_API_CALLBACKS
     (void)QTSS_CloseFileObject(fMovieFD);
 #endif
-#if __MacOSX__
-    ::close(fFile);
+#ifndef __Win32__
+    if( fMapBase != NULL )
+        (void)::munmap(fMapBase, (size_t)fMapLength);
 #endif
 }
 
@@ -174,10 +190,6 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
     fMoviePath = NEW char[strlen(MoviePath) + 1];
     ::strcpy(fMoviePath, MoviePath);
 
-#if __MacOSX__
-    fFile = open(fMoviePath, O_RDONLY);
-#endif
-
 
 #if DSS_USE_API_CALLBACKS
     QTSS_Error theErr = QTSS_OpenFileObject(fMoviePath, qtssOpenFileReadAhead, &fMovieFD);
@@ -240,6 +252,15 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
     // NOTE that the tracks are *not* initialized here.  That is done when they
     // are actually used; either directly or by a QTHintTrack.
     DEBUG_PRINT(("QTFile::Open - Loading tracks.\n"));
+
+    //
+    // A movie without hint tracks has its H.264 and AAC tracks packetized
+    // as it plays, so it can be streamed just the same.
+    Bool16 hasHintTracks = false;
+    TOCEntry = NULL;
+    while( !hasHintTracks && FindTOCEntry("moov:trak", &TOCEntry, TOCEntry) )
+        hasHintTracks = FindTOCEntry(":tref:hint", NULL, TOCEntry);
+
     TOCEntry = NULL;
     while( FindTOCEntry("moov:trak", &TOCEntry, TOCEntry) ) {
         // General vars
@@ -257,6 +278,9 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
         if( FindTOCEntry(":tref:hint", NULL, TOCEntry) ) {
             ListEntry->Track = NEW QTHintTrack(this, TOCEntry, fDebug, fDeepDebug);
             ListEntry->IsHintTrack = true;
+        } else if( !hasHintTracks && QTPacketizerTrack::CanPacketize(this, TOCEntry) ) {
+            ListEntry->Track = NEW QTPacketizerTrack(this, TOCEntry, fDebug, fDeepDebug);
+            ListEntry->IsHintTrack = true;
         } else {
             ListEntry->Track = NEW QTTrack(this, TOCEntry, fDebug, fDeepDebug);
             ListEntry->IsHintTrack = false;
@@ -295,6 +319,17 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
         fNumTracks++;
     }
     
+    //
+    // The samples of a fragmented movie are read in as they are needed.
+    if( fFirstFragmentPos != 0 ) {
+        DEBUG_PRINT(("QTFile::Open - Movie is fragmented.\n"));
+        fFragmentIndex = NEW QTFragmentIndex(this, fFirstFragmentPos);
+        if( fFragmentIndex == NULL )
+            return errInternalError;
+        if( !fFragmentIndex->Initialize() )
+            return errInvalidQuickTimeFile;
+    }
+    
     
     //
     // The file has been successfully opened.
@@ -587,7 +622,23 @@ Float64 QTFile::GetDurationInSeconds(void)
    if (fMovieHeaderAtom == NULL)
         return 0.0;
 
-    return fMovieHeaderAtom->GetDurationInSeconds();
+    //
+    // A fragmented movie's header needn't count the fragments.
+    Float64 theDuration = fMovieHeaderAtom->GetDurationInSeconds();
+    if( (theDuration == 0.0) && (fFragmentIndex != NULL) && (fMovieHeaderAtom->GetTimeScale() > 0.0) )
+        theDuration = (Float64)(SInt64)fFragmentIndex->GetDuration() / fMovieHeaderAtom->GetTimeScale();
+
+    return theDuration;
+}
+
+UInt64 QTFile::GetMovieHeaderSize()
+{
+    AtomTOCEntry *TOCEntry;
+    
+    if( !FindTOCEntry("moov", &TOCEntry) )
+        return 0;
+        
+    return TOCEntry->AtomHeaderSize + TOCEntry->AtomDataLength;
 }
 
 SInt64 QTFile::GetModDate()
@@ -608,9 +659,20 @@ SInt64 QTFile::GetModDate()
 Bool16 QTFile::Read(UInt64 Offset, char * const Buffer, UInt32 Length, QTFile_FileControlBlock * FCB)
 {
     // General vars
-    OSMutexLocker   ReadMutex(fReadMutex);
     Bool16 rv = false;
 
+    //
+    // Atom reads from the 'moov' atom don't need the file at all.
+    if( FCB == NULL ) {
+        char *MappedData = GetMappedData(Offset, Length);
+        if( MappedData != NULL ) {
+            ::memcpy(Buffer, MappedData, Length);
+            return true;
+        }
+    }
+
+    OSMutexLocker   ReadMutex(fReadMutex);
+
     if( FCB )
         rv = FCB->Read(&fMovieFD,Offset,Buffer,Length);
     else
@@ -651,6 +713,7 @@ Bool16 QTFile::GenerateAtomTOC(void)
                     *CurParent = NULL, *LastTOCEntry = NULL;
     Bool16 hasMoovAtom = false;
     Bool16 hasBigAtom = false;
+    Bool16 hasMovieExtendsAtom = false;
 
 
     //
@@ -789,6 +852,11 @@ Bool16 QTFile::GenerateAtomTOC(void)
         else if (AtomType == FOUR_CHARS_TO_INT('m', 'o', 'o', 'v'))
         {
            hasMoovAtom = true;
+           
+           //
+           // Map it before descending into it, so that its children are read
+           // out of memory from here on.
+           MapMovieHeader(CurPos - CurAtomHeaderSize, BigAtomLength);
         }
         else if (!hasMoovAtom)
         {
@@ -835,6 +903,9 @@ Bool16 QTFile::GenerateAtomTOC(void)
             fTOCOrdTail = NewTOCEntry;
         }
 
+        if( (AtomType == FOUR_CHARS_TO_INT('m', 'v', 'e', 'x')) && CurParent && (CurParent->AtomType == FOUR_CHARS_TO_INT('m', 'o', 'o', 'v')) )
+            hasMovieExtendsAtom = true;
+
         //
         // Make this the first child if we have one.
         if( CurParent && (CurParent->FirstChild == NULL) ) {
@@ -860,6 +931,7 @@ Bool16 QTFile::GenerateAtomTOC(void)
             case FOUR_CHARS_TO_INT('u', 'd', 't', 'a'): /* can appear anywhere */ //udta
             case FOUR_CHARS_TO_INT('h', 'n', 't', 'i'): //hnti
             case FOUR_CHARS_TO_INT('h', 'i', 'n', 'f'): //hinf
+            case FOUR_CHARS_TO_INT('m', 'v', 'e', 'x'): //mvex
             {
                 //
                 // All of the above atoms need to be descended into.  Set up
@@ -900,6 +972,15 @@ lbl_SkipAtom:
             LastTOCEntry = CurParent;
             CurParent = CurParent->Parent;
         }
+        
+        //
+        // The rest of a fragmented movie is movie fragments, which could go
+        // on for hours; QTFragmentIndex reads them as they are needed.
+        if( (CurParent == NULL) && hasMovieExtendsAtom ) {
+            DEEP_DEBUG_PRINT(("QTFile::GenerateAtomTOC - Found movie fragments at %"_64BITARG_"u.\n", CurPos));
+            fFirstFragmentPos = CurPos;
+            return true;
+        }
     }
 
 
@@ -914,34 +995,53 @@ lbl_SkipAtom:
 }
 
 
-char *QTFile::MapFileToMem(UInt64 offset, UInt32 length)
+void QTFile::MapMovieHeader(UInt64 Offset, UInt64 Length)
 {
-#if __MacOSX__
-    char*  mappedMem = (char *) mmap( NULL,
-                            (size_t) length,
-                            PROT_READ,
-                            0,
-                            fFile,
-                            (off_t) offset);
-                            
-            if(mappedMem == MAP_FAILED )
-            {  //printf("MAP_FAILED\n");
-               mappedMem = NULL;
+#ifndef __Win32__
+    if( !sMapMovieHeaders || (fMapBase != NULL) )
+        return;
+
+    //
+    // Use our own descriptor for this; the mapping outlives it.
+    int theFile = ::open(fMoviePath, O_RDONLY);
+    if( theFile == -1 )
+        return;
+    
+    //
+    // Touching a mapped page past the end of the file is fatal, so make sure a
+    // bad atom length doesn't get us there.
+    struct stat theStat;
+    if( (::fstat(theFile, &theStat) == 0) && (Offset + Length <= (UInt64)theStat.st_size) ) {
+        UInt64 thePageSize = (UInt64)::sysconf(_SC_PAGESIZE);
+        UInt64 theMapPos = Offset - (Offset % thePageSize);
+        UInt64 theMapLength = Length + (Offset - theMapPos);
+        
+        if( theMapLength == (UInt64)(size_t)theMapLength ) {
+            void *theMem = ::mmap(NULL, (size_t)theMapLength, PROT_READ, MAP_SHARED, theFile, (off_t)theMapPos);
+            if( theMem != MAP_FAILED ) {
+#ifdef MADV_WILLNEED
+                //
+                // All of it is about to be parsed; start reading it in now.
+                (void)::madvise(theMem, (size_t)theMapLength, MADV_WILLNEED);
+#endif
+                fMapBase = (char *)theMem;
+                fMapPos = theMapPos;
+                fMapLength = theMapLength;
+                DEBUG_PRINT(("QTFile::MapMovieHeader - Mapped %"_64BITARG_"u bytes at %"_64BITARG_"u.\n", fMapLength, fMapPos));
             }
-    return mappedMem;
-#else
-    return NULL;
+        }
+    }
+    
+    ::close(theFile);
 #endif
-
 }
 
-int QTFile::UnmapMem(char* memPtr, UInt32 length)
+char *QTFile::GetMappedData(UInt64 Offset, UInt32 Length)
 {
-#if __MacOSX__
-    return munmap( (caddr_t) memPtr, (size_t) length);
-#else
-    return 0;
-#endif
+    if( (fMapBase == NULL) || (Offset < fMapPos) || ((Offset - fMapPos) + Length > fMapLength) )
+        return NULL;
+    
+    return fMapBase + (Offset - fMapPos);
 }
 
 
@@ -44,6 +44,7 @@ class OSMutex;
 
 class QTAtom_mvhd;
 class QTTrack;
+class QTFragmentIndex;
 
 
 //
@@ -130,6 +131,13 @@ public:
             SInt64      GetModDate();
             // Returns the mod date as a RFC 1123 formatted string
             char*       GetModDateStr() { return fModDateBuffer.GetDateBuffer(); }
+            // Size of the 'moov' atom, which is about what the parsed movie
+            // holds on to, whether or not it is mapped
+            UInt64      GetMovieHeaderSize();
+    //
+    // The samples in the movie fragments that follow the 'moov' atom, or
+    // NULL if the movie isn't fragmented.
+    inline  QTFragmentIndex *GetFragmentIndex(void) { return fFragmentIndex; }
     //
     // Read functions.
             Bool16      Read(UInt64 Offset, char * const Buffer, UInt32 Length, QTFile_FileControlBlock * FCB = NULL);
@@ -145,11 +153,19 @@ public:
 #endif
 
     inline Bool16       ValidTOC();
-            
-            
-            char*      MapFileToMem(UInt64 offset, UInt32 length);
-            
-            int         UnmapMem(char *memPtr, UInt32 length);
+
+    //
+    // The 'moov' atom is mapped into memory read-only when the file is opened,
+    // and the atoms in it read their tables straight out of the mapping instead
+    // of copying them. Returns NULL if the data isn't mapped.
+            char*       GetMappedData(UInt64 Offset, UInt32 Length);
+
+    //
+    // Off by default. The mapping shares the file's pages, so a movie that is
+    // truncated or rewritten in place while it is open can take the process
+    // down with SIGBUS. Only turn this on where movies are replaced by renaming
+    // a new file over the old one.
+    static  void        SetMapMovieHeaders(Bool16 inEnabled) { sMapMovieHeaders = inEnabled; }
 
     //
     // Debugging functions.
@@ -159,6 +175,7 @@ protected:
     //
     // Protected member functions.
             Bool16      GenerateAtomTOC(void);
+            void        MapMovieHeader(UInt64 Offset, UInt64 Length);
     
     //
     // Protected member variables.
@@ -183,9 +200,16 @@ protected:
 
     QTAtom_mvhd         *fMovieHeaderAtom;
     
+    UInt64              fFirstFragmentPos;  // where the 'moov' atom ends, if the movie is fragmented
+    QTFragmentIndex     *fFragmentIndex;
+    
     OSMutex             *fReadMutex;
-    int                  fFile;
-                        
+
+    char                *fMapBase;      // page aligned start of the mapped 'moov' atom
+    UInt64              fMapPos;        // file offset of fMapBase
+    UInt64              fMapLength;
+
+    static Bool16       sMapMovieHeaders;
 };
 
 Bool16 QTFile::ValidTOC()
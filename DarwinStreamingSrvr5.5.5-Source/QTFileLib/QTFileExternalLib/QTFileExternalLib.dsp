@@ -201,14 +201,26 @@ SOURCE=..\QTFile_FileControlBlock.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTFragmentIndex.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTHintTrack.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTPacketizerTrack.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTRTPFile.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTRTPFileIndex.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTTrack.h
 # End Source File
 # Begin Source File
@@ -461,6 +473,20 @@ SOURCE=..\QTFile_FileControlBlock.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTFragmentIndex.cpp
+
+!IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
+
+!ELSEIF  "$(CFG)" == "QTFileExternalLib - Win32 Release"
+
+# ADD CPP /O1
+# SUBTRACT CPP /Z<none>
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTHintTrack.cpp
 
 !IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
@@ -475,6 +501,20 @@ SOURCE=..\QTHintTrack.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTPacketizerTrack.cpp
+
+!IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
+
+!ELSEIF  "$(CFG)" == "QTFileExternalLib - Win32 Release"
+
+# ADD CPP /O1
+# SUBTRACT CPP /Z<none>
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTRTPFile.cpp
 
 !IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
@@ -489,6 +529,20 @@ SOURCE=..\QTRTPFile.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\QTRTPFileIndex.cpp
+
+!IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
+
+!ELSEIF  "$(CFG)" == "QTFileExternalLib - Win32 Release"
+
+# ADD CPP /O1
+# SUBTRACT CPP /Z<none>
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=..\QTTrack.cpp
 
 !IF  "$(CFG)" == "QTFileExternalLib - Win32 Debug"
@@ -149,14 +149,26 @@ SOURCE=.\QTFile_FileControlBlock.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\QTFragmentIndex.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\QTHintTrack.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\QTPacketizerTrack.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\QTRTPFile.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\QTRTPFileIndex.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\QTTrack.cpp
 # End Source File
 # Begin Source File
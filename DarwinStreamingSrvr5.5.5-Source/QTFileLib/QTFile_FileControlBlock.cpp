@@ -69,7 +69,7 @@ QTFile_FileControlBlock::QTFile_FileControlBlock(void)
       fCurrentDataBuffer(NULL), fPreviousDataBuffer(NULL),
       fCurrentDataBufferLength(0), fPreviousDataBufferLength(0),
       fNumBlocksPerBuff(1),fNumBuffs(1),
-      fCacheEnabled(false)
+      fCacheEnabled(false), fIsAsync(false), fReadWouldBlock(false)
       
 {
 }
@@ -85,10 +85,14 @@ QTFile_FileControlBlock::~QTFile_FileControlBlock(void)
 }
 
 
-void QTFile_FileControlBlock::Set( char * DataPath)
+void QTFile_FileControlBlock::Set( char * DataPath, Bool16 inAsync)
 {
 #if DSS_USE_API_CALLBACKS
-    (void)QTSS_OpenFileObject(DataPath, qtssOpenFileReadAhead, &fDataFD);
+    QTSS_OpenFileFlags theFlags = qtssOpenFileReadAhead;
+    if (inAsync)
+        theFlags |= qtssOpenFileAsync;
+    (void)QTSS_OpenFileObject(DataPath, theFlags, &fDataFD);
+    fIsAsync = inAsync && this->IsValid();
 #else
     fDataFD.Set(DataPath);
 #endif
@@ -106,7 +110,10 @@ Bool16 QTFile_FileControlBlock::ReadInternal(FILE_SOURCE *dataFD, UInt64 inPosit
         if (theErr == QTSS_NoErr)
             theErr = QTSS_Read(*dataFD, inBuffer, inLength, &readLen);
         if (theErr != QTSS_NoErr)
+        {
+            fReadWouldBlock = (theErr == QTSS_WouldBlock);
             return false;
+        }
 #else
         if( dataFD->Read(inPosition, inBuffer, inLength, &readLen) != OS_NoErr )
             return false;
@@ -131,6 +138,8 @@ Bool16 QTFile_FileControlBlock::Read(FILE_SOURCE *dflt, UInt64 inPosition, void*
 
     // success or failure
     Bool16 result = false;
+    
+    fReadWouldBlock = false;
 
     // Get the file descriptor.  If the FCB is NULL, or the descriptor in
     // the FCB is -1, then we need to use the class' descriptor.
@@ -141,6 +150,8 @@ Bool16 QTFile_FileControlBlock::Read(FILE_SOURCE *dflt, UInt64 inPosition, void*
 
     if  (
             ( !fCacheEnabled) ||    // file control block caching disabled
+            ( OSFileBlockCache::GetCache() != NULL ) || // the file's reads are served from the server-wide block cache
+            ( fIsAsync && (dataFD == &fDataFD) ) ||     // the file system module buffers asynchronous reads
             ( inLength > fDataBufferSize ) ||   // too big for this cache
             ( inPosition < fDataBufferPosStart) // backing up
         )
@@ -279,6 +290,11 @@ void QTFile_FileControlBlock::AdjustDataBufferBitRate(UInt32 inUnitSizeInK, UInt
 {
     if (!fCacheEnabled)
         return;
+    
+    // Don't keep private copies of blocks that every reader shares, or that the
+    // file system module already buffers for us
+    if ((OSFileBlockCache::GetCache() != NULL) || fIsAsync)
+        return;
         
     // General vars
     UInt32  newDataBufferSizeInUnits = inNumBuffSizeUnits;
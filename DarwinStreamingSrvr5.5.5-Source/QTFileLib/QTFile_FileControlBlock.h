@@ -55,8 +55,9 @@ class QTFile_FileControlBlock {
     QTFile_FileControlBlock(void);
     virtual ~QTFile_FileControlBlock(void);
     
-    //Sets this object to reference this file
-    void Set(char *inPath);
+    //Sets this object to reference this file. If inAsync is true, reads may fail
+    //with ReadWouldBlock set while the file system module reads the data.
+    void Set(char *inPath, Bool16 inAsync = false);
         
     //Advise: this advises the OS that we are going to be reading soon from the
     //following position in the file
@@ -66,6 +67,15 @@ class QTFile_FileControlBlock {
 
     Bool16 ReadInternal(FILE_SOURCE *dataFD, UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32 *inReadLenPtr = NULL);
 
+    //
+    // True if the last Read failed only because the data hasn't been read from disk yet
+    Bool16 ReadWouldBlock() { return fReadWouldBlock; }
+#if DSS_USE_API_CALLBACKS
+    //
+    // Signals the current task once the data the last Read wanted is in
+    void RequestReadEvent() { (void)QTSS_RequestEvent(fDataFD, QTSS_ReadableEvent); }
+#endif
+
     //
     // Buffer management functions
     void AdjustDataBufferBitRate(UInt32 inUnitSizeInK = 32, UInt32 inFileBitRate = 32768, UInt32 inNumBuffSizeUnits = 0, UInt32 inMaxBitRateBuffSizeInBlocks = 8);
@@ -108,6 +118,8 @@ private:
     UInt32              fNumBlocksPerBuff;
     UInt32              fNumBuffs;
     Bool16              fCacheEnabled;
+    Bool16              fIsAsync;
+    Bool16              fReadWouldBlock;
 };
 
 #endif //_QTFILE_FILECONTROLBLOCK_H_
@@ -0,0 +1,863 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTFragmentIndex:
+//   The samples of a fragmented movie.
+//
+//  htons and friends are macros and should not include the global specifier ::
+
+
+// -------------------------------------
+// Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+
+#ifndef __Win32__
+#include <netinet/in.h>
+#endif
+
+#include "OSMutex.h"
+
+#include "QTFile.h"
+#include "QTAtom.h"
+
+#include "QTFragmentIndex.h"
+#include "OSMemory.h"
+
+
+// -------------------------------------
+// Constants
+//
+enum {
+    // 'tfhd' flags
+    kBaseDataOffsetPresent          = 0x000001,
+    kSampleDescriptionIndexPresent  = 0x000002,
+    kDefaultSampleDurationPresent   = 0x000008,
+    kDefaultSampleSizePresent       = 0x000010,
+    kDefaultSampleFlagsPresent      = 0x000020,
+    kDefaultBaseIsMoof              = 0x020000,
+
+    // 'trun' flags
+    kDataOffsetPresent              = 0x000001,
+    kFirstSampleFlagsPresent        = 0x000004,
+    kSampleDurationPresent          = 0x000100,
+    kSampleSizePresent              = 0x000200,
+    kSampleFlagsPresent             = 0x000400,
+    kSampleCompositionOffsetPresent = 0x000800,
+
+    // sample flags
+    kSampleIsNonSyncSample          = 0x00010000
+};
+
+
+// -------------------------------------
+// Track fragment lookups
+//
+QTFragmentIndex::TrackFragments::TrackFragments()
+    : fIndex(NULL), fTrackID(0),
+      fNumMovieSamples(0), fMovieDuration(0),
+      fDefaultSampleDescriptionIndex(1), fDefaultSampleDuration(0),
+      fDefaultSampleSize(0), fDefaultSampleFlags(0),
+      fRuns(NULL), fNumRuns(0), fMaxRuns(0), fLastRun(0),
+      fNumSamples(0), fEndMediaTime(0)
+{
+}
+
+QTFragmentIndex::TrackFragments::~TrackFragments()
+{
+    for( UInt32 runIndex = 0; runIndex < fNumRuns; runIndex++ )
+    {
+        delete [] fRuns[runIndex].fSampleOffsets;
+        delete [] fRuns[runIndex].fSampleTimes;
+        delete [] fRuns[runIndex].fSampleFlagsTable;
+        delete [] fRuns[runIndex].fCompositionOffsets;
+    }
+    delete [] fRuns;
+}
+
+QTFragmentIndex::TrackFragments::Run * QTFragmentIndex::TrackFragments::AddRun(void)
+{
+    if( fNumRuns == fMaxRuns )
+    {
+        UInt32  newMaxRuns = (fMaxRuns == 0) ? 16 : fMaxRuns * 2;
+        Run     *newRuns = NEW Run[newMaxRuns];
+        if( fNumRuns > 0 )
+            ::memcpy(newRuns, fRuns, fNumRuns * sizeof(Run));
+        delete [] fRuns;
+        fRuns = newRuns;
+        fMaxRuns = newMaxRuns;
+    }
+
+    Run *newRun = &fRuns[fNumRuns];
+    ::memset(newRun, 0, sizeof(Run));
+    return newRun;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::FindRun(UInt32 sampleNumber, Run ** foundRun, UInt32 * sampleInRun)
+{
+    if( sampleNumber <= fNumMovieSamples )
+        return false;
+    UInt32 fragmentSample = sampleNumber - fNumMovieSamples - 1;
+
+    while( fragmentSample >= fNumSamples )
+        if( !fIndex->ReadNextFragment() )
+            return false;
+
+    //
+    // Samples are mostly asked for in order, so try where the last one was
+    // and the run after it before searching.
+    UInt32 runIndex = fLastRun;
+    if( (runIndex < fNumRuns) && (fRuns[runIndex].fFirstSample <= fragmentSample) && (fragmentSample - fRuns[runIndex].fFirstSample >= fRuns[runIndex].fNumSamples) )
+        runIndex++;
+
+    if( (runIndex >= fNumRuns) || (fRuns[runIndex].fFirstSample > fragmentSample) || (fragmentSample - fRuns[runIndex].fFirstSample >= fRuns[runIndex].fNumSamples) )
+    {
+        UInt32  low = 0, high = fNumRuns;   // find the first run that starts after it
+        while( low < high )
+        {
+            UInt32 middle = low + ((high - low) / 2);
+            if( fRuns[middle].fFirstSample <= fragmentSample )
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        Assert(low > 0);
+        runIndex = low - 1;
+    }
+
+    fLastRun = runIndex;
+    *foundRun = &fRuns[runIndex];
+    *sampleInRun = fragmentSample - fRuns[runIndex].fFirstSample;
+    return true;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::FindRunByTime(UInt64 mediaTime, Run ** foundRun, UInt32 * sampleInRun)
+{
+    if( fNumRuns == 0 )
+        return false;
+
+    UInt32  low = 0, high = fNumRuns;   // find the first run that starts after it
+    while( low < high )
+    {
+        UInt32 middle = low + ((high - low) / 2);
+        if( fRuns[middle].fMediaTime <= mediaTime )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    Run     *theRun = &fRuns[(low > 0) ? low - 1 : 0];
+    UInt32  theSample = 0;
+    if( mediaTime > theRun->fMediaTime )
+    {
+        UInt64 timeInRun = mediaTime - theRun->fMediaTime;
+        if( theRun->fSampleTimes != NULL )
+        {
+            low = 0, high = theRun->fNumSamples;    // find the first sample that starts after it
+            while( low < high )
+            {
+                UInt32 middle = low + ((high - low) / 2);
+                if( theRun->fSampleTimes[middle] <= timeInRun )
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            theSample = low - 1;
+        }
+        else if( theRun->fSampleDuration > 0 )
+        {
+            timeInRun /= theRun->fSampleDuration;
+            theSample = (timeInRun < theRun->fNumSamples) ? (UInt32)timeInRun : theRun->fNumSamples - 1;
+        }
+    }
+
+    *foundRun = theRun;
+    *sampleInRun = theSample;
+    return true;
+}
+
+UInt32 QTFragmentIndex::TrackFragments::GetSampleFlags(Run * theRun, UInt32 sampleInRun)
+{
+    if( theRun->fSampleFlagsTable != NULL )
+        return theRun->fSampleFlagsTable[sampleInRun];
+    return (sampleInRun == 0) ? theRun->fFirstSampleFlags : theRun->fSampleFlags;
+}
+
+UInt64 QTFragmentIndex::TrackFragments::GetSampleTime(Run * theRun, UInt32 sampleInRun)
+{
+    if( theRun->fSampleTimes != NULL )
+        return theRun->fMediaTime + theRun->fSampleTimes[sampleInRun];
+    return theRun->fMediaTime + ((UInt64)theRun->fSampleDuration * sampleInRun);
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetSampleInfo(UInt32 sampleNumber, UInt32 * length, UInt64 * offset, UInt32 * sampleDescriptionIndex)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    if( !this->FindRun(sampleNumber, &theRun, &sampleInRun) )
+        return false;
+
+    UInt64  sampleOffset;
+    UInt32  sampleLength;
+    if( theRun->fSampleOffsets != NULL )
+    {
+        sampleOffset = theRun->fSampleOffsets[sampleInRun];
+        sampleLength = theRun->fSampleOffsets[sampleInRun + 1] - theRun->fSampleOffsets[sampleInRun];
+    }
+    else
+    {
+        sampleOffset = (UInt64)theRun->fSampleSize * sampleInRun;
+        sampleLength = theRun->fSampleSize;
+    }
+
+    if( length != NULL ) *length = sampleLength;
+    if( offset != NULL ) *offset = theRun->fDataOffset + sampleOffset;
+    if( sampleDescriptionIndex != NULL ) *sampleDescriptionIndex = theRun->fSampleDescriptionIndex;
+    return true;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetSampleMediaTime(UInt32 sampleNumber, UInt32 * mediaTime)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    if( this->FindRun(sampleNumber, &theRun, &sampleInRun) )
+    {
+        *mediaTime = (UInt32)this->GetSampleTime(theRun, sampleInRun);
+        return true;
+    }
+
+    //
+    // The end of the track counts as the start of one more sample.
+    if( sampleNumber == fNumMovieSamples + fNumSamples + 1 )
+    {
+        *mediaTime = (UInt32)fEndMediaTime;
+        return true;
+    }
+    return false;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetSampleMediaTimeOffset(UInt32 sampleNumber, UInt32 * mediaTimeOffset)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    if( !this->FindRun(sampleNumber, &theRun, &sampleInRun) )
+        return false;
+
+    *mediaTimeOffset = (theRun->fCompositionOffsets != NULL) ? theRun->fCompositionOffsets[sampleInRun] : 0;
+    return true;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetSampleNumberFromMediaTime(UInt32 mediaTime, UInt32 * sampleNumber)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    while( mediaTime >= fEndMediaTime )
+        if( !fIndex->ReadNextFragment() )
+            break;
+
+    //
+    // Like the time-to-sample table, this gives the sample that starts at
+    // or last before this time, or one past the last sample at the end.
+    if( mediaTime > fEndMediaTime )
+        return false;
+    if( mediaTime == fEndMediaTime )
+    {
+        if( fNumSamples == 0 )
+            return false;
+        *sampleNumber = fNumMovieSamples + fNumSamples + 1;
+        return true;
+    }
+
+    if( !this->FindRunByTime(mediaTime, &theRun, &sampleInRun) )
+        return false;
+
+    fLastRun = (UInt32)(theRun - fRuns);
+    *sampleNumber = fNumMovieSamples + theRun->fFirstSample + sampleInRun + 1;
+    return true;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::IsSyncSample(UInt32 sampleNumber)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    if( !this->FindRun(sampleNumber, &theRun, &sampleInRun) )
+        return false;
+
+    return (this->GetSampleFlags(theRun, sampleInRun) & kSampleIsNonSyncSample) == 0;
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetPreviousSyncSample(UInt32 sampleNumber, UInt32 * syncSampleNumber)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    if( !this->FindRun(sampleNumber, &theRun, &sampleInRun) )
+        return false;
+
+    //
+    // Walk back to the closest one, there is usually one every few seconds.
+    UInt32 runIndex = (UInt32)(theRun - fRuns);
+    UInt32 sampleCount = sampleInRun + 1;
+    for( ; ; )
+    {
+        while( sampleCount > 0 )
+        {
+            sampleCount--;
+            if( (this->GetSampleFlags(&fRuns[runIndex], sampleCount) & kSampleIsNonSyncSample) == 0 )
+            {
+                *syncSampleNumber = fNumMovieSamples + fRuns[runIndex].fFirstSample + sampleCount + 1;
+                return true;
+            }
+        }
+
+        if( runIndex == 0 )
+            return false;
+        runIndex--;
+        sampleCount = fRuns[runIndex].fNumSamples;
+    }
+}
+
+Bool16 QTFragmentIndex::TrackFragments::GetNextSyncSample(UInt32 sampleNumber, UInt32 * syncSampleNumber)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+    Run             *theRun;
+    UInt32          sampleInRun;
+
+    for( UInt32 nextSample = sampleNumber + 1; this->FindRun(nextSample, &theRun, &sampleInRun); nextSample++ )
+    {
+        if( (this->GetSampleFlags(theRun, sampleInRun) & kSampleIsNonSyncSample) == 0 )
+        {
+            *syncSampleNumber = nextSample;
+            return true;
+        }
+    }
+    return false;
+}
+
+UInt32 QTFragmentIndex::TrackFragments::GetNumSamples(void)
+{
+    OSMutexLocker   locker(fIndex->fFile->GetMutex());
+
+    while( fIndex->ReadNextFragment() )
+        { }
+
+    return fNumSamples;
+}
+
+
+// -------------------------------------
+// Constructors and destructors
+//
+QTFragmentIndex::QTFragmentIndex(QTFile * file, UInt64 firstFragmentPos)
+    : fFile(file),
+      fNumTracks(0), fTracks(NULL),
+      fDuration(0),
+      fNextFragmentPos(firstFragmentPos),
+      fNoMoreFragments(false),
+      fNumFragmentsRead(0)
+{
+}
+
+QTFragmentIndex::~QTFragmentIndex(void)
+{
+    delete [] fTracks;
+}
+
+
+// -------------------------------------
+// Initialization functions
+//
+Bool16 QTFragmentIndex::Initialize(void)
+{
+    // Temporary vars
+    QTFile::AtomTOCEntry    *tempTOCEntry;
+    UInt32                  tempInt32;
+
+
+    //
+    // How long the movie is with all of its fragments, if it says.
+    if( fFile->FindTOCEntry("moov:mvex:mehd", &tempTOCEntry) )
+    {
+        if( !this->ReadInt32(tempTOCEntry->AtomDataPos, &tempInt32) )
+            return false;
+
+        if( (tempInt32 >> 24) == 1 )
+        {
+            UInt32 durationHigh, durationLow;
+            if( !this->ReadInt32(tempTOCEntry->AtomDataPos + 4, &durationHigh) || !this->ReadInt32(tempTOCEntry->AtomDataPos + 8, &durationLow) )
+                return false;
+            fDuration = ((UInt64)durationHigh << 32) | durationLow;
+        }
+        else
+        {
+            if( !this->ReadInt32(tempTOCEntry->AtomDataPos + 4, &tempInt32) )
+                return false;
+            fDuration = tempInt32;
+        }
+    }
+
+    //
+    // Each track that can have fragments has a 'trex' atom with the defaults
+    // for the samples in them.
+    tempTOCEntry = NULL;
+    while( fFile->FindTOCEntry("moov:mvex:trex", &tempTOCEntry, tempTOCEntry) )
+        fNumTracks++;
+
+    if( fNumTracks == 0 )
+        return true;
+    fTracks = NEW TrackFragments[fNumTracks];
+
+    tempTOCEntry = NULL;
+    for( UInt32 trackNum = 0; trackNum < fNumTracks; trackNum++ )
+    {
+        TrackFragments  *track = &fTracks[trackNum];
+        UInt64          atomPos;
+
+        if( !fFile->FindTOCEntry("moov:mvex:trex", &tempTOCEntry, tempTOCEntry) )
+            return false;
+        atomPos = tempTOCEntry->AtomDataPos;
+
+        track->fIndex = this;
+        if( !this->ReadInt32(atomPos + 4, &track->fTrackID)
+            || !this->ReadInt32(atomPos + 8, &track->fDefaultSampleDescriptionIndex)
+            || !this->ReadInt32(atomPos + 12, &track->fDefaultSampleDuration)
+            || !this->ReadInt32(atomPos + 16, &track->fDefaultSampleSize)
+            || !this->ReadInt32(atomPos + 20, &track->fDefaultSampleFlags) )
+            return false;
+
+        //
+        // Find its 'trak' atom, to count the samples that come before the
+        // fragments.
+        QTFile::AtomTOCEntry    *trakTOCEntry = NULL, *tkhdTOCEntry;
+        Bool16                  foundTrack = false;
+        while( !foundTrack && fFile->FindTOCEntry("moov:trak", &trakTOCEntry, trakTOCEntry) )
+        {
+            if( !fFile->FindTOCEntry(":tkhd", &tkhdTOCEntry, trakTOCEntry) )
+                continue;
+            if( !this->ReadInt32(tkhdTOCEntry->AtomDataPos, &tempInt32) )
+                return false;
+            if( !this->ReadInt32(tkhdTOCEntry->AtomDataPos + (((tempInt32 >> 24) == 1) ? 20 : 12), &tempInt32) )
+                return false;
+            foundTrack = (tempInt32 == track->fTrackID);
+        }
+
+        if( !foundTrack || !this->ReadTrackMovieSamples(trakTOCEntry, track) )
+            return false;
+        track->fEndMediaTime = track->fMovieDuration;
+    }
+
+    return true;
+}
+
+Bool16 QTFragmentIndex::ReadTrackMovieSamples(QTFile::AtomTOCEntry * trakAtom, TrackFragments * track)
+{
+    // Temporary vars
+    QTFile::AtomTOCEntry    *tempTOCEntry;
+    UInt32                  numEntries;
+
+
+    if( !fFile->FindTOCEntry(":mdia:minf:stbl:stsz", &tempTOCEntry, trakAtom)
+        || !this->ReadInt32(tempTOCEntry->AtomDataPos + 8, &track->fNumMovieSamples) )
+        return false;
+
+    if( track->fNumMovieSamples == 0 )
+        return true;
+
+    if( !fFile->FindTOCEntry(":mdia:minf:stbl:stts", &tempTOCEntry, trakAtom)
+        || !this->ReadInt32(tempTOCEntry->AtomDataPos + 4, &numEntries) )
+        return false;
+
+    if( (UInt64)numEntries * 8 > tempTOCEntry->AtomDataLength - 8 )
+        return false;
+
+    char *table = NEW char[(numEntries * 8) + 1];
+    Bool16 result = fFile->Read(tempTOCEntry->AtomDataPos + 8, table, numEntries * 8);
+    for( UInt32 entry = 0; result && (entry < numEntries); entry++ )
+        track->fMovieDuration += (UInt64)QTAtom::TableInt32(table, entry * 2) * QTAtom::TableInt32(table, (entry * 2) + 1);
+    delete [] table;
+
+    return result;
+}
+
+
+// -------------------------------------
+// Accessors
+//
+QTFragmentIndex::TrackFragments * QTFragmentIndex::FindTrack(UInt32 trackID)
+{
+    for( UInt32 trackNum = 0; trackNum < fNumTracks; trackNum++ )
+        if( fTracks[trackNum].fTrackID == trackID )
+            return &fTracks[trackNum];
+    return NULL;
+}
+
+
+// -------------------------------------
+// Fragment parsing
+//
+Bool16 QTFragmentIndex::ReadInt32(UInt64 offset, UInt32 * datum)
+{
+    if( !fFile->Read(offset, (char *)datum, 4) )
+        return false;
+    *datum = ntohl(*datum);
+    return true;
+}
+
+Bool16 QTFragmentIndex::ReadNextFragment(void)
+{
+    // General vars
+    UInt32      atomLength, atomType;
+    UInt64      atomSize;
+    UInt32      headerSize;
+
+
+    while( !fNoMoreFragments )
+    {
+        //
+        // Anything we can't read yet might be there later, if the movie is
+        // still being written.
+        if( !this->ReadInt32(fNextFragmentPos, &atomLength) || !this->ReadInt32(fNextFragmentPos + 4, &atomType) )
+            return false;
+
+        atomSize = atomLength;
+        headerSize = 8;
+        if( atomLength == 1 )
+        {
+            UInt32 sizeHigh, sizeLow;
+            if( !this->ReadInt32(fNextFragmentPos + 8, &sizeHigh) || !this->ReadInt32(fNextFragmentPos + 12, &sizeLow) )
+                return false;
+            atomSize = ((UInt64)sizeHigh << 32) | sizeLow;
+            headerSize = 16;
+        }
+
+        //
+        // An atom that runs to the end of the file, the random access atoms
+        // at the end, or garbage: either way there are no more fragments.
+        if( (atomSize < headerSize) || (atomType == FOUR_CHARS_TO_INT('m', 'f', 'r', 'a')) )
+        {
+            fNoMoreFragments = true;
+            return false;
+        }
+
+        if( atomType != FOUR_CHARS_TO_INT('m', 'o', 'o', 'f') )
+        {
+            fNextFragmentPos += atomSize;
+            continue;
+        }
+
+        if( atomSize - headerSize > kMaxFragmentHeaderSize )
+        {
+            fNoMoreFragments = true;
+            return false;
+        }
+
+        UInt32  dataLength = (UInt32)(atomSize - headerSize);
+        char    *data = NEW char[dataLength + 1];
+        if( !fFile->Read(fNextFragmentPos + headerSize, data, dataLength) )
+        {
+            delete [] data;
+            return false;
+        }
+
+        Bool16 result = this->ParseMovieFragment(fNextFragmentPos, data, dataLength);
+        delete [] data;
+        if( !result )
+        {
+            fNoMoreFragments = true;
+            return false;
+        }
+
+        fNextFragmentPos += atomSize;
+        fNumFragmentsRead++;
+        return true;
+    }
+
+    return false;
+}
+
+Bool16 QTFragmentIndex::ParseMovieFragment(UInt64 moofPos, char * data, UInt32 length)
+{
+    //
+    // Without a base data offset, a track fragment's data starts where the
+    // last one's ended, and the first one's at the 'moof' atom.
+    UInt64  dataEnd = moofPos;
+    UInt32  pos = 0;
+
+    while( pos + 8 <= length )
+    {
+        UInt32 atomLength = QTAtom::TableInt32(data + pos, 0);
+        UInt32 atomType = QTAtom::TableInt32(data + pos, 1);
+        if( (atomLength < 8) || (atomLength > length - pos) )
+            return false;
+
+        if( atomType == FOUR_CHARS_TO_INT('t', 'r', 'a', 'f') )
+            if( !this->ParseTrackFragment(moofPos, data + pos + 8, atomLength - 8, &dataEnd) )
+                return false;
+
+        pos += atomLength;
+    }
+
+    return true;
+}
+
+Bool16 QTFragmentIndex::ParseTrackFragment(UInt64 moofPos, char * data, UInt32 length, UInt64 * dataEnd)
+{
+    // General vars
+    TrackFragmentDefaults   defaults;
+    TrackFragments          *track;
+    UInt32                  pos, tfhdLength, flags;
+
+
+    //
+    // The 'tfhd' atom comes first.
+    if( (length < 16) || (QTAtom::TableInt32(data, 1) != FOUR_CHARS_TO_INT('t', 'f', 'h', 'd')) )
+        return false;
+    tfhdLength = QTAtom::TableInt32(data, 0);
+    if( (tfhdLength < 16) || (tfhdLength > length) )
+        return false;
+
+    flags = QTAtom::TableInt32(data, 2) & 0x00ffffff;
+    track = this->FindTrack(QTAtom::TableInt32(data, 3));
+    if( track == NULL )
+        return true;    // not one we know the defaults of; skip it
+
+    pos = 16;
+    defaults.fBaseDataOffset = (flags & kDefaultBaseIsMoof) ? moofPos : *dataEnd;
+    defaults.fSampleDescriptionIndex = track->fDefaultSampleDescriptionIndex;
+    defaults.fSampleDuration = track->fDefaultSampleDuration;
+    defaults.fSampleSize = track->fDefaultSampleSize;
+    defaults.fSampleFlags = track->fDefaultSampleFlags;
+
+    if( flags & kBaseDataOffsetPresent )
+    {
+        if( pos + 8 > tfhdLength )
+            return false;
+        defaults.fBaseDataOffset = QTAtom::TableInt64(data + pos, 0);
+        pos += 8;
+    }
+
+    if( flags & kSampleDescriptionIndexPresent )
+    {
+        if( pos + 4 > tfhdLength )
+            return false;
+        defaults.fSampleDescriptionIndex = QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+    if( flags & kDefaultSampleDurationPresent )
+    {
+        if( pos + 4 > tfhdLength )
+            return false;
+        defaults.fSampleDuration = QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+    if( flags & kDefaultSampleSizePresent )
+    {
+        if( pos + 4 > tfhdLength )
+            return false;
+        defaults.fSampleSize = QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+    if( flags & kDefaultSampleFlagsPresent )
+    {
+        if( pos + 4 > tfhdLength )
+            return false;
+        defaults.fSampleFlags = QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+
+    //
+    // The runs follow one another in time, starting where the last fragment
+    // ended unless the 'tfdt' atom says otherwise, and in the file, starting
+    // at the base data offset unless they say otherwise.
+    UInt64  mediaTime = track->fEndMediaTime;
+    UInt64  dataPos = defaults.fBaseDataOffset;
+
+    for( pos = tfhdLength; pos + 8 <= length; )
+    {
+        UInt32 atomLength = QTAtom::TableInt32(data + pos, 0);
+        UInt32 atomType = QTAtom::TableInt32(data + pos, 1);
+        if( (atomLength < 8) || (atomLength > length - pos) )
+            return false;
+
+        if( (atomType == FOUR_CHARS_TO_INT('t', 'f', 'd', 't')) && (atomLength >= 16) )
+        {
+            if( (QTAtom::TableInt32(data + pos, 2) >> 24) == 1 )
+            {
+                if( atomLength < 20 )
+                    return false;
+                mediaTime = QTAtom::TableInt64(data + pos + 12, 0);
+            }
+            else
+                mediaTime = QTAtom::TableInt32(data + pos, 3);
+        }
+        else if( atomType == FOUR_CHARS_TO_INT('t', 'r', 'u', 'n') )
+        {
+            if( !this->ParseTrackRun(track, data + pos + 8, atomLength - 8, &defaults, &dataPos, &mediaTime) )
+                return false;
+        }
+
+        pos += atomLength;
+    }
+
+    track->fEndMediaTime = mediaTime;
+    *dataEnd = dataPos;
+    return true;
+}
+
+Bool16 QTFragmentIndex::ParseTrackRun(TrackFragments * track, char * data, UInt32 length, TrackFragmentDefaults * defaults,
+                                      UInt64 * dataPos, UInt64 * mediaTime)
+{
+    // General vars
+    UInt32      flags, numSamples, pos, entrySize;
+
+
+    if( length < 8 )
+        return false;
+    flags = QTAtom::TableInt32(data, 0) & 0x00ffffff;
+    numSamples = QTAtom::TableInt32(data, 1);
+    pos = 8;
+
+    UInt64  runDataPos = *dataPos;
+    if( flags & kDataOffsetPresent )
+    {
+        if( pos + 4 > length )
+            return false;
+        runDataPos = defaults->fBaseDataOffset + (SInt64)(SInt32)QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+
+    UInt32  firstSampleFlags = defaults->fSampleFlags;
+    if( flags & kFirstSampleFlagsPresent )
+    {
+        if( pos + 4 > length )
+            return false;
+        firstSampleFlags = QTAtom::TableInt32(data + pos, 0);
+        pos += 4;
+    }
+
+    entrySize = 0;
+    if( flags & kSampleDurationPresent ) entrySize += 4;
+    if( flags & kSampleSizePresent ) entrySize += 4;
+    if( flags & kSampleFlagsPresent ) entrySize += 4;
+    if( flags & kSampleCompositionOffsetPresent ) entrySize += 4;
+    if( (UInt64)numSamples * entrySize > length - pos )
+        return false;
+
+    if( numSamples == 0 )
+        return true;
+
+
+    //
+    // Build the tables for whatever differs from sample to sample.
+    TrackFragments::Run *run = track->AddRun();
+    run->fFirstSample = track->fNumSamples;
+    run->fNumSamples = numSamples;
+    run->fMediaTime = *mediaTime;
+    run->fDataOffset = runDataPos;
+    run->fSampleDescriptionIndex = defaults->fSampleDescriptionIndex;
+    run->fSampleSize = defaults->fSampleSize;
+    run->fSampleDuration = defaults->fSampleDuration;
+    run->fSampleFlags = defaults->fSampleFlags;
+    run->fFirstSampleFlags = firstSampleFlags;
+
+    if( flags & kSampleSizePresent )
+        run->fSampleOffsets = NEW UInt32[numSamples + 1];
+    if( flags & kSampleDurationPresent )
+        run->fSampleTimes = NEW UInt32[numSamples];
+    if( flags & kSampleFlagsPresent )
+        run->fSampleFlagsTable = NEW UInt32[numSamples];
+    if( flags & kSampleCompositionOffsetPresent )
+        run->fCompositionOffsets = NEW UInt32[numSamples];
+
+    UInt64  runLength = 0, runDuration = 0;
+    for( UInt32 sample = 0; sample < numSamples; sample++ )
+    {
+        UInt32 sampleDuration = run->fSampleDuration;
+        UInt32 sampleSize = run->fSampleSize;
+
+        if( flags & kSampleDurationPresent )
+        {
+            sampleDuration = QTAtom::TableInt32(data + pos, 0);
+            run->fSampleTimes[sample] = (UInt32)runDuration;
+            pos += 4;
+        }
+        if( flags & kSampleSizePresent )
+        {
+            sampleSize = QTAtom::TableInt32(data + pos, 0);
+            run->fSampleOffsets[sample] = (UInt32)runLength;
+            pos += 4;
+        }
+        if( flags & kSampleFlagsPresent )
+        {
+            run->fSampleFlagsTable[sample] = QTAtom::TableInt32(data + pos, 0);
+            pos += 4;
+        }
+        if( flags & kSampleCompositionOffsetPresent )
+        {
+            run->fCompositionOffsets[sample] = QTAtom::TableInt32(data + pos, 0);
+            pos += 4;
+        }
+
+        runDuration += sampleDuration;
+        runLength += sampleSize;
+    }
+
+    //
+    // The tables are offsets within the run, which had better fit.
+    if( (runLength > kUInt32_Max) || (runDuration > kUInt32_Max) )
+    {
+        delete [] run->fSampleOffsets;
+        delete [] run->fSampleTimes;
+        delete [] run->fSampleFlagsTable;
+        delete [] run->fCompositionOffsets;
+        return false;
+    }
+
+    if( run->fSampleOffsets != NULL )
+        run->fSampleOffsets[numSamples] = (UInt32)runLength;
+    if( (run->fSampleFlagsTable != NULL) && (flags & kFirstSampleFlagsPresent) )
+        run->fSampleFlagsTable[0] = firstSampleFlags;
+
+    track->fNumRuns++;
+    track->fNumSamples += numSamples;
+
+    *dataPos = runDataPos + runLength;
+    *mediaTime += runDuration;
+    return true;
+}
@@ -0,0 +1,193 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTFragmentIndex:
+//   The samples of a fragmented movie. A movie with a 'mvex' atom can put
+//   its samples in movie fragments after the 'moov' atom; each 'moof' atom
+//   has a 'traf' atom per track, whose 'trun' atoms list the sizes, times
+//   and flags of samples in the 'mdat' atom that follows.
+//
+//   QTFile stops reading atoms at the end of the 'moov' atom of such a
+//   movie, and the fragments are read here, one 'moof' atom at a time,
+//   when a sample past the ones already read is asked for. Opening a
+//   recording that is hours long only reads its 'moov' atom, and playing
+//   it reads the fragments as it gets to them.
+
+#ifndef QTFragmentIndex_H
+#define QTFragmentIndex_H
+
+
+//
+// Includes
+#include "OSHeaders.h"
+
+#include "QTFile.h"
+
+
+class QTFragmentIndex {
+
+public:
+    //
+    // The fragments of one track. Sample numbers carry on from the samples
+    // in the track's sample tables, if it has any, and start at 1 otherwise.
+    // Every lookup reads more fragments if it has to, and holds the file's
+    // mutex while it does.
+    class TrackFragments {
+
+    public:
+        inline  UInt32      GetTrackID(void) { return fTrackID; }
+        inline  UInt32      GetFirstSampleNumber(void) { return fNumMovieSamples + 1; }
+        inline  UInt64      GetFirstMediaTime(void) { return fMovieDuration; }
+
+        //
+        // These give the same answers as the QTTrack functions of the same
+        // name would if the samples were in the sample tables.
+                Bool16      GetSampleInfo(UInt32 SampleNumber, UInt32 * Length, UInt64 * Offset, UInt32 * SampleDescriptionIndex);
+                Bool16      GetSampleMediaTime(UInt32 SampleNumber, UInt32 * MediaTime);
+                Bool16      GetSampleMediaTimeOffset(UInt32 SampleNumber, UInt32 * MediaTimeOffset);
+                Bool16      GetSampleNumberFromMediaTime(UInt32 MediaTime, UInt32 * SampleNumber);
+                Bool16      IsSyncSample(UInt32 SampleNumber);
+
+        //
+        // These return false if there isn't a sync sample in the fragments
+        // before or after SampleNumber.
+                Bool16      GetPreviousSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber);
+                Bool16      GetNextSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber);
+
+        //
+        // Reads every fragment left to count them.
+                UInt32      GetNumSamples(void);
+
+    private:
+        //
+        // A 'trun' atom. The per sample tables are only there if the
+        // samples differ.
+        struct Run {
+            UInt32      fFirstSample;       // counting from 0 at the first fragment sample
+            UInt32      fNumSamples;
+            UInt64      fMediaTime;         // of the first sample
+            UInt64      fDataOffset;        // where the first sample is in the file
+            UInt32      fSampleDescriptionIndex;
+
+            UInt32      fSampleSize;
+            UInt32      fSampleDuration;
+            UInt32      fSampleFlags;
+            UInt32      fFirstSampleFlags;
+
+            UInt32      *fSampleOffsets;    // from fDataOffset, or NULL if every sample is fSampleSize
+            UInt32      *fSampleTimes;      // from fMediaTime, or NULL if every sample is fSampleDuration
+            UInt32      *fSampleFlagsTable; // or NULL if every sample but the first has fSampleFlags
+            UInt32      *fCompositionOffsets;   // or NULL if they are all 0
+        };
+
+                            TrackFragments();
+                            ~TrackFragments();
+
+                Bool16      FindRun(UInt32 SampleNumber, Run ** FoundRun, UInt32 * SampleInRun);
+                Bool16      FindRunByTime(UInt64 MediaTime, Run ** FoundRun, UInt32 * SampleInRun);
+                UInt32      GetSampleFlags(Run * InRun, UInt32 SampleInRun);
+                UInt64      GetSampleTime(Run * InRun, UInt32 SampleInRun);
+                Run         *AddRun(void);
+
+        QTFragmentIndex *fIndex;
+        UInt32      fTrackID;
+
+        UInt32      fNumMovieSamples;   // in the sample tables
+        UInt64      fMovieDuration;
+
+        //
+        // From the 'trex' atom
+        UInt32      fDefaultSampleDescriptionIndex;
+        UInt32      fDefaultSampleDuration;
+        UInt32      fDefaultSampleSize;
+        UInt32      fDefaultSampleFlags;
+
+        Run         *fRuns;
+        UInt32      fNumRuns, fMaxRuns;
+        UInt32      fLastRun;           // where the last lookup was
+
+        UInt32      fNumSamples;        // in the fragments read so far
+        UInt64      fEndMediaTime;      // of the fragments read so far
+
+        friend class QTFragmentIndex;
+    };
+
+    //
+    // FirstFragmentPos is where the 'moov' atom ends.
+                            QTFragmentIndex(QTFile * File, UInt64 FirstFragmentPos);
+                            ~QTFragmentIndex(void);
+
+    //
+    // Reads the 'mvex' atom; no fragments are read until a sample is asked
+    // for. Returns false if a track in the 'mvex' atom isn't in the movie.
+            Bool16          Initialize(void);
+
+    //
+    // Accessors
+            TrackFragments  *FindTrack(UInt32 TrackID);
+    //
+    // From the 'mehd' atom, in the movie's time scale. 0 if it doesn't have one.
+    inline  UInt64          GetDuration(void) { return fDuration; }
+    inline  UInt32          GetNumFragmentsRead(void) { return fNumFragmentsRead; }
+
+private:
+    //
+    // What a 'tfhd' atom says about the runs in its track fragment.
+    struct TrackFragmentDefaults {
+        UInt64      fBaseDataOffset;
+        UInt32      fSampleDescriptionIndex;
+        UInt32      fSampleDuration;
+        UInt32      fSampleSize;
+        UInt32      fSampleFlags;
+    };
+
+    //
+    // Reads the next 'moof' atom. Returns false if there are no more, or if
+    // the next one hasn't been completely written yet.
+            Bool16          ReadNextFragment(void);
+            Bool16          ParseMovieFragment(UInt64 MoofPos, char * Data, UInt32 Length);
+            Bool16          ParseTrackFragment(UInt64 MoofPos, char * Data, UInt32 Length, UInt64 * DataEnd);
+            Bool16          ParseTrackRun(TrackFragments * Track, char * Data, UInt32 Length, TrackFragmentDefaults * Defaults,
+                                          UInt64 * DataPos, UInt64 * MediaTime);
+
+            Bool16          ReadInt32(UInt64 Offset, UInt32 * Datum);
+            Bool16          ReadTrackMovieSamples(QTFile::AtomTOCEntry * TrakAtom, TrackFragments * Track);
+
+    enum {
+        kMaxFragmentHeaderSize  = 16 * 1024 * 1024  // bigger 'moof' atoms are taken to be bad
+    };
+
+    QTFile          *fFile;
+
+    UInt32          fNumTracks;
+    TrackFragments  *fTracks;
+    UInt64          fDuration;
+
+    UInt64          fNextFragmentPos;
+    Bool16          fNoMoreFragments;
+    UInt32          fNumFragmentsRead;
+};
+
+#endif // QTFragmentIndex_H
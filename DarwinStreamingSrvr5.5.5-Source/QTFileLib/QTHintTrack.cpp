@@ -59,6 +59,7 @@
 #include "QTAtom_tref.h"
 
 #include "QTHintTrack.h"
+#include "QTPacketizerTrack.h"
 #include "OSMutex.h"
 #include "FastCopyMacros.h"
 #include "MyAssert.h"
@@ -124,6 +125,7 @@ SInt64 GetMicroseconds()
 //
 QTHintTrack_HintTrackControlBlock::QTHintTrack_HintTrackControlBlock(QTFile_FileControlBlock * FCB)
     : fFCB(FCB),
+      fTrackIndex(NULL),
     
       fCachedSampleNumber(0),
       fCachedSample(NULL),
@@ -143,11 +145,13 @@ QTHintTrack_HintTrackControlBlock::QTHintTrack_HintTrackControlBlock(QTFile_File
 {
     fMediaTrackSTSC_STCB = NULL;
     fMediaTrackRefIndex = -2;
+    fPacketList = NULL;
 }
 
 QTHintTrack_HintTrackControlBlock::~QTHintTrack_HintTrackControlBlock(void)
 {
     delete fMediaTrackSTSC_STCB;
+    delete fPacketList;
     delete []fCachedSample;
     delete []fCachedHintTrackSample;
     
@@ -600,8 +604,9 @@ Bool16 QTHintTrack::GetSamplePtr(UInt32 sampleNumber, char ** samplePtr, UInt32
     UInt32      sampleDescriptionIndex;
     UInt64      sampleOffset;
     
-    if( !this->GetSampleInfo(sampleNumber, &newSampleLength, &sampleOffset, &sampleDescriptionIndex, &htcb->fstscSTCB) )
-        return false;
+    if( (htcb->fTrackIndex == NULL) || !htcb->fTrackIndex->GetSampleInfo(sampleNumber, &newSampleLength, &sampleOffset, &sampleDescriptionIndex) )
+        if( !this->GetSampleInfo(sampleNumber, &newSampleLength, &sampleOffset, &sampleDescriptionIndex, &htcb->fstscSTCB) )
+            return false;
     
     //
     // Create a new (bigger) cache samplePtr if the sample wouldn't fit in the
@@ -627,7 +632,9 @@ Bool16 QTHintTrack::GetSamplePtr(UInt32 sampleNumber, char ** samplePtr, UInt32
     
 
     //
-    // Read in the new sample.
+    // Read in the new sample. The old one is gone as soon as we start, even if
+    // the read doesn't finish.
+    htcb->fCachedSampleNumber = 0;
     htcb->fCachedSampleLength = newSampleLength;
     
     //- this did another GetSampleInfo and we already have that data...
@@ -1169,7 +1176,12 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
 
     //
     // Get the RTP timestamp for this sample.
-    if( !this->GetSampleMediaTime(sampleNumber, &mediaTime, &htcb->fsttsSTCB) )
+    if( htcb->fTrackIndex != NULL )
+    {
+        if( !htcb->fTrackIndex->GetSampleMediaTime(sampleNumber, &mediaTime) )
+            return errInvalidQuickTimeFile;
+    }
+    else if( !this->GetSampleMediaTime(sampleNumber, &mediaTime, &htcb->fsttsSTCB) )
         return errInvalidQuickTimeFile;
 
     if( fRTPTimescale != this->GetTimeScale() )
@@ -1262,77 +1274,8 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
     pPacketOutBuf += 4;
     
     //
-    // Go through each possible field. For each one, see if caller
-    // wants the field appended. If so, append the field
-    for ( UInt32 fieldCount = 0; fieldCount < RTPMetaInfoPacket::kNumFields; fieldCount++)
-    {
-        //
-        // If there is no field array, don't generate a packet
-        if (htcb->fRTPMetaInfoFieldArray == NULL)
-            break;
-            
-        //
-        // Check if field should be appended
-        if (htcb->fRTPMetaInfoFieldArray[fieldCount] == RTPMetaInfoPacket::kFieldNotUsed)
-            continue;
-        
-        switch (fieldCount)
-        {
-            case RTPMetaInfoPacket::kPacketPosField:
-            {
-                SInt64 curPacketPos = OS::HostToNetworkSInt64(htcb->fCurrentPacketPosition);
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kPacketPosField, htcb->fRTPMetaInfoFieldArray[fieldCount], &curPacketPos, sizeof(curPacketPos), &pPacketOutBuf);
-                break;
-            }
-            case RTPMetaInfoPacket::kTransTimeField:
-            {
-                SInt64 transmitTimeInMsec = OS::HostToNetworkSInt64((SInt64)(*transmitTime * 1000));
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kTransTimeField, htcb->fRTPMetaInfoFieldArray[fieldCount], &transmitTimeInMsec, sizeof(transmitTimeInMsec), &pPacketOutBuf);
-                break;
-            }
-            
-            case RTPMetaInfoPacket::kFrameTypeField:
-            {
-                UInt16 theFrameType = RTPMetaInfoPacket::kUnknownFrameType;
-                
-                if (!htcb->fIsVideo)
-                    theFrameType = RTPMetaInfoPacket::kUnknownFrameType;
-                else if (hdrData.hintFlags & kBFrameBitMask)
-                    theFrameType = RTPMetaInfoPacket::kBFrameType;
-                else if (this->IsSyncSample(sampleNumber, htcb->fSyncSampleCursor))
-                    theFrameType = RTPMetaInfoPacket::kKeyFrameType;
-                else
-                    theFrameType = RTPMetaInfoPacket::kPFrameType;
-
-                theFrameType = htons(theFrameType);
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kFrameTypeField, htcb->fRTPMetaInfoFieldArray[fieldCount], &theFrameType, sizeof(theFrameType), &pPacketOutBuf);
-                break;
-            }
-            case RTPMetaInfoPacket::kPacketNumField:
-            {
-                SInt64 curPacketNum = OS::HostToNetworkSInt64(htcb->fCurrentPacketNumber);
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kPacketNumField, htcb->fRTPMetaInfoFieldArray[fieldCount], &curPacketNum, sizeof(curPacketNum), &pPacketOutBuf);
-                break;
-            }
-            case RTPMetaInfoPacket::kSeqNumField:
-            {
-                tempInt16 = htons(hdrData.rtpSequenceNumber);
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kSeqNumField, htcb->fRTPMetaInfoFieldArray[fieldCount], &tempInt16, sizeof(tempInt16), &pPacketOutBuf);
-                break;
-            }
-            case RTPMetaInfoPacket::kMediaDataField:
-            {
-                //
-                // This field cannot be compressed
-                Assert(htcb->fRTPMetaInfoFieldArray[fieldCount] == RTPMetaInfoPacket::kUncompressed);
-                
-                //
-                // We don't have the data yet, so just write in the header
-                this->WriteMetaInfoField(RTPMetaInfoPacket::kMediaDataField, htcb->fRTPMetaInfoFieldArray[fieldCount], NULL, 0, &pPacketOutBuf);
-                break;
-            }
-        }
-    }
+    // Add in the RTP-Meta-Info fields, if this is an RTP-Meta-Info packet.
+    this->WriteMetaInfoFields(sampleNumber, hdrData.rtpSequenceNumber, *transmitTime, (hdrData.hintFlags & kBFrameBitMask) != 0, htcb, &pPacketOutBuf);
     
     char* endOfMetaInfo = pPacketOutBuf;
     packetSize = endOfMetaInfo - buffer;
@@ -1415,10 +1358,97 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
     DEEP_DEBUG_PRINT(("QTHintTrack::GetPacket - ..Packet length is %lu bytes.\n", packetSize));
 
     *length = packetSize;
+    this->FinishPacket(endOfMetaInfo, pPacketOutBuf, length, htcb);
     
+    //
+    // The packet has been generated.
+    return err;
+}
+
+void QTHintTrack::WriteMetaInfoFields(UInt32 sampleNumber, UInt16 rtpSequenceNumber, Float64 transmitTime, Bool16 isBFrame,
+                                      QTHintTrack_HintTrackControlBlock * htcb, char ** ioBuffer)
+{
+    UInt16      tempInt16;
+    
+    //
+    // Go through each possible field. For each one, see if caller
+    // wants the field appended. If so, append the field
+    for ( UInt32 fieldCount = 0; fieldCount < RTPMetaInfoPacket::kNumFields; fieldCount++)
+    {
+        //
+        // If there is no field array, don't generate a packet
+        if (htcb->fRTPMetaInfoFieldArray == NULL)
+            break;
+            
+        //
+        // Check if field should be appended
+        if (htcb->fRTPMetaInfoFieldArray[fieldCount] == RTPMetaInfoPacket::kFieldNotUsed)
+            continue;
+        
+        switch (fieldCount)
+        {
+            case RTPMetaInfoPacket::kPacketPosField:
+            {
+                SInt64 curPacketPos = OS::HostToNetworkSInt64(htcb->fCurrentPacketPosition);
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kPacketPosField, htcb->fRTPMetaInfoFieldArray[fieldCount], &curPacketPos, sizeof(curPacketPos), ioBuffer);
+                break;
+            }
+            case RTPMetaInfoPacket::kTransTimeField:
+            {
+                SInt64 transmitTimeInMsec = OS::HostToNetworkSInt64((SInt64)(transmitTime * 1000));
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kTransTimeField, htcb->fRTPMetaInfoFieldArray[fieldCount], &transmitTimeInMsec, sizeof(transmitTimeInMsec), ioBuffer);
+                break;
+            }
+            
+            case RTPMetaInfoPacket::kFrameTypeField:
+            {
+                UInt16 theFrameType = RTPMetaInfoPacket::kUnknownFrameType;
+                
+                if (!htcb->fIsVideo)
+                    theFrameType = RTPMetaInfoPacket::kUnknownFrameType;
+                else if (isBFrame)
+                    theFrameType = RTPMetaInfoPacket::kBFrameType;
+                else if ((htcb->fTrackIndex != NULL) ? htcb->fTrackIndex->IsSyncSample(sampleNumber) : this->IsSyncSample(sampleNumber, htcb->fSyncSampleCursor))
+                    theFrameType = RTPMetaInfoPacket::kKeyFrameType;
+                else
+                    theFrameType = RTPMetaInfoPacket::kPFrameType;
+
+                theFrameType = htons(theFrameType);
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kFrameTypeField, htcb->fRTPMetaInfoFieldArray[fieldCount], &theFrameType, sizeof(theFrameType), ioBuffer);
+                break;
+            }
+            case RTPMetaInfoPacket::kPacketNumField:
+            {
+                SInt64 curPacketNum = OS::HostToNetworkSInt64(htcb->fCurrentPacketNumber);
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kPacketNumField, htcb->fRTPMetaInfoFieldArray[fieldCount], &curPacketNum, sizeof(curPacketNum), ioBuffer);
+                break;
+            }
+            case RTPMetaInfoPacket::kSeqNumField:
+            {
+                tempInt16 = htons(rtpSequenceNumber);
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kSeqNumField, htcb->fRTPMetaInfoFieldArray[fieldCount], &tempInt16, sizeof(tempInt16), ioBuffer);
+                break;
+            }
+            case RTPMetaInfoPacket::kMediaDataField:
+            {
+                //
+                // This field cannot be compressed
+                Assert(htcb->fRTPMetaInfoFieldArray[fieldCount] == RTPMetaInfoPacket::kUncompressed);
+                
+                //
+                // We don't have the data yet, so just write in the header
+                this->WriteMetaInfoField(RTPMetaInfoPacket::kMediaDataField, htcb->fRTPMetaInfoFieldArray[fieldCount], NULL, 0, ioBuffer);
+                break;
+            }
+        }
+    }
+}
+
+void QTHintTrack::FinishPacket(char * endOfMetaInfo, char * endOfPacket, UInt32 * length, QTHintTrack_HintTrackControlBlock * htcb)
+{
     //
     // Always track packet number and packet position.
-    UInt16 thePacketDataLen = pPacketOutBuf - endOfMetaInfo;
+    UInt16 thePacketDataLen = endOfPacket - endOfMetaInfo;
     htcb->fCurrentPacketNumber++;
     htcb->fCurrentPacketPosition += thePacketDataLen;
         
@@ -1438,10 +1468,6 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
             COPY_WORD(endOfMetaInfo - 2, &thePacketDataLen);
         }
     }
-    
-    //
-    // The packet has been generated.
-    return err;
 }
 
 void QTHintTrack::WriteMetaInfoField(   RTPMetaInfoPacket::FieldIndex inFieldIndex,
@@ -35,6 +35,7 @@
 #include "QTTrack.h"
 #include "QTAtom_hinf.h"
 #include "QTAtom_tref.h"
+#include "QTRTPFileIndex.h"
 #include "RTPMetaInfoPacket.h"
 #include "MyAssert.h"
 
@@ -44,6 +45,7 @@
 class QTFile;
 class QTAtom_stsc_SampleTableControlBlock;
 class QTAtom_stts_SampleTableControlBlock;
+class QTPacketizerTrack_PacketList;
 
 
 class QTHintTrackRTPHeaderData {
@@ -90,6 +92,11 @@ public:
     // Sample Table control blocks
     QTAtom_stsc_SampleTableControlBlock  fstscSTCB;
     QTAtom_stts_SampleTableControlBlock  fsttsSTCB;
+    
+    //
+    // If the movie is indexed, sample times and offsets come from here
+    // instead of the sample tables.
+    QTRTPFileIndex::TrackIndex          *fTrackIndex;
      
     //
     // Sample cache
@@ -117,6 +124,10 @@ public:
     
     SInt32              fMediaTrackRefIndex;
     QTAtom_stsc_SampleTableControlBlock * fMediaTrackSTSC_STCB;
+    
+    //
+    // The packets of the cached sample, if the track is a QTPacketizerTrack
+    QTPacketizerTrack_PacketList        *fPacketList;
  
 };
 
@@ -141,10 +152,10 @@ public:
 
     //
     // Accessors.
-            ErrorCode   GetSDPFileLength(int * Length);
-            char *      GetSDPFile(int * Length);
+    virtual ErrorCode   GetSDPFileLength(int * Length);
+    virtual char *      GetSDPFile(int * Length);
             
-    inline  UInt64      GetTotalRTPBytes(void) { return fHintInfoAtom ? fHintInfoAtom->GetTotalRTPBytes() : 0; }
+    virtual UInt64      GetTotalRTPBytes(void) { return fHintInfoAtom ? fHintInfoAtom->GetTotalRTPBytes() : 0; }
     inline  UInt64      GetTotalRTPPackets(void) { return fHintInfoAtom ? fHintInfoAtom->GetTotalRTPPackets() : 0; }
 
     inline  UInt32      GetFirstRTPTimestamp(void) { return fFirstRTPTimestamp; }
@@ -162,7 +173,7 @@ public:
     
     inline  UInt16      GetRTPSequenceNumberRandomOffset(void) { return fSequenceNumberRandomOffset; }
     
-    ErrorCode   GetNumPackets(UInt32 SampleNumber, UInt16 * NumPackets,
+    virtual ErrorCode   GetNumPackets(UInt32 SampleNumber, UInt16 * NumPackets,
                                       QTHintTrack_HintTrackControlBlock * HTCB = NULL);
 
     //
@@ -176,7 +187,7 @@ public:
     //      is a compressed field ID.
     //
     // Supported fields: tt, md, ft, pp, pn, sq
-    ErrorCode   GetPacket(UInt32 SampleNumber, UInt16 PacketNumber,
+    virtual ErrorCode   GetPacket(UInt32 SampleNumber, UInt16 PacketNumber,
                                   char * Buffer, UInt32 * Length,
                                   Float64 * TransmitTime,
                                   Bool16 dropBFrames,
@@ -232,6 +243,15 @@ protected:
     void                WriteMetaInfoField( RTPMetaInfoPacket::FieldIndex inFieldIndex,
                                             RTPMetaInfoPacket::FieldID inFieldID,
                                             void* inFieldData, UInt32 inFieldLen, char** ioBuffer);
+    
+    //
+    // Write the RTP-Meta-Info fields the HTCB asks for after the RTP header,
+    // and, once the media data is in, count the packet and fix up or strip
+    // its 'md' field.
+    void                WriteMetaInfoFields(UInt32 sampleNumber, UInt16 rtpSequenceNumber, Float64 transmitTime, Bool16 isBFrame,
+                                            QTHintTrack_HintTrackControlBlock * htcb, char ** ioBuffer);
+    void                FinishPacket(char * endOfMetaInfo, char * endOfPacket, UInt32 * length,
+                                     QTHintTrack_HintTrackControlBlock * htcb);
 
     inline QTTrack::ErrorCode   GetSamplePacketPtr( char ** samplePacketPtr, UInt32 sampleNumber, UInt16 packetNumber, QTHintTrackRTPHeaderData &hdrData,  QTHintTrack_HintTrackControlBlock & htcb);
     inline void         GetSamplePacketHeaderVars( char *samplePacketPtr,char *maxBuffPtr, QTHintTrackRTPHeaderData &hdrData );
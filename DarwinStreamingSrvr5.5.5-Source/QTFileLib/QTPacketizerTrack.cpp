@@ -0,0 +1,897 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTPacketizerTrack:
+//   A media track of a movie without hint tracks, packetized as it is
+//   played.
+//
+//  htons and friends are macros and should not include the global specifier ::
+
+
+// -------------------------------------
+// Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+
+#ifndef __Win32__
+#include <netinet/in.h>
+#endif
+
+#include "QTFile.h"
+#include "QTAtom.h"
+#include "QTTrack.h"
+#include "QTHintTrack.h"
+
+#include "QTPacketizerTrack.h"
+#include "OSMutex.h"
+#include "FastCopyMacros.h"
+#include "MyAssert.h"
+#include "OSMemory.h"
+#include "base64.h"
+
+
+// -------------------------------------
+// Macros
+//
+#define DEBUG_PRINT(s) if(fDebug) qtss_printf s
+#define DEEP_DEBUG_PRINT(s) if(fDeepDebug) qtss_printf s
+
+
+// -------------------------------------
+// Constants
+//
+// The bytes before the child atoms of a visual and a (version 0) sound
+// sample description, counting its size and format.
+static const UInt32 kVisualSampleEntryLength = 86;
+static const UInt32 kSoundSampleEntryLength = 36;
+
+static const UInt32 kAACSampleRates[] = { 96000, 88200, 64000, 48000, 44100, 32000,
+                                          24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+static UInt32 ReadNALLength(char * Pos, UInt32 NALLengthSize)
+{
+    UInt32 nalLength = 0;
+    for( UInt32 i = 0; i < NALLengthSize; i++ )
+        nalLength = (nalLength << 8) | (UInt8)Pos[i];
+    return nalLength;
+}
+
+
+// -------------------------------------
+// QTPacketizerTrack_PacketList
+//
+QTPacketizerTrack_PacketList::QTPacketizerTrack_PacketList(void)
+    : fSampleNumber(0),
+      fMediaTime(0), fDuration(0),
+      fRTPTimestamp(0),
+      fIsDisposable(false),
+      fPackets(NULL),
+      fNumPackets(0), fMaxPackets(0)
+{
+}
+
+QTPacketizerTrack_PacketList::~QTPacketizerTrack_PacketList(void)
+{
+    delete [] fPackets;
+}
+
+QTPacketizerTrack_PacketList::Packet * QTPacketizerTrack_PacketList::AddPacket(void)
+{
+    if( fNumPackets == fMaxPackets )
+    {
+        UInt32 newMaxPackets = (fMaxPackets == 0) ? 16 : (fMaxPackets * 2);
+        Packet *newPackets = NEW Packet[newMaxPackets];
+        if( fPackets != NULL )
+        {
+            ::memcpy(newPackets, fPackets, fNumPackets * sizeof(Packet));
+            delete [] fPackets;
+        }
+        fPackets = newPackets;
+        fMaxPackets = newMaxPackets;
+    }
+
+    Packet *thePacket = &fPackets[fNumPackets++];
+    ::memset(thePacket, 0, sizeof(Packet));
+    return thePacket;
+}
+
+
+// -------------------------------------
+// Constructors and destructors
+//
+QTPacketizerTrack::QTPacketizerTrack(QTFile * File, QTFile::AtomTOCEntry * Atom, Bool16 Debug, Bool16 DeepDebug)
+    : QTHintTrack(File, Atom, Debug, DeepDebug),
+      fPayload(kH264Payload),
+      fMaxPayloadLength(kMaxRTPPacketLength - kRTPHeaderLength),
+      fNALLengthSize(4),
+      fParameterSets(NULL),
+      fAudioSpecificConfig(NULL),
+      fSampleRate(0), fNumChannels(0),
+      fSDP(NULL), fSDPLength(0),
+      fTotalRTPBytes(0)
+{
+    fProfileLevelID[0] = fProfileLevelID[1] = fProfileLevelID[2] = 0;
+}
+
+QTPacketizerTrack::~QTPacketizerTrack(void)
+{
+    delete [] fParameterSets;
+    delete [] fAudioSpecificConfig;
+    delete [] fSDP;
+}
+
+Bool16 QTPacketizerTrack::CanPacketize(QTFile * File, QTFile::AtomTOCEntry * trakAtom)
+{
+    QTFile::AtomTOCEntry    *stsdTOCEntry;
+    OSType                  dataFormat;
+
+    //
+    // The format of the first sample description; the table starts with its
+    // version, flags and entry count, and the entry with its size.
+    if( !File->FindTOCEntry(":mdia:minf:stbl:stsd", &stsdTOCEntry, trakAtom) )
+        return false;
+    if( stsdTOCEntry->AtomDataLength < 16 )
+        return false;
+    if( !File->Read(stsdTOCEntry->AtomDataPos + 12, (char *)&dataFormat, 4) )
+        return false;
+
+    switch( ntohl(dataFormat) )
+    {
+        case FOUR_CHARS_TO_INT('a', 'v', 'c', '1'):
+        case FOUR_CHARS_TO_INT('a', 'v', 'c', '3'):
+        case FOUR_CHARS_TO_INT('m', 'p', '4', 'a'):
+            return true;
+    }
+
+    return false;
+}
+
+
+// -------------------------------------
+// Initialization functions
+//
+QTTrack::ErrorCode QTPacketizerTrack::Initialize(void)
+{
+    char        *sampleDescription;
+    UInt32      sampleDescriptionLength;
+
+    //
+    // Don't initialize more than once.
+    if( IsHintTrackInitialized() )
+        return errNoError;
+
+    //
+    // Initialize the QTTrack class.
+    if( QTTrack::Initialize() != errNoError )
+        return errInvalidQuickTimeFile;
+    if( this->GetTimeScale() <= 0.0 )
+        return errInvalidQuickTimeFile;
+
+    //
+    // Read the codec's configuration out of the sample description.
+    if( fSampleDescriptionAtom->FindSampleDescription(FOUR_CHARS_TO_INT('a', 'v', 'c', '1'), &sampleDescription, &sampleDescriptionLength)
+        || fSampleDescriptionAtom->FindSampleDescription(FOUR_CHARS_TO_INT('a', 'v', 'c', '3'), &sampleDescription, &sampleDescriptionLength) )
+    {
+        fPayload = kH264Payload;
+        if( !this->ReadH264Description(sampleDescription, sampleDescriptionLength) )
+            return errInvalidQuickTimeFile;
+        fRTPTimescale = kH264RTPTimescale;
+    }
+    else if( fSampleDescriptionAtom->FindSampleDescription(FOUR_CHARS_TO_INT('m', 'p', '4', 'a'), &sampleDescription, &sampleDescriptionLength) )
+    {
+        fPayload = kAACPayload;
+        if( !this->ReadAACDescription(sampleDescription, sampleDescriptionLength) )
+            return errInvalidQuickTimeFile;
+        fRTPTimescale = (fSampleRate != 0) ? fSampleRate : (UInt32)this->GetTimeScale();
+    }
+    else
+        return errInvalidQuickTimeFile;
+
+    fMaxPacketSize = kMaxRTPPacketLength;
+    fMaxPayloadLength = kMaxRTPPacketLength - kRTPHeaderLength;
+
+    //
+    // Calculate the first RTP timestamp for this track.
+    if( GetFirstEditMovieTime() > 0 )
+    {
+        UInt64 trackTime = GetFirstEditMovieTime();
+
+        trackTime *= fRTPTimescale;
+
+        if( fFile->GetTimeScale() > 0.0 )
+            trackTime /= (UInt64)fFile->GetTimeScale();
+
+        fFirstRTPTimestamp = (UInt32)(trackTime & 0xffffffff);
+    }
+    else
+    {
+        fFirstRTPTimestamp = 0;
+    }
+
+    this->ComputeTotalRTPBytes();
+    if( !this->BuildSDP() )
+        return errInternalError;
+
+    DEBUG_PRINT(("QTPacketizerTrack::Initialize - Track %lu packetized as %s.\n", this->GetTrackID(), (fPayload == kH264Payload) ? "H.264" : "AAC"));
+
+    //
+    // This track has been successfully initialiazed.
+    fHintTrackInitialized = true;
+
+    return errNoError;
+}
+
+Bool16 QTPacketizerTrack::ReadH264Description(char * sampleDescription, UInt32 sampleDescriptionLength)
+{
+    char        *avcC, *pos, *end;
+    UInt32      avcCLength;
+    char        *parameterSets;
+
+    if( !FindChildAtom(sampleDescription, sampleDescriptionLength, kVisualSampleEntryLength,
+                       FOUR_CHARS_TO_INT('a', 'v', 'c', 'C'), &avcC, &avcCLength) )
+        return false;
+    avcC += 8;
+    avcCLength -= 8;
+
+    //
+    // The AVCDecoderConfigurationRecord: a version, the profile, profile
+    // compatibility and level, the NAL unit length size, then the sequence
+    // and picture parameter sets, each with a 16 bit length.
+    if( (avcCLength < 7) || (avcC[0] != 1) )
+        return false;
+    fProfileLevelID[0] = (UInt8)avcC[1];
+    fProfileLevelID[1] = (UInt8)avcC[2];
+    fProfileLevelID[2] = (UInt8)avcC[3];
+    fNALLengthSize = (avcC[4] & 0x03) + 1;
+    if( fNALLengthSize == 3 )
+        return false;
+
+    //
+    // Base64 takes 4 bytes for every 3, plus a comma between each set.
+    parameterSets = NEW char[(avcCLength * 2) + 64];
+    parameterSets[0] = '\0';
+    UInt32 parameterSetsLength = 0;
+
+    pos = avcC + 5;
+    end = avcC + avcCLength;
+    for( int list = 0; list < 2; list++ )
+    {
+        if( pos >= end )
+            break;
+
+        UInt32 numSets = (UInt8)*pos++;
+        if( list == 0 )
+            numSets &= 0x1f;
+
+        for( UInt32 curSet = 0; curSet < numSets; curSet++ )
+        {
+            if( (end - pos) < 2 )
+                break;
+            UInt32 setLength = ((UInt8)pos[0] << 8) | (UInt8)pos[1];
+            pos += 2;
+            if( (UInt32)(end - pos) < setLength )
+                break;
+
+            if( parameterSetsLength > 0 )
+                parameterSets[parameterSetsLength++] = ',';
+            parameterSetsLength += Base64encode(parameterSets + parameterSetsLength, pos, setLength) - 1;
+            pos += setLength;
+        }
+    }
+
+    fParameterSets = parameterSets;
+    return true;
+}
+
+Bool16 QTPacketizerTrack::ReadAACDescription(char * sampleDescription, UInt32 sampleDescriptionLength)
+{
+    char        *esds, *wave, *pos, *end;
+    UInt32      esdsLength, waveLength, childrenPos, descriptorLength;
+    UInt16      soundVersion;
+    UInt8       tag;
+
+    if( sampleDescriptionLength < kSoundSampleEntryLength )
+        return false;
+
+    //
+    // The sample description has the channel count and the sample rate (16.16),
+    // and version 1 and 2 descriptions have more fields before the children.
+    MOVE_WORD(soundVersion, sampleDescription + 16);
+    soundVersion = ntohs(soundVersion);
+
+    UInt16 numChannels;
+    MOVE_WORD(numChannels, sampleDescription + 24);
+    fNumChannels = ntohs(numChannels);
+
+    UInt32 sampleRate;
+    MOVE_LONG_WORD(sampleRate, sampleDescription + 32);
+    fSampleRate = ntohl(sampleRate) >> 16;
+
+    childrenPos = kSoundSampleEntryLength;
+    if( soundVersion == 1 )
+        childrenPos += 16;
+    else if( soundVersion == 2 )
+        childrenPos += 36;
+
+    //
+    // QuickTime movies keep the 'esds' atom inside a 'wave' atom.
+    if( !FindChildAtom(sampleDescription, sampleDescriptionLength, childrenPos,
+                       FOUR_CHARS_TO_INT('e', 's', 'd', 's'), &esds, &esdsLength) )
+    {
+        if( !FindChildAtom(sampleDescription, sampleDescriptionLength, childrenPos,
+                           FOUR_CHARS_TO_INT('w', 'a', 'v', 'e'), &wave, &waveLength) )
+            return false;
+        if( !FindChildAtom(wave, waveLength, 8, FOUR_CHARS_TO_INT('e', 's', 'd', 's'), &esds, &esdsLength) )
+            return false;
+    }
+
+    //
+    // Past the atom header, version and flags is the ES_Descriptor.
+    if( esdsLength < 12 )
+        return false;
+    pos = esds + 12;
+    end = esds + esdsLength;
+
+    if( !ReadDescriptor(&pos, end, &tag, &descriptorLength) || (tag != 0x03) || (descriptorLength < 3) )
+        return false;
+    end = pos + descriptorLength;
+
+    UInt8 esFlags = (UInt8)pos[2];
+    pos += 3;
+    if( esFlags & 0x80 )        // streamDependenceFlag
+        pos += 2;
+    if( (esFlags & 0x40) && (pos < end) )   // URL_Flag
+        pos += 1 + (UInt8)*pos;
+    if( esFlags & 0x20 )        // OCRstreamFlag
+        pos += 2;
+
+    //
+    // The DecoderConfigDescriptor says it is MPEG-4 or MPEG-2 AAC, and the
+    // DecoderSpecificInfo in it is the AudioSpecificConfig.
+    if( !ReadDescriptor(&pos, end, &tag, &descriptorLength) || (tag != 0x04) || (descriptorLength < 13) )
+        return false;
+
+    UInt8 objectType = (UInt8)pos[0];
+    if( (objectType != 0x40) && ((objectType < 0x66) || (objectType > 0x68)) )
+        return false;
+
+    end = pos + descriptorLength;
+    pos += 13;
+    if( !ReadDescriptor(&pos, end, &tag, &descriptorLength) || (tag != 0x05) || (descriptorLength < 2) )
+        return false;
+
+    fAudioSpecificConfig = NEW char[(descriptorLength * 2) + 1];
+    for( UInt32 i = 0; i < descriptorLength; i++ )
+        qtss_sprintf(fAudioSpecificConfig + (i * 2), "%02x", (UInt8)pos[i]);
+
+    //
+    // Prefer the sampling frequency and channel configuration of the
+    // AudioSpecificConfig to the sample description's, which is often 0 or
+    // 16 bits too small to hold the rate.
+    UInt32 frequencyIndex = (((UInt8)pos[0] & 0x07) << 1) | ((UInt8)pos[1] >> 7);
+    if( frequencyIndex < (sizeof(kAACSampleRates) / sizeof(kAACSampleRates[0])) )
+        fSampleRate = kAACSampleRates[frequencyIndex];
+
+    UInt32 channelConfiguration = ((UInt8)pos[1] >> 3) & 0x0f;
+    if( (channelConfiguration > 0) && (channelConfiguration < 7) )
+        fNumChannels = channelConfiguration;
+    else if( channelConfiguration == 7 )
+        fNumChannels = 8;
+
+    if( fNumChannels == 0 )
+        fNumChannels = 1;
+
+    return true;
+}
+
+Bool16 QTPacketizerTrack::FindChildAtom(char * parent, UInt32 parentLength, UInt32 childrenPos, OSType atomType,
+                                        char ** child, UInt32 * childLength)
+{
+    UInt32      pos = childrenPos;
+
+    while( (pos + 8) <= parentLength )
+    {
+        UInt32      atomLength, curType;
+
+        MOVE_LONG_WORD(atomLength, parent + pos);
+        atomLength = ntohl(atomLength);
+        MOVE_LONG_WORD(curType, parent + pos + 4);
+        curType = ntohl(curType);
+
+        if( (atomLength < 8) || (atomLength > (parentLength - pos)) )
+            return false;
+
+        if( curType == atomType )
+        {
+            *child = parent + pos;
+            *childLength = atomLength;
+            return true;
+        }
+
+        pos += atomLength;
+    }
+
+    return false;
+}
+
+Bool16 QTPacketizerTrack::ReadDescriptor(char ** pos, char * end, UInt8 * tag, UInt32 * length)
+{
+    char        *p = *pos;
+
+    //
+    // A tag, then a length in up to four bytes of seven bits each.
+    if( p >= end )
+        return false;
+    *tag = (UInt8)*p++;
+
+    *length = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+        if( p >= end )
+            return false;
+        UInt8 b = (UInt8)*p++;
+        *length = (*length << 7) | (b & 0x7f);
+        if( (b & 0x80) == 0 )
+            break;
+    }
+
+    if( *length > (UInt32)(end - p) )
+        return false;
+
+    *pos = p;
+    return true;
+}
+
+void QTPacketizerTrack::ComputeTotalRTPBytes(void)
+{
+    //
+    // The samples of a fragmented track aren't all known until it has been
+    // played, so it isn't estimated at all.
+    fTotalRTPBytes = 0;
+    if( this->IsFragmented() )
+        return;
+
+    //
+    // Each sample, plus an RTP header and payload header for every packet
+    // it will take.
+    UInt32 numSamples = fSampleSizeAtom->GetNumEntries();
+    for( UInt32 curSample = 1; curSample <= numSamples; curSample++ )
+    {
+        UInt32 sampleSize = 0;
+        if( !fSampleSizeAtom->SampleSize(curSample, &sampleSize) )
+            break;
+
+        UInt32 numPackets = (sampleSize / (fMaxPayloadLength - 4)) + 1;
+        fTotalRTPBytes += sampleSize + (numPackets * (kRTPHeaderLength + 4));
+    }
+}
+
+Bool16 QTPacketizerTrack::BuildSDP(void)
+{
+    char        bandwidth[32];
+    UInt32      sdpBufferSize;
+
+    //
+    // The bandwidth, in kbits/sec, if there is a size to work it out from.
+    bandwidth[0] = '\0';
+    Float64 duration = 0.0;
+    if( fFile->GetTimeScale() > 0.0 )
+        duration = (Float64)this->GetDuration() / fFile->GetTimeScale();   // the track header's duration is in movie time
+    if( (fTotalRTPBytes > 0) && (duration > 0.0) )
+        qtss_sprintf(bandwidth, "b=AS:%lu\r\n", (UInt32)(((Float64)(SInt64)fTotalRTPBytes * 8.0 / 1000.0 / duration) + 1.0));
+
+    sdpBufferSize = 512;
+    if( fParameterSets != NULL )
+        sdpBufferSize += ::strlen(fParameterSets);
+    if( fAudioSpecificConfig != NULL )
+        sdpBufferSize += ::strlen(fAudioSpecificConfig);
+
+    delete [] fSDP;
+    fSDP = NEW char[sdpBufferSize];
+
+    if( fPayload == kH264Payload )
+    {
+        qtss_sprintf(fSDP,
+            "m=video 0 RTP/AVP %u\r\n"
+            "%s"
+            "a=rtpmap:%u H264/%lu\r\n"
+            "a=control:trackID=%lu\r\n"
+            "a=fmtp:%u packetization-mode=1;profile-level-id=%02X%02X%02X%s%s\r\n",
+            kH264PayloadType,
+            bandwidth,
+            kH264PayloadType, fRTPTimescale,
+            this->GetTrackID(),
+            kH264PayloadType, fProfileLevelID[0], fProfileLevelID[1], fProfileLevelID[2],
+            ((fParameterSets != NULL) && (fParameterSets[0] != '\0')) ? ";sprop-parameter-sets=" : "",
+            (fParameterSets != NULL) ? fParameterSets : "");
+    }
+    else
+    {
+        qtss_sprintf(fSDP,
+            "m=audio 0 RTP/AVP %u\r\n"
+            "%s"
+            "a=rtpmap:%u mpeg4-generic/%lu/%lu\r\n"
+            "a=control:trackID=%lu\r\n"
+            "a=fmtp:%u streamtype=5;profile-level-id=15;mode=AAC-hbr;sizelength=13;indexlength=3;indexdeltalength=3;config=%s\r\n",
+            kAACPayloadType,
+            bandwidth,
+            kAACPayloadType, fRTPTimescale, fNumChannels,
+            this->GetTrackID(),
+            kAACPayloadType, fAudioSpecificConfig);
+    }
+
+    fSDPLength = ::strlen(fSDP);
+    return true;
+}
+
+
+
+// -------------------------------------
+// Accessors.
+//
+QTTrack::ErrorCode QTPacketizerTrack::GetSDPFileLength(int * length)
+{
+    OSMutexLocker locker(fFile->GetMutex());
+
+    if( this->Initialize() != errNoError )
+        return errInvalidQuickTimeFile;
+
+    *length = (int) fSDPLength;
+    return errNoError;
+}
+
+char * QTPacketizerTrack::GetSDPFile(int * length)
+{
+    OSMutexLocker locker(fFile->GetMutex());
+
+    if( this->Initialize() != errNoError )
+        return NULL;
+
+    char *sdpBuffer = NEW char[fSDPLength];
+    ::memcpy(sdpBuffer, fSDP, fSDPLength);
+    *length = (int) fSDPLength;
+
+    return sdpBuffer;
+}
+
+
+
+// -------------------------------------
+// Packet functions
+//
+QTTrack::ErrorCode QTPacketizerTrack::BuildH264Packets(char * sample, UInt32 sampleLength, QTPacketizerTrack_PacketList * list)
+{
+    QTPacketizerTrack_PacketList::Packet    *aggregate = NULL;
+    UInt32      aggregateLength = 0;
+    UInt32      pos = 0;
+    Bool16      sawVCLUnit = false, isReference = false;
+
+    //
+    // NAL units that fit in a packet are put in the one before if there is
+    // room, as an STAP-A, and ones that don't are split into FU-A packets.
+    while( pos < sampleLength )
+    {
+        if( (sampleLength - pos) < fNALLengthSize )
+            return errInvalidQuickTimeFile;
+
+        UInt32 nalLength = ReadNALLength(sample + pos, fNALLengthSize);
+        UInt32 nalPos = pos + fNALLengthSize;
+        if( nalLength > (sampleLength - nalPos) )
+            return errInvalidQuickTimeFile;
+        pos = nalPos + nalLength;
+
+        if( nalLength == 0 )
+            continue;
+
+        UInt8 nalHeader = (UInt8)sample[nalPos];
+        UInt8 nalType = nalHeader & 0x1f;
+        if( (nalType >= 1) && (nalType <= 5) )
+        {
+            sawVCLUnit = true;
+            if( nalHeader & 0x60 )
+                isReference = true;
+        }
+
+        if( nalLength <= fMaxPayloadLength )
+        {
+            if( (aggregate != NULL) && ((aggregateLength + 2 + nalLength) <= fMaxPayloadLength) )
+            {
+                aggregate->fNumUnits++;
+                aggregate->fLength += nalLength;
+                aggregateLength += 2 + nalLength;
+            }
+            else
+            {
+                aggregate = list->AddPacket();
+                aggregate->fOffset = nalPos;
+                aggregate->fLength = nalLength;
+                aggregate->fNumUnits = 1;
+                aggregateLength = 1 + 2 + nalLength;
+            }
+            continue;
+        }
+
+        //
+        // The NAL unit header goes in the FU indicator and header of every
+        // fragment instead of in the payload.
+        aggregate = NULL;
+        UInt32 fragmentPos = nalPos + 1;
+        UInt32 remaining = nalLength - 1;
+        UInt8 startBit = 0x80;
+        while( remaining > 0 )
+        {
+            QTPacketizerTrack_PacketList::Packet *fragment = list->AddPacket();
+            UInt32 fragmentLength = (remaining < (fMaxPayloadLength - 2)) ? remaining : (fMaxPayloadLength - 2);
+
+            fragment->fOffset = fragmentPos;
+            fragment->fLength = fragmentLength;
+            fragment->fNumUnits = 0;
+            fragment->fFragmentHeader = nalHeader;
+            fragment->fFragmentFlags = startBit | ((fragmentLength == remaining) ? 0x40 : 0);
+
+            startBit = 0;
+            fragmentPos += fragmentLength;
+            remaining -= fragmentLength;
+        }
+    }
+
+    list->fIsDisposable = sawVCLUnit && !isReference;
+    return errNoError;
+}
+
+QTTrack::ErrorCode QTPacketizerTrack::BuildAACPackets(char * /* sample */, UInt32 sampleLength, QTPacketizerTrack_PacketList * list)
+{
+    //
+    // The AU-size field is 13 bits.
+    if( sampleLength >= (1 << 13) )
+        return errInvalidQuickTimeFile;
+
+    UInt32 maxFragmentLength = fMaxPayloadLength - 4;
+    UInt32 pos = 0;
+    do
+    {
+        QTPacketizerTrack_PacketList::Packet *thePacket = list->AddPacket();
+        thePacket->fOffset = pos;
+        thePacket->fLength = ((sampleLength - pos) < maxFragmentLength) ? (sampleLength - pos) : maxFragmentLength;
+        thePacket->fNumUnits = 1;
+        pos += thePacket->fLength;
+    } while( pos < sampleLength );
+
+    return errNoError;
+}
+
+QTTrack::ErrorCode QTPacketizerTrack::GetNumPackets(UInt32 sampleNumber, UInt16 * numPackets, QTHintTrack_HintTrackControlBlock * htcb)
+{
+    char        *sample;
+    UInt32      sampleLength;
+    UInt32      mediaTime, nextMediaTime, mediaTimeOffset;
+    ErrorCode   err;
+
+    Assert(htcb != NULL);
+
+    if( htcb->fPacketList == NULL )
+        htcb->fPacketList = NEW QTPacketizerTrack_PacketList();
+    QTPacketizerTrack_PacketList *list = htcb->fPacketList;
+
+    //
+    // Read this sample; if its packets have already been worked out, they
+    // are still good.
+    if( !this->GetSamplePtr(sampleNumber, &sample, &sampleLength, htcb) )
+        return errInvalidQuickTimeFile;
+
+    if( list->fSampleNumber == sampleNumber )
+    {
+        *numPackets = (UInt16)list->fNumPackets;
+        return errNoError;
+    }
+
+    list->fSampleNumber = 0;
+    list->fNumPackets = 0;
+    list->fIsDisposable = false;
+
+    if( fPayload == kH264Payload )
+        err = this->BuildH264Packets(sample, sampleLength, list);
+    else
+        err = this->BuildAACPackets(sample, sampleLength, list);
+    if( err != errNoError )
+        return err;
+    if( list->fNumPackets > 0xFFFF )
+        return errInvalidQuickTimeFile;
+
+    //
+    // The packets of a sample go out spread over its duration.
+    if( htcb->fTrackIndex != NULL )
+    {
+        if( !htcb->fTrackIndex->GetSampleMediaTime(sampleNumber, &mediaTime) )
+            return errInvalidQuickTimeFile;
+        if( !htcb->fTrackIndex->GetSampleMediaTime(sampleNumber + 1, &nextMediaTime) )
+            nextMediaTime = mediaTime;
+    }
+    else
+    {
+        if( !this->GetSampleMediaTime(sampleNumber, &mediaTime, &htcb->fsttsSTCB) )
+            return errInvalidQuickTimeFile;
+        if( !this->GetSampleMediaTime(sampleNumber + 1, &nextMediaTime, &htcb->fsttsSTCB) )
+            nextMediaTime = mediaTime;
+    }
+
+    list->fMediaTime = mediaTime;
+    list->fDuration = (nextMediaTime > mediaTime) ? (nextMediaTime - mediaTime) : 0;
+
+    //
+    // The RTP timestamp is the sample's presentation time.
+    SInt64 presentationTime = mediaTime;
+    if( this->GetSampleMediaTimeOffset(sampleNumber, &mediaTimeOffset, &list->fcttsSTCB) )
+        presentationTime += (SInt32)mediaTimeOffset;
+
+    list->fRTPTimestamp = (UInt32)((presentationTime * (SInt64)fRTPTimescale) / (SInt64)this->GetTimeScale());
+    list->fRTPTimestamp += fFirstRTPTimestamp;
+
+    list->fSampleNumber = sampleNumber;
+    *numPackets = (UInt16)list->fNumPackets;
+
+    return errNoError;
+}
+
+UInt32 QTPacketizerTrack::WriteH264Payload(char * sample, QTPacketizerTrack_PacketList::Packet * thePacket, char * buffer)
+{
+    //
+    // FU-A: the FU indicator has the NAL unit's F and NRI bits, the FU header
+    // its type.
+    if( thePacket->fNumUnits == 0 )
+    {
+        buffer[0] = (thePacket->fFragmentHeader & 0xe0) | 28;
+        buffer[1] = thePacket->fFragmentFlags | (thePacket->fFragmentHeader & 0x1f);
+        ::memcpy(buffer + 2, sample + thePacket->fOffset, thePacket->fLength);
+        return thePacket->fLength + 2;
+    }
+
+    //
+    // Single NAL unit packet
+    if( thePacket->fNumUnits == 1 )
+    {
+        ::memcpy(buffer, sample + thePacket->fOffset, thePacket->fLength);
+        return thePacket->fLength;
+    }
+
+    //
+    // STAP-A: its F bit is set if any unit's is, and its NRI is the highest.
+    UInt8 stapHeader = 0;
+    char *pOutBuf = buffer + 1;
+    UInt32 pos = thePacket->fOffset - fNALLengthSize;
+    for( UInt16 curUnit = 0; curUnit < thePacket->fNumUnits; )
+    {
+        UInt32 nalLength = ReadNALLength(sample + pos, fNALLengthSize);
+        UInt32 nalPos = pos + fNALLengthSize;
+        pos = nalPos + nalLength;
+        if( nalLength == 0 )
+            continue;
+
+        UInt8 nalHeader = (UInt8)sample[nalPos];
+        stapHeader |= nalHeader & 0x80;
+        if( (nalHeader & 0x60) > (stapHeader & 0x60) )
+            stapHeader = (stapHeader & 0x80) | (nalHeader & 0x60);
+
+        pOutBuf[0] = (char)(nalLength >> 8);
+        pOutBuf[1] = (char)(nalLength & 0xff);
+        ::memcpy(pOutBuf + 2, sample + nalPos, nalLength);
+        pOutBuf += 2 + nalLength;
+        curUnit++;
+    }
+    buffer[0] = stapHeader | 24;
+
+    return pOutBuf - buffer;
+}
+
+UInt32 QTPacketizerTrack::WriteAACPayload(char * sample, UInt32 sampleLength, QTPacketizerTrack_PacketList::Packet * thePacket, char * buffer)
+{
+    //
+    // The AU-headers-length in bits, then one AU-header: the size of the
+    // whole access unit, and an AU-Index of 0.
+    UInt16 tempInt16 = htons(16);
+    COPY_WORD(buffer, &tempInt16);
+    tempInt16 = htons((UInt16)(sampleLength << 3));
+    COPY_WORD(buffer + 2, &tempInt16);
+
+    ::memcpy(buffer + 4, sample + thePacket->fOffset, thePacket->fLength);
+    return thePacket->fLength + 4;
+}
+
+QTTrack::ErrorCode QTPacketizerTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumber, char * buffer, UInt32 * length
+                        , Float64 * transmitTime, Bool16 dropBFrames, Bool16 /* dropRepeatPackets */, UInt32 ssrc, QTHintTrack_HintTrackControlBlock * htcb)
+{
+    UInt16      numPackets, tempInt16;
+    UInt32      tempInt32;
+    ErrorCode   err;
+
+    Assert(htcb != NULL);
+
+    DEEP_DEBUG_PRINT(("QTPacketizerTrack::GetPacket - Building packet #%u in sample %lu.\n", packetNumber, sampleNumber));
+
+    err = this->GetNumPackets(sampleNumber, &numPackets, htcb);
+    if( err != errNoError )
+        return err;
+    if( (packetNumber == 0) || (packetNumber > numPackets) )
+        return errInvalidQuickTimeFile;
+
+    QTPacketizerTrack_PacketList *list = htcb->fPacketList;
+    QTPacketizerTrack_PacketList::Packet *thePacket = &list->fPackets[packetNumber - 1];
+
+    *transmitTime = ( list->fMediaTime + this->GetFirstEditMediaTime()
+                      + (((Float64)list->fDuration * (packetNumber - 1)) / numPackets) ) * this->GetTimeScaleRecip();
+
+    if( dropBFrames && list->fIsDisposable )
+        return QTTrack::errIsSkippedPacket;
+
+    //
+    // The RTP header. The marker bit is set on the last packet of a sample,
+    // and the sequence number counts the packets sent.
+    UInt16 rtpSequenceNumber = (UInt16)htcb->fCurrentPacketNumber;
+    char *pPacketOutBuf = buffer;
+
+    tempInt16 = (fPayload == kH264Payload) ? kH264PayloadType : kAACPayloadType;
+    if( packetNumber == numPackets )
+        tempInt16 |= 0x80;
+    tempInt16 = htons(tempInt16 | 0x8000 /* v2 RTP header */);
+    COPY_WORD(pPacketOutBuf, &tempInt16);
+    pPacketOutBuf += 2;
+
+    tempInt16 = htons(rtpSequenceNumber);
+    COPY_WORD(pPacketOutBuf, &tempInt16);
+    pPacketOutBuf += 2;
+
+    tempInt32 = htonl(list->fRTPTimestamp);
+    COPY_LONG_WORD(pPacketOutBuf, &tempInt32);
+    pPacketOutBuf += 4;
+
+    tempInt32 = htonl(ssrc);
+    COPY_LONG_WORD(pPacketOutBuf, &tempInt32);
+    pPacketOutBuf += 4;
+
+    //
+    // Add in the RTP-Meta-Info fields, if this is an RTP-Meta-Info packet.
+    this->WriteMetaInfoFields(sampleNumber, rtpSequenceNumber, *transmitTime, list->fIsDisposable, htcb, &pPacketOutBuf);
+
+    char *endOfMetaInfo = pPacketOutBuf;
+    if( *length < (UInt32)(endOfMetaInfo - buffer) + fMaxPayloadLength )
+        return errParamError;
+
+    //
+    // And the payload.
+    if( fPayload == kH264Payload )
+        pPacketOutBuf += this->WriteH264Payload(htcb->fCachedSample, thePacket, pPacketOutBuf);
+    else
+        pPacketOutBuf += this->WriteAACPayload(htcb->fCachedSample, htcb->fCachedSampleLength, thePacket, pPacketOutBuf);
+
+    DEEP_DEBUG_PRINT(("QTPacketizerTrack::GetPacket - ..rtpTimestamp=%lu; rtpSequenceNumber=%u; transmitTime=%.2f\n", list->fRTPTimestamp, rtpSequenceNumber, *transmitTime));
+
+    *length = pPacketOutBuf - buffer;
+    this->FinishPacket(endOfMetaInfo, pPacketOutBuf, length, htcb);
+
+    return errNoError;
+}
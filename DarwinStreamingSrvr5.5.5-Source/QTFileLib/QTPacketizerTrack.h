@@ -0,0 +1,177 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTPacketizerTrack:
+//   A media track of a movie without hint tracks, packetized as it is
+//   played. H.264 video ('avc1', 'avc3') goes out as RFC 6184 packets in
+//   non-interleaved mode: NAL units that fit are aggregated into STAP-A
+//   packets, and ones that don't are split into FU-A packets. AAC audio
+//   ('mp4a') goes out as RFC 3640 AAC-hbr packets, one access unit or
+//   access unit fragment to a packet.
+//
+//   It stands in for a hint track whose samples are the media samples, so
+//   QTRTPFile plays, seeks and thins it like one. Each sample is read in
+//   one piece and its packets are worked out once, instead of reading a
+//   hint sample and then the media data it points to for every packet.
+
+#ifndef QTPacketizerTrack_H
+#define QTPacketizerTrack_H
+
+
+//
+// Includes
+#include "QTHintTrack.h"
+
+
+//
+// The packets of a sample; kept in the HTCB along with the sample itself.
+class QTPacketizerTrack_PacketList {
+
+public:
+    //
+    // Constructor and destructor.
+                        QTPacketizerTrack_PacketList(void);
+                        ~QTPacketizerTrack_PacketList(void);
+
+    //
+    // Where a packet's payload comes from in the sample.
+    struct Packet {
+        UInt32      fOffset;
+        UInt32      fLength;
+        UInt16      fNumUnits;          // NAL units in an STAP-A, 0 for a fragment, 1 otherwise
+        UInt8       fFragmentHeader;    // FU-A: the NAL unit header
+        UInt8       fFragmentFlags;     // FU-A: start and end bits
+    };
+
+    Packet              *AddPacket(void);
+
+    UInt32              fSampleNumber;      // the packets are of this sample, or 0
+    UInt32              fMediaTime, fDuration;
+    UInt32              fRTPTimestamp;
+    Bool16              fIsDisposable;      // no other sample refers to it
+
+    QTAtom_ctts_SampleTableControlBlock fcttsSTCB;
+
+    Packet              *fPackets;
+    UInt32              fNumPackets, fMaxPackets;
+};
+
+
+//
+// QTPacketizerTrack class
+class QTPacketizerTrack : public QTHintTrack {
+
+public:
+    //
+    // Constructors and destructor.
+                        QTPacketizerTrack(QTFile * File, QTFile::AtomTOCEntry * trakAtom,
+                               Bool16 Debug = false, Bool16 DeepDebug = false);
+    virtual             ~QTPacketizerTrack(void);
+
+    //
+    // Whether the track's first sample description is in a format that
+    // can be packetized. Only looks at the format, so Initialize can still
+    // fail on a malformed description.
+    static  Bool16      CanPacketize(QTFile * File, QTFile::AtomTOCEntry * trakAtom);
+
+    //
+    // Initialization functions.
+    virtual ErrorCode   Initialize(void);
+
+    //
+    // Accessors. The SDP is made up from the sample description.
+    virtual ErrorCode   GetSDPFileLength(int * Length);
+    virtual char *      GetSDPFile(int * Length);
+
+    //
+    // An estimate from the sample sizes; 0 for a fragmented track.
+    virtual UInt64      GetTotalRTPBytes(void) { return fTotalRTPBytes; }
+
+    //
+    // Packet functions
+    virtual ErrorCode   GetNumPackets(UInt32 SampleNumber, UInt16 * NumPackets,
+                                      QTHintTrack_HintTrackControlBlock * HTCB = NULL);
+
+    virtual ErrorCode   GetPacket(UInt32 SampleNumber, UInt16 PacketNumber,
+                                  char * Buffer, UInt32 * Length,
+                                  Float64 * TransmitTime,
+                                  Bool16 dropBFrames,
+                                  Bool16 dropRepeatPackets = false,
+                                  UInt32 SSRC = 0,
+                                  QTHintTrack_HintTrackControlBlock * HTCB = NULL);
+
+protected:
+
+    enum {
+        kH264Payload,
+        kAACPayload
+    };
+
+    enum {
+        kMaxRTPPacketLength     = 1400,     // bytes, counting the RTP header
+        kRTPHeaderLength        = 12,
+        kH264PayloadType        = 96,
+        kAACPayloadType         = 97,
+        kH264RTPTimescale       = 90000
+    };
+
+    //
+    // Protected member functions.
+            Bool16      ReadH264Description(char * SampleDescription, UInt32 Length);
+            Bool16      ReadAACDescription(char * SampleDescription, UInt32 Length);
+            Bool16      BuildSDP(void);
+            void        ComputeTotalRTPBytes(void);
+
+            ErrorCode   BuildH264Packets(char * Sample, UInt32 Length, QTPacketizerTrack_PacketList * List);
+            ErrorCode   BuildAACPackets(char * Sample, UInt32 Length, QTPacketizerTrack_PacketList * List);
+            UInt32      WriteH264Payload(char * Sample, QTPacketizerTrack_PacketList::Packet * ThePacket, char * Buffer);
+            UInt32      WriteAACPayload(char * Sample, UInt32 SampleLength, QTPacketizerTrack_PacketList::Packet * ThePacket, char * Buffer);
+
+    static  Bool16      FindChildAtom(char * Parent, UInt32 ParentLength, UInt32 ChildrenPos, OSType AtomType,
+                                      char ** Child, UInt32 * ChildLength);
+    static  Bool16      ReadDescriptor(char ** Pos, char * End, UInt8 * Tag, UInt32 * Length);
+
+    //
+    // Protected member variables.
+    UInt32              fPayload;
+    UInt32              fMaxPayloadLength;
+
+    //
+    // H.264: from the 'avcC' atom
+    UInt32              fNALLengthSize;
+    char                *fParameterSets;        // sprop-parameter-sets, base64 encoded
+    UInt8               fProfileLevelID[3];
+
+    //
+    // AAC: from the 'esds' atom
+    char                *fAudioSpecificConfig;  // config, in hex
+    UInt32              fSampleRate, fNumChannels;
+
+    char                *fSDP;
+    UInt32              fSDPLength;
+    UInt64              fTotalRTPBytes;
+};
+
+#endif // QTPacketizerTrack_H
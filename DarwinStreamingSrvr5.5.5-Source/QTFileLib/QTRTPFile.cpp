@@ -35,6 +35,8 @@
 #include <stdlib.h>
 #include "SafeStdLib.h"
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "OSMutex.h"
 
@@ -45,6 +47,7 @@
 
 #include "QTRTPFile.h"
 #include "OSMemory.h"
+#include "OSAsyncFileReader.h"
 
 
 #define QT_PROFILE 0
@@ -75,273 +78,339 @@ const RTPMetaInfoPacket::FieldID QTRTPFile::kMetaInfoFields[] =
 // -------------------------------------
 // Protected cache functions and variables.
 //
-OSMutex                         *QTRTPFile::gFileCacheMutex,
-                                *QTRTPFile::gFileCacheAddMutex;
-QTRTPFile::RTPFileCacheEntry    *QTRTPFile::gFirstFileCacheEntry = NULL;
+QTRTPFile::RTPFileCacheShard    QTRTPFile::gFileCacheShards[QTRTPFile::kNumFileCacheShards];
+UInt64                          QTRTPFile::gFileCacheShardMaxBytes = 0;
+Bool16                          QTRTPFile::gPacketIndexEnabled = true;
+
+static void GetFileModDateAndLength(const char * filePath, SInt64 * outModDate, SInt64 * outLength)
+{
+    struct stat theStat;
+    
+    *outModDate = -1;
+    *outLength = -1;
+    if( ::stat(filePath, &theStat) != 0 )
+        return;
+        
+    *outModDate = (SInt64)theStat.st_mtime * 1000;
+    *outLength = (SInt64)theStat.st_size;
+}
+
+//
+// OSHeap orders by a 64-bit integer. The bits of an IEEE double already sort
+// like one when it is positive; flipping all but the sign bit of a negative
+// one makes those sort too. The low bits then get the track's index, so that
+// when packets have the same time the one from the last track comes out first,
+// as it did before the heap, whatever shape the heap is in. That gives up the
+// last few bits of the time, far less than a nanosecond.
+static inline SInt64 PacketTimeToHeapValue(Float64 packetTime, UInt32 trackIndex)
+{
+    const UInt64 kTrackIndexMask = (1 << 8) - 1;
+    
+    SInt64 heapValue;
+    ::memcpy(&heapValue, &packetTime, sizeof(heapValue));
+    if( heapValue < 0 )
+        heapValue = (SInt64)((UInt64)heapValue ^ (~(UInt64)0 >> 1));
+    return (SInt64)(((UInt64)heapValue & ~kTrackIndexMask) | (kTrackIndexMask - (trackIndex & kTrackIndexMask)));
+}
 
 void QTRTPFile::Initialize(void)
 {
-    QTRTPFile::gFileCacheMutex = NEW OSMutex();
-    QTRTPFile::gFileCacheAddMutex = NEW OSMutex();
+    // The file cache is statically allocated, so that tools which never
+    // call this can still open movies. Nothing else needs setting up yet.
+}
+
+void QTRTPFile::SetFileCacheSize(UInt64 inMaxBytes)
+{
+    QTRTPFile::gFileCacheShardMaxBytes = inMaxBytes / kNumFileCacheShards;
+    
+    //
+    // Let go of whatever no longer fits.
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+    {
+        OSMutexLocker   shardMutex(&QTRTPFile::gFileCacheShards[shardIndex].fMutex);
+        QTRTPFile::EvictIdleFileCacheEntries(&QTRTPFile::gFileCacheShards[shardIndex]);
+    }
+}
+
+UInt64 QTRTPFile::GetFileCacheHits()
+{
+    UInt64 theTotal = 0;
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+        theTotal += QTRTPFile::gFileCacheShards[shardIndex].fNumHits;
+    return theTotal;
+}
+
+UInt64 QTRTPFile::GetFileCacheMisses()
+{
+    UInt64 theTotal = 0;
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+        theTotal += QTRTPFile::gFileCacheShards[shardIndex].fNumMisses;
+    return theTotal;
+}
+
+UInt64 QTRTPFile::GetFileCacheEvictions()
+{
+    UInt64 theTotal = 0;
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+        theTotal += QTRTPFile::gFileCacheShards[shardIndex].fNumEvictions;
+    return theTotal;
+}
+
+UInt64 QTRTPFile::GetFileCacheBytes()
+{
+    UInt64 theTotal = 0;
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+        theTotal += QTRTPFile::gFileCacheShards[shardIndex].fBytesCached;
+    return theTotal;
+}
+
+UInt32 QTRTPFile::GetFileCacheEntries(FileCacheEntryInfo* outInfo, UInt32 inMaxEntries)
+{
+    UInt32 numEntries = 0;
+    
+    for( UInt32 shardIndex = 0; shardIndex < kNumFileCacheShards; shardIndex++ )
+    {
+        RTPFileCacheShard   *shard = &QTRTPFile::gFileCacheShards[shardIndex];
+        OSMutexLocker       shardMutex(&shard->fMutex);
+        
+        OSHashTableIter<RTPFileCacheEntry, QTRTPFileCacheKey> theIter(&shard->fTable);
+        for( ; !theIter.IsDone() && (numEntries < inMaxEntries); theIter.Next() )
+        {
+            RTPFileCacheEntry *cacheEntry = theIter.GetCurrent();
+            if( cacheEntry->File == NULL )
+                continue; // still being opened
+                
+            ::strncpy(outInfo[numEntries].fFilename, cacheEntry->fFilename, sizeof(outInfo[numEntries].fFilename) - 1);
+            outInfo[numEntries].fFilename[sizeof(outInfo[numEntries].fFilename) - 1] = '\0';
+            outInfo[numEntries].fMemoryUsed = cacheEntry->fMemoryUsed;
+            outInfo[numEntries].fNumUsers = cacheEntry->ReferenceCount;
+            numEntries++;
+        }
+    }
+    
+    return numEntries;
 }
 
 
-QTRTPFile::ErrorCode QTRTPFile::new_QTFile(const char * filePath, QTFile ** theQTFile, Bool16 debugFlag, Bool16 deepDebugFlag)
+QTRTPFile::ErrorCode QTRTPFile::new_QTFile(const char * filePath, QTFile ** theQTFile, RTPFileCacheEntry ** theCacheEntry, Bool16 debugFlag, Bool16 deepDebugFlag)
 {
     // Temporary vars
     QTFile::ErrorCode   rcFile;
+    QTRTPFile::ErrorCode rc = errNoError;
 
     // General vars
-    OSMutexLocker       fileCacheAddMutex(QTRTPFile::gFileCacheAddMutex);
-
+    QTRTPFileCacheKey   cacheKey(filePath);
+    RTPFileCacheShard   *shard = &QTRTPFile::gFileCacheShards[cacheKey.GetShard()];
+    SInt64              modDate, fileLength;
+    GetFileModDateAndLength(filePath, &modDate, &fileLength);
+    
+    OSMutexLocker       shardMutex(&shard->fMutex);
     QTRTPFile::RTPFileCacheEntry    *fileCacheEntry;
     
+    
+    //
+    // A movie that changed on disk since we opened it is stale. Whoever is
+    // playing it keeps the old copy, but nobody new gets it. The length is
+    // checked too, since a rewrite can land within the mod date's second.
+    fileCacheEntry = shard->fTable.Map(&cacheKey);
+    if( (fileCacheEntry != NULL) && (fileCacheEntry->File != NULL)
+        && ((fileCacheEntry->fModDate != modDate) || (fileCacheEntry->fFileLength != fileLength)) )
+    {
+        QTRTPFile::RemoveFromFileCache(shard, fileCacheEntry);
+        fileCacheEntry = NULL;
+    }
         
     //
     // Find and return the QTFile object out of our cache, if it exists.
-    if( QTRTPFile::FindAndRefcountFileCacheEntry(filePath, &fileCacheEntry) ) 
+    if( fileCacheEntry != NULL ) 
     {
-        fileCacheAddMutex.Unlock();
+        if( fileCacheEntry->ReferenceCount++ == 0 )
+            shard->fLRUQueue.Remove(&fileCacheEntry->fLRUElem);
+        shard->fNumHits++;
+        shardMutex.Unlock();
     
-        fileCacheEntry->InitMutex->Lock();  // Guaranteed to block as the mutex
-                                            // is acquired before it is added to
-                                            // the list.
+        fileCacheEntry->InitMutex->Lock();  // Blocks while whoever added the
+                                            // entry is still opening the file.
         fileCacheEntry->InitMutex->Unlock();// Because we don't actually need it.
     
-        *theQTFile = fileCacheEntry->File;
-        Assert(*theQTFile);
+        if( fileCacheEntry->File == NULL )
+        {   // The open failed
+            rc = fileCacheEntry->fOpenErr;
+            QTRTPFile::delete_QTFile(fileCacheEntry);
+            return rc;
+        }
         
+        *theQTFile = fileCacheEntry->File;
+        *theCacheEntry = fileCacheEntry;
         return errNoError;
     }
 
 
     //
-    // Construct our file object.
-    *theQTFile = NEW QTFile(debugFlag, deepDebugFlag);
-    if( *theQTFile == NULL )
-        return errInternalError;
-        
+    // Add an entry for this file, so that anyone else who wants it waits for
+    // us to open it instead of opening it too.
+    fileCacheEntry = NEW QTRTPFile::RTPFileCacheEntry();
+    fileCacheEntry->InitMutex = NEW OSMutex();
+    fileCacheEntry->InitMutex->Lock();
+    
+    fileCacheEntry->fFilename = NEW char[(::strlen(filePath) + 2)];
+    ::strcpy(fileCacheEntry->fFilename, filePath);
+    fileCacheEntry->File = NULL;
+    fileCacheEntry->fOpenErr = errNoError;
+    fileCacheEntry->fModDate = modDate;
+    fileCacheEntry->fFileLength = fileLength;
+    fileCacheEntry->fMemoryUsed = 0;
+    fileCacheEntry->fIndex = NULL;
+    fileCacheEntry->fIndexChecked = false;
+    
+    fileCacheEntry->ReferenceCount = 1;
+    
+    fileCacheEntry->fHashKey = cacheKey.GetHashKey();
+    fileCacheEntry->fShard = cacheKey.GetShard();
+    fileCacheEntry->fIsInTable = true;
+    fileCacheEntry->fLRUElem.SetEnclosingObject(fileCacheEntry);
+    fileCacheEntry->fNextHashEntry = NULL;
+    
+    shard->fTable.Add(fileCacheEntry);
+    shard->fNumMisses++;
+    shardMutex.Unlock();
+
+
     //
-    // Open the specified movie.
+    // Construct our file object and open the specified movie.
+    *theQTFile = NEW QTFile(debugFlag, deepDebugFlag);
     if( (rcFile = (*theQTFile)->Open(filePath)) != QTFile::errNoError ) 
     {
         delete *theQTFile;
+        *theQTFile = NULL;
         
         switch( rcFile ) 
         {
             case errFileNotFound:
-                return errFileNotFound;
+                rc = errFileNotFound;
+                break;
                 
             case errInvalidQuickTimeFile: 
-                return errInvalidQuickTimeFile;
+                rc = errInvalidQuickTimeFile;
+                break;
                 
             default: 
-                return errInternalError;
+                rc = errInternalError;
+                break;
         }
     }
     
 
     //
-    // Add this file to our cache and release the global add mutex.
-    QTRTPFile::AddFileToCache(filePath, &fileCacheEntry); // Grabs InitMutex.
-    fileCacheAddMutex.Unlock();
-
-
-    //
-    // Finish setting up the fileCacheEntry.
-    if( fileCacheEntry != NULL )
-    {   // it may not have been cached..
-        fileCacheEntry->File = *theQTFile;      
-        fileCacheEntry->InitMutex->Unlock();
+    // Finish setting up the fileCacheEntry. Failures aren't cached.
+    shardMutex.Lock();
+    fileCacheEntry->File = *theQTFile;
+    fileCacheEntry->fOpenErr = rc;
+    if( *theQTFile != NULL )
+    {
+        fileCacheEntry->fMemoryUsed = (*theQTFile)->GetMovieHeaderSize();
+        shard->fBytesCached += fileCacheEntry->fMemoryUsed;
     }
+    else
+        QTRTPFile::RemoveFromFileCache(shard, fileCacheEntry);
+    shardMutex.Unlock();
+    
+    fileCacheEntry->InitMutex->Unlock();
 
+    if( rc != errNoError )
+    {
+        QTRTPFile::delete_QTFile(fileCacheEntry);
+        return rc;
+    }
+    
     //
     // Return the file object.
+    *theCacheEntry = fileCacheEntry;
     return errNoError;
 }
 
 
-void QTRTPFile::delete_QTFile(QTFile * theQTFile)
+void QTRTPFile::delete_QTFile(RTPFileCacheEntry * cacheEntry)
 {
-
+    if( cacheEntry == NULL )
+        return;
+        
     // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
-    QTRTPFile::RTPFileCacheEntry    *listEntry;
-
-
-    //
-    // Find the specified cache entry.
-    for ( listEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry ) 
-    {
-        //
-        // Check for matches.
-        if( listEntry->File != theQTFile )
-            continue;
-            
-        theQTFile->DecBufferUserCount();
-        //
-        // Delete the object if the reference count has dropped to zero.
-        if ( --listEntry->ReferenceCount == 0 ) 
-        {
-            //
-            // Delete the file.
-            if( theQTFile != NULL )
-            {   delete theQTFile;
-            }
+    RTPFileCacheShard   *shard = &QTRTPFile::gFileCacheShards[cacheEntry->fShard];
+    OSMutexLocker       shardMutex(&shard->fMutex);
 
-            //
-            // Free our other vars.
-            if( listEntry->InitMutex != NULL )
-                delete listEntry->InitMutex;
 
-            if( listEntry->fFilename != NULL )
-                delete [] listEntry->fFilename;
-            
-            //
-            // Remove this entry from the list.
-            if( listEntry->PrevEntry != NULL )
-                listEntry->PrevEntry->NextEntry = listEntry->NextEntry;
-        
-            if( listEntry->NextEntry != NULL )
-                listEntry->NextEntry->PrevEntry = listEntry->PrevEntry;
+    if( cacheEntry->File != NULL )
+        cacheEntry->File->DecBufferUserCount();
         
-            if( QTRTPFile::gFirstFileCacheEntry == listEntry )
-                QTRTPFile::gFirstFileCacheEntry = listEntry->NextEntry;
-                
-            delete listEntry;
-        }
-
-        //
-        // Return.
+    if( --cacheEntry->ReferenceCount > 0 )
         return;
-    }
-
+        
     //
-    // The object was not in the cache.  Delete it
-    if( theQTFile != NULL )
-    {   delete theQTFile;
+    // Nobody is using the file any more. Keep it around for the next viewer
+    // if there's room, unless it has already been taken out of the cache.
+    if( cacheEntry->fIsInTable )
+    {
+        shard->fLRUQueue.EnQueue(&cacheEntry->fLRUElem);
+        QTRTPFile::EvictIdleFileCacheEntries(shard);
     }
+    else
+        QTRTPFile::DeleteFileCacheEntry(cacheEntry);
 }
 
 
-void QTRTPFile::AddFileToCache(const char *inFilename, QTRTPFile::RTPFileCacheEntry ** newListEntry)
+void QTRTPFile::RemoveFromFileCache(RTPFileCacheShard * shard, RTPFileCacheEntry * cacheEntry)
 {
-    // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
-    QTRTPFile::RTPFileCacheEntry*   listEntry;
-    QTRTPFile::RTPFileCacheEntry*   lastListEntry;
+    // Call with the shard mutex held
+    Assert(cacheEntry->fIsInTable);
     
+    shard->fTable.Remove(cacheEntry);
+    shard->fBytesCached -= cacheEntry->fMemoryUsed;
+    cacheEntry->fIsInTable = false;
     
     //
-    // Add this track object to our track list.
-    (*newListEntry) = NEW QTRTPFile::RTPFileCacheEntry();
-    if( (*newListEntry) == NULL )
-        return;
-
-    (*newListEntry)->InitMutex = NEW OSMutex();
-    if( (*newListEntry)->InitMutex == NULL ) {
-        delete (*newListEntry);
-        *newListEntry = NULL;
-        return;
+    // An entry in use gets deleted when its last user lets go of it.
+    if( cacheEntry->ReferenceCount == 0 )
+    {
+        shard->fLRUQueue.Remove(&cacheEntry->fLRUElem);
+        QTRTPFile::DeleteFileCacheEntry(cacheEntry);
     }
-    (*newListEntry)->InitMutex->Lock();
-    
-    (*newListEntry)->fFilename = NEW char[(::strlen(inFilename) + 2)];
-    ::strcpy((*newListEntry)->fFilename, inFilename);
-    (*newListEntry)->File = NULL;
-    
-    (*newListEntry)->ReferenceCount = 1;
+}
 
-    (*newListEntry)->PrevEntry = NULL;
-    (*newListEntry)->NextEntry = NULL;
 
-    //
-    // Make this the first entry if there are no entries, otherwise we need to
-    // find out where this file fits in the list and insert it there.
-    if( QTRTPFile::gFirstFileCacheEntry == NULL ) 
-    {
-        QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-    }
-    else
+void QTRTPFile::EvictIdleFileCacheEntries(RTPFileCacheShard * shard)
+{
+    // Call with the shard mutex held
+    while( shard->fBytesCached > QTRTPFile::gFileCacheShardMaxBytes )
     {
-        //
-        // Go through the cache list until we find an inode number greater than
-        // the one that we have now.  Insert it in the list when we find this.
-        for( listEntry = lastListEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry ) {
-            //
-            // This is the last list entry that we saw (useful for later).
-            lastListEntry = listEntry;
+        OSQueueElem *theElem = shard->fLRUQueue.GetHead();
+        if( theElem == NULL )
+            break; // everything left is in use
             
-            //
-            // Skip this entry if this inode number is smaller than the one
-            // for our new entry.
-            if( strcmp(listEntry->fFilename,inFilename) < 0 )
-                continue;
-            
-            //
-            // We've found a larger inode; insert this one in the list.
-            if( listEntry->PrevEntry == NULL )
-                QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-            else
-                listEntry->PrevEntry->NextEntry = (*newListEntry);
-                
-            (*newListEntry)->PrevEntry = listEntry->PrevEntry;
-            
-            listEntry->PrevEntry = (*newListEntry);
-            
-            (*newListEntry)->NextEntry = listEntry;
-            
-            return;
-        }
-        
-        //
-        // We fell out of our loop; this means that we are the largest inode
-        // in the list; add ourselves to the end of the list.
-        if( lastListEntry == NULL ) { // this can't happen, but..
-            QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-        }
-        else
-        {
-            lastListEntry->NextEntry = (*newListEntry);
-            (*newListEntry)->PrevEntry = lastListEntry;
-        }
+        shard->fNumEvictions++;
+        QTRTPFile::RemoveFromFileCache(shard, (RTPFileCacheEntry *)theElem->GetEnclosingObject());
     }
 }
 
-Bool16 QTRTPFile::FindAndRefcountFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **cacheEntry)
-{
-    // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
-    QTRTPFile::RTPFileCacheEntry    *listEntry;
-
-
-    //
-    // Find the specified cache entry.
-    for( listEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry )
-    {
-        //
-        // Check for matches.
-        if( ::strcmp(listEntry->fFilename, inFilename) != 0 )
-            continue;
 
-        //
-        // Update the reference count and set the return value.
-        listEntry->ReferenceCount++;
+void QTRTPFile::DeleteFileCacheEntry(RTPFileCacheEntry * cacheEntry)
+{
+    if( cacheEntry->fIndex != NULL )
+        delete cacheEntry->fIndex;
         
-        *cacheEntry = listEntry;
+    if( cacheEntry->File != NULL )
+        delete cacheEntry->File;
         
-        //
-        // Return.
-        return true;
-    }
-
-    //
-    // The search failed.
-    return false;
+    if( cacheEntry->InitMutex != NULL )
+        delete cacheEntry->InitMutex;
+        
+    if( cacheEntry->fFilename != NULL )
+        delete [] cacheEntry->fFilename;
+        
+    delete cacheEntry;
 }
 
 
-
 // -------------------------------------
 // Constructors and destructors
 //
@@ -349,11 +418,14 @@ QTRTPFile::QTRTPFile(Bool16 debugFlag, Bool16 deepDebugFlag)
     : fDebug(debugFlag)
     , fDeepDebug(deepDebugFlag)
     , fFile(NULL)
+    , fFileCacheEntry(NULL)
     , fFCB(NULL)
     , fNumHintTracks(0)
     , fFirstTrack(NULL)
     , fLastTrack(NULL)
     , fCurSeekTrack(NULL)
+    , fPacketHeap(4)
+    , fPacketHeapIsValid(false)
     , fSDPFile(NULL)
     , fSDPFileLength(0)
     , fNumSkippedSamples(0)
@@ -364,6 +436,8 @@ QTRTPFile::QTRTPFile(Bool16 debugFlag, Bool16 deepDebugFlag)
     , fHasRTPMetaInfoFieldArray(false)
     , fWasLastSeekASeekToPacketNumber(false)
     , fDropRepeatPackets(false)
+    , fReadWouldBlock(false)
+    , fIndexChecked(false)
     , fErr(errNoError)
 {
     fFCB = NEW QTFile_FileControlBlock();
@@ -398,7 +472,7 @@ QTRTPFile::~QTRTPFile(void)
     if( fSDPFile != NULL )
         delete[] fSDPFile;
     
-    this->delete_QTFile(fFile);
+    this->delete_QTFile(fFileCacheEntry);
 
     if( fFCB != NULL )
         delete fFCB;
@@ -420,12 +494,21 @@ QTRTPFile::ErrorCode QTRTPFile::Initialize(const char * filePath)
     
     //
     // Create our file object.
-    rc = this->new_QTFile(filePath, &fFile, fDebug, fDeepDebug);
+    rc = this->new_QTFile(filePath, &fFile, &fFileCacheEntry, fDebug, fDeepDebug);
     if ( rc != errNoError ){
         fFile = NULL;
+        fFileCacheEntry = NULL;
         return rc;
     }
 
+#if DSS_USE_API_CALLBACKS
+    //
+    // The QTFile is shared with everyone playing this movie. Give ourselves
+    // a file object of our own, so our packet reads can be asynchronous.
+    if (OSAsyncFileReader::IsEnabled())
+        fFCB->Set((char *)filePath, true);
+#endif
+
 
     //
     // Iterate through all of the tracks, adding hint tracks to our list.
@@ -478,6 +561,8 @@ QTRTPFile::ErrorCode QTRTPFile::Initialize(const char * filePath)
         
         listEntry->CurPacketTime = 0.0;
         listEntry->CurPacketLength = 0;
+        listEntry->PacketHeapElem.SetEnclosingObject(listEntry);
+        listEntry->TrackIndex = fNumHintTracks;
 
         listEntry->NextTrack = NULL;
 
@@ -713,6 +798,7 @@ QTRTPFile::ErrorCode QTRTPFile::AddTrack(UInt32 trackID, Bool16 useRandomOffset)
     //
     // This track is now active.
     trackEntry->IsTrackActive = true;
+    fPacketHeapIsValid = false;
     
     //
     // The track has been added.
@@ -880,6 +966,8 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
     RTPTrackListEntry   *listEntry;
     Float64             syncToTime = seekToTime;
 
+    fReadWouldBlock = false;
+    
     if (fErr == errCallAgain)
     {
         fErr = this->ScanToCorrectSample();
@@ -889,6 +977,8 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
     //
     // This is Seek, not SeekToPacketNumber.
     fWasLastSeekASeekToPacketNumber = false;
+    
+    this->FindIndex();
 
 
     //
@@ -916,18 +1006,18 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
         if ( mediaTime < 0 )
             mediaTime = 0;
             
-        if ( !listEntry->HintTrack->GetSampleNumberFromMediaTime(mediaTime, &newSampleNumber, &listEntry->HTCB->fsttsSTCB) )
+        if ( !this->GetSampleNumberFromMediaTime(listEntry, mediaTime, &newSampleNumber) )
             continue;   // This track is probably done playing.
         
         //
         // Find the nearest (moving backwards in time) keyframe.
-        listEntry->HintTrack->GetPreviousSyncSample(newSampleNumber, &newSyncSampleNumber);
+        this->GetPreviousSyncSample(listEntry, newSampleNumber, &newSyncSampleNumber);
         if ( newSampleNumber == newSyncSampleNumber )
             continue;
 
         //
         // Figure out what time this sample is at.
-        if( !listEntry->HintTrack->GetSampleMediaTime(newSyncSampleNumber, &newSampleMediaTime, &listEntry->HTCB->fsttsSTCB) )
+        if( !this->GetSampleMediaTime(listEntry, newSyncSampleNumber, &newSampleMediaTime) )
             return errInvalidQuickTimeFile;
             
         newSampleMediaTime += listEntry->HintTrack->GetFirstEditMediaTime();
@@ -973,6 +1063,7 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
     else
         fSeekTime = seekToTime;
     
+    fPacketHeapIsValid = false;
     for ( listEntry = fFirstTrack; listEntry != NULL; listEntry = listEntry->NextTrack ) 
     {
         if( !listEntry->IsTrackActive )
@@ -993,7 +1084,7 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
             mediaTime = 0;
 
         listEntry->SampleToSeekTo = 0;
-        if (!listEntry->HintTrack->GetSampleNumberFromMediaTime(mediaTime, &listEntry->SampleToSeekTo, &listEntry->HTCB->fsttsSTCB))
+        if (!this->GetSampleNumberFromMediaTime(listEntry, mediaTime, &listEntry->SampleToSeekTo))
             continue;
         
         //
@@ -1008,7 +1099,7 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
                 mediaTime = 0;
 
             listEntry->CurSampleNumber = 0;
-            if (!listEntry->HintTrack->GetSampleNumberFromMediaTime(mediaTime, &listEntry->CurSampleNumber, &listEntry->HTCB->fsttsSTCB))
+            if (!this->GetSampleNumberFromMediaTime(listEntry, mediaTime, &listEntry->CurSampleNumber))
                 continue;
         }
         else
@@ -1023,6 +1114,11 @@ QTRTPFile::ErrorCode QTRTPFile::Seek(Float64 seekToTime, Float64 maxBackupTime)
             listEntry->IsPacketAvailable = true;
     }
     
+    //
+    // Nothing above depends on earlier calls, so just start over once the data is in
+    if (fReadWouldBlock)
+        return errCallAgain;
+    
     //
     // 'Forget' that we had a previous packet.
     fLastPacketTrack = NULL;
@@ -1049,6 +1145,8 @@ QTRTPFile::ErrorCode QTRTPFile::ScanToCorrectSample()
         if( !fCurSeekTrack->IsTrackActive )
             continue;
         
+        this->SkipToSampleBeforeSeekSample(fCurSeekTrack);
+        
         //
         // Scan through all the packets in this track until we get to the sample we want
         while (fCurSeekTrack->CurSampleNumber < fCurSeekTrack->SampleToSeekTo)
@@ -1060,6 +1158,9 @@ QTRTPFile::ErrorCode QTRTPFile::ScanToCorrectSample()
             
             if (!this->PrefetchNextPacket(fCurSeekTrack))
             {
+                if (fReadWouldBlock)
+                    return errCallAgain;
+                    
                 fCurSeekTrack->IsPacketAvailable = false;
                 break;
             }
@@ -1069,8 +1170,106 @@ QTRTPFile::ErrorCode QTRTPFile::ScanToCorrectSample()
     return errNoError;
 }
 
+void QTRTPFile::SkipToSampleBeforeSeekSample(RTPTrackListEntry * trackEntry)
+{
+    //
+    // If the index has numbered the packets, there is no need to build every
+    // packet on the way to the sample we're seeking to. Pick up as if we had
+    // just built the last packet of the sample before it. Skipped packets
+    // aren't counted, so this only works if none are being skipped.
+    QTRTPFileIndex::TrackIndex  *trackIndex = trackEntry->HTCB->fTrackIndex;
+    UInt64      curPacketNumber, curPacketPosition;
+    UInt64      lastPacketNumber, lastPacketPosition;
+    UInt64      packetNumber, packetPosition;
+    
+    if( (trackIndex == NULL) || !trackIndex->HasPacketNumbers() )
+        return;
+    if( (trackEntry->QualityLevel != kAllPackets) || fDropRepeatPackets )
+        return;
+    if( trackEntry->CurSampleNumber + 1 >= trackEntry->SampleToSeekTo )
+        return;
+    
+    //
+    // Make sure the packet counts so far agree with the index.
+    if( !trackIndex->GetPacketsBeforeSample(trackEntry->CurSampleNumber, &curPacketNumber, &curPacketPosition)
+        || (curPacketNumber + trackEntry->CurPacketNumber != trackEntry->HTCB->fCurrentPacketNumber) )
+        return;
+    
+    UInt32 lastSampleNumber = trackEntry->SampleToSeekTo - 1;
+    if( !trackIndex->GetPacketsBeforeSample(lastSampleNumber, &lastPacketNumber, &lastPacketPosition)
+        || !trackIndex->GetPacketsBeforeSample(trackEntry->SampleToSeekTo, &packetNumber, &packetPosition)
+        || (packetNumber - lastPacketNumber > 0xFFFF) )
+        return;
+    
+    UInt32 firstSampleNumber = trackEntry->CurSampleNumber;
+    trackEntry->CurSampleNumber = lastSampleNumber;
+    trackEntry->NumPacketsInThisSample = (UInt16)(packetNumber - lastPacketNumber);
+    trackEntry->CurPacketNumber = trackEntry->NumPacketsInThisSample;
+    trackEntry->HTCB->fCurrentPacketNumber = packetNumber;
+    trackEntry->HTCB->fCurrentPacketPosition = packetPosition;
+    
+    //
+    // The last sync sample we went past, as scanning would have left it.
+    UInt32 syncSampleNumber;
+    trackIndex->GetPreviousSyncSample(lastSampleNumber - 1, &syncSampleNumber);
+    if( (syncSampleNumber >= firstSampleNumber) && trackIndex->IsSyncSample(syncSampleNumber) )
+    {
+        trackEntry->LastSyncSampleNumber = syncSampleNumber;
+        trackEntry->NextSyncSampleNumber = 0;
+    }
+}
+
+void QTRTPFile::FindIndex()
+{
+    if( fIndexChecked )
+        return;
+    fIndexChecked = true;
+    
+    if( !QTRTPFile::gPacketIndexEnabled || (fFileCacheEntry == NULL) )
+        return;
+        
+    //
+    // Whoever seeks first in a movie reads its index, or builds one from the
+    // sample tables. Anyone else who wants it meanwhile waits for them, just
+    // like they would for the file to be opened.
+    RTPFileCacheEntry   *cacheEntry = fFileCacheEntry;
+    
+    cacheEntry->InitMutex->Lock();
+    if( !cacheEntry->fIndexChecked )
+    {
+        QTRTPFileIndex  *index;
+        {
+            OSMutexLocker locker(fFile->GetMutex());
+            index = QTRTPFileIndex::Read(fFile);
+            if( index == NULL )
+                index = QTRTPFileIndex::Build(fFile);
+        }
+        
+        RTPFileCacheShard   *shard = &QTRTPFile::gFileCacheShards[cacheEntry->fShard];
+        OSMutexLocker       shardMutex(&shard->fMutex);
+        
+        cacheEntry->fIndex = index;
+        cacheEntry->fIndexChecked = true;
+        if( index != NULL )
+        {
+            cacheEntry->fMemoryUsed += index->GetMemoryUsed();
+            if( cacheEntry->fIsInTable )
+                shard->fBytesCached += index->GetMemoryUsed();
+        }
+    }
+    cacheEntry->InitMutex->Unlock();
+    
+    if( cacheEntry->fIndex == NULL )
+        return;
+        
+    for( RTPTrackListEntry *listEntry = fFirstTrack; listEntry != NULL; listEntry = listEntry->NextTrack )
+        listEntry->HTCB->fTrackIndex = cacheEntry->fIndex->FindTrack(listEntry->TrackID);
+}
+
 QTRTPFile::ErrorCode QTRTPFile::SeekToPacketNumber(UInt32 inTrackID, UInt64 inPacketNumber)
 {
+    fReadWouldBlock = false;
+    
     if (fErr == errCallAgain)
     {
         fErr = this->ScanToCorrectPacketNumber(inTrackID, inPacketNumber);
@@ -1080,7 +1279,10 @@ QTRTPFile::ErrorCode QTRTPFile::SeekToPacketNumber(UInt32 inTrackID, UInt64 inPa
     //
     // We need to track this so that we don't use the sync sample table if we start thinnning
     fWasLastSeekASeekToPacketNumber = true;
+    
+    this->FindIndex();
 
+    fPacketHeapIsValid = false;
     for (RTPTrackListEntry  *listEntry = fFirstTrack; listEntry != NULL; listEntry = listEntry->NextTrack ) 
     {
         if( !listEntry->IsTrackActive )
@@ -1101,7 +1303,7 @@ QTRTPFile::ErrorCode QTRTPFile::SeekToPacketNumber(UInt32 inTrackID, UInt64 inPa
             mediaTime = 0;
 
         listEntry->CurSampleNumber = 0;
-        if (!listEntry->HintTrack->GetSampleNumberFromMediaTime(mediaTime, &listEntry->CurSampleNumber, &listEntry->HTCB->fsttsSTCB))
+        if (!this->GetSampleNumberFromMediaTime(listEntry, mediaTime, &listEntry->CurSampleNumber))
             continue;
         
         //
@@ -1113,6 +1315,9 @@ QTRTPFile::ErrorCode QTRTPFile::SeekToPacketNumber(UInt32 inTrackID, UInt64 inPa
             listEntry->IsPacketAvailable = true;
     }
     
+    if (fReadWouldBlock)
+        return errCallAgain;
+        
     if (inPacketNumber == 0)
         return errNoError;
         
@@ -1130,7 +1335,7 @@ QTRTPFile::ErrorCode    QTRTPFile::ScanToCorrectPacketNumber(UInt32 inTrackID, U
             UInt32          newSampleMediaTime;
             //
             // Figure out what time this sample is at.
-            if( !fLastPacketTrack->HintTrack->GetSampleMediaTime(fLastPacketTrack->CurSampleNumber, &newSampleMediaTime, &fLastPacketTrack->HTCB->fsttsSTCB) )
+            if( !this->GetSampleMediaTime(fLastPacketTrack, fLastPacketTrack->CurSampleNumber, &newSampleMediaTime) )
                 return errInvalidQuickTimeFile;
                 
             newSampleMediaTime += fLastPacketTrack->HintTrack->GetFirstEditMediaTime();
@@ -1143,7 +1348,7 @@ QTRTPFile::ErrorCode    QTRTPFile::ScanToCorrectPacketNumber(UInt32 inTrackID, U
         (void)this->GetNextPacket(&thePacket, &theLen);
         
         if (thePacket == NULL)
-            return errInvalidQuickTimeFile;
+            return fReadWouldBlock ? errCallAgain : errInvalidQuickTimeFile;
     }
     
     return errCallAgain;
@@ -1224,10 +1429,6 @@ UInt16 QTRTPFile::GetNextTrackSequenceNumber(UInt32 trackID)
 Float64 QTRTPFile::GetNextPacket(char ** outPacket, int * outPacketLength)
 {
     // General vars
-    RTPTrackListEntry   *listEntry;
-
-    Bool16              haveFirstPacketTime = false;
-    Float64             firstPacketTime = 0.0;
     RTPTrackListEntry   *firstPacket = NULL;
 
 
@@ -1235,39 +1436,41 @@ Float64 QTRTPFile::GetNextPacket(char ** outPacket, int * outPacketLength)
     // Clear the input.
     *outPacket = NULL;
     *outPacketLength = 0;
+    fReadWouldBlock = false;
     
     //
     // Prefetch the next packet of the track that the *last* packet came from.
     if( fLastPacketTrack != NULL )
     {
         if ( !this->PrefetchNextPacket(fLastPacketTrack) )
+        {
+            //
+            // Leave fLastPacketTrack alone, so the next call tries this track again.
+            if (fReadWouldBlock)
+                return 0.0;
+                
             fLastPacketTrack->IsPacketAvailable = false;
+        }
     }
     
     //
-    // Figure out which track is going to produce the next packet.
-    for( listEntry = fFirstTrack; listEntry != NULL; listEntry = listEntry->NextTrack ) 
+    // Put the track back in the heap with the time of its new packet. After a
+    // seek, start the heap over with every track.
+    if( !fPacketHeapIsValid )
+        this->BuildPacketHeap();
+    else if( (fLastPacketTrack != NULL) && fLastPacketTrack->IsTrackActive && fLastPacketTrack->IsPacketAvailable )
     {
-        //
-        // Only look at active tracks that have packets.
-        if( !listEntry->IsTrackActive || !listEntry->IsPacketAvailable)
-            continue;
-        
-        //
-        // See if this track has a time earlier than our initial time.
-        if( (listEntry->CurPacketTime <= firstPacketTime) || !haveFirstPacketTime ) 
-        {
-            haveFirstPacketTime     = true;
-            firstPacketTime         = listEntry->CurPacketTime;
-            firstPacket             = listEntry;
-        }
+        fLastPacketTrack->PacketHeapElem.SetValue(PacketTimeToHeapValue(fLastPacketTrack->CurPacketTime, fLastPacketTrack->TrackIndex));
+        fPacketHeap.Insert(&fLastPacketTrack->PacketHeapElem);
     }
     
     //
     // Abort if we didn't find a packet.  Either the movie is over, or there
     // weren't any packets to begin with.
-    if( firstPacket == NULL )
+    OSHeapElem *firstElem = fPacketHeap.ExtractMin();
+    if( firstElem == NULL )
         return 0.0;
+    firstPacket = (RTPTrackListEntry *)firstElem->GetEnclosingObject();
     
     //
     // Remember the sequence number of this packet.
@@ -1284,6 +1487,30 @@ Float64 QTRTPFile::GetNextPacket(char ** outPacket, int * outPacketLength)
     return firstPacket->CurPacketTime;
 }
 
+UInt32 QTRTPFile::GetNextPackets(RTPPacketInfo * outPackets, UInt32 inMaxPackets)
+{
+    UInt32  numPackets = 0;
+    
+    while( numPackets < inMaxPackets )
+    {
+        char    *thePacket = NULL;
+        int     thePacketLength = 0;
+        
+        Float64 theTransmitTime = this->GetNextPacket(&thePacket, &thePacketLength);
+        if( (thePacket == NULL) || (fErr != errNoError) )
+            break;
+        
+        RTPPacketInfo *packetInfo = &outPackets[numPackets++];
+        packetInfo->TransmitTime = theTransmitTime;
+        packetInfo->TrackEntry = fLastPacketTrack;
+        packetInfo->PacketNumber = fLastPacketTrack->HTCB->fCurrentPacketNumber;
+        packetInfo->PacketLength = thePacketLength;
+        ::memcpy(packetInfo->Packet, thePacket, thePacketLength);
+    }
+    
+    return numPackets;
+}
+
 
 
 // -------------------------------------
@@ -1313,6 +1540,25 @@ Bool16 QTRTPFile::FindTrackEntry(UInt32 trackID, RTPTrackListEntry **trackEntry)
     return false;
 }
 
+void QTRTPFile::BuildPacketHeap()
+{
+    while( fPacketHeap.ExtractMin() != NULL )
+        ;
+    
+    for( RTPTrackListEntry *listEntry = fFirstTrack; listEntry != NULL; listEntry = listEntry->NextTrack ) 
+    {
+        //
+        // Only look at active tracks that have packets.
+        if( !listEntry->IsTrackActive || !listEntry->IsPacketAvailable )
+            continue;
+        
+        listEntry->PacketHeapElem.SetValue(PacketTimeToHeapValue(listEntry->CurPacketTime, listEntry->TrackIndex));
+        fPacketHeap.Insert(&listEntry->PacketHeapElem);
+    }
+    
+    fPacketHeapIsValid = true;
+}
+
 SInt32  QTRTPFile::GetMovieHintType()
 { 
     SInt32 movieHintType= 0;
@@ -1347,6 +1593,14 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
     // Temporary vars
     QTTrack::ErrorCode  getPacketErr = QTTrack::errIsSkippedPacket;
     
+    TrackPosition   savedPosition;
+    savedPosition.CurSampleNumber = trackEntry->CurSampleNumber;
+    savedPosition.LastSyncSampleNumber = trackEntry->LastSyncSampleNumber;
+    savedPosition.NextSyncSampleNumber = trackEntry->NextSyncSampleNumber;
+    savedPosition.NumPacketsInThisSample = trackEntry->NumPacketsInThisSample;
+    savedPosition.CurPacketNumber = trackEntry->CurPacketNumber;
+    savedPosition.NumSkippedSamples = fNumSkippedSamples;
+    
     // If we are dropping b-frames or repeat packets, QTHintTrack::GetPacket will return the errIsSkippedPacket error to us.
     // If we get that error, we should fetch another packet. So, we have this loop here.
     while (getPacketErr == QTTrack::errIsSkippedPacket)
@@ -1361,7 +1615,7 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
               && (trackEntry->NumPacketsInThisSample != 0)
             ) 
         {
-            if (trackEntry->HintTrack->IsSyncSample(trackEntry->CurSampleNumber, 0))
+            if (this->IsSyncSample(trackEntry, trackEntry->CurSampleNumber))
             {
                 trackEntry->LastSyncSampleNumber = trackEntry->CurSampleNumber;
                 if (trackEntry->NextSyncSampleNumber != trackEntry->CurSampleNumber)
@@ -1374,7 +1628,7 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
             // move on.
             if( trackEntry->QualityLevel >= kKeyFramesOnly )
             {
-                trackEntry->HintTrack->GetNextSyncSample(trackEntry->CurSampleNumber, &trackEntry->NextSyncSampleNumber);
+                this->GetNextSyncSample(trackEntry, trackEntry->CurSampleNumber, &trackEntry->NextSyncSampleNumber);
                 if (!fHasRTPMetaInfoFieldArray && !fWasLastSeekASeekToPacketNumber)
                 {
                      fNumSkippedSamples += trackEntry->NextSyncSampleNumber - trackEntry->CurSampleNumber;
@@ -1406,13 +1660,13 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
 
                                 //
                                 // Only skip this sample if it is not a sync sample
-                if (!trackEntry->HintTrack->IsSyncSample(trackEntry->CurSampleNumber, 0))
+                if (!this->IsSyncSample(trackEntry, trackEntry->CurSampleNumber))
                 {
                                         //
                                         // figure out where the next sync sample is
                     if (trackEntry->CurSampleNumber >= trackEntry->NextSyncSampleNumber)
                     {
-                        trackEntry->HintTrack->GetNextSyncSample(trackEntry->CurSampleNumber, &trackEntry->NextSyncSampleNumber);
+                        this->GetNextSyncSample(trackEntry, trackEntry->CurSampleNumber, &trackEntry->NextSyncSampleNumber);
                     }
 
                     // this shouldn't ever be false, but I'm worried about when people skip backwards in movies
@@ -1444,7 +1698,10 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
         while ( trackEntry->NumPacketsInThisSample == 0 ) 
         {
             if ( trackEntry->HintTrack->GetNumPackets(trackEntry->CurSampleNumber, &trackEntry->NumPacketsInThisSample, trackEntry->HTCB) != QTTrack::errNoError )
+            {
+                (void)this->BackOutIfReadWouldBlock(trackEntry, savedPosition);
                 return false;
+            }
                 
             if ( trackEntry->NumPacketsInThisSample == 0 )
                 trackEntry->CurSampleNumber++;
@@ -1483,7 +1740,8 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
     }
 
     if( getPacketErr != QTTrack::errNoError )
-    {   fErr = errInvalidQuickTimeFile; 
+    {   if (!this->BackOutIfReadWouldBlock(trackEntry, savedPosition))
+            fErr = errInvalidQuickTimeFile; 
         return false;
     }
         
@@ -1505,3 +1763,30 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
     // Return the packet.
     return true;
 }
+
+Bool16 QTRTPFile::BackOutIfReadWouldBlock(RTPTrackListEntry * trackEntry, const TrackPosition & savedPosition)
+{
+    //
+    // If PrefetchNextPacket failed because the file data isn't in yet, put the
+    // track back where it was so the next prefetch tries the same packet again.
+    // The hint track caches don't remember anything from a read that didn't finish.
+    if ( !fFCB->ReadWouldBlock() )
+        return false;
+        
+    trackEntry->CurSampleNumber = savedPosition.CurSampleNumber;
+    trackEntry->LastSyncSampleNumber = savedPosition.LastSyncSampleNumber;
+    trackEntry->NextSyncSampleNumber = savedPosition.NextSyncSampleNumber;
+    trackEntry->NumPacketsInThisSample = savedPosition.NumPacketsInThisSample;
+    trackEntry->CurPacketNumber = savedPosition.CurPacketNumber;
+    fNumSkippedSamples = savedPosition.NumSkippedSamples;
+    
+    fReadWouldBlock = true;
+    return true;
+}
+
+#if DSS_USE_API_CALLBACKS
+void QTRTPFile::RequestReadEvent()
+{
+    fFCB->RequestReadEvent();
+}
+#endif
@@ -33,10 +33,17 @@
 
 //
 // Includes
+#include <string.h>
+
 #include "OSHeaders.h"
 #include "MyAssert.h"
+#include "OSMutex.h"
 #include "RTPMetaInfoPacket.h"
 #include "QTHintTrack.h"
+#include "QTRTPFileIndex.h"
+#include "OSQueue.h"
+#include "OSHashTable.h"
+#include "OSHeap.h"
 
 #ifndef __Win32__
 #include <sys/stat.h>
@@ -49,9 +56,8 @@
 
 //
 // QTRTPFile class
-class OSMutex;
-
 class QTFile;
+class QTRTPFileCacheKey;
 class QTFile_FileControlBlock;
 class QTHintTrack;
 class QTHintTrack_HintTrackControlBlock;
@@ -84,14 +90,38 @@ public:
         // File information
         char*       fFilename;
         QTFile      *File;
+        ErrorCode   fOpenErr;       // why File is NULL, once InitMutex is released
+        SInt64      fModDate;       // of the file when it was opened
+        SInt64      fFileLength;    // ditto
+        UInt64      fMemoryUsed;    // roughly; see QTFile::GetMovieHeaderSize
+        
+        //
+        // The index of the hint tracks, looked for the first time anyone
+        // seeks. Guarded by InitMutex until fIndexChecked is set.
+        QTRTPFileIndex  *fIndex;
+        Bool16      fIndexChecked;
         
         //
         // Reference count for this cache entry
         int         ReferenceCount; 
         
         //
-        // List pointers
-        RTPFileCacheEntry   *PrevEntry, *NextEntry;
+        // Cache pointers. An entry stays in its shard's table until it is
+        // evicted or found to be stale, and is on the shard's LRU queue
+        // while its reference count is 0.
+        UInt32              fHashKey;
+        UInt32              fShard;
+        Bool16              fIsInTable;
+        OSQueueElem         fLRUElem;
+        RTPFileCacheEntry   *fNextHashEntry;
+    };
+    
+    //
+    // What GetFileCacheEntries reports about each cached movie.
+    struct FileCacheEntryInfo {
+        char        fFilename[256];     // truncated if need be
+        UInt64      fMemoryUsed;
+        UInt32      fNumUsers;          // 0 if it is only being kept warm
     };
     
     struct RTPTrackListEntry {
@@ -128,10 +158,26 @@ public:
         char            CurPacket[QTRTPFILE_MAX_PACKET_LENGTH];
         UInt32          CurPacketLength;
 
+        //
+        // Keyed on CurPacketTime, then the last TrackIndex first, while this
+        // track has a packet waiting to go
+        OSHeapElem      PacketHeapElem;
+        UInt32          TrackIndex;     // where it is in the track list
+
         //
         // List pointers
         RTPTrackListEntry   *NextTrack;
     };
+    
+    //
+    // A packet copied out by GetNextPackets.
+    struct RTPPacketInfo {
+        Float64             TransmitTime;
+        RTPTrackListEntry   *TrackEntry;
+        UInt64              PacketNumber;   // HTCB->fCurrentPacketNumber of its track when it was built
+        int                 PacketLength;
+        char                Packet[QTRTPFILE_MAX_PACKET_LENGTH];
+    };
 
 
 public:
@@ -139,6 +185,29 @@ public:
     // Global initialize function; CALL THIS FIRST!
     static void         Initialize(void);
     
+    //
+    // Parsed movies stay cached after their last user goes away, as long as
+    // the cache, counting movies still in use, fits in this many bytes. Least
+    // recently used movies go first. 0, the default, keeps none.
+    static void         SetFileCacheSize(UInt64 inMaxBytes);
+    
+    //
+    // File cache statistics.
+    static UInt64       GetFileCacheHits();
+    static UInt64       GetFileCacheMisses();
+    static UInt64       GetFileCacheEvictions();
+    static UInt64       GetFileCacheBytes();
+    
+    //
+    // Fills in at most inMaxEntries infos, one per cached movie, and
+    // returns how many it filled in.
+    static UInt32       GetFileCacheEntries(FileCacheEntryInfo* outInfo, UInt32 inMaxEntries);
+    
+    //
+    // Seeks use the index saved next to a movie by QTRTPIndexGen, or build
+    // one from the sample tables if there isn't one. On by default.
+    static void         SetPacketIndexEnabled(Bool16 inEnabled) { gPacketIndexEnabled = inEnabled; }
+    
     //
     // Returns a static array of the RTP-Meta-Info fields supported by QTFileLib.
     // It also returns field IDs for the fields it recommends being compressed.
@@ -224,41 +293,123 @@ public:
             UInt16      GetNextTrackSequenceNumber(UInt32 TrackID);
             Float64     GetNextPacket(char ** Packet, int * PacketLength);
             
+            //
+            // Copies out up to MaxPackets packets, in the order GetNextPacket
+            // would return them. Stops short at the end of the movie, when
+            // ReadWouldBlock, or on an error, and doesn't copy the packet that
+            // caused the error. A return of 0 means the same as GetNextPacket
+            // returning no packet.
+            UInt32      GetNextPackets(RTPPacketInfo * Packets, UInt32 MaxPackets);
+            
             SInt32      GetMovieHintType();
             Bool16      DropRepeatPackets() { return fDropRepeatPackets; }
             Bool16      SetDropRepeatPackets(Bool16 allowRepeatPackets) { (!fHasRTPMetaInfoFieldArray) ? fDropRepeatPackets = allowRepeatPackets : fDropRepeatPackets = false; return fDropRepeatPackets;}
 
             ErrorCode   Error() { return fErr; };
             
+            //
+            // If the server has file reading threads, the movie data is read
+            // asynchronously. When the data isn't in yet, GetNextPacket returns no
+            // packet and Seek returns errCallAgain with ReadWouldBlock set. Call
+            // RequestReadEvent to have the current task signalled once it is in,
+            // then make the same call again.
+            Bool16      ReadWouldBlock() { return fReadWouldBlock; }
+#if DSS_USE_API_CALLBACKS
+            void        RequestReadEvent();
+#endif
+            
             Bool16      FindTrackEntry(UInt32 TrackID, RTPTrackListEntry **TrackEntry);
 protected:
     //
     // Protected cache functions and variables.
-    static  OSMutex             *gFileCacheMutex, *gFileCacheAddMutex;
-    static  RTPFileCacheEntry   *gFirstFileCacheEntry;
+    // The cache is split into shards by filename hash, each with its own
+    // lock, table and LRU queue, so opens of different movies rarely contend.
+    enum {
+        kNumFileCacheShards     = 8,    // must be a power of 2
+        kFileCacheTableSize     = 64    // per shard; must be a power of 2
+    };
+    
+    struct RTPFileCacheShard {
+        RTPFileCacheShard() : fTable(kFileCacheTableSize), fBytesCached(0),
+                              fNumHits(0), fNumMisses(0), fNumEvictions(0) {}
+        
+        OSMutex             fMutex;
+        OSHashTable<RTPFileCacheEntry, QTRTPFileCacheKey>   fTable;
+        OSQueue             fLRUQueue;      // idle entries, least recently used at the head
+        UInt64              fBytesCached;   // by the entries in fTable
+        UInt64              fNumHits, fNumMisses, fNumEvictions;
+    };
+    
+    static  RTPFileCacheShard   gFileCacheShards[kNumFileCacheShards];
+    static  UInt64              gFileCacheShardMaxBytes;
+    static  Bool16              gPacketIndexEnabled;
     
-    static  ErrorCode   new_QTFile(const char * FilePath, QTFile ** File, Bool16 Debug = false, Bool16 DeepDebug = false);
-    static  void        delete_QTFile(QTFile * File);
+    static  ErrorCode   new_QTFile(const char * FilePath, QTFile ** File, RTPFileCacheEntry ** CacheEntry, Bool16 Debug = false, Bool16 DeepDebug = false);
+    static  void        delete_QTFile(RTPFileCacheEntry * CacheEntry);
 
-    static  void        AddFileToCache(const char *inFilename, QTRTPFile::RTPFileCacheEntry ** NewListEntry);
-    static  Bool16      FindAndRefcountFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **CacheEntry);
+    static  void        RemoveFromFileCache(RTPFileCacheShard * Shard, RTPFileCacheEntry * CacheEntry);
+    static  void        EvictIdleFileCacheEntries(RTPFileCacheShard * Shard);
+    static  void        DeleteFileCacheEntry(RTPFileCacheEntry * CacheEntry);
+
+    //
+    // Where a track is in its hint samples
+    struct TrackPosition {
+        UInt32          CurSampleNumber, LastSyncSampleNumber, NextSyncSampleNumber;
+        UInt16          NumPacketsInThisSample, CurPacketNumber;
+        UInt32          NumSkippedSamples;
+    };
 
     //
     // Protected member functions.
             Bool16      PrefetchNextPacket(RTPTrackListEntry * TrackEntry, Bool16 doSeek = false);
+            Bool16      BackOutIfReadWouldBlock(RTPTrackListEntry * TrackEntry, const TrackPosition & SavedPosition);
             ErrorCode   ScanToCorrectSample();
+            void        BuildPacketHeap();
             ErrorCode   ScanToCorrectPacketNumber(UInt32 inTrackID, UInt64 inPacketNumber);
+            void        FindIndex();
+            void        SkipToSampleBeforeSeekSample(RTPTrackListEntry * TrackEntry);
+
+    //
+    // Sample table lookups, through the index if the movie has one.
+    inline  Bool16      GetSampleNumberFromMediaTime(RTPTrackListEntry * TrackEntry, UInt32 MediaTime, UInt32 * SampleNumber)
+                        {   if( TrackEntry->HTCB->fTrackIndex != NULL ) return TrackEntry->HTCB->fTrackIndex->GetSampleNumberFromMediaTime(MediaTime, SampleNumber);
+                            return TrackEntry->HintTrack->GetSampleNumberFromMediaTime(MediaTime, SampleNumber, &TrackEntry->HTCB->fsttsSTCB);
+                        }
+    inline  Bool16      GetSampleMediaTime(RTPTrackListEntry * TrackEntry, UInt32 SampleNumber, UInt32 * MediaTime)
+                        {   if( TrackEntry->HTCB->fTrackIndex != NULL ) return TrackEntry->HTCB->fTrackIndex->GetSampleMediaTime(SampleNumber, MediaTime);
+                            return TrackEntry->HintTrack->GetSampleMediaTime(SampleNumber, MediaTime, &TrackEntry->HTCB->fsttsSTCB);
+                        }
+    inline  void        GetPreviousSyncSample(RTPTrackListEntry * TrackEntry, UInt32 SampleNumber, UInt32 * SyncSampleNumber)
+                        {   if( TrackEntry->HTCB->fTrackIndex != NULL ) TrackEntry->HTCB->fTrackIndex->GetPreviousSyncSample(SampleNumber, SyncSampleNumber);
+                            else TrackEntry->HintTrack->GetPreviousSyncSample(SampleNumber, SyncSampleNumber);
+                        }
+    inline  void        GetNextSyncSample(RTPTrackListEntry * TrackEntry, UInt32 SampleNumber, UInt32 * SyncSampleNumber)
+                        {   if( TrackEntry->HTCB->fTrackIndex != NULL ) TrackEntry->HTCB->fTrackIndex->GetNextSyncSample(SampleNumber, SyncSampleNumber);
+                            else TrackEntry->HintTrack->GetNextSyncSample(SampleNumber, SyncSampleNumber);
+                        }
+    inline  Bool16      IsSyncSample(RTPTrackListEntry * TrackEntry, UInt32 SampleNumber)
+                        {   if( TrackEntry->HTCB->fTrackIndex != NULL ) return TrackEntry->HTCB->fTrackIndex->IsSyncSample(SampleNumber);
+                            return TrackEntry->HintTrack->IsSyncSample(SampleNumber, 0);
+                        }
 
     //
     // Protected member variables.
     Bool16              fDebug, fDeepDebug;
 
     QTFile              *fFile;
+    RTPFileCacheEntry   *fFileCacheEntry;
     QTFile_FileControlBlock *fFCB;
     
     UInt32              fNumHintTracks;
     RTPTrackListEntry   *fFirstTrack, *fLastTrack, *fCurSeekTrack;
     
+    //
+    // The active tracks that have a packet, other than fLastPacketTrack, so
+    // GetNextPacket doesn't have to look at every track to find the next one.
+    // Seeking or adding a track invalidates it.
+    OSHeap              fPacketHeap;
+    Bool16              fPacketHeapIsValid;
+    
     char                *fSDPFile;
     UInt32              fSDPFileLength;
         UInt32              fNumSkippedSamples;
@@ -272,9 +423,47 @@ protected:
     Bool16              fHasRTPMetaInfoFieldArray;
     Bool16              fWasLastSeekASeekToPacketNumber;
     Bool16              fDropRepeatPackets;
+    Bool16              fReadWouldBlock;
+    Bool16              fIndexChecked;
     ErrorCode           fErr;
     
     static const RTPMetaInfoPacket::FieldID kMetaInfoFields[];
+    
+    friend class QTRTPFileCacheKey;
+};
+
+class QTRTPFileCacheKey
+{
+    public:
+    
+        QTRTPFileCacheKey(const char* inFilename)
+            : fFilename(inFilename), fHashKey(HashFilename(inFilename)) {}
+        QTRTPFileCacheKey(QTRTPFile::RTPFileCacheEntry* inEntry)
+            : fFilename(inEntry->fFilename), fHashKey(inEntry->fHashKey) {}
+        
+        UInt32  GetHashKey()    { return fHashKey; }
+        
+        // Uses bits the table index doesn't
+        UInt32  GetShard()      { return (fHashKey >> 24) & (QTRTPFile::kNumFileCacheShards - 1); }
+        
+        friend int operator ==(const QTRTPFileCacheKey& key1, const QTRTPFileCacheKey& key2)
+        {
+            return (key1.fHashKey == key2.fHashKey) && (::strcmp(key1.fFilename, key2.fFilename) == 0);
+        }
+        
+    private:
+    
+        // FNV-1a; paths in one directory tend to differ only near the end
+        static UInt32   HashFilename(const char* inFilename)
+        {
+            UInt32 theHash = 2166136261U;
+            for ( ; *inFilename != '\0'; inFilename++)
+                theHash = (theHash ^ (UInt8)*inFilename) * 16777619U;
+            return theHash;
+        }
+        
+        const char* fFilename;
+        UInt32      fHashKey;
 };
 
 #endif // QTRTPFile
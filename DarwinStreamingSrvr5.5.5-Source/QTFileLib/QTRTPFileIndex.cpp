@@ -0,0 +1,673 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPFileIndex:
+//   A flat table of every sample in the hint tracks of a movie.
+//
+//  htons and friends are macros and should not include the global specifier ::
+
+
+// -------------------------------------
+// Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef __Win32__
+#include <netinet/in.h>
+#endif
+
+#include "QTFile.h"
+#include "QTAtom.h"
+#include "QTTrack.h"
+#include "QTHintTrack.h"
+
+#include "QTRTPFileIndex.h"
+#include "OSMemory.h"
+
+
+// -------------------------------------
+// Index file layout
+//
+// Everything is in network byte order. The header is followed by each
+// track, and each track by its tables, one after the other:
+//
+//   UInt32 'rtpi', UInt32 version, UInt64 movie length, SInt64 movie
+//   modification date, UInt32 flags, UInt32 number of tracks
+//
+//   UInt32 track ID, number of samples, sample description index, number of
+//   sync samples (kAllSyncSamples if there is no sync sample table)
+//   UInt32 media times[samples + 1], UInt64 offsets[samples],
+//   UInt32 lengths[samples], UInt32 sync samples[sync samples]
+//   UInt64 packet numbers[samples + 1], UInt64 packet positions[samples + 1]
+//      (only if the header flags have kHasPacketNumbers)
+//
+static const UInt32 kIndexFileType = FOUR_CHARS_TO_INT('r', 't', 'p', 'i');
+
+enum {
+    kHeaderSize         = 32,
+    kTrackHeaderSize    = 16,
+    kHasPacketNumbers   = 0x00000001,
+    kAllSyncSamples     = 0xFFFFFFFF,
+    kMaxPacketLength    = 65536     // the most a hint track will build
+};
+
+static void PutInt32(char ** ioBuffer, UInt32 inValue)
+{
+    inValue = htonl(inValue);
+    ::memcpy(*ioBuffer, &inValue, 4);
+    *ioBuffer += 4;
+}
+
+static void PutInt64(char ** ioBuffer, UInt64 inValue)
+{
+    SInt64 tempDatum = QTAtom::NTOH64((SInt64)inValue);
+    ::memcpy(*ioBuffer, &tempDatum, 8);
+    *ioBuffer += 8;
+}
+
+
+// -------------------------------------
+// Track index lookups
+//
+QTRTPFileIndex::TrackIndex::TrackIndex()
+    : fTrackID(0), fNumSamples(0), fSampleDescriptionIndex(0),
+      fMediaTimes(NULL), fOffsets(NULL), fLengths(NULL),
+      fNumSyncSamples(0), fSyncSamples(NULL),
+      fPacketNumbers(NULL), fPacketPositions(NULL)
+{
+}
+
+QTRTPFileIndex::TrackIndex::~TrackIndex()
+{
+    delete [] fMediaTimes;
+    delete [] fOffsets;
+    delete [] fLengths;
+    delete [] fSyncSamples;
+    delete [] fPacketNumbers;
+    delete [] fPacketPositions;
+}
+
+Bool16 QTRTPFileIndex::TrackIndex::GetSampleNumberFromMediaTime(UInt32 mediaTime, UInt32 * sampleNumber)
+{
+    //
+    // The time-to-sample table gives the first sample that starts at exactly
+    // this time, otherwise the last one that starts before it. The end of
+    // the track counts as the start of one more sample.
+    if( mediaTime > fMediaTimes[fNumSamples] )
+        return false;
+    if( fNumSamples == 0 )
+        return false;
+
+    UInt32  low = 0, high = fNumSamples;    // find the first time >= mediaTime
+    while( low < high )
+    {
+        UInt32 middle = low + ((high - low) / 2);
+        if( fMediaTimes[middle] < mediaTime )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if( fMediaTimes[low] == mediaTime )
+        *sampleNumber = low + 1;
+    else
+        *sampleNumber = low;    // the one before it
+    return true;
+}
+
+void QTRTPFileIndex::TrackIndex::GetPreviousSyncSample(UInt32 sampleNumber, UInt32 * syncSampleNumber)
+{
+    *syncSampleNumber = sampleNumber;
+    if( fSyncSamples == NULL )
+        return;
+
+    UInt32  low = 0, high = fNumSyncSamples;    // find the first one > sampleNumber
+    while( low < high )
+    {
+        UInt32 middle = low + ((high - low) / 2);
+        if( fSyncSamples[middle] <= sampleNumber )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if( low > 0 )
+        *syncSampleNumber = fSyncSamples[low - 1];
+}
+
+void QTRTPFileIndex::TrackIndex::GetNextSyncSample(UInt32 sampleNumber, UInt32 * syncSampleNumber)
+{
+    *syncSampleNumber = sampleNumber + 1;
+    if( fSyncSamples == NULL )
+        return;
+
+    UInt32  low = 0, high = fNumSyncSamples;    // find the first one > sampleNumber
+    while( low < high )
+    {
+        UInt32 middle = low + ((high - low) / 2);
+        if( fSyncSamples[middle] <= sampleNumber )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if( low < fNumSyncSamples )
+        *syncSampleNumber = fSyncSamples[low];
+}
+
+Bool16 QTRTPFileIndex::TrackIndex::IsSyncSample(UInt32 sampleNumber)
+{
+    if( fSyncSamples == NULL )
+        return true;
+
+    UInt32 previousSyncSample;
+    this->GetPreviousSyncSample(sampleNumber, &previousSyncSample);
+    return (fNumSyncSamples > 0) && (fSyncSamples[0] <= sampleNumber) && (previousSyncSample == sampleNumber);
+}
+
+Bool16 QTRTPFileIndex::TrackIndex::GetSampleInfo(UInt32 sampleNumber, UInt32 * length, UInt64 * offset, UInt32 * sampleDescriptionIndex)
+{
+    if( (fSampleDescriptionIndex == 0) || (sampleNumber == 0) || (sampleNumber > fNumSamples) )
+        return false;
+
+    *length = fLengths[sampleNumber - 1];
+    *offset = fOffsets[sampleNumber - 1];
+    *sampleDescriptionIndex = fSampleDescriptionIndex;
+    return true;
+}
+
+Bool16 QTRTPFileIndex::TrackIndex::GetPacketsBeforeSample(UInt32 sampleNumber, UInt64 * packetNumber, UInt64 * packetPosition)
+{
+    if( (fPacketNumbers == NULL) || (sampleNumber == 0) || (sampleNumber > fNumSamples + 1) )
+        return false;
+
+    *packetNumber = fPacketNumbers[sampleNumber - 1];
+    *packetPosition = fPacketPositions[sampleNumber - 1];
+    return true;
+}
+
+
+// -------------------------------------
+// Constructors and destructors
+//
+QTRTPFileIndex::QTRTPFileIndex(UInt32 numTracks)
+    : fNumTracks(numTracks),
+      fTracks(NULL),
+      fHasPacketNumbers(false),
+      fMemoryUsed(0)
+{
+    if( fNumTracks > 0 )
+        fTracks = NEW TrackIndex[fNumTracks];
+}
+
+QTRTPFileIndex::~QTRTPFileIndex(void)
+{
+    delete [] fTracks;
+}
+
+
+// -------------------------------------
+// Accessors
+//
+QTRTPFileIndex::TrackIndex * QTRTPFileIndex::FindTrack(UInt32 trackID)
+{
+    for( UInt32 trackIndex = 0; trackIndex < fNumTracks; trackIndex++ )
+        if( fTracks[trackIndex].fTrackID == trackID )
+            return &fTracks[trackIndex];
+
+    return NULL;
+}
+
+void QTRTPFileIndex::ComputeMemoryUsed(void)
+{
+    fMemoryUsed = sizeof(QTRTPFileIndex) + (fNumTracks * sizeof(TrackIndex));
+    for( UInt32 trackIndex = 0; trackIndex < fNumTracks; trackIndex++ )
+    {
+        TrackIndex *track = &fTracks[trackIndex];
+        fMemoryUsed += (track->fNumSamples + 1) * 4;    // media times
+        fMemoryUsed += track->fNumSamples * (8 + 4);    // offsets and lengths
+        if( track->fSyncSamples != NULL )
+            fMemoryUsed += track->fNumSyncSamples * 4;
+        if( track->fPacketNumbers != NULL )
+            fMemoryUsed += (track->fNumSamples + 1) * (8 + 8);
+    }
+}
+
+
+// -------------------------------------
+// Building an index
+//
+QTRTPFileIndex * QTRTPFileIndex::Build(QTFile * file, Bool16 countPackets)
+{
+    // General vars
+    QTTrack         *track;
+    UInt32          numHintTracks = 0;
+
+
+    for( track = NULL; file->NextTrack(&track, track); )
+        if( file->IsHintTrack(track) )
+            numHintTracks++;
+
+    QTRTPFileIndex  *index = NEW QTRTPFileIndex(numHintTracks);
+    index->fHasPacketNumbers = countPackets;
+
+    UInt32 trackIndex = 0;
+    for( track = NULL; file->NextTrack(&track, track); )
+    {
+        if( !file->IsHintTrack(track) )
+            continue;
+
+        if( !BuildTrack((QTHintTrack *)track, &index->fTracks[trackIndex++], countPackets) )
+        {
+            delete index;
+            return NULL;
+        }
+    }
+
+    index->ComputeMemoryUsed();
+    return index;
+}
+
+Bool16 QTRTPFileIndex::BuildTrack(QTHintTrack * hintTrack, TrackIndex * trackIndex, Bool16 countPackets)
+{
+    // General vars
+    QTAtom_stts_SampleTableControlBlock sttsSTCB;
+    QTAtom_stsc_SampleTableControlBlock stscSTCB;
+    UInt32          sampleNumber;
+
+
+    if( hintTrack->Initialize() != QTTrack::errNoError )
+        return false;
+
+    //
+    // Counting the samples of a fragmented track means reading all of its
+    // fragments, which is what QTFragmentIndex puts off until they are played.
+    if( hintTrack->IsFragmented() )
+        return false;
+
+    trackIndex->fTrackID = hintTrack->GetTrackID();
+    trackIndex->fNumSamples = hintTrack->GetNumSamples();
+
+    //
+    // Where every sample is, in time and in the file.
+    UInt32 numSamples = trackIndex->fNumSamples;
+    trackIndex->fMediaTimes = NEW UInt32[numSamples + 1];
+    trackIndex->fOffsets = NEW UInt64[numSamples];
+    trackIndex->fLengths = NEW UInt32[numSamples];
+
+    for( sampleNumber = 1; sampleNumber <= numSamples; sampleNumber++ )
+    {
+        UInt32  sampleDescriptionIndex;
+
+        if( !hintTrack->GetSampleMediaTime(sampleNumber, &trackIndex->fMediaTimes[sampleNumber - 1], &sttsSTCB) )
+            return false;
+        if( !hintTrack->GetSampleInfo(sampleNumber, &trackIndex->fLengths[sampleNumber - 1], &trackIndex->fOffsets[sampleNumber - 1], &sampleDescriptionIndex, &stscSTCB) )
+            return false;
+
+        if( sampleNumber == 1 )
+            trackIndex->fSampleDescriptionIndex = sampleDescriptionIndex;
+        else if( sampleDescriptionIndex != trackIndex->fSampleDescriptionIndex )
+            trackIndex->fSampleDescriptionIndex = 0;
+    }
+
+    if( !hintTrack->GetSampleMediaTime(numSamples + 1, &trackIndex->fMediaTimes[numSamples], &sttsSTCB) )
+        return false;
+
+    //
+    // The lookups are binary searches, so the times and sync samples had
+    // better be in order. They always are in a well formed movie.
+    for( sampleNumber = 1; sampleNumber <= numSamples; sampleNumber++ )
+        if( trackIndex->fMediaTimes[sampleNumber] < trackIndex->fMediaTimes[sampleNumber - 1] )
+            return false;
+
+    if( hintTrack->HasSyncSampleTable() )
+    {
+        trackIndex->fNumSyncSamples = hintTrack->GetNumSyncSamples();
+        trackIndex->fSyncSamples = NEW UInt32[trackIndex->fNumSyncSamples + 1];
+        for( UInt32 syncIndex = 0; syncIndex < trackIndex->fNumSyncSamples; syncIndex++ )
+        {
+            trackIndex->fSyncSamples[syncIndex] = hintTrack->GetSyncSampleNumber(syncIndex);
+            if( (syncIndex > 0) && (trackIndex->fSyncSamples[syncIndex] <= trackIndex->fSyncSamples[syncIndex - 1]) )
+                return false;
+        }
+    }
+
+    if( !countPackets )
+        return true;
+
+    //
+    // Build every packet, keeping count the way QTHintTrack::GetPacket does
+    // when it writes the RTP-Meta-Info packet number and position fields.
+    QTHintTrack_HintTrackControlBlock   htcb;
+    char        *packetBuffer = NEW char[kMaxPacketLength];
+    Bool16      buildSucceeds = true;
+
+    trackIndex->fPacketNumbers = NEW UInt64[numSamples + 1];
+    trackIndex->fPacketPositions = NEW UInt64[numSamples + 1];
+
+    for( sampleNumber = 1; buildSucceeds && (sampleNumber <= numSamples); sampleNumber++ )
+    {
+        UInt16  numPackets;
+
+        trackIndex->fPacketNumbers[sampleNumber - 1] = htcb.fCurrentPacketNumber;
+        trackIndex->fPacketPositions[sampleNumber - 1] = htcb.fCurrentPacketPosition;
+
+        if( hintTrack->GetNumPackets(sampleNumber, &numPackets, &htcb) != QTTrack::errNoError )
+            buildSucceeds = false;
+
+        for( UInt16 packetNumber = 1; buildSucceeds && (packetNumber <= numPackets); packetNumber++ )
+        {
+            UInt32  packetLength = kMaxPacketLength;
+            Float64 transmitTime;
+
+            if( hintTrack->GetPacket(sampleNumber, packetNumber, packetBuffer, &packetLength, &transmitTime, false, false, 0, &htcb) != QTTrack::errNoError )
+                buildSucceeds = false;
+        }
+    }
+
+    trackIndex->fPacketNumbers[numSamples] = htcb.fCurrentPacketNumber;
+    trackIndex->fPacketPositions[numSamples] = htcb.fCurrentPacketPosition;
+
+    delete [] packetBuffer;
+    return buildSucceeds;
+}
+
+
+// -------------------------------------
+// Index files
+//
+char * QTRTPFileIndex::GetIndexFilePath(QTFile * file)
+{
+    char *moviePath = file->GetMoviePath();
+    if( moviePath == NULL )
+        return NULL;
+
+    char *indexPath = NEW char[::strlen(moviePath) + ::strlen(GetFileNameSuffix()) + 1];
+    ::strcpy(indexPath, moviePath);
+    ::strcat(indexPath, GetFileNameSuffix());
+    return indexPath;
+}
+
+Bool16 QTRTPFileIndex::GetMovieFileInfo(QTFile * file, UInt64 * length, SInt64 * modDate)
+{
+    struct stat theStat;
+
+    if( (file->GetMoviePath() == NULL) || (::stat(file->GetMoviePath(), &theStat) != 0) )
+        return false;
+
+    *length = (UInt64)theStat.st_size;
+    *modDate = (SInt64)theStat.st_mtime;
+    return true;
+}
+
+QTRTPFileIndex * QTRTPFileIndex::Read(QTFile * file)
+{
+    // General vars
+    UInt64          movieLength;
+    SInt64          movieModDate;
+    char            *indexPath;
+    FILE            *indexFile;
+    char            *indexData = NULL;
+    long            indexLength = 0;
+
+
+    if( !GetMovieFileInfo(file, &movieLength, &movieModDate) )
+        return NULL;
+    if( (indexPath = GetIndexFilePath(file)) == NULL )
+        return NULL;
+
+    //
+    // Slurp the whole thing in.
+    indexFile = ::fopen(indexPath, "rb");
+    delete [] indexPath;
+    if( indexFile == NULL )
+        return NULL;
+
+    if( (::fseek(indexFile, 0, SEEK_END) == 0) && ((indexLength = ::ftell(indexFile)) >= kHeaderSize) && (::fseek(indexFile, 0, SEEK_SET) == 0) )
+    {
+        indexData = NEW char[indexLength];
+        if( ::fread(indexData, 1, indexLength, indexFile) != (size_t)indexLength )
+        {
+            delete [] indexData;
+            indexData = NULL;
+        }
+    }
+    ::fclose(indexFile);
+
+    if( indexData == NULL )
+        return NULL;
+
+    //
+    // Check that it is an index of this version of this movie.
+    UInt32      numTracks = QTAtom::TableInt32(indexData, 7);
+    UInt32      numHintTracks = 0;
+    QTTrack     *track;
+
+    for( track = NULL; file->NextTrack(&track, track); )
+        if( file->IsHintTrack(track) )
+            numHintTracks++;
+
+    if( (QTAtom::TableInt32(indexData, 0) != kIndexFileType)
+        || (QTAtom::TableInt32(indexData, 1) != kIndexFileVersion)
+        || (QTAtom::TableInt64(indexData + 8, 0) != movieLength)
+        || ((SInt64)QTAtom::TableInt64(indexData + 16, 0) != movieModDate)
+        || (numTracks != numHintTracks) )
+    {
+        delete [] indexData;
+        return NULL;
+    }
+
+    QTRTPFileIndex *index = NEW QTRTPFileIndex(numTracks);
+    index->fHasPacketNumbers = (QTAtom::TableInt32(indexData, 6) & kHasPacketNumbers) != 0;
+
+    //
+    // Read in the tracks, making sure that every one of them is there and
+    // matches a hint track in the movie.
+    UInt64      position = kHeaderSize;
+    Bool16      readSucceeds = true;
+
+    for( UInt32 trackNum = 0; readSucceeds && (trackNum < numTracks); trackNum++ )
+    {
+        TrackIndex  *trackIndex = &index->fTracks[trackNum];
+        UInt32      sampleIndex;
+
+        if( position + kTrackHeaderSize > (UInt64)indexLength )
+        {
+            readSucceeds = false;
+            break;
+        }
+
+        trackIndex->fTrackID = QTAtom::TableInt32(indexData + position, 0);
+        trackIndex->fNumSamples = QTAtom::TableInt32(indexData + position, 1);
+        trackIndex->fSampleDescriptionIndex = QTAtom::TableInt32(indexData + position, 2);
+        UInt32 numSyncSamples = QTAtom::TableInt32(indexData + position, 3);
+        position += kTrackHeaderSize;
+
+        if( !file->FindTrack(trackIndex->fTrackID, &track) || !file->IsHintTrack(track)
+            || (track->Initialize() != QTTrack::errNoError)
+            || (track->GetNumSamples() != trackIndex->fNumSamples) )
+        {
+            readSucceeds = false;
+            break;
+        }
+
+        UInt64 numSamples = trackIndex->fNumSamples;
+        UInt64 tablesLength = ((numSamples + 1) * 4) + (numSamples * (8 + 4));
+        if( numSyncSamples != kAllSyncSamples )
+            tablesLength += (UInt64)numSyncSamples * 4;
+        if( index->fHasPacketNumbers )
+            tablesLength += (numSamples + 1) * (8 + 8);
+        if( position + tablesLength > (UInt64)indexLength )
+        {
+            readSucceeds = false;
+            break;
+        }
+
+        trackIndex->fMediaTimes = NEW UInt32[numSamples + 1];
+        for( sampleIndex = 0; sampleIndex <= numSamples; sampleIndex++ )
+            trackIndex->fMediaTimes[sampleIndex] = QTAtom::TableInt32(indexData + position, sampleIndex);
+        position += (numSamples + 1) * 4;
+
+        trackIndex->fOffsets = NEW UInt64[numSamples];
+        for( sampleIndex = 0; sampleIndex < numSamples; sampleIndex++ )
+            trackIndex->fOffsets[sampleIndex] = QTAtom::TableInt64(indexData + position, sampleIndex);
+        position += numSamples * 8;
+
+        trackIndex->fLengths = NEW UInt32[numSamples];
+        for( sampleIndex = 0; sampleIndex < numSamples; sampleIndex++ )
+            trackIndex->fLengths[sampleIndex] = QTAtom::TableInt32(indexData + position, sampleIndex);
+        position += numSamples * 4;
+
+        if( numSyncSamples != kAllSyncSamples )
+        {
+            trackIndex->fNumSyncSamples = numSyncSamples;
+            trackIndex->fSyncSamples = NEW UInt32[numSyncSamples + 1];
+            for( UInt32 syncIndex = 0; syncIndex < numSyncSamples; syncIndex++ )
+                trackIndex->fSyncSamples[syncIndex] = QTAtom::TableInt32(indexData + position, syncIndex);
+            position += (UInt64)numSyncSamples * 4;
+        }
+
+        if( index->fHasPacketNumbers )
+        {
+            trackIndex->fPacketNumbers = NEW UInt64[numSamples + 1];
+            for( sampleIndex = 0; sampleIndex <= numSamples; sampleIndex++ )
+                trackIndex->fPacketNumbers[sampleIndex] = QTAtom::TableInt64(indexData + position, sampleIndex);
+            position += (numSamples + 1) * 8;
+
+            trackIndex->fPacketPositions = NEW UInt64[numSamples + 1];
+            for( sampleIndex = 0; sampleIndex <= numSamples; sampleIndex++ )
+                trackIndex->fPacketPositions[sampleIndex] = QTAtom::TableInt64(indexData + position, sampleIndex);
+            position += (numSamples + 1) * 8;
+        }
+    }
+
+    delete [] indexData;
+
+    if( !readSucceeds )
+    {
+        delete index;
+        return NULL;
+    }
+
+    index->ComputeMemoryUsed();
+    return index;
+}
+
+Bool16 QTRTPFileIndex::Write(QTFile * file)
+{
+    // General vars
+    UInt64          movieLength;
+    SInt64          movieModDate;
+    UInt64          indexLength = kHeaderSize;
+    UInt32          trackNum;
+
+
+    if( !GetMovieFileInfo(file, &movieLength, &movieModDate) )
+        return false;
+
+    for( trackNum = 0; trackNum < fNumTracks; trackNum++ )
+    {
+        UInt64 numSamples = fTracks[trackNum].fNumSamples;
+        indexLength += kTrackHeaderSize + ((numSamples + 1) * 4) + (numSamples * (8 + 4));
+        if( fTracks[trackNum].fSyncSamples != NULL )
+            indexLength += (UInt64)fTracks[trackNum].fNumSyncSamples * 4;
+        if( fHasPacketNumbers )
+            indexLength += (numSamples + 1) * (8 + 8);
+    }
+
+    //
+    // Lay the whole thing out in memory, then write it in one go.
+    char    *indexData = NEW char[indexLength];
+    char    *indexPtr = indexData;
+
+    PutInt32(&indexPtr, kIndexFileType);
+    PutInt32(&indexPtr, kIndexFileVersion);
+    PutInt64(&indexPtr, movieLength);
+    PutInt64(&indexPtr, (UInt64)movieModDate);
+    PutInt32(&indexPtr, fHasPacketNumbers ? kHasPacketNumbers : 0);
+    PutInt32(&indexPtr, fNumTracks);
+
+    for( trackNum = 0; trackNum < fNumTracks; trackNum++ )
+    {
+        TrackIndex  *trackIndex = &fTracks[trackNum];
+        UInt32      sampleIndex;
+
+        PutInt32(&indexPtr, trackIndex->fTrackID);
+        PutInt32(&indexPtr, trackIndex->fNumSamples);
+        PutInt32(&indexPtr, trackIndex->fSampleDescriptionIndex);
+        PutInt32(&indexPtr, (trackIndex->fSyncSamples != NULL) ? trackIndex->fNumSyncSamples : (UInt32)kAllSyncSamples);
+
+        for( sampleIndex = 0; sampleIndex <= trackIndex->fNumSamples; sampleIndex++ )
+            PutInt32(&indexPtr, trackIndex->fMediaTimes[sampleIndex]);
+        for( sampleIndex = 0; sampleIndex < trackIndex->fNumSamples; sampleIndex++ )
+            PutInt64(&indexPtr, trackIndex->fOffsets[sampleIndex]);
+        for( sampleIndex = 0; sampleIndex < trackIndex->fNumSamples; sampleIndex++ )
+            PutInt32(&indexPtr, trackIndex->fLengths[sampleIndex]);
+
+        if( trackIndex->fSyncSamples != NULL )
+            for( UInt32 syncIndex = 0; syncIndex < trackIndex->fNumSyncSamples; syncIndex++ )
+                PutInt32(&indexPtr, trackIndex->fSyncSamples[syncIndex]);
+
+        if( fHasPacketNumbers )
+        {
+            for( sampleIndex = 0; sampleIndex <= trackIndex->fNumSamples; sampleIndex++ )
+                PutInt64(&indexPtr, trackIndex->fPacketNumbers[sampleIndex]);
+            for( sampleIndex = 0; sampleIndex <= trackIndex->fNumSamples; sampleIndex++ )
+                PutInt64(&indexPtr, trackIndex->fPacketPositions[sampleIndex]);
+        }
+    }
+    Assert((UInt64)(indexPtr - indexData) == indexLength);
+
+    //
+    // Write it under another name and rename it into place, so that a
+    // server playing the movie never reads half an index.
+    char    *indexPath = GetIndexFilePath(file);
+    char    *tempPath = NEW char[::strlen(indexPath) + 5];
+    ::strcpy(tempPath, indexPath);
+    ::strcat(tempPath, ".tmp");
+
+    Bool16  writeSucceeds = false;
+    FILE    *indexFile = ::fopen(tempPath, "wb");
+    if( indexFile != NULL )
+    {
+        writeSucceeds = (::fwrite(indexData, 1, (size_t)indexLength, indexFile) == (size_t)indexLength);
+        writeSucceeds = (::fclose(indexFile) == 0) && writeSucceeds;
+
+        if( writeSucceeds )
+            writeSucceeds = (::rename(tempPath, indexPath) == 0);
+        if( !writeSucceeds )
+            (void)::remove(tempPath);
+    }
+
+    delete [] tempPath;
+    delete [] indexPath;
+    delete [] indexData;
+    return writeSucceeds;
+}
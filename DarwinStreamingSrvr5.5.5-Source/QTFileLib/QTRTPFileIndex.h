@@ -0,0 +1,154 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPFileIndex:
+//   A flat table of every sample in the hint tracks of a movie, so that
+//   QTRTPFile can find the sample at a given time, the sync samples around it
+//   and where it is in the file with a binary search or an array lookup,
+//   instead of walking the sample tables from the start.
+//
+//   An index can also number every packet, which lets an RTP-Meta-Info seek
+//   jump straight to the sample it wants instead of building every packet
+//   up to it. Counting the packets means reading every hint sample, so
+//   QTRTPIndexGen does that ahead of time and saves the index next to the
+//   movie. Without a saved index, QTRTPFile builds one without packet
+//   numbers from the sample tables when the movie is first played.
+
+#ifndef QTRTPFileIndex_H
+#define QTRTPFileIndex_H
+
+
+//
+// Includes
+#include "OSHeaders.h"
+
+
+//
+// External classes
+class QTFile;
+class QTHintTrack;
+
+
+class QTRTPFileIndex {
+
+public:
+    //
+    // The index of one hint track. Sample numbers start at 1, like they
+    // do everywhere else in QTFileLib.
+    class TrackIndex {
+
+    public:
+        inline  UInt32      GetTrackID(void) { return fTrackID; }
+        inline  UInt32      GetNumSamples(void) { return fNumSamples; }
+        inline  Bool16      HasPacketNumbers(void) { return fPacketNumbers != NULL; }
+
+        //
+        // These give the same answers as the QTTrack functions of the same
+        // name, sample table quirks included.
+                Bool16      GetSampleNumberFromMediaTime(UInt32 MediaTime, UInt32 * SampleNumber);
+        inline  Bool16      GetSampleMediaTime(UInt32 SampleNumber, UInt32 * MediaTime)
+                            {   if( (SampleNumber == 0) || (SampleNumber > fNumSamples + 1) ) return false;
+                                *MediaTime = fMediaTimes[SampleNumber - 1]; return true;
+                            }
+                void        GetPreviousSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber);
+                void        GetNextSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber);
+                Bool16      IsSyncSample(UInt32 SampleNumber);
+
+        //
+        // Returns false if the sample description differs from sample to
+        // sample, in which case only the sample tables can say.
+                Bool16      GetSampleInfo(UInt32 SampleNumber, UInt32 * Length, UInt64 * Offset, UInt32 * SampleDescriptionIndex);
+
+        //
+        // How many packets (and RTP-Meta-Info packet position bytes) come
+        // before the first packet of this sample, counting from sample 1.
+        // Only there if HasPacketNumbers.
+                Bool16      GetPacketsBeforeSample(UInt32 SampleNumber, UInt64 * PacketNumber, UInt64 * PacketPosition);
+
+    private:
+                            TrackIndex();
+                            ~TrackIndex();
+
+        UInt32      fTrackID;
+        UInt32      fNumSamples;
+        UInt32      fSampleDescriptionIndex;    // of every sample, or 0 if they differ
+
+        UInt32      *fMediaTimes;       // fNumSamples + 1 of them; the last is where the track ends
+        UInt64      *fOffsets;
+        UInt32      *fLengths;
+
+        UInt32      fNumSyncSamples;
+        UInt32      *fSyncSamples;      // sorted; NULL if every sample is a sync sample
+
+        UInt64      *fPacketNumbers;    // fNumSamples + 1 of them, or NULL
+        UInt64      *fPacketPositions;
+
+        friend class QTRTPFileIndex;
+    };
+
+    //
+    // Indexes every hint track in the file. If CountPackets is set, this
+    // reads every hint sample and builds every packet in it to number them,
+    // which takes about as long as streaming the movie. Returns NULL if the
+    // sample tables of a hint track don't add up.
+    static  QTRTPFileIndex  *Build(QTFile * File, Bool16 CountPackets = false);
+
+    //
+    // Reads the index saved for this file. Returns NULL if there isn't one,
+    // or if the movie has changed since it was saved.
+    static  QTRTPFileIndex  *Read(QTFile * File);
+            Bool16          Write(QTFile * File);
+
+    //
+    // The index of a movie is saved next to it, with this appended to its name.
+    static  const char      *GetFileNameSuffix(void) { return ".rtpidx"; }
+
+                            ~QTRTPFileIndex(void);
+
+    //
+    // Accessors
+            TrackIndex      *FindTrack(UInt32 TrackID);
+    inline  Bool16          HasPacketNumbers(void) { return fHasPacketNumbers; }
+    inline  UInt64          GetMemoryUsed(void) { return fMemoryUsed; }
+
+private:
+                            QTRTPFileIndex(UInt32 NumTracks);
+
+    static  Bool16          BuildTrack(QTHintTrack * HintTrack, TrackIndex * Index, Bool16 CountPackets);
+    static  char            *GetIndexFilePath(QTFile * File);
+    static  Bool16          GetMovieFileInfo(QTFile * File, UInt64 * Length, SInt64 * ModDate);
+            void            ComputeMemoryUsed(void);
+
+    enum {
+        kIndexFileVersion   = 1
+    };
+
+    UInt32          fNumTracks;
+    TrackIndex      *fTracks;
+    Bool16          fHasPacketNumbers;
+    UInt64          fMemoryUsed;
+};
+
+#endif // QTRTPFileIndex_H
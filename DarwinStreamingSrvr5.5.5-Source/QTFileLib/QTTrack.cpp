@@ -73,6 +73,7 @@ QTTrack::QTTrack(QTFile * File, QTFile::AtomTOCEntry * Atom, Bool16 Debug, Bool1
       fEditListAtom(NULL), fDataReferenceAtom(NULL),
       fTimeToSampleAtom(NULL),fCompTimeToSampleAtom(NULL), fSampleToChunkAtom(NULL), fSampleDescriptionAtom(NULL),
       fChunkOffsetAtom(NULL), fSampleSizeAtom(NULL), fSyncSampleAtom(NULL),
+      fFragments(NULL),
       fFirstEditMediaTime(0)
 {
     // Temporary vars
@@ -282,6 +283,11 @@ QTTrack::ErrorCode QTTrack::Initialize(void)
         fSyncSampleAtom = NULL;
     }
     
+    //
+    // Hook up this track's movie fragments, if it has any.
+    if( fFile->GetFragmentIndex() != NULL )
+        fFragments = fFile->GetFragmentIndex()->FindTrack(GetTrackID());
+    
     
     //
     // This track has been successfully initialiazed.
@@ -299,6 +305,9 @@ Bool16 QTTrack::GetSampleInfo(UInt32 SampleNumber, UInt32 * const Length, UInt64
     
     Assert(STCB != NULL);
     
+    if( IsFragmentSample(SampleNumber) )
+        return fFragments->GetSampleInfo(SampleNumber, Length, Offset, SampleDescriptionIndex);
+
 //  qtss_printf("GetSampleInfo QTTrack SampleNumber = %ld \n", SampleNumber);
 
     if (STCB->fGetSampleInfo_SampleNumber == SampleNumber && STCB->fGetSampleInfo_Length > 0)
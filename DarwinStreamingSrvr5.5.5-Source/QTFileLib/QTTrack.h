@@ -42,6 +42,7 @@
 #include "QTAtom_stss.h"
 #include "QTAtom_stsz.h"
 #include "QTAtom_stts.h"
+#include "QTFragmentIndex.h"
 
 
 //
@@ -96,6 +97,13 @@ public:
                                               { if(fEditListAtom != NULL) return fEditListAtom->FirstEditMovieTime();
                                                 else return 0; }
     inline  UInt32      GetFirstEditMediaTime(void) { return fFirstEditMediaTime; }
+
+    //
+    // The samples of a track in a fragmented movie carry on in the movie
+    // fragments after the ones in the sample tables. The sample functions
+    // below cover both, except for the chunk functions and the sync sample
+    // table accessors, which only know about the sample tables.
+    inline  Bool16      IsFragmented(void) { return fFragments != NULL; }
     
     //
     // Sample functions
@@ -128,9 +136,14 @@ public:
                         }
 
     inline  Bool16      SampleSize(UInt32 SampleNumber, UInt32 *Size = NULL) 
-                        {   return fSampleSizeAtom->SampleSize(SampleNumber, Size); 
+                        {   if( IsFragmentSample(SampleNumber) ) return fFragments->GetSampleInfo(SampleNumber, Size, NULL, NULL);
+                            return fSampleSizeAtom->SampleSize(SampleNumber, Size); 
                         }
 
+    //
+    // A fragmented track has to read all of its fragments to count them.
+    inline  UInt32      GetNumSamples(void) { return fSampleSizeAtom->GetNumEntries() + (fFragments ? fFragments->GetNumSamples() : 0); }
+
     inline  Bool16      SampleRangeSize(UInt32 firstSample, UInt32 lastSample, UInt32 *sizePtr = NULL) 
                         {   return fSampleSizeAtom->SampleRangeSize(firstSample, lastSample, sizePtr); 
                         }
@@ -143,27 +156,38 @@ public:
 
     inline  Bool16      GetSampleMediaTime(UInt32 SampleNumber, UInt32 * const MediaTime, 
                                                 QTAtom_stts_SampleTableControlBlock * STCB)
-                        {   return fTimeToSampleAtom->SampleNumberToMediaTime(SampleNumber, MediaTime, STCB); 
+                        {   if( IsFragmentSample(SampleNumber) ) return fFragments->GetSampleMediaTime(SampleNumber, MediaTime);
+                            return fTimeToSampleAtom->SampleNumberToMediaTime(SampleNumber, MediaTime, STCB); 
                         }                       
 
     inline  Bool16      GetSampleNumberFromMediaTime(UInt32 MediaTime, UInt32 * const SampleNumber, 
                                                 QTAtom_stts_SampleTableControlBlock * STCB)
-                        {   return fTimeToSampleAtom->MediaTimeToSampleNumber(MediaTime, SampleNumber, STCB); 
+                        {   if( (fFragments != NULL) && (MediaTime >= fFragments->GetFirstMediaTime()) ) return fFragments->GetSampleNumberFromMediaTime(MediaTime, SampleNumber);
+                            return fTimeToSampleAtom->MediaTimeToSampleNumber(MediaTime, SampleNumber, STCB); 
                         }
 
 
     inline  void        GetPreviousSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber)
-                        {   if(fSyncSampleAtom != NULL) fSyncSampleAtom->PreviousSyncSample(SampleNumber, SyncSampleNumber);
+                        {   if( IsFragmentSample(SampleNumber) && fFragments->GetPreviousSyncSample(SampleNumber, SyncSampleNumber) ) return;
+                            if(fSyncSampleAtom != NULL) fSyncSampleAtom->PreviousSyncSample(SampleNumber, SyncSampleNumber);
                             else *SyncSampleNumber = SampleNumber; 
                         }
                         
     inline  void        GetNextSyncSample(UInt32 SampleNumber, UInt32 * SyncSampleNumber)
-                        {       if(fSyncSampleAtom != NULL) fSyncSampleAtom->NextSyncSample(SampleNumber, SyncSampleNumber);
+                        {       if( IsFragmentSample(SampleNumber + 1) ) { if( !fFragments->GetNextSyncSample(SampleNumber, SyncSampleNumber) ) *SyncSampleNumber = SampleNumber + 1; }
+                                else if(fSyncSampleAtom != NULL) fSyncSampleAtom->NextSyncSample(SampleNumber, SyncSampleNumber);
                                 else *SyncSampleNumber = SampleNumber + 1; 
                         }
 
+    //
+    // Without a sync sample table, every sample is a sync sample.
+    inline  Bool16      HasSyncSampleTable(void) { return fSyncSampleAtom != NULL; }
+    inline  UInt32      GetNumSyncSamples(void) { return fSyncSampleAtom ? fSyncSampleAtom->GetNumEntries() : 0; }
+    inline  UInt32      GetSyncSampleNumber(UInt32 SyncSampleIndex) { return fSyncSampleAtom->GetSyncSample(SyncSampleIndex); }
+
     inline Bool16           IsSyncSample(UInt32 SampleNumber, UInt32 SyncSampleCursor)
-                        { if (fSyncSampleAtom != NULL) return fSyncSampleAtom->IsSyncSample(SampleNumber, SyncSampleCursor);
+                        { if( IsFragmentSample(SampleNumber) ) return fFragments->IsSyncSample(SampleNumber);
+                          if (fSyncSampleAtom != NULL) return fSyncSampleAtom->IsSyncSample(SampleNumber, SyncSampleCursor);
                             else return true;
                         } 
     //
@@ -175,6 +199,8 @@ public:
 
     inline Bool16       GetSampleMediaTimeOffset(UInt32 SampleNumber, UInt32 *mediaTimeOffset, QTAtom_ctts_SampleTableControlBlock * STCB)
                         {   
+                            if( IsFragmentSample(SampleNumber) )
+                                return fFragments->GetSampleMediaTimeOffset(SampleNumber, mediaTimeOffset);
                             if (fCompTimeToSampleAtom) 
                                 return fCompTimeToSampleAtom->SampleNumberToMediaTimeOffset(SampleNumber, mediaTimeOffset, STCB);
                             else 
@@ -191,6 +217,9 @@ public:
 
 
 protected:
+    inline  Bool16      IsFragmentSample(UInt32 SampleNumber)
+                        {   return (fFragments != NULL) && (SampleNumber >= fFragments->GetFirstSampleNumber()); }
+
     //
     // Protected member variables.
     Bool16              fDebug, fDeepDebug;
@@ -215,6 +244,8 @@ protected:
     QTAtom_stsz         *fSampleSizeAtom;
     QTAtom_stss         *fSyncSampleAtom;
 
+    QTFragmentIndex::TrackFragments *fFragments;
+
     UInt32              fFirstEditMediaTime;
 };
 
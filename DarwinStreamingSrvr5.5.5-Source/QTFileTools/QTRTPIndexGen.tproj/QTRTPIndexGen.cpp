@@ -0,0 +1,229 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPIndexGen:
+//   Saves the index of the hint tracks of a movie next to it, with every
+//   packet numbered, so the server doesn't have to build one. Can also
+//   time random seeks in the movie with and without the index.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+
+#ifndef __MacOSX__
+#include "getopt.h"
+#include <unistd.h>
+#endif
+
+#include "OS.h"
+#include "QTFile.h"
+#include "QTTrack.h"
+#include "QTRTPFile.h"
+#include "QTRTPFileIndex.h"
+
+
+static Bool16 WriteIndex(const char * movieFilename, Bool16 debug, Bool16 deepDebug)
+{
+    QTFile  file(debug, deepDebug);
+    if( file.Open(movieFilename) != QTFile::errNoError ) {
+        qtss_printf("Error!  Could not open movie file \"%s\"!\n", movieFilename);
+        return false;
+    }
+
+    SInt64 startTime = OS::Milliseconds();
+    QTRTPFileIndex *index = QTRTPFileIndex::Build(&file, true);
+    if( index == NULL ) {
+        qtss_printf("Error!  Could not index the hint tracks of \"%s\"!\n", movieFilename);
+        return false;
+    }
+
+    Bool16 writeSucceeds = index->Write(&file);
+    if( writeSucceeds )
+        qtss_printf("%s%s: %"_64BITARG_"u bytes in memory, built in %"_64BITARG_"d msec\n", movieFilename, QTRTPFileIndex::GetFileNameSuffix(),
+                        index->GetMemoryUsed(), OS::Milliseconds() - startTime);
+    else
+        qtss_printf("Error!  Could not write \"%s%s\"!\n", movieFilename, QTRTPFileIndex::GetFileNameSuffix());
+
+    delete index;
+    return writeSucceeds;
+}
+
+static QTRTPFile * OpenForSeeking(const char * movieFilename, Bool16 useMetaInfo)
+{
+    QTRTPFile *rtpFile = new QTRTPFile();
+    if( rtpFile->Initialize(movieFilename) != QTRTPFile::errNoError ) {
+        delete rtpFile;
+        return NULL;
+    }
+
+    QTTrack *track = NULL;
+    while( rtpFile->GetQTFile()->NextTrack(&track, track) ) {
+        if( !rtpFile->GetQTFile()->IsHintTrack(track) )
+            continue;
+
+        (void)rtpFile->AddTrack(track->GetTrackID(), false);
+        if( useMetaInfo ) {
+            RTPMetaInfoPacket::FieldID *fields = new RTPMetaInfoPacket::FieldID[RTPMetaInfoPacket::kNumFields];
+            ::memcpy(fields, QTRTPFile::GetSupportedRTPMetaInfoFields(), sizeof(RTPMetaInfoPacket::FieldID) * RTPMetaInfoPacket::kNumFields);
+            rtpFile->SetTrackRTPMetaInfo(track->GetTrackID(), fields, true);
+        }
+    }
+
+    return rtpFile;
+}
+
+static SInt64 TimeSeek(QTRTPFile * rtpFile, Float64 seekTime, UInt32 * packetChecksum)
+{
+    char    *packet = NULL;
+    int     packetLength = 0;
+
+    SInt64 startTime = OS::Microseconds();
+    QTRTPFile::ErrorCode err = rtpFile->Seek(seekTime);
+    while( err == QTRTPFile::errCallAgain )
+        err = rtpFile->Seek(seekTime);
+    if( err == QTRTPFile::errNoError )
+        (void)rtpFile->GetNextPacket(&packet, &packetLength);
+    SInt64 duration = OS::Microseconds() - startTime;
+
+    *packetChecksum = (UInt32)packetLength;
+    for( int byteIndex = 0; byteIndex < packetLength; byteIndex++ )
+        *packetChecksum = (*packetChecksum * 31) + (UInt8)packet[byteIndex];
+
+    return duration;
+}
+
+static void BenchmarkSeeks(const char * movieFilename, UInt32 numSeeks, Bool16 useMetaInfo)
+{
+    Float64     *seekTimes = new Float64[numSeeks];
+    UInt32      *checksums = new UInt32[numSeeks];
+    UInt32      numMismatches = 0;
+
+    qtss_printf("%lu random seeks in %s%s (Seek and the first GetNextPacket):\n", numSeeks, movieFilename, useMetaInfo ? ", RTP-Meta-Info" : "");
+
+    for( int useIndex = 0; useIndex <= 1; useIndex++ ) {
+        QTRTPFile::SetPacketIndexEnabled(useIndex);
+
+        QTRTPFile *rtpFile = OpenForSeeking(movieFilename, useMetaInfo);
+        if( rtpFile == NULL ) {
+            qtss_printf("Error!  Could not open movie file \"%s\"!\n", movieFilename);
+            break;
+        }
+
+        if( !useIndex ) {
+            ::srand(1);
+            for( UInt32 seekIndex = 0; seekIndex < numSeeks; seekIndex++ )
+                seekTimes[seekIndex] = rtpFile->GetMovieDuration() * ::rand() / RAND_MAX;
+        }
+
+        //
+        // The first seek is the one that reads or builds the index.
+        UInt32  checksum;
+        SInt64  firstSeekTime = TimeSeek(rtpFile, 0.0, &checksum);
+        SInt64  totalTime = 0, maxTime = 0;
+
+        for( UInt32 seekIndex = 0; seekIndex < numSeeks; seekIndex++ ) {
+            SInt64 seekDuration = TimeSeek(rtpFile, seekTimes[seekIndex], &checksum);
+            totalTime += seekDuration;
+            if( seekDuration > maxTime )
+                maxTime = seekDuration;
+
+            if( !useIndex )
+                checksums[seekIndex] = checksum;
+            else if( checksum != checksums[seekIndex] )
+                numMismatches++;
+        }
+
+        qtss_printf("   %-9s: first %"_64BITARG_"d usec, average %.1f usec, max %"_64BITARG_"d usec\n", useIndex ? "index" : "no index",
+                        firstSeekTime, numSeeks ? (Float64)totalTime / numSeeks : 0.0, maxTime);
+        delete rtpFile;
+    }
+
+    if( numMismatches > 0 )
+        qtss_printf("Error!  %lu seeks got a different packet with the index!\n", numMismatches);
+
+    delete [] seekTimes;
+    delete [] checksums;
+}
+
+int main(int argc, char *argv[]) {
+    // Temporary vars
+    int         ch;
+
+    // General vars
+    bool            Debug = false, DeepDebug = false;
+    bool            useMetaInfo = false;
+    UInt32          numSeeks = 0;
+    int             exitCode = 0;
+    extern int optind;
+    extern char* optarg;
+
+    //
+    // Read our command line options
+    while( (ch = getopt(argc, argv, "dDb:m")) != -1 ) {
+        switch( ch ) {
+            case 'd':
+                Debug = true;
+            break;
+
+            case 'D':
+                Debug = true;
+                DeepDebug = true;
+            break;
+
+            case 'b':
+                numSeeks = ::atoi(optarg);
+            break;
+
+            case 'm':
+                useMetaInfo = true;
+            break;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    //
+    // Validate our arguments.
+    if( argc < 1 ) {
+        qtss_printf("usage: QTRTPIndexGen [-d] [-D] [-b <seeks>] [-m] <filename> ..\n");
+        qtss_printf("usage: -b time this many random seeks with and without the index\n");
+        qtss_printf("usage: -m time seeks with RTP-Meta-Info packets\n");
+        exit(1);
+    }
+
+    for( ; argc > 0; argc--, argv++ ) {
+        if( !WriteIndex(*argv, Debug, DeepDebug) ) {
+            exitCode = 1;
+            continue;
+        }
+
+        if( numSeeks > 0 )
+            BenchmarkSeeks(*argv, numSeeks, useMetaInfo);
+    }
+
+    return exitCode;
+}
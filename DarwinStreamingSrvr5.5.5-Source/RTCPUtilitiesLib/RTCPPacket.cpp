@@ -134,6 +134,48 @@ UInt32 RTCPReceiverPacket::GetCumulativeTotalLostPackets()
 
 
 
+Bool16 RTCPNACKPacket::ParseNACKPacket(UInt8* inPacketBuffer, UInt32 inPacketLength)
+{
+    Bool16 ok = this->ParsePacket(inPacketBuffer, inPacketLength);
+    if (!ok)
+        return false;
+    
+    if ((this->GetPacketType() != kRTPFeedbackPacketType) || (this->GetReportCount() != kGenericNACKFormat))
+        return false;
+
+    //there has to be room for the media source SSRC and at least one NACK
+    if (this->GetPacketLength() < 3)
+        return false;
+        
+    fNACKArray = inPacketBuffer + kNACKOffset;
+    return true;
+}
+
+UInt32 RTCPNACKPacket::GetNumLostPackets()
+{
+    UInt32 numLostPackets = 0;
+    for (int i = 0; i < this->GetNumNACKs(); i++)
+    {
+        numLostPackets++;
+        for (UInt16 theMask = this->GetLostPacketBitmask(i); theMask != 0; theMask &= theMask - 1)
+            numLostPackets++;
+    }
+    
+    return numLostPackets;
+}
+
+void RTCPNACKPacket::Dump()//Override
+{
+    RTCPPacket::Dump();
+    
+    qtss_printf( "   H_media_ssrc=%lu\n", this->GetMediaSourceSSRC() );
+    for (int i = 0; i < this->GetNumNACKs(); i++)
+        qtss_printf( "   [%d] H_pid=%u, H_blp=0x%04x\n", i, this->GetPacketID(i), this->GetLostPacketBitmask(i) );
+}
+
+
+
+
 void RTCPPacket::Dump()
 {  
     qtss_printf( "H_vers=%d, H_pad=%d, H_rprt_count=%d, H_type=%d, H_length=%d, H_ssrc=%ld\n",
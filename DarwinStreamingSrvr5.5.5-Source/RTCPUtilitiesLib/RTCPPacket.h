@@ -54,7 +54,8 @@ public:
     {
         kReceiverPacketType     = 201,  //UInt32
         kSDESPacketType         = 202,  //UInt32
-        kAPPPacketType          = 204   //UInt32
+        kAPPPacketType          = 204,  //UInt32
+        kRTPFeedbackPacketType  = 205   //UInt32
     };
     
 
@@ -179,6 +180,44 @@ protected:
 
 };
 
+class RTCPNACKPacket  : public RTCPPacket
+{
+public:
+
+    RTCPNACKPacket() : RTCPPacket(), fNACKArray(NULL) {}
+
+    //Call this before any accessor method. Returns true if this is a generic NACK
+    //(an RTPFB packet with FMT=1, RFC 4585), false otherwise
+    Bool16 ParseNACKPacket(UInt8* inPacketBuffer, UInt32 inPacketLength);
+
+    inline UInt32 GetMediaSourceSSRC();
+    inline int GetNumNACKs() { return (this->GetPacketLength() - 2); }
+    inline UInt16 GetPacketID(int inNACKNum);
+    inline UInt16 GetLostPacketBitmask(int inNACKNum);
+
+    //Counts each packet ID and each bit set in the bitmasks
+    UInt32 GetNumLostPackets();
+    
+    virtual void Dump(); //Override
+    
+protected:
+
+    UInt8* fNACKArray;  //points into fReceiverPacketBuffer
+
+    enum
+    {
+        kGenericNACKFormat = 1,     //in the report count field
+
+        kNACKSizeInBytes = 4,
+        kMediaSourceSSRCOffset = kPacketSourceIDOffset + kPacketSourceIDSize,
+        kNACKOffset = kMediaSourceSSRCOffset + 4,
+
+        kPacketIDOffset = 0,
+        kLostPacketBitmaskOffset = 2
+    };
+
+};
+
 /**************  RTCPPacket  inlines **************/
 inline int RTCPPacket::GetVersion()
 {
@@ -267,6 +306,23 @@ inline UInt32 RTCPReceiverPacket::GetLastSenderReportDelay(int inReportNum)
 }
 
 
+/**************  RTCPNACKPacket  inlines **************/
+inline UInt32 RTCPNACKPacket::GetMediaSourceSSRC()
+{
+    return (UInt32) ntohl(*(UInt32*)&fReceiverPacketBuffer[kMediaSourceSSRCOffset]) ;
+}
+
+inline UInt16 RTCPNACKPacket::GetPacketID(int inNACKNum)
+{
+    return (UInt16) ntohs(*(UInt16*)&fNACKArray[(inNACKNum * kNACKSizeInBytes) + kPacketIDOffset]) ;
+}
+
+inline UInt16 RTCPNACKPacket::GetLostPacketBitmask(int inNACKNum)
+{
+    return (UInt16) ntohs(*(UInt16*)&fNACKArray[(inNACKNum * kNACKSizeInBytes) + kLostPacketBitmaskOffset]) ;
+}
+
+
 /*
 Receiver Report
 ---------------
@@ -298,6 +354,22 @@ Receiver Report
 +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 
 
+Generic NACK (RFC 4585)
+-----------------------
+ 0                   1                   2                   3
+ 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|V=2|P| FMT=1   |  PT=RTPFB=205 |             length            | header
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|                  SSRC of packet sender                        |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|                  SSRC of media source                         |
++=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+|            PID                |             BLP               | one or
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ more
+
+PID is the sequence number of a lost packet. Bit i of BLP is set if
+packet PID+i+1 was lost too.
 
 */
 
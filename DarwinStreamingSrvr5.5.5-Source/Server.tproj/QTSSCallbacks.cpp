@@ -376,6 +376,21 @@ QTSS_Error  QTSSCallbacks::QTSS_Write(QTSS_StreamRef inStream, void* inBuffer, U
         return theErr;
 }
 
+QTSS_Error  QTSSCallbacks::QTSS_WritePackets(QTSS_StreamRef inStream, QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets, UInt32* outNumPacketsWritten, UInt32 inFlags)
+{
+    if ((inStream == NULL) || (inPackets == NULL) || (inPacketLens == NULL) || (outNumPacketsWritten == NULL))
+        return QTSS_BadArgument;
+    QTSS_Error theErr = ((QTSSStream*)inStream)->WritePackets(inPackets, inPacketLens, inNumPackets, outNumPacketsWritten, inFlags);
+    
+    // Same as QTSS_Write
+    if (theErr == EAGAIN)
+        return QTSS_WouldBlock;
+    else if (theErr > 0)
+        return QTSS_NotConnected;
+    else
+        return theErr;
+}
+
 QTSS_Error  QTSSCallbacks::QTSS_WriteV(QTSS_StreamRef inStream, iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength, UInt32* outLenWritten)
 {
     if (inStream == NULL)
@@ -117,6 +117,7 @@ class QTSSCallbacks
         
         static QTSS_Error   QTSS_Write(QTSS_StreamRef inStream, void* inBuffer, UInt32 inLen, UInt32* outLenWritten, QTSS_WriteFlags inFlags);
         static QTSS_Error   QTSS_WriteV(QTSS_StreamRef inStream, iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength, UInt32* outLenWritten);
+        static QTSS_Error   QTSS_WritePackets(QTSS_StreamRef inStream, QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets, UInt32* outNumPacketsWritten, QTSS_WriteFlags inFlags);
         static QTSS_Error   QTSS_Flush(QTSS_StreamRef inStream);
         static QTSS_Error   QTSS_Read(QTSS_StreamRef inRef, void* ioBuffer, UInt32 inBufLen, UInt32* outLengthRead);
         static QTSS_Error   QTSS_Seek(QTSS_StreamRef inRef, UInt64 inNewPosition);
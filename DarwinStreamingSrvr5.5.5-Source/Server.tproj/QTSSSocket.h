@@ -46,7 +46,7 @@ class QTSSSocket : public QTSSStream
 {
     public:
 
-        QTSSSocket(int inFileDesc) : fEventContext(inFileDesc, Socket::GetEventThread()) {}
+        QTSSSocket(int inFileDesc) : fEventContext(inFileDesc, Socket::GetEventThread(inFileDesc)) {}
         virtual ~QTSSSocket() {}
         
         //
@@ -62,6 +62,10 @@ class QTSSStream
         virtual QTSS_Error  WriteV(iovec* /*inVec*/, UInt32 /*inNumVectors*/, UInt32 /*inTotalLength*/, UInt32* /*outLenWritten*/)
                                                             { return QTSS_Unimplemented; }
                                                             
+        virtual QTSS_Error  WritePackets(QTSS_PacketStruct* /*inPackets*/, UInt32* /*inPacketLens*/, UInt32 /*inNumPackets*/,
+                                        UInt32* /*outNumPacketsWritten*/, UInt32 /*inFlags*/)
+                                                            { return QTSS_Unimplemented; }
+                                                            
         virtual QTSS_Error  Flush()                         { return QTSS_Unimplemented; }
         
         virtual QTSS_Error  Seek(UInt64 /*inNewPosition*/)  { return QTSS_Unimplemented; }
@@ -114,6 +114,7 @@ class RTPSocketPool : public UDPSocketPool
         virtual void            DestructUDPSocketPair(UDPSocketPair* inPair);
 
         virtual void            SetUDPSocketOptions(UDPSocketPair* inPair);
+        virtual void            ActivateUDPSocketPair(UDPSocketPair* inPair);
 };
 
 
@@ -720,7 +721,6 @@ Bool16  QTSServer::SetupUDPSockets()
                 {
             theNumAllocatedPairs++;
                         thePair->GetSocketA()->RequestEvent(EV_RE);
-                        thePair->GetSocketB()->RequestEvent(EV_RE);
                 }
         }
     //only return an error if we couldn't allocate ANY pairs of sockets
@@ -972,6 +972,7 @@ void    QTSServer::InitCallbacks()
     
     sCallbacks.addr[kLockStdLibCallback] =                  (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_LockStdLib;
     sCallbacks.addr[kUnlockStdLibCallback] =                (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_UnlockStdLib;
+    sCallbacks.addr[kWritePacketsCallback] =                (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_WritePackets;
 }
 
 void QTSServer::LoadModules(QTSServerPrefs* inPrefs)
@@ -1382,7 +1383,7 @@ Bool16 RTSPListenerSocket::OverMaxConnections(UInt32 buffer)
 
 UDPSocketPair*  RTPSocketPool::ConstructUDPSocketPair()
 {
-    Task* theTask = ((QTSServer*)QTSServerInterface::GetServer())->fRTCPTask;
+    RTCPTask* theTask = ((QTSServer*)QTSServerInterface::GetServer())->fRTCPTask;
     
     //construct a pair of UDP sockets, the lower one for RTP data (outgoing only, no demuxer
     //necessary), and one for RTCP data (incoming, so definitely need a demuxer).
@@ -1390,7 +1391,7 @@ UDPSocketPair*  RTPSocketPool::ConstructUDPSocketPair()
 	// They do receive events - we don't poll from them anymore
     return NEW
         UDPSocketPair(  NEW UDPSocket(theTask, Socket::kNonBlockingSocketType),
-                        NEW UDPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType));
+                        NEW RTCPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType));
 }
 
 void RTPSocketPool::DestructUDPSocketPair(UDPSocketPair* inPair)
@@ -1435,6 +1436,14 @@ void RTPSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
     }
 }
 
+void RTPSocketPool::ActivateUDPSocketPair(UDPSocketPair* inPair)
+{
+    //
+    // The RTCPTask only reads RTCP sockets that have signalled, so every
+    // new RTCP socket must be watching for data from the start.
+    inPair->GetSocketB()->RequestEvent(EV_RE);
+}
+
 
 
 QTSS_Error QTSServer::RereadPrefsService(QTSS_ServiceFunctionArgsPtr /*inArgs*/)
@@ -43,6 +43,10 @@
 #include "UDPSocketPool.h"
 #include "RTSPProtocol.h"
 #include "RTPPacketResender.h"
+#include "OSFileBlockCache.h"
+#include "QTRTPFile.h"
+#include "SDPCache.h"
+
 #ifndef __MacOSX__
 #include "revision.h"
 #endif
@@ -140,7 +144,29 @@ QTSSAttrInfoDict::AttrInfo  QTSServerInterface::sAttributes[] =
     /* 38  */ { "qtssSvrServerBuild",           NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 39  */ { "qtssSvrServerPlatform",        NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 40  */ { "qtssSvrRTSPServerComment",     NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
-    /* 41  */ { "qtssSvrNumThinned",            NULL,   qtssAttrDataTypeSInt32,     qtssAttrModeRead | qtssAttrModeWrite  }
+    /* 41  */ { "qtssSvrNumThinned",            NULL,   qtssAttrDataTypeSInt32,     qtssAttrModeRead | qtssAttrModeWrite  },
+    /* 42  */ { "qtssSvrEventThreadEventsPerSec",NULL,  qtssAttrDataTypeUInt32,     qtssAttrModeRead },
+    /* 43  */ { "qtssSvrUDPSendBatchAvgSize",   NULL,   qtssAttrDataTypeFloat32,    qtssAttrModeRead },
+    /* 44  */ { "qtssSvrUDPSendSyscallsSaved",  NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 45  */ { "qtssSvrFileBlockCacheHitRatio",NULL,   qtssAttrDataTypeFloat32,    qtssAttrModeRead },
+    /* 46  */ { "qtssSvrFileBlockCacheBytes",   NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 47  */ { "qtssSvrFileBlockCacheEvictions",NULL,  qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 48  */ { "qtssSvrMovieCacheHits",        NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 49  */ { "qtssSvrMovieCacheMisses",      NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 50  */ { "qtssSvrMovieCacheEvictions",   NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 51  */ { "qtssSvrMovieCacheBytes",       NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 52  */ { "qtssSvrMovieCacheEntries",     NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead },
+    /* 53  */ { "qtssSvrSDPCacheHits",          NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 54  */ { "qtssSvrSDPCacheMisses",        NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 55  */ { "qtssSvrSDPCacheHitRatio",      NULL,   qtssAttrDataTypeFloat32,    qtssAttrModeRead },
+    /* 56  */ { "qtssSvrSDPCacheBytes",         NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 57  */ { "qtssSvrReliableUDPBufferBytes", NULL,  qtssAttrDataTypeUInt64,     qtssAttrModeRead },
+    /* 58  */ { "qtssSvrReliableUDPBufferCacheHitRatio", NULL, qtssAttrDataTypeFloat32, qtssAttrModeRead },
+    /* 59  */ { "qtssSvrReliableUDPBufferContention", NULL, qtssAttrDataTypeUInt64,  qtssAttrModeRead },
+    /* 60  */ { "qtssSvrRTPSendLatenessHistogram",  NULL, qtssAttrDataTypeCharArray, qtssAttrModeRead },
+    /* 61  */ { "qtssSvrRTPJitterHistogram",        NULL, qtssAttrDataTypeCharArray, qtssAttrModeRead },
+    /* 62  */ { "qtssSvrRTPRoundTripTimeHistogram", NULL, qtssAttrDataTypeCharArray, qtssAttrModeRead },
+    /* 63  */ { "qtssSvrRTPPacketLossHistogram",    NULL, qtssAttrDataTypeCharArray, qtssAttrModeRead }
 };
 
 void    QTSServerInterface::Initialize()
@@ -236,7 +262,25 @@ QTSServerInterface::QTSServerInterface()
     fTotalLate(0),
     fCurrentMaxLate(0),
     fTotalQuality(0),
-    fNumThinned(0)
+    fNumThinned(0),
+    fTotalUDPBatchedPackets(0),
+    fTotalUDPBatchedSends(0),
+    fUDPSendBatchAvgSize(0),
+    fUDPSendSyscallsSaved(0),
+    fFileBlockCacheHitRatio(0),
+    fFileBlockCacheBytes(0),
+    fFileBlockCacheEvictions(0),
+    fMovieCacheHits(0),
+    fMovieCacheMisses(0),
+    fMovieCacheEvictions(0),
+    fMovieCacheBytes(0),
+    fSDPCacheHits(0),
+    fSDPCacheMisses(0),
+    fSDPCacheHitRatio(0),
+    fSDPCacheBytes(0),
+    fUDPBufferBytes(0),
+    fUDPBufferCacheHitRatio(0),
+    fUDPBufferContention(0)
 {
     for (UInt32 y = 0; y < QTSSModule::kNumRoles; y++)
     {
@@ -274,6 +318,22 @@ QTSServerInterface::QTSServerInterface()
     this->SetVal(qtssSvrServerPlatform,     sServerPlatformStr.Ptr, sServerPlatformStr.Len);
 
     this->SetVal(qtssSvrNumThinned,         &fNumThinned,               sizeof(fNumThinned));
+    this->SetVal(qtssSvrUDPSendBatchAvgSize,    &fUDPSendBatchAvgSize,  sizeof(fUDPSendBatchAvgSize));
+    this->SetVal(qtssSvrUDPSendSyscallsSaved,   &fUDPSendSyscallsSaved, sizeof(fUDPSendSyscallsSaved));
+    this->SetVal(qtssSvrFileBlockCacheHitRatio, &fFileBlockCacheHitRatio,   sizeof(fFileBlockCacheHitRatio));
+    this->SetVal(qtssSvrFileBlockCacheBytes,    &fFileBlockCacheBytes,      sizeof(fFileBlockCacheBytes));
+    this->SetVal(qtssSvrFileBlockCacheEvictions,&fFileBlockCacheEvictions,  sizeof(fFileBlockCacheEvictions));
+    this->SetVal(qtssSvrMovieCacheHits,         &fMovieCacheHits,           sizeof(fMovieCacheHits));
+    this->SetVal(qtssSvrMovieCacheMisses,       &fMovieCacheMisses,         sizeof(fMovieCacheMisses));
+    this->SetVal(qtssSvrMovieCacheEvictions,    &fMovieCacheEvictions,      sizeof(fMovieCacheEvictions));
+    this->SetVal(qtssSvrMovieCacheBytes,        &fMovieCacheBytes,          sizeof(fMovieCacheBytes));
+    this->SetVal(qtssSvrSDPCacheHits,           &fSDPCacheHits,             sizeof(fSDPCacheHits));
+    this->SetVal(qtssSvrSDPCacheMisses,         &fSDPCacheMisses,           sizeof(fSDPCacheMisses));
+    this->SetVal(qtssSvrSDPCacheHitRatio,       &fSDPCacheHitRatio,         sizeof(fSDPCacheHitRatio));
+    this->SetVal(qtssSvrSDPCacheBytes,          &fSDPCacheBytes,            sizeof(fSDPCacheBytes));
+    this->SetVal(qtssSvrReliableUDPBufferBytes, &fUDPBufferBytes,           sizeof(fUDPBufferBytes));
+    this->SetVal(qtssSvrReliableUDPBufferCacheHitRatio, &fUDPBufferCacheHitRatio, sizeof(fUDPBufferCacheHitRatio));
+    this->SetVal(qtssSvrReliableUDPBufferContention, &fUDPBufferContention, sizeof(fUDPBufferContention));
     
 
     sServer = this;
@@ -346,8 +406,10 @@ void QTSServerInterface::SetValueComplete(UInt32 inAttrIndex, QTSSDictionaryMap*
 
 
 RTPStatsUpdaterTask::RTPStatsUpdaterTask()
-:   Task(), fLastBandwidthTime(0), fLastBandwidthAvg(0), fLastBytesSent(0), fLastTotalMP3Bytes(0)
+:   Task(), fLastBandwidthTime(0), fLastBandwidthAvg(0), fLastBytesSent(0), fLastTotalMP3Bytes(0),
+    fLastUDPBatchedPackets(0), fLastUDPBatchedSends(0)
 {
+    ::memset(fLastEventsDispatched, 0, sizeof(fLastEventsDispatched));
     this->SetTaskName("RTPStatsUpdaterTask");
     this->Signal(Task::kStartEvent);
 }
@@ -457,8 +519,87 @@ SInt64 RTPStatsUpdaterTask::Run()
 		
 		if (numProcessors > 1)
 			theServer->fCPUPercent /= numProcessors;
+
+        //events per second for each event thread
+        for (UInt32 x = 0; x < Socket::GetNumEventThreads(); x++)
+        {
+            UInt32 eventsPerSecond = Socket::GetEventThreadByIndex(x)->GetNumEventsDispatched() - fLastEventsDispatched[x];
+            eventsPerSecond /= theTime;
+            (void)theServer->SetValue(qtssSvrEventThreadEventsPerSec, x, &eventsPerSecond, sizeof(eventsPerSecond), QTSSDictionary::kDontObeyReadOnly);
+        }
     }
     
+    for (UInt32 y = 0; y < Socket::GetNumEventThreads(); y++)
+        fLastEventsDispatched[y] = Socket::GetEventThreadByIndex(y)->GetNumEventsDispatched();
+    
+    //UDP send batching. The socket counters are 32 bits and wrap, so accumulate
+    //the differences into 64 bit totals
+    UInt32 batchedPackets = UDPSocket::GetNumBatchedPackets();
+    UInt32 batchedSends = UDPSocket::GetNumBatchedSends();
+    theServer->fTotalUDPBatchedPackets += batchedPackets - fLastUDPBatchedPackets;
+    theServer->fTotalUDPBatchedSends += batchedSends - fLastUDPBatchedSends;
+    fLastUDPBatchedPackets = batchedPackets;
+    fLastUDPBatchedSends = batchedSends;
+    if (theServer->fTotalUDPBatchedSends > 0)
+    {
+        theServer->fUDPSendBatchAvgSize = (Float32)theServer->fTotalUDPBatchedPackets / (Float32)theServer->fTotalUDPBatchedSends;
+        theServer->fUDPSendSyscallsSaved = theServer->fTotalUDPBatchedPackets - theServer->fTotalUDPBatchedSends;
+    }
+    
+    //Shared file block cache
+    UInt64 blockCacheLookups = OSFileBlockCache::GetNumHits() + OSFileBlockCache::GetNumMisses();
+    if (blockCacheLookups > 0)
+        theServer->fFileBlockCacheHitRatio = (Float32)OSFileBlockCache::GetNumHits() / (Float32)blockCacheLookups;
+    theServer->fFileBlockCacheBytes = OSFileBlockCache::GetBytesResident();
+    theServer->fFileBlockCacheEvictions = OSFileBlockCache::GetNumEvictions();
+    
+    //Parsed movie cache, and what is in it
+    theServer->fMovieCacheHits = QTRTPFile::GetFileCacheHits();
+    theServer->fMovieCacheMisses = QTRTPFile::GetFileCacheMisses();
+    theServer->fMovieCacheEvictions = QTRTPFile::GetFileCacheEvictions();
+    theServer->fMovieCacheBytes = QTRTPFile::GetFileCacheBytes();
+    
+    QTRTPFile::FileCacheEntryInfo theMovies[kMaxMovieCacheEntriesReported];
+    UInt32 numMovies = QTRTPFile::GetFileCacheEntries(theMovies, kMaxMovieCacheEntriesReported);
+    for (UInt32 z = 0; z < numMovies; z++)
+    {
+        char theEntry[sizeof(theMovies[z].fFilename) + 32];
+        qtss_sprintf(theEntry, "%"_64BITARG_"u %lu %s", theMovies[z].fMemoryUsed, theMovies[z].fNumUsers, theMovies[z].fFilename);
+        (void)theServer->SetValue(qtssSvrMovieCacheEntries, z, theEntry, ::strlen(theEntry), QTSSDictionary::kDontObeyReadOnly);
+    }
+    while (theServer->GetNumValues(qtssSvrMovieCacheEntries) > numMovies)
+        (void)theServer->RemoveValue(qtssSvrMovieCacheEntries, numMovies, QTSSDictionary::kDontObeyReadOnly);
+    
+    //DESCRIBE responses cached by the file module
+    theServer->fSDPCacheHits = SDPCache::GetNumHits();
+    theServer->fSDPCacheMisses = SDPCache::GetNumMisses();
+    if (theServer->fSDPCacheHits + theServer->fSDPCacheMisses > 0)
+        theServer->fSDPCacheHitRatio = (Float32)theServer->fSDPCacheHits / (Float32)(theServer->fSDPCacheHits + theServer->fSDPCacheMisses);
+    theServer->fSDPCacheBytes = SDPCache::GetBytesUsed();
+    
+    //Reliable UDP retransmit buffers
+    OSSizeClassBufferPool* theUDPBufferPool = RTPPacketResender::GetBufferPool();
+    UInt64 theUDPBufferHits = theUDPBufferPool->GetNumCacheHits();
+    UInt64 theUDPBufferMisses = theUDPBufferPool->GetNumCacheMisses();
+    theServer->fUDPBufferBytes = theUDPBufferPool->GetTotalBufferBytes();
+    if (theUDPBufferHits + theUDPBufferMisses > 0)
+        theServer->fUDPBufferCacheHitRatio = (Float32)theUDPBufferHits / (Float32)(theUDPBufferHits + theUDPBufferMisses);
+    theServer->fUDPBufferContention = theUDPBufferPool->GetNumContendedUpdates();
+    
+    //Stream statistic distributions. Each thread records into its own
+    //histogram, so add them all up
+    for (UInt32 theHistogramIndex = 0; theHistogramIndex < QTSServerInterface::kNumRTPHistograms; theHistogramIndex++)
+    {
+        OSHistogram theHistogram;
+        theServer->fRTPHistograms[theHistogramIndex].GetHistogram(&theHistogram);
+        
+        char theSummary[OSHistogram::kSummaryBufferSize];
+        UInt32 theSummaryLen = theHistogram.GetSummary(theSummary);
+        (void)theServer->SetValue(qtssSvrRTPSendLatenessHistogram + theHistogramIndex, 0, theSummary, theSummaryLen, QTSSDictionary::kDontObeyReadOnly);
+    }
+    
+
+
     fLastTotalMP3Bytes = (SInt64)theServer->fTotalMP3Bytes;
     fLastBandwidthTime = curTime;
     // We use a running average for avg. bandwidth calculations
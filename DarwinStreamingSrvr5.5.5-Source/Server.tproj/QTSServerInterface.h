@@ -46,6 +46,7 @@
 #include "atomic.h"
 
 #include "OSMutex.h"
+#include "OSHistogram.h"
 #include "Task.h"
 #include "TCPListenerSocket.h"
 #include "ResizeableStringFormatter.h"
@@ -137,6 +138,21 @@ class QTSServerInterface : public QTSSDictionary
            { OSMutexLocker locker(&fMutex); fCurrentMaxLate = 0;  }
         void            ClearTotalQuality()
            { OSMutexLocker locker(&fMutex); fTotalQuality = 0;  }
+
+        //
+        // Distributions of stream statistics. RTPStream records every sample in its
+        // own histogram as well as here. They are in the same order as the
+        // qtssSvrRTP...Histogram, qtssCliSes...Histogram and qtssRTPStr...Histogram attributes.
+        enum
+        {
+            kSendLatenessHistogram  = 0,    // msec each RTP packet went out after its transmit time
+            kJitterHistogram        = 1,    // msec, from receiver reports
+            kRoundTripTimeHistogram = 2,    // msec, from receiver reports
+            kPacketLossHistogram    = 3,    // percent, from receiver reports
+            kNumRTPHistograms       = 4
+        };
+        void            RecordRTPStat(UInt32 inHistogram, UInt32 inValue)
+                                        { fRTPHistograms[inHistogram].Record(inValue); }
      
 
         //
@@ -381,6 +397,38 @@ class QTSServerInterface : public QTSSDictionary
         SInt64          fCurrentMaxLate;
         SInt64          fTotalQuality;
         SInt32          fNumThinned;
+        
+        //UDP send batching (see UDPSocket::QueueTo)
+        UInt64          fTotalUDPBatchedPackets;
+        UInt64          fTotalUDPBatchedSends;
+        Float32         fUDPSendBatchAvgSize;
+        UInt64          fUDPSendSyscallsSaved;
+        
+        //Shared file block cache (see OSFileBlockCache)
+        Float32         fFileBlockCacheHitRatio;
+        UInt64          fFileBlockCacheBytes;
+        UInt64          fFileBlockCacheEvictions;
+        
+        //Parsed movie cache (see QTRTPFile::SetFileCacheSize)
+        UInt64          fMovieCacheHits;
+        UInt64          fMovieCacheMisses;
+        UInt64          fMovieCacheEvictions;
+        UInt64          fMovieCacheBytes;
+        
+        //DESCRIBE responses cached by QTSSFileModule (see SDPCache)
+        UInt64          fSDPCacheHits;
+        UInt64          fSDPCacheMisses;
+        Float32         fSDPCacheHitRatio;
+        UInt64          fSDPCacheBytes;
+        
+        //Reliable UDP retransmit buffers (see RTPPacketResender)
+        UInt64          fUDPBufferBytes;
+        Float32         fUDPBufferCacheHitRatio;
+        UInt64          fUDPBufferContention;
+        
+        //Stream statistics of every stream, recorded without locking (see RecordRTPStat)
+        OSShardedHistogram  fRTPHistograms[kNumRTPHistograms];
+
 
         // Param retrieval functions
         static void* CurrentUnixTimeMilli(QTSSDictionary* inServer, UInt32* outLen);
@@ -408,6 +456,11 @@ class RTPStatsUpdaterTask : public Task
     
     private:
     
+        enum
+        {
+            kMaxMovieCacheEntriesReported = 64  // in qtssSvrMovieCacheEntries
+        };
+        
         virtual SInt64 Run();
         RTPSessionInterface* GetNewestSession(OSRefTable* inRTPSessionMap);
                 Float32 GetCPUTimeInSeconds();
@@ -416,9 +469,14 @@ class RTPStatsUpdaterTask : public Task
         SInt64 fLastBandwidthAvg;
         SInt64 fLastBytesSent;
         SInt64 fLastTotalMP3Bytes;
+        UInt32 fLastEventsDispatched[Socket::kMaxNumEventThreads];
+        UInt32 fLastUDPBatchedPackets;
+        UInt32 fLastUDPBatchedSends;
+
 };
 
 
 
+
 #endif // __QTSSERVERINTERFACE_H__
 
@@ -37,6 +37,7 @@
 #include "QTSSDataConverter.h"
 #include "defaultPaths.h"
 #include "QTSSRollingLog.h"
+#include "RTPCongestionController.h"
  
 #ifndef __Win32__
 #include <sys/types.h>
@@ -155,7 +156,13 @@ QTSServerPrefs::PrefInfo QTSServerPrefs::sPrefInfo[] =
     { kDontAllowMultipleValues, "false",    NULL                    },   //disable_thinning
     { kAllowMultipleValues,     "Nokia",    sRTP_Header_Players     },  //player_requires_rtp_header_info
     { kAllowMultipleValues,     "Nokia",    sAdjust_Bandwidth_Players     },  //player_requires_bandwidth_adjustment
-    { kAllowMultipleValues,     "Nokia",    sNo_Pause_Time_Adjustment_Players     }  //player_requires_no_pause_time_adjustment
+    { kAllowMultipleValues,     "Nokia",    sNo_Pause_Time_Adjustment_Players     },  //player_requires_no_pause_time_adjustment
+    { kDontAllowMultipleValues, "1",        NULL                    },  //run_num_event_threads
+    { kDontAllowMultipleValues, "false",    NULL                    },  //run_task_thread_work_stealing
+    { kDontAllowMultipleValues, "false",    NULL                    },  //run_task_timing_wheel
+    { kDontAllowMultipleValues, "0",        NULL                    },  //file_block_cache_size_mb
+    { kDontAllowMultipleValues, "0",        NULL                    },  //async_file_read_threads
+    { kDontAllowMultipleValues, "reno",     NULL                    },  //reliable_udp_congestion_control
    
 
 };
@@ -236,7 +243,13 @@ QTSSAttrInfoDict::AttrInfo  QTSServerPrefs::sAttributes[] =
     /* 69 */ { "disable_thinning",                      NULL,                   qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
 	/* 70 */ { "player_requires_rtp_header_info",		NULL,					qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
 	/* 71 */ { "player_requires_bandwidth_adjustment",	NULL,					qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
-	/* 72 */ { "player_requires_no_pause_time_adjustment",	NULL,				qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite }
+	/* 72 */ { "player_requires_no_pause_time_adjustment",	NULL,				qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
+    /* 73 */ { "run_num_event_threads",                  NULL,                   qtssAttrDataTypeUInt32,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 74 */ { "run_task_thread_work_stealing",          NULL,                   qtssAttrDataTypeBool16,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 75 */ { "run_task_timing_wheel",                  NULL,                   qtssAttrDataTypeBool16,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 76 */ { "file_block_cache_size_mb",               NULL,                   qtssAttrDataTypeUInt32,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 77 */ { "async_file_read_threads",                NULL,                   qtssAttrDataTypeUInt32,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 78 */ { "reliable_udp_congestion_control",        NULL,                   qtssAttrDataTypeCharArray, qtssAttrModeRead | qtssAttrModeWrite }
 
 };
 
@@ -304,7 +317,13 @@ QTSServerPrefs::QTSServerPrefs(XMLPrefsParser* inPrefsSource, Bool16 inWriteMiss
     fEnablePacketHeaderPrintfs(false),   
     fPacketHeaderPrintfOptions(kRTPALL | kRTCPSR | kRTCPRR | kRTCPAPP | kRTCPACK),
     fCloseLogsOnWrite(false),
-    fDisableThinning(false)
+    fDisableThinning(false),
+    fNumEventThreads(1),
+    fTaskThreadWorkStealing(false),
+    fTaskTimingWheel(false),
+    fFileBlockCacheSizeInMB(0),
+    fNumAsyncFileReadThreads(0),
+    fCongestionControl(RTPCongestionController::kRenoCongestionControl)
 {
 	/* ö̬ */
     SetupAttributes();
@@ -392,6 +411,11 @@ void QTSServerPrefs::SetupAttributes()
     this->SetVal(qtssPrefsCloseLogsOnWrite,             &fCloseLogsOnWrite,             sizeof(fCloseLogsOnWrite));
 	this->SetVal(qtssPrefsOverbufferRate,				&fOverbufferRate,				sizeof(fOverbufferRate));
     this->SetVal(qtssPrefsDisableThinning,              &fDisableThinning,              sizeof(fDisableThinning));
+    this->SetVal(qtssPrefsRunNumEventThreads,         &fNumEventThreads,              sizeof(fNumEventThreads));
+    this->SetVal(qtssPrefsRunTaskThreadWorkStealing,  &fTaskThreadWorkStealing,       sizeof(fTaskThreadWorkStealing));
+    this->SetVal(qtssPrefsRunTaskTimingWheel,         &fTaskTimingWheel,              sizeof(fTaskTimingWheel));
+    this->SetVal(qtssPrefsFileBlockCacheSizeInMB,     &fFileBlockCacheSizeInMB,       sizeof(fFileBlockCacheSizeInMB));
+    this->SetVal(qtssPrefsNumAsyncFileReadThreads,    &fNumAsyncFileReadThreads,      sizeof(fNumAsyncFileReadThreads));
 
 }
 
@@ -513,6 +537,7 @@ void QTSServerPrefs::RereadServerPreferences(Bool16 inWriteMissingPrefs)
     //
     // Do any special pref post-processing
     this->UpdateAuthScheme();
+    this->UpdateCongestionControl();
     this->UpdatePrintfOptions();
     QTSSModuleUtils::SetEnableRTSPErrorMsg(fEnableRTSPErrMsg);
     
@@ -539,6 +564,19 @@ void    QTSServerPrefs::UpdateAuthScheme()
         fAuthScheme = qtssAuthDigest;
 }
 
+void    QTSServerPrefs::UpdateCongestionControl()
+{
+    static StrPtrLen sRenoCongestionControl("reno");
+    static StrPtrLen sDelayBasedCongestionControl("bbr");
+
+    StrPtrLen* theCongestionControl = this->GetValue(qtssPrefsReliableUDPCongestionControl);
+
+    if (theCongestionControl->Equal(sDelayBasedCongestionControl))
+        fCongestionControl = RTPCongestionController::kDelayBasedCongestionControl;
+    else if (theCongestionControl->Equal(sRenoCongestionControl))
+        fCongestionControl = RTPCongestionController::kRenoCongestionControl;
+}
+
 char*   QTSServerPrefs::GetMovieFolder(char* inBuffer, UInt32* ioLen)
 {
     OSMutexLocker locker(&fPrefsMutex);
@@ -119,6 +119,7 @@ class QTSServerPrefs : public QTSSPrefs
         UInt32  GetSendIntervalInMsec()         { return fSendIntervalInMsec; }
         UInt32  GetMaxSendAheadTimeInSecs()     { return fMaxSendAheadTimeInSecs; }
         Bool16  IsSlowStartEnabled()            { return fIsSlowStartEnabled; }
+        UInt32  GetCongestionControl()          { return fCongestionControl; }    // an RTPCongestionController type
         Bool16  GetReliableUDPPrintfsEnabled()  { return fReliableUDPPrintfs; }
         Bool16  GetRTSPDebugPrintfs()           { return fEnableRTSPDebugPrintfs; }
         Bool16  GetRTSPServerInfoEnabled()      { return fEnableRTSPServerInfo; }
@@ -192,6 +193,11 @@ class QTSServerPrefs : public QTSSPrefs
         UInt32  GetNumThreads()             { return fNumThreads; }
         
         Bool16  DisableThinning()           { return fDisableThinning; }
+        UInt32  GetNumEventThreads()        { return fNumEventThreads; }
+        Bool16  GetTaskThreadWorkStealing() { return fTaskThreadWorkStealing; }
+        Bool16  GetTaskTimingWheel()        { return fTaskTimingWheel; }
+        UInt32  GetFileBlockCacheSizeInMB() { return fFileBlockCacheSizeInMB; }
+        UInt32  GetNumAsyncFileReadThreads() { return fNumAsyncFileReadThreads; }
     private:
 
         UInt32      fRTSPTimeoutInSecs;
@@ -264,6 +270,12 @@ class QTSServerPrefs : public QTSSPrefs
         Bool16  fCloseLogsOnWrite;
         
         Bool16 fDisableThinning;
+        UInt32  fNumEventThreads;
+        Bool16  fTaskThreadWorkStealing;
+        Bool16  fTaskTimingWheel;
+        UInt32  fFileBlockCacheSizeInMB;
+        UInt32  fNumAsyncFileReadThreads;
+        UInt32  fCongestionControl;
         enum //fPacketHeaderPrintfOptions
         {
             kRTPALL = 1 << 0,
@@ -288,6 +300,7 @@ class QTSServerPrefs : public QTSSPrefs
             
         void SetupAttributes();
         void UpdateAuthScheme();
+        void UpdateCongestionControl();
         void UpdatePrintfOptions();
         //
         // Returns the string preference with the specified ID. If there
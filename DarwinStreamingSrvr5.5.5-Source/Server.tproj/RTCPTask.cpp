@@ -38,68 +38,80 @@
 #include "UDPSocketPool.h"
 #include "RTPStream.h"
 
+#if _RTCPTASK_TESTING_
+#include <stdlib.h>
+#include "OS.h"
+#include "SafeStdLib.h"
+#endif
+
 SInt64 RTCPTask::Run()
 {
     const UInt32 kMaxRTCPPacketSize = 2048;
-    char thePacketBuffer[kMaxRTCPPacketSize];
-    StrPtrLen thePacket(thePacketBuffer, 0);
-    QTSServerInterface* theServer = QTSServerInterface::GetServer();
+    const UInt32 kNumPacketsPerRecv = 16;
+    char thePacketBuffers[kNumPacketsPerRecv][kMaxRTCPPacketSize];
+    void* theBuffers[kNumPacketsPerRecv];
+    for (UInt32 theIndex = 0; theIndex < kNumPacketsPerRecv; theIndex++)
+        theBuffers[theIndex] = thePacketBuffers[theIndex];
+    UInt32 theRemoteAddrs[kNumPacketsPerRecv];
+    UInt16 theRemotePorts[kNumPacketsPerRecv];
+    UInt32 theRecvLens[kNumPacketsPerRecv];
     
-    //This task goes through all the UDPSockets in the RTPSocketPool, checking to see
-    //if they have data. If they do, it demuxes the packets and sends the packet onto
-    //the proper RTP session.
+    //This task goes through the RTCP sockets on the ready queue, reading all the
+    //packets they have. It demuxes the packets and sends each one onto the
+    //proper RTP session.
     EventFlags events = this->GetEvents(); // get and clear events
     
     if ( (events & Task::kReadEvent) || (events & Task::kIdleEvent) )
+    {
+        while (true)
         {
-                //Must be done atomically wrt the socket pool.
+            RTCPSocket* theSocket = NULL;
+            UDPDemuxer* theDemuxer = NULL;
+            {
+                OSMutexLocker locker(&fReadyMutex);
+                OSQueueElem* theElem = fReadyQueue.DeQueue();
+                if (theElem == NULL)
+                    break;
+                    
+                theSocket = (RTCPSocket*)theElem->GetEnclosingObject();
+                theDemuxer = theSocket->GetDemuxer();
+                Assert(theDemuxer != NULL);
+                
+                //Take the demuxer mutex before letting go of the ready queue. That
+                //keeps the socket alive until we are done with it (see RemoveSocket).
+                theDemuxer->GetMutex()->Lock();
+            }
+            
+            while (true) //get all the outstanding packets for this socket
+            {
+                UInt32 theNumPackets = 0;
+                (void)theSocket->RecvMultipleFrom(theRemoteAddrs, theRemotePorts, theBuffers,
+                                                kMaxRTCPPacketSize, theRecvLens, kNumPacketsPerRecv, &theNumPackets);
+#if _RTCPTASK_TESTING_
+                fNumPacketsRead += theNumPackets;
+#endif
                 
-                OSMutexLocker locker(theServer->GetSocketPool()->GetMutex());
-                for (OSQueueIter iter(theServer->GetSocketPool()->GetSocketQueue());
-                                !iter.IsDone(); iter.Next())
+                for (UInt32 y = 0; y < theNumPackets; y++)
                 {
-                        UInt32 theRemoteAddr = 0;
-                        UInt16 theRemotePort = 0;
-        
-                        UDPSocketPair* thePair = (UDPSocketPair*)iter.GetCurrent()->GetEnclosingObject();
-                        Assert(thePair != NULL);
+                    if (theRecvLens[y] == 0)
+                        continue;
                         
-                        for (UInt32 x = 0; x < 2; x++)
-                        {
-                                UDPSocket* theSocket = NULL;
-                                if (x == 0)
-                                        theSocket = thePair->GetSocketA();
-                                else
-                                        theSocket = thePair->GetSocketB();
-                                        
-                                UDPDemuxer* theDemuxer = theSocket->GetDemuxer();
-                        if (theDemuxer == NULL) 
-                            continue;
-                        else
-                        {
-                                        theDemuxer->GetMutex()->Lock();
-                            while (true) //get all the outstanding packets for this socket
-                                {
-                                        thePacket.Len = 0;
-                                        theSocket->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket.Ptr,  
-                                                                        kMaxRTCPPacketSize, &thePacket.Len);
-                                        if (thePacket.Len == 0)
-                                        {
-                                                theSocket->RequestEvent(EV_RE);   
-                                                break;//no more packets on this socket!
-                                        }
-                                        
-                                        //if this socket has a demuxer, find the target RTPStream
-                                        if (theDemuxer != NULL)
-                                        {
-                                                RTPStream* theStream = (RTPStream*)theDemuxer->GetTask(theRemoteAddr, theRemotePort);
-                                                if (theStream != NULL)
-                                                        theStream->ProcessIncomingRTCPPacket(&thePacket);
-                                        }
-                                }
-                                        theDemuxer->GetMutex()->Unlock();
-                        }
+                    //find the target RTPStream
+                    RTPStream* theStream = (RTPStream*)theDemuxer->GetTask(theRemoteAddrs[y], theRemotePorts[y]);
+                    if (theStream != NULL)
+                    {
+                        StrPtrLen thePacket((char*)theBuffers[y], theRecvLens[y]);
+                        theStream->ProcessIncomingRTCPPacket(&thePacket);
+                    }
+                }
+                
+                if (theNumPackets < kNumPacketsPerRecv)
+                {
+                    theSocket->RequestEvent(EV_RE);   
+                    break;//no more packets on this socket!
                 }
+            }
+            theDemuxer->GetMutex()->Unlock();
         }
     }
      
@@ -112,3 +124,129 @@ SInt64 RTCPTask::Run()
    return result;
    */
 }
+
+void RTCPTask::SocketReady(RTCPSocket* inSocket)
+{
+    {
+        OSMutexLocker locker(&fReadyMutex);
+        if (inSocket->fRemoved)
+            return;
+        fReadyQueue.EnQueue(&inSocket->fReadyElem);
+    }
+    this->Signal(Task::kReadEvent);
+}
+
+void RTCPTask::RemoveSocket(RTCPSocket* inSocket)
+{
+    OSMutexLocker locker(&fReadyMutex);
+    inSocket->fRemoved = true;
+    fReadyQueue.Remove(&inSocket->fReadyElem);
+    
+    //If Run is reading this socket right now, wait for it to finish
+    OSMutexLocker theDemuxerLocker(inSocket->GetDemuxer()->GetMutex());
+}
+
+RTCPSocket::~RTCPSocket()
+{
+    //Take this socket away from the task first, and only then close it. If Run is
+    //reading it, Run re-requests its read event, which must not happen on a closed fd.
+    fRTCPTask->RemoveSocket(this);
+    this->Cleanup();
+}
+
+void RTCPSocket::ProcessEvent(int /*eventBits*/)
+{
+    fRTCPTask->SocketReady(this);
+}
+
+#if _RTCPTASK_TESTING_
+
+Bool16 RTCPTask::Test()
+{
+    enum
+    {
+        kNumSockets = 10000,
+        kNumRounds = 200,
+        kPacketsPerRound = 50,
+        kMaxWaitInMilSecs = 5000
+    };
+    
+    // Read events go from the event thread to a task thread, so both must be running
+    select_startevents();
+    Socket::Initialize();
+    Socket::StartThread();
+    TaskThreadPool::AddThreads(1);
+    
+    RTCPTask* theTask = NEW RTCPTask();
+    theTask->fNumPacketsRead = 0;
+    
+    RTCPSocket** theSockets = NEW RTCPSocket*[kNumSockets];
+    for (UInt32 x = 0; x < kNumSockets; x++)
+    {
+        theSockets[x] = NEW RTCPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType);
+        if ((theSockets[x]->Open() != OS_NoErr) || (theSockets[x]->Bind(INADDR_LOOPBACK, 0) != OS_NoErr))
+            return false;
+        theSockets[x]->RequestEvent(EV_RE);
+    }
+    
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    if ((theSender.Open() != OS_NoErr) || (theSender.Bind(INADDR_LOOPBACK, 0) != OS_NoErr))
+        return false;
+        
+    char thePacket[64]; // about the size of a receiver report
+    ::memset(thePacket, 0, sizeof(thePacket));
+    
+    Bool16 theResult = true;
+    UInt32 theNumSent = 0;
+    SInt64 theStartTime = OS::Microseconds();
+    for (UInt32 theRound = 0; (theRound < kNumRounds) && theResult; theRound++)
+    {
+        for (UInt32 y = 0; y < kPacketsPerRound; y++)
+        {
+            RTCPSocket* theSocket = theSockets[::rand() % kNumSockets];
+            (void)theSender.SendTo(INADDR_LOOPBACK, theSocket->GetLocalPort(), thePacket, sizeof(thePacket));
+            theNumSent++;
+        }
+        
+        SInt64 theGiveUpTime = OS::Milliseconds() + kMaxWaitInMilSecs;
+        while (theTask->fNumPacketsRead < theNumSent)
+        {
+            if (OS::Milliseconds() > theGiveUpTime)
+            {
+                theResult = false;
+                break;
+            }
+            OSThread::ThreadYield();
+        }
+    }
+    SInt64 theReadyTime = OS::Microseconds() - theStartTime;
+    
+    // What every read event used to cost: a read of every socket in the pool,
+    // and asking for its read event again
+    theStartTime = OS::Microseconds();
+    for (UInt32 z = 0; z < kNumSockets; z++)
+    {
+        UInt32 theRemoteAddr = 0;
+        UInt16 theRemotePort = 0;
+        UInt32 theLen = 0;
+        
+        OSMutexLocker locker(theSockets[z]->GetDemuxer()->GetMutex());
+        (void)theSockets[z]->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket, sizeof(thePacket), &theLen);
+        theSockets[z]->RequestEvent(EV_RE);
+    }
+    SInt64 theSweepTime = OS::Microseconds() - theStartTime;
+    
+    qtss_printf("RTCPTask: %d sockets, %lu of %lu packets read, %.1f usec per packet from send to read\n",
+                kNumSockets, theTask->fNumPacketsRead, theNumSent, (Float32)theReadyTime / (Float32)theNumSent);
+    qtss_printf("RTCPTask: reading every socket once (the old cost of each read event) takes %"_64BITARG_"d usec\n", theSweepTime);
+    
+    // The sockets go away while their read events are still requested
+    for (UInt32 w = 0; w < kNumSockets; w++)
+        delete theSockets[w];
+    delete [] theSockets;
+    
+    TaskThreadPool::RemoveThreads();
+    return theResult;
+}
+
+#endif
@@ -35,17 +35,67 @@
 #define __RTCP_TASK_H__
 
 #include "Task.h"
+#include "UDPSocket.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+
+#define _RTCPTASK_TESTING_ 0
+
+class RTCPSocket;
 
 class RTCPTask : public Task
 {
     public:
-        //This task handles all incoming RTCP data. It just polls, so make sure
-        //to start the polling process by signalling a start event.
+        //This task handles all incoming RTCP data. It only reads the RTCP sockets
+        //that have signalled a read event (they put themselves on this task's ready
+        //queue), so the cost per packet doesn't depend on the size of the socket pool.
         RTCPTask() : Task() {this->SetTaskName("RTCPTask"); this->Signal(Task::kStartEvent); }
         virtual ~RTCPTask() {}
+        
+#if _RTCPTASK_TESTING_
+        //
+        // Spreads RTCP packets over 10,000 sockets and times how long this task
+        // takes to read them, next to how long reading every socket once takes
+        // (which is what it used to do on every read event). Starts its own event
+        // and task threads, so call it from a test program, not a server.
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
     
     private:
         virtual SInt64 Run();
+        
+        //Called by the event threads
+        void    SocketReady(RTCPSocket* inSocket);
+        //Called when an RTCPSocket goes away
+        void    RemoveSocket(RTCPSocket* inSocket);
+        
+        OSMutex     fReadyMutex;
+        OSQueue     fReadyQueue;
+#if _RTCPTASK_TESTING_
+        UInt32      fNumPacketsRead;
+#endif
+        
+        friend class RTCPSocket;
+};
+
+//The RTCP socket of each pair in the RTP socket pool.
+class RTCPSocket : public UDPSocket
+{
+    public:
+        RTCPSocket(RTCPTask* inTask, UInt32 inSocketType)
+            : UDPSocket(inTask, inSocketType), fRTCPTask(inTask), fReadyElem(this), fRemoved(false) {}
+        virtual ~RTCPSocket();
+        
+    private:
+        //Rather than just signalling the task, queue up this socket for it
+        virtual void ProcessEvent(int eventBits);
+        
+        RTCPTask*   fRTCPTask;
+        OSQueueElem fReadyElem;
+        Bool16      fRemoved;   // by RemoveSocket, so it can't go back on the ready queue
+        
+        friend class RTCPTask;
 };
 
 #endif //__RTCP_TASK_H__
@@ -33,6 +33,11 @@
 #include "MyAssert.h"
 #include "OS.h"
 
+#if _RTPBANDWIDTHTRACKER_TESTING_
+#include <string.h>
+#include "OSMemory.h"
+#endif
+
 void RTPBandwidthTracker::SetWindowSize( SInt32 clientWindowSize )
 {
     //
@@ -44,7 +49,6 @@ void RTPBandwidthTracker::SetWindowSize( SInt32 clientWindowSize )
     // since this occurs before the stream starts to send
         
     fClientWindow = clientWindowSize;
-    fLastCongestionAdjust = 0;
     
 #if RTP_PACKET_RESENDER_DEBUGGING   
     // test to see what happens w/o slow start at beginning
@@ -54,26 +58,24 @@ void RTPBandwidthTracker::SetWindowSize( SInt32 clientWindowSize )
     //  qtss_printf( "ack list initializing at full speed.\n" );
 #endif
             
-    if ( fUseSlowStart )
-    {
-        fSlowStartThreshold = clientWindowSize * 3 / 4;
+    fController->SetWindowSize(clientWindowSize);
+}
+
+void RTPBandwidthTracker::AckWindow( UInt32 bytesIncreased, SInt64 inCurTimeMSecs )
+{
+    if (bytesIncreased == 0)
+        return;
         
-        //
-        // This is a change to the standard TCP slow start algorithm. What
-        // we found was that on high bitrate high latency networks (a DSL connection, perhaps),
-        // it took just too long for the ACKs to come in and for the window size to
-        // grow enough. So we cheat a bit.
-        fCongestionWindow = clientWindowSize / 2;
-        //fCongestionWindow = kMaximumSegmentSize;
-    }
-    else
-    {   
-        fSlowStartThreshold = clientWindowSize;
-        fCongestionWindow = clientWindowSize;
-    }
+    Assert(fClientWindow > 0 && this->CongestionWindow() > 0);
     
-    if ( fSlowStartThreshold < kMaximumSegmentSize )
-        fSlowStartThreshold = kMaximumSegmentSize;
+    if(fBytesInList < bytesIncreased)
+        bytesIncreased = fBytesInList;
+        
+    fBytesInList -= bytesIncreased;
+
+    Assert(fBytesInList < ((UInt32)fClientWindow + 2000)); //mainly just to catch fBytesInList wrapping below 0
+    
+    fController->PacketAcked(bytesIncreased, fBytesInList, inCurTimeMSecs);
 }
 
 void RTPBandwidthTracker::EmptyWindow( UInt32 bytesIncreased, Bool16 updateBytesInList )
@@ -81,7 +83,7 @@ void RTPBandwidthTracker::EmptyWindow( UInt32 bytesIncreased, Bool16 updateBytes
     if (bytesIncreased == 0)
         return;
         
-    Assert(fClientWindow > 0 && fCongestionWindow > 0);
+    Assert(fClientWindow > 0 && this->CongestionWindow() > 0);
     
     if(fBytesInList < bytesIncreased)
         bytesIncreased = fBytesInList;
@@ -92,81 +94,19 @@ void RTPBandwidthTracker::EmptyWindow( UInt32 bytesIncreased, Bool16 updateBytes
     // this assert hits
     Assert(fBytesInList < ((UInt32)fClientWindow + 2000)); //mainly just to catch fBytesInList wrapping below 0
     
-    // update the congestion window by the number of bytes just acknowledged.
-            
-    if ( fCongestionWindow >= fSlowStartThreshold )
-    {
-        // when we hit the slow start threshold, only increase the 
-        // window for each window full of acks.
-        fCongestionWindow += bytesIncreased * bytesIncreased / fCongestionWindow;
-    }
-    else
-        //
-        // This is a change to the standard TCP slow start algorithm. What
-        // we found was that on high bitrate high latency networks (a DSL connection, perhaps),
-        // it took just too long for the ACKs to come in and for the window size to
-        // grow enough. So we cheat a bit.
-        fCongestionWindow += bytesIncreased;
-
-    
-    if ( fCongestionWindow > fClientWindow )
-        fCongestionWindow = fClientWindow;
-    
-//  qtss_printf("Window = %d, %d left\n", fCongestionWindow, fCongestionWindow-fBytesInList);
+    fController->WindowEmptied(bytesIncreased, fBytesInList);
 }
 
-void RTPBandwidthTracker::AdjustWindowForRetransmit()
+void RTPBandwidthTracker::AdjustWindowForRetransmit(SInt64 inCurTimeMSecs)
 {
     // this assert hits
     Assert(fBytesInList < ((UInt32)fClientWindow + 2000)); //mainly just to catch fBytesInList wrapping below 0
 
-    // slow start says that we should reduce the new ss threshold to 1/2
-    // of where started getting errors ( the current congestion window size )
-            
-    // so, we get a burst of re-tx becuase our RTO was mis-estimated
-    // it doesn't seem like we should lower the threshold for each one.
-    // it seems like we should just lower it when we first enter
-    // the re-transmit "state" 
-//  if ( !fIsRetransmitting )
-//      fSlowStartThreshold = fCongestionWindow/2;
-    
-    // make sure that it is at least 1 packet
-    if ( fSlowStartThreshold < kMaximumSegmentSize )
-        fSlowStartThreshold = kMaximumSegmentSize;
-
-    // start the full window segemnt counter over again.
-    fSlowStartByteCount = 0;
-    
-    // tcp resets to one (max segment size) mss, but i'm experimenting a bit
-    // with not being so brutal.
-    
-    //curAckList->fCongestionWindow = kMaximumSegmentSize;
-    
-//  fCongestionWindow = kMaximumSegmentSize;
-//  fCongestionWindow = fCongestionWindow / 2;  // half the congestion window size
-    SInt64 theTime = OS::Milliseconds();
-    if (theTime - fLastCongestionAdjust > 250)
-    {
-        fSlowStartThreshold = fCongestionWindow * 3 / 4;
-        fCongestionWindow = fCongestionWindow / 2;
-        fLastCongestionAdjust = theTime;
-    }
-
-/*
-    if ( fSlowStartThreshold < fCongestionWindow )
-        fCongestionWindow = fSlowStartThreshold/2;
-    else
-        fCongestionWindow = fCongestionWindow /2;
-*/  
-        
-    if ( fCongestionWindow < kMaximumSegmentSize )
-        fCongestionWindow = kMaximumSegmentSize;
-
-    // qtss_printf("Congestion window now %d\n", fCongestionWindow);
+    fController->PacketResent(inCurTimeMSecs);
     fIsRetransmitting = true;
 }
 
-void RTPBandwidthTracker::AddToRTTEstimate( SInt32 rttSampleMSecs )
+void RTPBandwidthTracker::AddToRTTEstimate( SInt32 rttSampleMSecs, SInt64 inCurTimeMSecs )
 {
 //  qtss_printf("%d ", rttSampleMSecs);
 //  static int count = 0;
@@ -209,23 +149,26 @@ void RTPBandwidthTracker::AddToRTTEstimate( SInt32 rttSampleMSecs )
     if ( fCurRetransmitTimeout > kMaxRetransmitIntervalMSecs )
         fCurRetransmitTimeout = kMaxRetransmitIntervalMSecs;
 //  qtss_printf("CurTimeout == %d\n", fCurRetransmitTimeout);
+
+    fController->RTTSample(rttSampleMSecs, inCurTimeMSecs);
 }
 
 void RTPBandwidthTracker::UpdateStats()
 {
     fNumStatsSamples++;
     
-    if (fMaxCongestionWindowSize < fCongestionWindow)
-        fMaxCongestionWindowSize = fCongestionWindow;
-    if (fMinCongestionWindowSize > fCongestionWindow)
-        fMinCongestionWindowSize = fCongestionWindow;
+    SInt32 theCongestionWindow = this->CongestionWindow();
+    if (fMaxCongestionWindowSize < theCongestionWindow)
+        fMaxCongestionWindowSize = theCongestionWindow;
+    if (fMinCongestionWindowSize > theCongestionWindow)
+        fMinCongestionWindowSize = theCongestionWindow;
         
     if (fMaxRTO < fUnadjustedRTO)
         fMaxRTO = fUnadjustedRTO;
     if (fMinRTO > fUnadjustedRTO)
         fMinRTO = fUnadjustedRTO;
 
-    fTotalCongestionWindowSize += fCongestionWindow;
+    fTotalCongestionWindowSize += theCongestionWindow;
     fTotalRTO += fUnadjustedRTO;
 }
 
@@ -236,7 +179,7 @@ void RTPBandwidthTracker::UpdateAckTimeout(UInt32 bitsSentInInterval, SInt64 int
     // the movie's current bit rate
     UInt32 unadjustedTimeout = 0;
     if (bitsSentInInterval > 0)
-        unadjustedTimeout = (UInt32) ((intervalLengthInMsec * fCongestionWindow) / bitsSentInInterval);
+        unadjustedTimeout = (UInt32) ((intervalLengthInMsec * this->CongestionWindow()) / bitsSentInInterval);
 
     //
     // If we wait that long, that's too long because we need to actually wait for the ack to arrive.
@@ -256,3 +199,321 @@ void RTPBandwidthTracker::UpdateAckTimeout(UInt32 bitsSentInInterval, SInt64 int
     else if (fAckTimeout < kMinAckTimeout)
         fAckTimeout = kMinAckTimeout;
 }
+
+#if _RTPBANDWIDTHTRACKER_TESTING_
+
+//
+// RTPBandwidthTracker::Test streams a simulated movie over a simulated link, with the
+// tracker doing what it does for an RTPStream and its RTPPacketResender.
+//
+// Packets wait in a drop tail queue for the bottleneck, then take fDelayMSecs to get to
+// the client, and some are lost at random on the way. The client acks what it gets every
+// RecommendedClientAckTimeout, and the acks take fDelayMSecs to come back.
+//
+// The server sends ahead of the movie's clock the way overbuffering does, and gives up on
+// a packet drop_all_packets_delay after it was due. The client starts playing once it has
+// kPrebufferMSecs of movie. When the next packet it needs is missing, and the server hasn't
+// given up on it, the client rebuffers until it has kPrebufferMSecs again.
+
+struct SimScenario
+{
+    char*   fName;
+    UInt32  fLinkKbps;
+    UInt32  fDelayMSecs;        // one way
+    UInt32  fQueueKBytes;
+    UInt32  fLossPerMille;
+    UInt32  fMovieKbps;
+};
+
+struct SimPacket
+{
+    UInt32  fSize;
+    SInt64  fPlayTime;          // in movie time
+    SInt64  fAddedTime;         // these are as in RTPResenderEntry
+    SInt64  fExpireTime;
+    SInt32  fOrigRetransTimeout;
+    UInt32  fNumResends;
+    Bool16  fInList;
+    Bool16  fGivenUp;           // expired in the resender, or too late to send
+    Bool16  fReceived;
+};
+
+class SimLink
+{
+    public:
+        SimLink(SimScenario* inScenario) : fScenario(inScenario), fBusyUntil(0), fRandom(1) {}
+
+        //
+        // Queues inPacket for the client, unless it is lost or the queue is full
+        void        SendData(SInt64 inCurTimeUSecs, UInt32 inPacket, UInt32 inSize);
+        void        SendAck(SInt64 inCurTimeUSecs, UInt32 inPacket)
+                        { fAckPath.Push(inCurTimeUSecs + fScenario->fDelayMSecs * 1000, inPacket); }
+
+        //
+        // Return the next packet or ack that has arrived by inCurTimeUSecs, or -1
+        SInt32      ReceiveData(SInt64 inCurTimeUSecs)  { return fDataPath.Pop(inCurTimeUSecs); }
+        SInt32      ReceiveAck(SInt64 inCurTimeUSecs)   { return fAckPath.Pop(inCurTimeUSecs); }
+
+    private:
+
+        class Path
+        {
+            public:
+                Path() : fHead(0), fTail(0) {}
+                void    Push(SInt64 inTime, UInt32 inPacket)
+                            { fTimes[fTail & kMask] = inTime; fPackets[fTail & kMask] = inPacket; fTail++; }
+                SInt32  Pop(SInt64 inCurTime)
+                            { return ((fHead != fTail) && (fTimes[fHead & kMask] <= inCurTime)) ? (SInt32)fPackets[fHead++ & kMask] : -1; }
+            private:
+                enum { kMask = 0xFFFF };    // packets take the same time, so they arrive in order
+                SInt64  fTimes[kMask + 1];
+                UInt32  fPackets[kMask + 1];
+                UInt32  fHead;
+                UInt32  fTail;
+        };
+
+        SimScenario*    fScenario;
+        SInt64          fBusyUntil;     // when the bottleneck has sent what is queued
+        UInt32          fRandom;
+        Path            fDataPath;
+        Path            fAckPath;
+};
+
+void SimLink::SendData(SInt64 inCurTimeUSecs, UInt32 inPacket, UInt32 inSize)
+{
+    fRandom = fRandom * 1103515245 + 12345;
+    if ((fRandom >> 16) % 1000 < fScenario->fLossPerMille)
+        return;
+
+    SInt64 theStart = (fBusyUntil > inCurTimeUSecs) ? fBusyUntil : inCurTimeUSecs;
+    SInt64 theQueuedBytes = ((theStart - inCurTimeUSecs) * fScenario->fLinkKbps) / 8000;
+    if (theQueuedBytes + inSize > fScenario->fQueueKBytes * 1024)
+        return;
+
+    fBusyUntil = theStart + (inSize * 8000) / fScenario->fLinkKbps;
+    fDataPath.Push(fBusyUntil + fScenario->fDelayMSecs * 1000, inPacket);
+}
+
+static void SimulateStream(SimScenario* inScenario, UInt32 inCongestionControl)
+{
+    enum
+    {
+        kMovieMSecs         = 60000,
+        kMaxRunMSecs        = 180000,
+        kMaxSendAheadMSecs  = 25000,    // max_send_ahead_time
+        kDropAllMSecs       = 1750,     // drop_all_packets_delay
+        kPrebufferMSecs     = 3000
+    };
+
+    //
+    // The movie: packets of 1000 to 1450 bytes at fMovieKbps
+    UInt32 theNumPackets = (UInt32)(((SInt64)kMovieMSecs * inScenario->fMovieKbps) / (8 * 1225));
+    SimPacket* thePackets = NEW SimPacket[theNumPackets];
+    ::memset(thePackets, 0, theNumPackets * sizeof(SimPacket));
+    UInt64 theMovieBits = 0;
+    for (UInt32 x = 0; x < theNumPackets; x++)
+    {
+        thePackets[x].fSize = 1000 + (x * 7919) % 451;
+        thePackets[x].fPlayTime = theMovieBits / inScenario->fMovieKbps;
+        theMovieBits += 8 * thePackets[x].fSize;
+    }
+
+    UInt32* theList = NEW UInt32[theNumPackets];     // the resender's packets
+    UInt32 theListSize = 0;
+    UInt32* theUnacked = NEW UInt32[theNumPackets];  // what the client hasn't acked yet
+    UInt32 theNumUnacked = 0;
+    SInt64 theLastAckTime = 0;
+    SimLink* theLink = NEW SimLink(inScenario);
+
+    //
+    // Same window sizes as RTPSession::Play, with the default prefs
+    RTPBandwidthTracker theTracker(true, inCongestionControl);
+    if (inScenario->fMovieKbps > 1000)
+        theTracker.SetWindowSize(64 * 1024);
+    else if (inScenario->fMovieKbps > 200)
+        theTracker.SetWindowSize(48 * 1024);
+    else
+        theTracker.SetWindowSize(24 * 1024);
+
+    UInt32 theNextToSend = 0;
+    UInt32 theNextToPlay = 0;
+    SInt64 theMovieClock = 0;
+    Bool16 isPlaying = false;
+    UInt32 theNumRebuffers = 0;
+    SInt64 theStalledMSecs = 0;
+    UInt32 theNumSkipped = 0;
+    UInt32 theNumResends = 0;
+    UInt64 theBytesReceived = 0;
+    SInt64 theLastReceiveTime = 1;
+    UInt64 theBitsSent = 0;
+    SInt64 theWindowTotal = 0;
+    SInt64 theRTTTotal = 0;
+    SInt64 theCurTime = 0;
+
+    for (theCurTime = 1; (theCurTime < kMaxRunMSecs) && (theNextToPlay < theNumPackets); theCurTime++)
+    {
+        SInt64 theCurTimeUSecs = theCurTime * 1000;
+        SInt32 thePacketIndex = 0;
+
+        //
+        // Client: take what arrived, and ack it every RecommendedClientAckTimeout
+        while ((thePacketIndex = theLink->ReceiveData(theCurTimeUSecs)) >= 0)
+        {
+            if (!thePackets[thePacketIndex].fReceived)
+            {
+                theBytesReceived += thePackets[thePacketIndex].fSize;
+                theLastReceiveTime = theCurTime;
+            }
+            thePackets[thePacketIndex].fReceived = true;
+            theUnacked[theNumUnacked++] = thePacketIndex;
+        }
+        if (theCurTime - theLastAckTime >= (SInt64)theTracker.RecommendedClientAckTimeout())
+        {
+            for (UInt32 x = 0; x < theNumUnacked; x++)
+                theLink->SendAck(theCurTimeUSecs, theUnacked[x]);
+            theNumUnacked = 0;
+            theLastAckTime = theCurTime;
+        }
+
+        //
+        // Server: acks, as in RTPPacketResender::AckPacket
+        while ((thePacketIndex = theLink->ReceiveAck(theCurTimeUSecs)) >= 0)
+        {
+            SimPacket* thePacket = &thePackets[thePacketIndex];
+            if (!thePacket->fInList)
+            {
+                theTracker.EmptyWindow(RTPBandwidthTracker::kMaximumSegmentSize, false);
+                continue;
+            }
+            theTracker.AckWindow(thePacket->fSize, theCurTime);
+            if (thePacket->fNumResends == 0)
+                theTracker.AddToRTTEstimate((SInt32)(theCurTime - thePacket->fAddedTime), theCurTime);
+            thePacket->fInList = false;
+        }
+
+        //
+        // Resends and expirations, as in RTPPacketResender::ResendDueEntries
+        for (SInt32 x = theListSize - 1; x >= 0; x--)
+        {
+            SimPacket* thePacket = &thePackets[theList[x]];
+            if (thePacket->fInList && (theCurTime - thePacket->fAddedTime <= theTracker.CurRetransmitTimeout()))
+                continue;
+
+            if (thePacket->fInList && (theCurTime > thePacket->fExpireTime))
+            {
+                theTracker.EmptyWindow(thePacket->fSize);
+                thePacket->fInList = false;
+                thePacket->fGivenUp = true;
+            }
+            if (!thePacket->fInList)
+            {
+                theList[x] = theList[--theListSize];
+                continue;
+            }
+
+            theLink->SendData(theCurTimeUSecs, theList[x], thePacket->fSize);
+            thePacket->fNumResends++;
+            theNumResends++;
+            if (thePacket->fNumResends == 1)
+                theTracker.AddToRTTEstimate((thePacket->fOrigRetransTimeout * 3) / 2, theCurTime);
+            thePacket->fAddedTime = theCurTime;
+            theTracker.AdjustWindowForRetransmit(theCurTime);
+        }
+
+        //
+        // New packets, as fast as the window and the send ahead limit allow
+        SInt64 theSendAhead = (theCurTime < kMaxSendAheadMSecs) ? theCurTime : kMaxSendAheadMSecs;
+        while ((theNextToSend < theNumPackets) && (thePackets[theNextToSend].fPlayTime <= theCurTime + theSendAhead)
+                && !theTracker.IsFlowControlled())
+        {
+            SimPacket* thePacket = &thePackets[theNextToSend++];
+            SInt64 theAgeLimit = kDropAllMSecs - (theCurTime - thePacket->fPlayTime);
+            if (theAgeLimit <= 0)
+            {
+                thePacket->fGivenUp = true;
+                continue;
+            }
+
+            theLink->SendData(theCurTimeUSecs, theNextToSend - 1, thePacket->fSize);
+            thePacket->fAddedTime = theCurTime;
+            thePacket->fOrigRetransTimeout = theTracker.CurRetransmitTimeout();
+            thePacket->fExpireTime = theCurTime + theAgeLimit;
+            thePacket->fInList = true;
+            theList[theListSize++] = theNextToSend - 1;
+            theTracker.FillWindow(thePacket->fSize);
+            theBitsSent += 8 * thePacket->fSize;
+        }
+
+        //
+        // Once a second, as RTPSessionInterface::UpdateBitRateInternal does
+        if ((theCurTime % 1000) == 0)
+        {
+            theTracker.UpdateAckTimeout((UInt32)theBitsSent, 1000);
+            theBitsSent = 0;
+        }
+        theWindowTotal += theTracker.CongestionWindow();
+        theRTTTotal += theTracker.RunningAverageMSecs();
+
+        //
+        // Client playback
+        UInt32 theBuffered = theNextToPlay;
+        while ((theBuffered < theNumPackets) && (thePackets[theBuffered].fReceived || thePackets[theBuffered].fGivenUp)
+                && (thePackets[theBuffered].fPlayTime < theMovieClock + kPrebufferMSecs))
+            theBuffered++;
+        if (!isPlaying)
+        {
+            if ((theBuffered == theNumPackets) || (thePackets[theBuffered].fPlayTime >= theMovieClock + kPrebufferMSecs))
+                isPlaying = true;
+            else if (theNextToPlay > 0)
+                theStalledMSecs++;
+            continue;
+        }
+
+        theMovieClock++;
+        while ((theNextToPlay < theNumPackets) && (thePackets[theNextToPlay].fPlayTime < theMovieClock))
+        {
+            if (!thePackets[theNextToPlay].fReceived && !thePackets[theNextToPlay].fGivenUp)
+            {
+                theMovieClock--;
+                isPlaying = false;
+                theNumRebuffers++;
+                break;
+            }
+            if (!thePackets[theNextToPlay].fReceived)
+                theNumSkipped++;
+            theNextToPlay++;
+        }
+    }
+
+    qtss_printf("%-16s %-5s %6lu kbps %4lu rebuffers %6qd ms stalled %5lu skipped %6lu resends %6qd avg window %5qd ms avg srtt\n",
+                inScenario->fName, (inCongestionControl == RTPCongestionController::kDelayBasedCongestionControl) ? "bbr" : "reno",
+                (UInt32)((theBytesReceived * 8) / (UInt64)theLastReceiveTime), theNumRebuffers, theStalledMSecs,
+                theNumSkipped, theNumResends, theWindowTotal / theCurTime, theRTTTotal / theCurTime);
+
+    delete theLink;
+    delete [] theUnacked;
+    delete [] theList;
+    delete [] thePackets;
+}
+
+void RTPBandwidthTracker::Test()
+{
+    static SimScenario sScenarios[] =
+    {
+        //  name                link kbps   delay   queue K     loss/1000   movie kbps
+        {   "dsl",              1500,       20,     32,         0,          300     },
+        {   "congested",        800,        40,     16,         0,          700     },
+        {   "long fat pipe",    20000,      100,    512,        1,          1500    },
+        {   "lossy wireless",   6000,       30,     64,         20,         2500    },
+        {   "lossy long",       10000,      80,     128,        10,         1500    }
+    };
+
+    qtss_printf("RTPBandwidthTracker::Test: goodput is the unique bytes the client got, over the time it took to get them\n");
+    for (UInt32 x = 0; x < sizeof(sScenarios) / sizeof(SimScenario); x++)
+    {
+        SimulateStream(&sScenarios[x], RTPCongestionController::kRenoCongestionControl);
+        SimulateStream(&sScenarios[x], RTPCongestionController::kDelayBasedCongestionControl);
+    }
+}
+
+#endif
@@ -27,6 +27,8 @@
 
     Contains:   Uses Karns Algorithm to measure round trip times. This also
                 tracks the current window size based on input from the caller.
+                The congestion window itself comes from an RTPCongestionController,
+                chosen per session by the reliable_udp_congestion_control pref.
     
     ref:
     
@@ -41,22 +43,22 @@
 #define __RTP_BANDWIDTH_TRACKER_H__
 
 #include "OSHeaders.h"
+#include "RTPCongestionController.h"
+
+#define _RTPBANDWIDTHTRACKER_TESTING_ 0
 
 class RTPBandwidthTracker
 {
     public:
-        RTPBandwidthTracker(Bool16 inUseSlowStart)
+        RTPBandwidthTracker(Bool16 inUseSlowStart, UInt32 inCongestionControl = RTPCongestionController::kRenoCongestionControl)
          :  fRunningAverageMSecs(0),
             fRunningMeanDevationMSecs(0),
             fCurRetransmitTimeout( kMinRetransmitIntervalMSecs ),
             fUnadjustedRTO( kMinRetransmitIntervalMSecs ),
-            fCongestionWindow(kMaximumSegmentSize),
-            fSlowStartThreshold(0),
-            fSlowStartByteCount(0),
+            fController(RTPCongestionController::Create(inCongestionControl, inUseSlowStart)),
             fClientWindow(0),
             fBytesInList(0),
             fAckTimeout(kMinAckTimeout),
-            fUseSlowStart(inUseSlowStart),
             fMaxCongestionWindowSize(0),
             fMinCongestionWindowSize(1000000),
             fMaxRTO(0),
@@ -66,7 +68,7 @@ class RTPBandwidthTracker
             fNumStatsSamples(0)
         {}
         
-        ~RTPBandwidthTracker() {}
+        ~RTPBandwidthTracker() { delete fController; }
         
         //
         // Initialization - give the client's window size.
@@ -75,37 +77,43 @@ class RTPBandwidthTracker
         //
         // Each RTT sample you get, let the tracker know what it is
         // so it can keep a good running average.
-        void AddToRTTEstimate( SInt32 rttSampleMSecs );
+        void AddToRTTEstimate( SInt32 rttSampleMSecs, SInt64 inCurTimeMSecs );
         
         //
         // Before sending new data, let the tracker know
         // how much data you are sending so it can adjust the window.
         void FillWindow(UInt32 inNumBytes)
-            { fBytesInList += inNumBytes; fIsRetransmitting = false; }
+            { fBytesInList += inNumBytes; fIsRetransmitting = false; fController->PacketSent(inNumBytes, fBytesInList); }
         
         //
         // When data is acked, let the tracker know how much
         // data was acked so it can adjust the window
+        void AckWindow(UInt32 inNumBytes, SInt64 inCurTimeMSecs);
+        
+        //
+        // When data leaves the window without being acked (it expired, or the ack
+        // was for a packet we no longer have), let the tracker know how much.
         void EmptyWindow(UInt32 inNumBytes, Bool16 updateBytesInList = true);
         
         //
         // When retransmitting a packet, call this function so
         // the tracker can adjust the window sizes and back off.
-        void AdjustWindowForRetransmit();
+        void AdjustWindowForRetransmit(SInt64 inCurTimeMSecs);
         
         //
         // ACCESSORS
-        const Bool16 ReadyForAckProcessing()    { return (fClientWindow > 0 && fCongestionWindow > 0); } // see RTPBandwidthTracker::EmptyWindow for requirements
-        const Bool16 IsFlowControlled()         { return ( (SInt32)fBytesInList >= fCongestionWindow ); }
+        const Bool16 ReadyForAckProcessing()    { return (fClientWindow > 0 && fController->CongestionWindow() > 0); } // see RTPBandwidthTracker::EmptyWindow for requirements
+        const Bool16 IsFlowControlled()         { return ( (SInt32)fBytesInList >= fController->CongestionWindow() ); }
         const SInt32 ClientWindowSize()         { return fClientWindow; }
         const UInt32 BytesInList()              { return fBytesInList; }
-        const SInt32 CongestionWindow()         { return fCongestionWindow; }
-        const SInt32 SlowStartThreshold()       { return fSlowStartThreshold; }
+        const SInt32 CongestionWindow()         { return fController->CongestionWindow(); }
+        const SInt32 SlowStartThreshold()       { return fController->SlowStartThreshold(); }
         const SInt32 RunningAverageMSecs()      { return fRunningAverageMSecs / 8; }  // fRunningAverageMSecs is stored scaled up 8x
         const SInt32 RunningMeanDevationMSecs() { return fRunningMeanDevationMSecs/ 4; } // fRunningMeanDevationMSecs is stored scaled up 4x
         const SInt32 CurRetransmitTimeout()     { return fCurRetransmitTimeout; }
         const SInt32 GetCurrentBandwidthInBps()
-            { return (fUnadjustedRTO > 0) ? (fCongestionWindow * 1000) / fUnadjustedRTO : 0; }
+            { return (fUnadjustedRTO > 0) ? (this->CongestionWindow() * 1000) / fUnadjustedRTO : 0; }
+        RTPCongestionController* GetCongestionController() { return fController; }
         inline const UInt32 RecommendedClientAckTimeout() { return fAckTimeout; }
         void UpdateAckTimeout(UInt32 bitsSentInInterval, SInt64 intervalLengthInMsec);
         void UpdateStats();
@@ -119,9 +127,16 @@ class RTPBandwidthTracker
         SInt32              GetMinRTO()                     { return fMinRTO; }
         SInt32              GetAvgRTO()                     { return (SInt32)(fTotalRTO / (SInt64)fNumStatsSamples); }
         
+#if _RTPBANDWIDTHTRACKER_TESTING_
+        //
+        // Streams a simulated movie over a few simulated links with each congestion
+        // controller, and prints the goodput and the rebuffer events at the client.
+        static void Test();
+#endif
+        
         enum
         {
-            kMaximumSegmentSize = 1466,  // enet - just a guess!
+            kMaximumSegmentSize = RTPCongestionController::kMaximumSegmentSize,
             
             //
             // Our algorithm for telling the client what the ack timeout
@@ -142,15 +157,11 @@ class RTPBandwidthTracker
         
         //
         // Tracking our window sizes
-        SInt64              fLastCongestionAdjust;
-        SInt32              fCongestionWindow;      // implentation of VJ congestion avoidance
-        SInt32              fSlowStartThreshold;    // point at which we stop adding to the window for each ack, and add to the window for each window full of acks
-        SInt32              fSlowStartByteCount;            // counts window a full of acks when past ss thresh
+        RTPCongestionController* fController;       // owns the congestion window
         SInt32              fClientWindow;          // max window size based on client UDP buffer
         UInt32              fBytesInList;               // how many unacked bytes on this stream
         UInt32              fAckTimeout;
         
-        Bool16              fUseSlowStart;
         Bool16              fIsRetransmitting;      // are we in the re-transmit 'state' ( started resending, but have yet to send 'new' data
 
         //
@@ -0,0 +1,350 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPCongestionController.cpp
+
+    Contains:   Implementation of classes decribed in .h file
+
+*/
+
+#include "RTPCongestionController.h"
+#include "OSMemory.h"
+
+RTPCongestionController* RTPCongestionController::Create(UInt32 inType, Bool16 inUseSlowStart)
+{
+    if (inType == kDelayBasedCongestionControl)
+        return NEW RTPDelayBasedController(inUseSlowStart);
+
+    return NEW RTPRenoController(inUseSlowStart);
+}
+
+void RTPRenoController::SetWindowSize(SInt32 inClientWindow)
+{
+    fClientWindow = inClientWindow;
+    fLastCongestionAdjust = 0;
+
+    if ( fUseSlowStart )
+    {
+        fSlowStartThreshold = inClientWindow * 3 / 4;
+
+        //
+        // This is a change to the standard TCP slow start algorithm. What
+        // we found was that on high bitrate high latency networks (a DSL connection, perhaps),
+        // it took just too long for the ACKs to come in and for the window size to
+        // grow enough. So we cheat a bit.
+        fCongestionWindow = inClientWindow / 2;
+        //fCongestionWindow = kMaximumSegmentSize;
+    }
+    else
+    {
+        fSlowStartThreshold = inClientWindow;
+        fCongestionWindow = inClientWindow;
+    }
+
+    if ( fSlowStartThreshold < kMaximumSegmentSize )
+        fSlowStartThreshold = kMaximumSegmentSize;
+}
+
+void RTPRenoController::OpenWindow(UInt32 bytesIncreased)
+{
+    // update the congestion window by the number of bytes just acknowledged.
+
+    if ( fCongestionWindow >= fSlowStartThreshold )
+    {
+        // when we hit the slow start threshold, only increase the
+        // window for each window full of acks.
+        fCongestionWindow += bytesIncreased * bytesIncreased / fCongestionWindow;
+    }
+    else
+        //
+        // This is a change to the standard TCP slow start algorithm. What
+        // we found was that on high bitrate high latency networks (a DSL connection, perhaps),
+        // it took just too long for the ACKs to come in and for the window size to
+        // grow enough. So we cheat a bit.
+        fCongestionWindow += bytesIncreased;
+
+
+    if ( fCongestionWindow > fClientWindow )
+        fCongestionWindow = fClientWindow;
+
+//  qtss_printf("Window = %d\n", fCongestionWindow);
+}
+
+void RTPRenoController::PacketResent(SInt64 inCurTimeMSecs)
+{
+    // slow start says that we should reduce the new ss threshold to 1/2
+    // of where started getting errors ( the current congestion window size )
+
+    // so, we get a burst of re-tx becuase our RTO was mis-estimated
+    // it doesn't seem like we should lower the threshold for each one.
+    // it seems like we should just lower it when we first enter
+    // the re-transmit "state"
+//  if ( !fIsRetransmitting )
+//      fSlowStartThreshold = fCongestionWindow/2;
+
+    // make sure that it is at least 1 packet
+    if ( fSlowStartThreshold < kMaximumSegmentSize )
+        fSlowStartThreshold = kMaximumSegmentSize;
+
+    // start the full window segemnt counter over again.
+    fSlowStartByteCount = 0;
+
+    // tcp resets to one (max segment size) mss, but i'm experimenting a bit
+    // with not being so brutal.
+
+    //curAckList->fCongestionWindow = kMaximumSegmentSize;
+
+//  fCongestionWindow = kMaximumSegmentSize;
+//  fCongestionWindow = fCongestionWindow / 2;  // half the congestion window size
+    if (inCurTimeMSecs - fLastCongestionAdjust > 250)
+    {
+        fSlowStartThreshold = fCongestionWindow * 3 / 4;
+        fCongestionWindow = fCongestionWindow / 2;
+        fLastCongestionAdjust = inCurTimeMSecs;
+    }
+
+/*
+    if ( fSlowStartThreshold < fCongestionWindow )
+        fCongestionWindow = fSlowStartThreshold/2;
+    else
+        fCongestionWindow = fCongestionWindow /2;
+*/
+
+    if ( fCongestionWindow < kMaximumSegmentSize )
+        fCongestionWindow = kMaximumSegmentSize;
+
+    // qtss_printf("Congestion window now %d\n", fCongestionWindow);
+}
+
+UInt32 RTPDelayBasedController::sProbeBWGainPercent[kNumGainCycles] = { 125, 75, 100, 100, 100, 100, 100, 100 };
+
+RTPDelayBasedController::RTPDelayBasedController(Bool16 inUseSlowStart)
+ :  RTPCongestionController(kDelayBasedCongestionControl),
+    fState(kStartupState),
+    fUseSlowStart(inUseSlowStart),
+    fSegmentSize(0),
+    fBottleneckBandwidth(0),
+    fFullBandwidth(0),
+    fFullBandwidthRounds(0),
+    fDelivered(0),
+    fRoundStartDelivered(0),
+    fRoundEndDelivered(0),
+    fRoundStartTime(0),
+    fRoundCount(0),
+    fRoundWindowLimited(false),
+    fGainCycle(0),
+    fMinRTT(0),
+    fMinRTTStamp(0),
+    fProbeRTTMin(0),
+    fProbeRTTDoneTime(0),
+    fStateBeforeProbeRTT(kStartupState)
+{
+    for (UInt32 x = 0; x < kBandwidthFilterRounds; x++)
+        fBandwidthSamples[x] = 0;
+}
+
+void RTPDelayBasedController::SetWindowSize(SInt32 inClientWindow)
+{
+    fClientWindow = inClientWindow;
+
+    //
+    // Start where the Reno controller does. Until the first round is over there
+    // is nothing to base the window on, and the acks are slow to come in.
+    if (fUseSlowStart)
+        fCongestionWindow = inClientWindow / 2;
+    else
+        fCongestionWindow = inClientWindow;
+
+    if (fCongestionWindow < this->GetMinWindow())
+        fCongestionWindow = this->GetMinWindow();
+}
+
+void RTPDelayBasedController::PacketSent(UInt32 inNumBytes, UInt32 inBytesInList)
+{
+    if ((SInt32)inNumBytes > fSegmentSize)
+        fSegmentSize = inNumBytes;
+    if ((SInt32)inBytesInList >= fCongestionWindow)
+        fRoundWindowLimited = true;
+}
+
+void RTPDelayBasedController::PacketAcked(UInt32 inNumBytes, UInt32 inBytesInList, SInt64 inCurTimeMSecs)
+{
+    fDelivered += inNumBytes;
+
+    //
+    // Rounds last at least one min RTT, so a few acks that come in together
+    // don't make a bandwidth sample.
+    if (fRoundStartTime == 0)
+        this->StartRound(inBytesInList, inCurTimeMSecs);
+    else if ((fDelivered >= fRoundEndDelivered) && (inCurTimeMSecs - fRoundStartTime >= ((fMinRTT > 0) ? fMinRTT : 1)))
+        this->EndRound(inBytesInList, inCurTimeMSecs);
+
+    if ((fState == kDrainState) && ((SInt32)inBytesInList <= this->GetBandwidthDelayProduct()))
+    {
+        fState = kProbeBWState;
+        fGainCycle = 2;
+    }
+
+    this->CheckProbeRTT(inBytesInList, inCurTimeMSecs);
+    this->SetTargetWindow(inNumBytes);
+}
+
+void RTPDelayBasedController::StartRound(UInt32 inBytesInList, SInt64 inCurTimeMSecs)
+{
+    fRoundStartTime = inCurTimeMSecs;
+    fRoundStartDelivered = fDelivered;
+    fRoundEndDelivered = fDelivered + inBytesInList;
+    fRoundWindowLimited = ((SInt32)inBytesInList >= fCongestionWindow);
+}
+
+void RTPDelayBasedController::EndRound(UInt32 inBytesInList, SInt64 inCurTimeMSecs)
+{
+    UInt32 theSample = (UInt32)(((fDelivered - fRoundStartDelivered) * 1000) / (UInt64)(inCurTimeMSecs - fRoundStartTime));
+
+    //
+    // If the window never filled up, the acks came in as fast as we had packets
+    // to send, not as fast as the path could take them. That can raise the
+    // estimate but not lower it.
+    if (!fRoundWindowLimited && (theSample < fBottleneckBandwidth))
+        theSample = fBottleneckBandwidth;
+
+    fRoundCount++;
+    fBandwidthSamples[fRoundCount % kBandwidthFilterRounds] = theSample;
+    fBottleneckBandwidth = 0;
+    for (UInt32 x = 0; x < kBandwidthFilterRounds; x++)
+    {
+        if (fBandwidthSamples[x] > fBottleneckBandwidth)
+            fBottleneckBandwidth = fBandwidthSamples[x];
+    }
+
+    if ((fState == kStartupState) && fRoundWindowLimited)
+    {
+        if ((UInt64)fBottleneckBandwidth * 4 >= (UInt64)fFullBandwidth * 5)
+        {
+            fFullBandwidth = fBottleneckBandwidth;
+            fFullBandwidthRounds = 0;
+        }
+        else if (++fFullBandwidthRounds >= kFullBandwidthRounds)
+            fState = kDrainState;
+    }
+    else if (fState == kProbeBWState)
+        fGainCycle = (fGainCycle + 1) % kNumGainCycles;
+
+    this->StartRound(inBytesInList, inCurTimeMSecs);
+}
+
+void RTPDelayBasedController::CheckProbeRTT(UInt32 inBytesInList, SInt64 inCurTimeMSecs)
+{
+    if (fState != kProbeRTTState)
+    {
+        //
+        // The min RTT only goes down, so once in a while we let the queue empty
+        // to see if the path got longer.
+        if ((fMinRTTStamp != 0) && (inCurTimeMSecs - fMinRTTStamp > kMinRTTLifetimeMSecs))
+        {
+            fStateBeforeProbeRTT = fState;
+            fState = kProbeRTTState;
+            fProbeRTTMin = 0;
+            fProbeRTTDoneTime = 0;
+        }
+        return;
+    }
+
+    if (fProbeRTTDoneTime == 0)
+    {
+        if ((SInt32)inBytesInList <= this->GetMinWindow())
+            fProbeRTTDoneTime = inCurTimeMSecs + kProbeRTTMSecs;
+    }
+    else if (inCurTimeMSecs >= fProbeRTTDoneTime)
+    {
+        if (fProbeRTTMin > 0)
+            fMinRTT = fProbeRTTMin;
+        fMinRTTStamp = inCurTimeMSecs;
+        fState = fStateBeforeProbeRTT;
+    }
+}
+
+void RTPDelayBasedController::SetTargetWindow(UInt32 inNumBytesAcked)
+{
+    SInt32 theBDP = this->GetBandwidthDelayProduct();
+    fSlowStartThreshold = theBDP;
+
+    SInt32 theTarget = fClientWindow;
+    if (theBDP > 0)
+    {
+        switch (fState)
+        {
+            case kStartupState:
+                theTarget = (SInt32)(((SInt64)theBDP * kStartupGainPercent) / 100);
+                break;
+            case kDrainState:
+                theTarget = theBDP;
+                break;
+            case kProbeBWState:
+                theTarget = (SInt32)(((SInt64)theBDP * kWindowGainPercent * sProbeBWGainPercent[fGainCycle]) / 10000);
+                break;
+            case kProbeRTTState:
+                theTarget = 0;
+                break;
+        }
+    }
+
+    if (theTarget < this->GetMinWindow())
+        theTarget = this->GetMinWindow();
+    if (theTarget > fClientWindow)
+        theTarget = fClientWindow;
+
+    //
+    // Grow toward the target as acks come in, but drop to it at once
+    if (fCongestionWindow + (SInt32)inNumBytesAcked < theTarget)
+        fCongestionWindow += inNumBytesAcked;
+    else
+        fCongestionWindow = theTarget;
+}
+
+void RTPDelayBasedController::PacketResent(SInt64 /*inCurTimeMSecs*/)
+{
+    //
+    // On a lossy link resends say nothing about the queue, so they don't shrink
+    // the window. They do end startup, since by then the window is usually big
+    // enough to overflow the queue.
+    if ((fState == kStartupState) && (fBottleneckBandwidth > 0))
+        fState = kDrainState;
+}
+
+void RTPDelayBasedController::RTTSample(SInt32 inRTTMSecs, SInt64 inCurTimeMSecs)
+{
+    if (inRTTMSecs < 1)
+        inRTTMSecs = 1;
+
+    if ((fState == kProbeRTTState) && ((fProbeRTTMin == 0) || (inRTTMSecs < fProbeRTTMin)))
+        fProbeRTTMin = inRTTMSecs;
+
+    if ((fMinRTT == 0) || (inRTTMSecs <= fMinRTT))
+    {
+        fMinRTT = inRTTMSecs;
+        fMinRTTStamp = inCurTimeMSecs;
+    }
+}
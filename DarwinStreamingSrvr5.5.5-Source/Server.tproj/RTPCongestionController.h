@@ -0,0 +1,229 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPCongestionController.h
+
+    Contains:   The congestion window of an RTPBandwidthTracker. The tracker keeps
+                the bytes in flight and the RTT estimate, and tells its controller
+                about every packet sent, acked, expired and resent. The controller
+                decides how big the window is.
+
+                RTPRenoController is the Van Jacobson slow start and congestion
+                avoidance the tracker has always used.
+
+                RTPDelayBasedController is modelled on BBR. It estimates the
+                bottleneck bandwidth from the rate acks come in and the propagation
+                delay from the smallest RTT, and keeps the window at a multiple of
+                their product. Resends don't shrink the window, so random loss
+                doesn't collapse it.
+
+    ref:
+
+    BBR: Congestion-Based Congestion Control - Cardwell, Cheng, Gunn, Yeganeh,
+    Jacobson, ACM Queue, September-October 2016
+*/
+
+#ifndef __RTP_CONGESTION_CONTROLLER_H__
+#define __RTP_CONGESTION_CONTROLLER_H__
+
+#include "OSHeaders.h"
+
+class RTPCongestionController
+{
+    public:
+
+        enum
+        {
+            kRenoCongestionControl          = 0,    // "reno"
+            kDelayBasedCongestionControl    = 1,    // "bbr"
+
+            kMaximumSegmentSize = 1466  // enet - just a guess!
+        };
+
+        //
+        // Returns a new controller of the given type. Unknown types get
+        // a Reno controller.
+        static RTPCongestionController* Create(UInt32 inType, Bool16 inUseSlowStart);
+
+        virtual ~RTPCongestionController() {}
+
+        //
+        // Called once, before the stream starts to send, with the client's window size.
+        virtual void    SetWindowSize(SInt32 inClientWindow) = 0;
+
+        //
+        // inNumBytes were just sent. inBytesInList includes them.
+        virtual void    PacketSent(UInt32 /*inNumBytes*/, UInt32 /*inBytesInList*/) {}
+
+        //
+        // inNumBytes were acked by the client. inBytesInList no longer includes them.
+        virtual void    PacketAcked(UInt32 inNumBytes, UInt32 inBytesInList, SInt64 inCurTimeMSecs) = 0;
+
+        //
+        // inNumBytes left the window without being acked: they expired, or
+        // they stand in for an ack of a packet we no longer have.
+        virtual void    WindowEmptied(UInt32 inNumBytes, UInt32 inBytesInList) = 0;
+
+        //
+        // A packet was resent because its ack didn't come in time.
+        virtual void    PacketResent(SInt64 inCurTimeMSecs) = 0;
+
+        //
+        // Every sample RTPBandwidthTracker::AddToRTTEstimate gets.
+        virtual void    RTTSample(SInt32 /*inRTTMSecs*/, SInt64 /*inCurTimeMSecs*/) {}
+
+        //
+        // ACCESSORS
+        UInt32  GetType()               { return fType; }
+        SInt32  CongestionWindow()      { return fCongestionWindow; }
+        SInt32  SlowStartThreshold()    { return fSlowStartThreshold; }
+
+    protected:
+
+        RTPCongestionController(UInt32 inType)
+         :  fType(inType),
+            fClientWindow(0),
+            fCongestionWindow(kMaximumSegmentSize),
+            fSlowStartThreshold(0)
+        {}
+
+        UInt32  fType;
+        SInt32  fClientWindow;          // max window size based on client UDP buffer
+        SInt32  fCongestionWindow;
+        SInt32  fSlowStartThreshold;    // the Reno threshold; the delay based controller reports its bandwidth-delay product here
+};
+
+class RTPRenoController : public RTPCongestionController
+{
+    public:
+
+        RTPRenoController(Bool16 inUseSlowStart)
+         :  RTPCongestionController(kRenoCongestionControl),
+            fLastCongestionAdjust(0),
+            fSlowStartByteCount(0),
+            fUseSlowStart(inUseSlowStart)
+        {}
+
+        virtual ~RTPRenoController() {}
+
+        virtual void    SetWindowSize(SInt32 inClientWindow);
+        virtual void    PacketAcked(UInt32 inNumBytes, UInt32 /*inBytesInList*/, SInt64 /*inCurTimeMSecs*/)
+                            { this->OpenWindow(inNumBytes); }
+        virtual void    WindowEmptied(UInt32 inNumBytes, UInt32 /*inBytesInList*/)
+                            { this->OpenWindow(inNumBytes); }
+        virtual void    PacketResent(SInt64 inCurTimeMSecs);
+
+    private:
+
+        void            OpenWindow(UInt32 inNumBytes);
+
+        SInt64  fLastCongestionAdjust;
+        SInt32  fSlowStartByteCount;    // counts window a full of acks when past ss thresh
+        Bool16  fUseSlowStart;
+};
+
+class RTPDelayBasedController : public RTPCongestionController
+{
+    public:
+
+        RTPDelayBasedController(Bool16 inUseSlowStart);
+        virtual ~RTPDelayBasedController() {}
+
+        virtual void    SetWindowSize(SInt32 inClientWindow);
+        virtual void    PacketSent(UInt32 inNumBytes, UInt32 inBytesInList);
+        virtual void    PacketAcked(UInt32 inNumBytes, UInt32 inBytesInList, SInt64 inCurTimeMSecs);
+        virtual void    WindowEmptied(UInt32 /*inNumBytes*/, UInt32 /*inBytesInList*/) {}
+        virtual void    PacketResent(SInt64 inCurTimeMSecs);
+        virtual void    RTTSample(SInt32 inRTTMSecs, SInt64 inCurTimeMSecs);
+
+        //
+        // ACCESSORS
+        UInt32  GetBottleneckBandwidthInBps()   { return fBottleneckBandwidth; }
+        SInt32  GetMinRTTMSecs()                { return fMinRTT; }
+
+        enum
+        {
+            kStartupState   = 0,    // open the window by every byte acked until the bandwidth stops growing
+            kDrainState     = 1,    // one bandwidth-delay product, until the queue startup built is gone
+            kProbeBWState   = 2,    // cycle the window around kWindowGainPercent of the bandwidth-delay product
+            kProbeRTTState  = 3     // a few packets, long enough to see the propagation delay again
+        };
+        UInt32  GetState()                      { return fState; }
+
+    private:
+
+        void    StartRound(UInt32 inBytesInList, SInt64 inCurTimeMSecs);
+        void    EndRound(UInt32 inBytesInList, SInt64 inCurTimeMSecs);
+        void    CheckProbeRTT(UInt32 inBytesInList, SInt64 inCurTimeMSecs);
+        void    SetTargetWindow(UInt32 inNumBytesAcked);
+        SInt32  GetMinWindow()  { return kMinWindowSegments * ((fSegmentSize > 0) ? fSegmentSize : (SInt32)kMaximumSegmentSize); }
+        SInt32  GetBandwidthDelayProduct()
+                    { return (SInt32)(((SInt64)fBottleneckBandwidth * fMinRTT) / 1000); }
+
+        enum
+        {
+            kBandwidthFilterRounds  = 10,       // the bandwidth estimate is the biggest sample in this many rounds
+            kMinRTTLifetimeMSecs    = 10000,    // go to kProbeRTTState if the min RTT is older than this
+            kProbeRTTMSecs          = 200,
+            kMinWindowSegments      = 4,
+            kFullBandwidthRounds    = 3,        // startup ends after this many rounds without 25% more bandwidth
+            kNumGainCycles          = 8,
+
+            kStartupGainPercent     = 289,      // 2 / ln 2, which doubles the rate every round
+            kWindowGainPercent      = 150       // BBR uses 200, but our RTT samples already include the time the client holds acks
+        };
+        static UInt32   sProbeBWGainPercent[kNumGainCycles];
+
+        UInt32  fState;
+        Bool16  fUseSlowStart;
+        SInt32  fSegmentSize;           // the largest packet sent
+
+        //
+        // Bandwidth estimate, in bytes per second
+        UInt32  fBottleneckBandwidth;
+        UInt32  fBandwidthSamples[kBandwidthFilterRounds];
+        UInt32  fFullBandwidth;         // best estimate so far in startup
+        UInt32  fFullBandwidthRounds;
+
+        //
+        // A round ends when everything in flight at its start has been acked.
+        UInt64  fDelivered;             // bytes acked so far
+        UInt64  fRoundStartDelivered;
+        UInt64  fRoundEndDelivered;
+        SInt64  fRoundStartTime;
+        UInt32  fRoundCount;
+        Bool16  fRoundWindowLimited;    // the window was full at some point in the round
+        UInt32  fGainCycle;
+
+        //
+        // Propagation delay estimate
+        SInt32  fMinRTT;
+        SInt64  fMinRTTStamp;
+        SInt32  fProbeRTTMin;
+        SInt64  fProbeRTTDoneTime;
+        UInt32  fStateBeforeProbeRTT;
+};
+
+#endif // __RTP_CONGESTION_CONTROLLER_H__
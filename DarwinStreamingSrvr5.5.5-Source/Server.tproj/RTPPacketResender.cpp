@@ -76,8 +76,12 @@ static const UInt32 kPacketArrayIncreaseInterval = 32;// must be multiple of 2
 static const UInt32 kInitialPacketArraySize = 64;// must be multiple of kPacketArrayIncreaseInterval (Turns out this is as big as we typically need)
 //static const UInt32 kMaxPacketArraySize = 512;// must be multiple of kPacketArrayIncreaseInterval it would have to be a 3 mbit or more
 
+//
+// Packets are copied into the smallest of these that fits. Most are either
+// audio, a few hundred bytes, or video packets close to the MTU.
 static const UInt32 kMaxDataBufferSize = 1600;
-OSBufferPool RTPPacketResender::sBufferPool(kMaxDataBufferSize);
+static const UInt32 kBufferSizeClasses[] = { 128, 256, 512, 768, 1024, 1280, 1472, kMaxDataBufferSize };
+OSSizeClassBufferPool RTPPacketResender::sBufferPool(kBufferSizeClasses, sizeof(kBufferSizeClasses) / sizeof(kBufferSizeClasses[0]));
 unsigned int    RTPPacketResender::sNumWastedBytes = 0;
 
 RTPPacketResender::RTPPacketResender()
@@ -108,14 +112,8 @@ RTPPacketResender::~RTPPacketResender()
     for (UInt32 x = 0; x < fPacketArraySize; x++)
     {
         if (fPacketArray[x].fPacketSize > 0)
-            atomic_sub(&sNumWastedBytes, kMaxDataBufferSize - fPacketArray[x].fPacketSize);
-        if (fPacketArray[x].fPacketData != NULL)
-        {
-            if (fPacketArray[x].fIsSpecialBuffer)
-                delete [] (char*)fPacketArray[x].fPacketData;
-            else
-                sBufferPool.Put(fPacketArray[x].fPacketData);
-        }
+            atomic_sub(&sNumWastedBytes, GetWastedBytes(&fPacketArray[x]));
+        ReleasePacketData(&fPacketArray[x]);
     }
             
     delete [] fPacketArray;
@@ -226,7 +224,25 @@ void RTPPacketResender::SetDestination(UDPSocket* inOutputSocket, UInt32 inDestA
     fDestPort = inDestPort;
 }
 
-RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize)
+UInt32 RTPPacketResender::GetWastedBytes(RTPResenderEntry* inEntry)
+{
+    // Special buffers are allocated to fit, and shared ones aren't ours
+    if (inEntry->fIsSpecialBuffer || (inEntry->fSharedBuffer != NULL) || (inEntry->fPacketData == NULL))
+        return 0;
+    return OSSizeClassBufferPool::GetBufferSize(inEntry->fPacketData) - inEntry->fPacketSize;
+}
+
+void RTPPacketResender::ReleasePacketData(RTPResenderEntry* inEntry)
+{
+    if (inEntry->fSharedBuffer != NULL)
+        inEntry->fSharedBuffer->Release();
+    else if (inEntry->fIsSpecialBuffer)
+        delete [] (char*)inEntry->fPacketData;
+    else if (inEntry->fPacketData != NULL)
+        sBufferPool.Put(inEntry->fPacketData);
+}
+
+RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize, OSSharedBuffer* inSharedBuffer)
 {
     
     RTPResenderEntry* theEntry = NULL;
@@ -271,9 +287,17 @@ RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inP
     }
             
     //
-    // Check to see if this packet is too big for the buffer. If it is, then
-    // we need to specially allocate a special buffer
-    if (inPacketSize > kMaxDataBufferSize)
+    // A shared packet doesn't need a buffer of its own, only a reference.
+    // Otherwise, check to see if this packet is too big for the buffer. If it is,
+    // then we need to specially allocate a special buffer
+    if (inSharedBuffer != NULL)
+    {
+        theEntry->fIsSpecialBuffer = false;
+        inSharedBuffer->Retain();
+        theEntry->fSharedBuffer = inSharedBuffer;
+        theEntry->fPacketData = inSharedBuffer->GetData();
+    }
+    else if (inPacketSize > kMaxDataBufferSize)
     {
         //sBufferPool.Put(theEntry->fPacketData);
         theEntry->fIsSpecialBuffer = true;
@@ -281,7 +305,7 @@ RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inP
     }
     else// It is not special, it's from the buffer pool
     {   theEntry->fIsSpecialBuffer = false;
-        theEntry->fPacketData = sBufferPool.Get();
+        theEntry->fPacketData = sBufferPool.Get(inPacketSize);
     }
 
     
@@ -306,7 +330,7 @@ void RTPPacketResender::ClearOutstandingPackets()
     Assert(fPacketsInList == 0);
 }
 
-void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32 ageLimit )
+void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32 ageLimit, OSSharedBuffer* inSharedBuffer )
 {
     //OSMutexLocker packetQLocker(&fPacketQMutex);
     // the caller needs to adjust the overall age limit by reducing it
@@ -319,7 +343,7 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
     
     if ( ageLimit > 0 )
     {   
-        RTPResenderEntry* theEntry = this->GetEmptyEntry(theSeqNum, packetSize);
+        RTPResenderEntry* theEntry = this->GetEmptyEntry(theSeqNum, packetSize, inSharedBuffer);
 
         //
         // This may happen if this sequence number has already been added.
@@ -329,7 +353,8 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
             
         //
         // Reset all the information in the RTPResenderEntry
-        ::memcpy(theEntry->fPacketData, inRTPPacket, packetSize);
+        if (theEntry->fSharedBuffer == NULL)
+            ::memcpy(theEntry->fPacketData, inRTPPacket, packetSize);
         theEntry->fPacketSize = packetSize;
         theEntry->fAddedTime = OS::Milliseconds();
         theEntry->fOrigRetransTimeout = fBandwidthTracker->CurRetransmitTimeout();
@@ -339,7 +364,7 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
         
         //
         // Track the number of wasted bytes we have
-        atomic_add(&sNumWastedBytes, kMaxDataBufferSize - packetSize);
+        atomic_add(&sNumWastedBytes, GetWastedBytes(theEntry));
         
         //PLDoubleLinkedListNode<RTPResenderEntry> * listNode = NEW PLDoubleLinkedListNode<RTPResenderEntry>( new RTPResenderEntry(inRTPPacket, packetSize, ageLimit, fRTTEstimator.CurRetransmitTimeout() ) );
         //fAckList.AddNodeToTail(listNode);
@@ -410,14 +435,14 @@ void RTPPacketResender::AckPacket( UInt16 inSeqNum, SInt64& inCurTimeInMsec )
         , (long)inSeqNum, fTrackID, OS::Milliseconds()
          );
 #endif      
-        fBandwidthTracker->EmptyWindow(theEntry->fPacketSize);
+        fBandwidthTracker->AckWindow(theEntry->fPacketSize, inCurTimeInMsec);
         if ( theEntry->fNumResends == 0 )
         {
             // add RTT sample...        
             // only use rtt from packets acked after their initial send, do not use
             // estimates gatherered from re-trasnmitted packets.
             //fRTTEstimator.AddToEstimate( theEntry->fPacketRTTDuration.DurationInMilliseconds() );
-            fBandwidthTracker->AddToRTTEstimate( (SInt32) ( inCurTimeInMsec - theEntry->fAddedTime ) );
+            fBandwidthTracker->AddToRTTEstimate( (SInt32) ( inCurTimeInMsec - theEntry->fAddedTime ), inCurTimeInMsec );
         
 //          qtss_printf("Got ack for packet %d RTT = %qd\n", inSeqNum, inCurTimeInMsec - theEntry->fAddedTime);
         }
@@ -450,18 +475,14 @@ void RTPPacketResender::RemovePacket(UInt32 packetIndex, Bool16 reuseIndex)
         
     //
     // Track the number of wasted bytes we have
-    atomic_sub(&sNumWastedBytes, kMaxDataBufferSize - theEntry->fPacketSize);
+    atomic_sub(&sNumWastedBytes, GetWastedBytes(theEntry));
     Assert(theEntry->fPacketSize > 0);
 
     //
     // Update our list information
     Assert(fPacketsInList > 0);
     
-    if (theEntry->fIsSpecialBuffer)
-    {   delete [] (char*)theEntry->fPacketData;
-    }
-    else if (theEntry->fPacketData != NULL)
-        sBufferPool.Put(theEntry->fPacketData);
+    ReleasePacketData(theEntry);
         
 
     if (reuseIndex) // we are re-using the space so keep array contiguous
@@ -544,11 +565,11 @@ void RTPPacketResender::ResendDueEntries()
             // if it's not a dupe, but rather an actual loss, the subseqnuent actuals wil bring down the average quickly
             
             if ( theEntry->fNumResends == 1 )
-                fBandwidthTracker->AddToRTTEstimate( (SInt32) ((theEntry->fOrigRetransTimeout  * 3) / 2 ));
+                fBandwidthTracker->AddToRTTEstimate( (SInt32) ((theEntry->fOrigRetransTimeout  * 3) / 2 ), curTime );
             
 //          qtss_printf("Retransmitted packet %d\n", theEntry->fSeqNum);
             theEntry->fAddedTime = curTime;
-            fBandwidthTracker->AdjustWindowForRetransmit();
+            fBandwidthTracker->AdjustWindowForRetransmit(curTime);
             continue;
         }
         
@@ -42,7 +42,8 @@
 #include "DssStopwatch.h"
 #include "UDPSocket.h"
 #include "OSMemory.h"
-#include "OSBufferPool.h"
+#include "OSSizeClassBufferPool.h"
+#include "OSSharedBuffer.h"
 #include "OSMutex.h"
 
 #define RTP_PACKET_RESENDER_DEBUGGING 0
@@ -56,6 +57,7 @@ class RTPResenderEntry
         void*               fPacketData;
         UInt32              fPacketSize;
         Bool16              fIsSpecialBuffer;
+        OSSharedBuffer*     fSharedBuffer;  // if set, fPacketData is in it, and this holds a reference to it
         SInt64              fExpireTime;
         SInt64              fAddedTime;
         SInt64              fOrigRetransTimeout;
@@ -81,8 +83,10 @@ class RTPPacketResender
         
         //
         // AddPacket adds a new packet to the resend queue. This will not send the packet.
+        // If inSharedBuffer is given, rtpPacket is its data, and the queue holds a
+        // reference to it rather than a copy of the packet.
         // AddPacket itself is not thread safe.
-        void                AddPacket( void * rtpPacket, UInt32 packetSize, SInt32 ageLimitInMsec );
+        void                AddPacket( void * rtpPacket, UInt32 packetSize, SInt32 ageLimitInMsec, OSSharedBuffer* inSharedBuffer = NULL );
         
         //
         // Acks a packet. Also not thread safe.
@@ -106,6 +110,7 @@ class RTPPacketResender
         
         static UInt32       GetNumRetransmitBuffers() { return sBufferPool.GetTotalNumBuffers(); }
         static UInt32       GetWastedBufferBytes() { return sNumWastedBytes; }
+        static OSSizeClassBufferPool* GetBufferPool() { return &sBufferPool; }
 
 #if RTP_PACKET_RESENDER_DEBUGGING
         void                SetDebugInfo(UInt32 trackID, UInt16 remoteRTCPPort, UInt32 curPacketDelay);
@@ -155,12 +160,15 @@ class RTPPacketResender
         RTPResenderEntry*   GetEntryByIndex(UInt16 inIndex);
         RTPResenderEntry*   GetEntryBySeqNum(UInt16 inSeqNum);
 
-        RTPResenderEntry*   GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize);
+        RTPResenderEntry*   GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize, OSSharedBuffer* inSharedBuffer);
         void ReallocatePacketArray();
         void RemovePacket(UInt32 packetIndex, Bool16 reuse=true);
         void RemovePacket(RTPResenderEntry* inEntry);
 
-        static OSBufferPool sBufferPool;
+        static UInt32       GetWastedBytes(RTPResenderEntry* inEntry);
+        static void         ReleasePacketData(RTPResenderEntry* inEntry);
+
+        static OSSizeClassBufferPool sBufferPool;
         static unsigned int sNumWastedBytes;
         
         void            UpdateCongestionWindow(SInt32 bytesToOpenBy );
@@ -630,6 +630,15 @@ SInt64 RTPSession::Run()
     		(void)fModule->GetValueAsString (qtssModName, 0, &moduleName);
       		/* ģķͽɫʼRTPݰ */
             (void)fModule->CallDispatch(QTSS_RTPSendPackets_Role, &theParams);
+            
+            //
+            // Send out anything the module wrote with qtssWriteFlagsBufferData
+            RTPStream** theStream = NULL;
+            UInt32 theStreamLen = 0;
+            for (int streamIter = 0; this->GetValuePtr(qtssCliSesStreamObjects, streamIter, (void**)&theStream, &theStreamLen) == QTSS_NoErr; streamIter++)
+                if (theStream && *theStream)
+                    (void)(*theStream)->Flush();
+
 
     #if RTPSESSION_DEBUGGING
             qtss_printf("RTPSession %ld: back from sendPackets, nextPacketTime = %"_64BITARG_"d\n",(SInt32)this, theParams.rtpSendPacketsParams.outNextPacketTime);
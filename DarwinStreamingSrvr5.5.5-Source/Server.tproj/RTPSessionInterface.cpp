@@ -86,7 +86,11 @@ QTSSAttrInfoDict::AttrInfo  RTPSessionInterface::sAttributes[] =
 	/* 33 */ { "qtssCliSesOverBufferEnabled",       NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
     /* 34 */ { "qtssCliSesRTCPPacketsRecv",         NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 35 */ { "qtssCliSesRTCPBytesRecv",           NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
-	/* 36 */ { "qtssCliSesStartedThinning",         NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite  | qtssAttrModePreempSafe }
+	/* 36 */ { "qtssCliSesStartedThinning",         NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite  | qtssAttrModePreempSafe },
+    /* 37 */ { "qtssCliSesSendLatenessHistogram",   SendLatenessHistogram,  qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 38 */ { "qtssCliSesJitterHistogram",         JitterHistogram,        qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 39 */ { "qtssCliSesRoundTripTimeHistogram",  RoundTripTimeHistogram, qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 40 */ { "qtssCliSesPacketLossHistogram",     PacketLossHistogram,    qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe }
     
 };
 
@@ -137,7 +141,7 @@ RTPSessionInterface::RTPSessionInterface()
     fMovieAverageBitRate(0),
     fTeardownReason(0),
     fUniqueID(0),
-    fTracker(QTSServerInterface::GetServer()->GetPrefs()->IsSlowStartEnabled()),
+    fTracker(QTSServerInterface::GetServer()->GetPrefs()->IsSlowStartEnabled(), QTSServerInterface::GetServer()->GetPrefs()->GetCongestionControl()),
 	fOverbufferWindow(QTSServerInterface::GetServer()->GetPrefs()->GetSendIntervalInMsec(),kUInt32_Max, QTSServerInterface::GetServer()->GetPrefs()->GetMaxSendAheadTimeInSecs(),
 	QTSServerInterface::GetServer()->GetPrefs()->GetOverbufferRate()),
     fAuthScheme(QTSServerInterface::GetServer()->GetPrefs()->GetAuthScheme()),
@@ -346,6 +350,26 @@ void* RTPSessionInterface::PacketLossPercent(QTSSDictionary* inSession, UInt32*
     return &theSession->fPacketLossPercent;
 }
 
+void* RTPSessionInterface::GetHistogramSummary(QTSSDictionary* inSession, UInt32 inHistogram, UInt32* outLen)
+{
+    RTPSessionInterface* theSession = (RTPSessionInterface*)inSession;
+    RTPStream* theStream = NULL;
+    UInt32 theLen = sizeof(theStream);
+    
+    OSHistogram theHistogram;
+    for (int x = 0; theSession->GetValue(qtssCliSesStreamObjects, x, (void*)&theStream, &theLen) == QTSS_NoErr; x++)
+    {
+        if (theStream != NULL)
+            theStream->AddToHistogram(inHistogram, &theHistogram);
+
+        theStream = NULL;
+        theLen = sizeof(theStream);
+    }
+    
+    *outLen = theHistogram.GetSummary(theSession->fHistogramSummaries[inHistogram]);
+    return theSession->fHistogramSummaries[inHistogram];
+}
+
 void RTPSessionInterface::CreateDigestAuthenticationNonce() {
 
     // Calculate nonce: MD5 of sessionid:timestamp
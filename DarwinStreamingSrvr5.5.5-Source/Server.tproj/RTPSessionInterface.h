@@ -239,6 +239,17 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         static void* TimeConnected(QTSSDictionary* inSession, UInt32* outLen);
         static void* CurrentBitRate(QTSSDictionary* inSession, UInt32* outLen);
         
+        // The histograms of all the streams added up
+        static void* GetHistogramSummary(QTSSDictionary* inSession, UInt32 inHistogram, UInt32* outLen);
+        static void* SendLatenessHistogram(QTSSDictionary* inSession, UInt32* outLen)
+                        { return GetHistogramSummary(inSession, QTSServerInterface::kSendLatenessHistogram, outLen); }
+        static void* JitterHistogram(QTSSDictionary* inSession, UInt32* outLen)
+                        { return GetHistogramSummary(inSession, QTSServerInterface::kJitterHistogram, outLen); }
+        static void* RoundTripTimeHistogram(QTSSDictionary* inSession, UInt32* outLen)
+                        { return GetHistogramSummary(inSession, QTSServerInterface::kRoundTripTimeHistogram, outLen); }
+        static void* PacketLossHistogram(QTSSDictionary* inSession, UInt32* outLen)
+                        { return GetHistogramSummary(inSession, QTSServerInterface::kPacketLossHistogram, outLen); }
+        
         // Create nonce
         void CreateDigestAuthenticationNonce();
 
@@ -297,6 +308,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         UInt32 fPacketsSent;    
         Float32 fPacketLossPercent;
         SInt64 fTimeConnected;
+        char   fHistogramSummaries[QTSServerInterface::kNumRTPHistograms][OSHistogram::kSummaryBufferSize];
         UInt32 fTotalRTCPPacketsRecv;
         UInt32 fTotalRTCPBytesRecv;
         // Movie size & movie duration. It may not be so good to associate these
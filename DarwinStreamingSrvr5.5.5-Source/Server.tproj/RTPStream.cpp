@@ -95,7 +95,13 @@ QTSSAttrInfoDict::AttrInfo  RTPStream::sAttributes[] =
     /* 35 */ { "qtssRTPStrPacketCountInRTCPInterval",       NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe  },
     /* 36 */ { "qtssRTPStrSvrRTPPort",              NULL,   qtssAttrDataTypeUInt16, qtssAttrModeRead | qtssAttrModePreempSafe  },
     /* 37 */ { "qtssRTPStrClientRTPPort",           NULL,   qtssAttrDataTypeUInt16, qtssAttrModeRead | qtssAttrModePreempSafe  },
-    /* 38 */ { "qtssRTPStrNetworkMode",             NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe  }
+    /* 38 */ { "qtssRTPStrNetworkMode",             NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 39 */ { "qtssRTPStrRoundTripTimeInMsec",     NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 40 */ { "qtssRTPStrTotalNACKedPackets",      NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 41 */ { "qtssRTPStrSendLatenessHistogram",   SendLatenessHistogram,  qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 42 */ { "qtssRTPStrJitterHistogram",         JitterHistogram,        qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 43 */ { "qtssRTPStrRoundTripTimeHistogram",  RoundTripTimeHistogram, qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe  },
+    /* 44 */ { "qtssRTPStrPacketLossHistogram",     PacketLossHistogram,    qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe  }
 
 };
 
@@ -151,6 +157,7 @@ QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)
     fLastPacketCount(0),
     fPacketCountInRTCPInterval(0),
     fByteCount(0),
+    fNextSenderReportIndex(0),
     fTrackID(0),
     fSsrc(inSSRC),
     fSsrcStringPtr(fSsrcString, 0),
@@ -186,6 +193,8 @@ QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)
     fExpectedFrameRate(0),
     fAudioDryCount(0),
     fClientSSRC(0),
+    fRoundTripTime(0),
+    fTotalNACKedPackets(0),
     fIsTCP(false),
     fTransportType(qtssRTPTransportTypeUDP),
     fTurnThinningOffDelay_TCP(0),
@@ -221,6 +230,9 @@ QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)
     fFlowControlStartedMsec = 0;
     fFlowControlDurationMsec = 0;
 #endif
+    ::memset(fSenderReportNTPTimes, 0, sizeof(fSenderReportNTPTimes));
+    ::memset(fSenderReportSendTimes, 0, sizeof(fSenderReportSendTimes));
+
     //format the ssrc as a string
     qtss_sprintf(fSsrcString, "%lu", fSsrc);
     fSsrcStringPtr.Len = ::strlen(fSsrcString);
@@ -267,6 +279,8 @@ QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)
     this->SetVal(qtssRTPStrSvrRTPPort,          &fLocalRTPPort,         sizeof(fLocalRTPPort));
     this->SetVal(qtssRTPStrClientRTPPort,       &fRemoteRTPPort,        sizeof(fRemoteRTPPort));
     this->SetVal(qtssRTPStrNetworkMode,         &fNetworkMode,          sizeof(fNetworkMode));
+    this->SetVal(qtssRTPStrRoundTripTimeInMsec, &fRoundTripTime,        sizeof(fRoundTripTime));
+    this->SetVal(qtssRTPStrTotalNACKedPackets,  &fTotalNACKedPackets,   sizeof(fTotalNACKedPackets));
     
     
 }
@@ -296,6 +310,13 @@ RTPStream::~RTPStream()
 #endif
 }
 
+void* RTPStream::GetHistogramSummary(QTSSDictionary* inStream, UInt32 inHistogram, UInt32* outLen)
+{
+    RTPStream* theStream = (RTPStream*)inStream;
+    *outLen = theStream->fHistograms[inHistogram].GetSummary(theStream->fHistogramSummaries[inHistogram]);
+    return theStream->fHistogramSummaries[inHistogram];
+}
+
 SInt32 RTPStream::GetQualityLevel()
 {
     if (fTransportType == qtssRTPTransportTypeUDP)
@@ -721,7 +742,7 @@ void    RTPStream::SendRetransmits()
 }
 
 //ReliableRTPWrite must be called from a fSession mutex protected caller
-QTSS_Error RTPStream::ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt64& curPacketDelay)
+QTSS_Error RTPStream::ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt64& curPacketDelay, OSSharedBuffer* inSharedBuffer)
 {
     QTSS_Error err = QTSS_NoErr;
 
@@ -784,7 +805,7 @@ QTSS_Error RTPStream::ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt6
         // Assign a lifetime to the packet using the current delay of the packet and
         // the time until this packet becomes stale.
         fBytesSentThisInterval += inLen;
-        fResender.AddPacket( inBuffer, inLen, (SInt32) (fDropAllPacketsForThisStreamDelay - curPacketDelay) );
+        fResender.AddPacket( inBuffer, inLen, (SInt32) (fDropAllPacketsForThisStreamDelay - curPacketDelay), inSharedBuffer );
 
         (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, inBuffer, inLen);
     }
@@ -793,6 +814,13 @@ QTSS_Error RTPStream::ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt6
     return err;
 }
 
+QTSS_Error RTPStream::Flush()
+{
+    if ((fSockets != NULL) && (fTransportType != qtssRTPTransportTypeTCP))
+        (void)fSockets->GetSocketA()->FlushQueue();
+    return QTSS_NoErr;
+}
+
 void RTPStream::SetThinningParams()
 {
     SInt32 toleranceAdjust = 1500 - (SInt32(fLateToleranceInSec * 1000));
@@ -935,11 +963,6 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
     // Data passed into this version of write must be a QTSS_PacketStruct
     QTSS_PacketStruct* thePacket = (QTSS_PacketStruct*)inBuffer;
     thePacket->suggestedWakeupTime = -1;
-    SInt64 theCurrentPacketDelay = theTime - thePacket->packetTransmitTime;
-    
-#if RTP_PACKET_RESENDER_DEBUGGING
-    UInt16* theSeqNum = (UInt16*)thePacket->packetData;
-#endif
 
     //
     // Empty the overbuffer window
@@ -983,137 +1006,213 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
     }
     else if (inFlags & qtssWriteFlagsIsRTP)
     {
-        //
-        // Check to see if this packet fits in the overbuffer window
-        thePacket->suggestedWakeupTime = fSession->GetOverbufferWindow()->CheckTransmitTime(thePacket->packetTransmitTime, theTime, inLen);
-        if (thePacket->suggestedWakeupTime > theTime)
+        err = this->WriteRTPPacket(thePacket, inLen, outLenWritten, inFlags, theTime);
+        if (err == QTSS_WouldBlock)
         {
-            Assert(thePacket->suggestedWakeupTime >= fSession->GetOverbufferWindow()->GetSendInterval());
-#if RTP_PACKET_RESENDER_DEBUGGING
-            fResender.logprintf("Overbuffer window full. Num bytes in overbuffer: %d. Wakeup time: %qd\n",fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), thePacket->packetTransmitTime);
-#endif
-            //qtss_printf("Overbuffer window full. Returning: %qd\n", thePacket->suggestedWakeupTime - theTime);
-            
             fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
             return QTSS_WouldBlock;
         }
+    }
+    else
+    {   fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
+        return QTSS_BadArgument;//qtssWriteFlagsIsRTCP or qtssWriteFlagsIsRTP wasn't specified
+    }
+    
+    if (outLenWritten != NULL)
+        *outLenWritten = inLen;
+        
+    fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
+    return err;
+}
 
-        //
-        // Check to make sure our quality level is correct. This function
-        // also tells us whether this packet is just too old to send
-        if (this->UpdateQualityLevel(thePacket->packetTransmitTime, theCurrentPacketDelay, theTime, inLen))
+
+
+QTSS_Error  RTPStream::WriteRTPPacket(QTSS_PacketStruct* inPacket, UInt32 inLen, UInt32* outLenWritten, UInt32 inFlags,
+                                        const SInt64& inCurrentTime)
+{
+    QTSS_Error err = QTSS_NoErr;
+    SInt64 theCurrentPacketDelay = inCurrentTime - inPacket->packetTransmitTime;
+    
+#if RTP_PACKET_RESENDER_DEBUGGING
+    UInt16* theSeqNum = (UInt16*)inPacket->packetData;
+#endif
+
+    //
+    // Check to see if this packet fits in the overbuffer window
+    inPacket->suggestedWakeupTime = fSession->GetOverbufferWindow()->CheckTransmitTime(inPacket->packetTransmitTime, inCurrentTime, inLen);
+    if (inPacket->suggestedWakeupTime > inCurrentTime)
+    {
+        Assert(inPacket->suggestedWakeupTime >= fSession->GetOverbufferWindow()->GetSendInterval());
+#if RTP_PACKET_RESENDER_DEBUGGING
+        fResender.logprintf("Overbuffer window full. Num bytes in overbuffer: %d. Wakeup time: %qd\n",fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), inPacket->packetTransmitTime);
+#endif
+        //qtss_printf("Overbuffer window full. Returning: %qd\n", inPacket->suggestedWakeupTime - inCurrentTime);
+        
+        return QTSS_WouldBlock;
+    }
+
+    //
+    // Check to make sure our quality level is correct. This function
+    // also tells us whether this packet is just too old to send
+    if (this->UpdateQualityLevel(inPacket->packetTransmitTime, theCurrentPacketDelay, inCurrentTime, inLen))
+    {
+        if ( fTransportType == qtssRTPTransportTypeTCP )    // write out in interleave format on the RTSP TCP channel
+            err = this->InterleavedWrite( inPacket->packetData, inLen, outLenWritten, fRTPChannel );       
+        else if ( fTransportType == qtssRTPTransportTypeReliableUDP )
         {
-            if ( fTransportType == qtssRTPTransportTypeTCP )    // write out in interleave format on the RTSP TCP channel
-                err = this->InterleavedWrite( thePacket->packetData, inLen, outLenWritten, fRTPChannel );       
-            else if ( fTransportType == qtssRTPTransportTypeReliableUDP )
-                err = this->ReliableRTPWrite( thePacket->packetData, inLen, theCurrentPacketDelay );
-            else if ( inLen > 0 )
-                (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
-            
-            if (err == QTSS_NoErr)
-                PrintPacketPrefEnabled( (char*) thePacket->packetData, inLen, (SInt32) RTPStream::rtp);
+            OSSharedBuffer* theSharedBuffer = NULL;
+            if (inFlags & qtssWriteFlagsSharedData)
+                theSharedBuffer = OSSharedBuffer::FromData(inPacket->packetData);
+            err = this->ReliableRTPWrite( inPacket->packetData, inLen, theCurrentPacketDelay, theSharedBuffer );
+        }
+        else if ( (inLen > 0) && (inFlags & qtssWriteFlagsBufferData) && (inFlags & qtssWriteFlagsNoCopy) )
+        {
+            struct iovec theVec;
+            theVec.iov_base = (char*)inPacket->packetData;
+            theVec.iov_len = inLen;
+            (void)fSockets->GetSocketA()->QueueVTo(fRemoteAddr, fRemoteRTPPort, &theVec, 1);
+        }
+        else if ( (inLen > 0) && (inFlags & qtssWriteFlagsBufferData) )
+            (void)fSockets->GetSocketA()->QueueTo(fRemoteAddr, fRemoteRTPPort, inPacket->packetData, inLen);
+        else if ( inLen > 0 )
+            (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, inPacket->packetData, inLen);
         
-            if (err == 0)
+        if (err == QTSS_NoErr)
+            PrintPacketPrefEnabled( (char*) inPacket->packetData, inLen, (SInt32) RTPStream::rtp);
+    
+        if (err == 0)
+        {
+            static SInt64 time = -1;
+            static int byteCount = 0;
+            static SInt64 startTime = -1;
+            static int totalBytes = 0;
+            static int numPackets = 0;
+            static SInt64 firstTime;
+            
+            if (inCurrentTime - time > 1000)
             {
-                static SInt64 time = -1;
-                static int byteCount = 0;
-                static SInt64 startTime = -1;
-                static int totalBytes = 0;
-                static int numPackets = 0;
-                static SInt64 firstTime;
-                
-                if (theTime - time > 1000)
+                if (time != -1)
                 {
-                    if (time != -1)
-                    {
-//                      qtss_printf("   %qd KBit (%d in %qd secs)", byteCount * 8 * 1000 / (theTime - time) / 1024, totalBytes, (theTime - startTime) / 1000);
+//                      qtss_printf("   %qd KBit (%d in %qd secs)", byteCount * 8 * 1000 / (inCurrentTime - time) / 1024, totalBytes, (inCurrentTime - startTime) / 1000);
 //                      if (fTracker)
 //                          qtss_printf(" Window = %d\n", fTracker->CongestionWindow());
 //                      else
 //                          qtss_printf("\n");
-//                      qtss_printf("Packet #%d xmit time = %qd\n", numPackets, (thePacket->packetTransmitTime - firstTime) / 1000);
-                    }
-                    else
-                    {
-                        startTime = theTime;
-                        firstTime = thePacket->packetTransmitTime;
-                    }
-                    
-                    byteCount = 0;
-                    time = theTime;
+//                      qtss_printf("Packet #%d xmit time = %qd\n", numPackets, (inPacket->packetTransmitTime - firstTime) / 1000);
+                }
+                else
+                {
+                    startTime = inCurrentTime;
+                    firstTime = inPacket->packetTransmitTime;
                 }
-
-                byteCount += inLen;
-                totalBytes += inLen;
-                numPackets++;
                 
-//              UInt16* theSeqNumP = (UInt16*)thePacket->packetData;
-//              UInt16 theSeqNum = ntohs(theSeqNumP[1]);
-//				qtss_printf("Packet %d for time %qd sent at %qd (%d bytes)\n", theSeqNum, thePacket->packetTransmitTime - fSession->GetPlayTime(), theTime - fSession->GetPlayTime(), inLen);
+                byteCount = 0;
+                time = inCurrentTime;
             }
-        }   
+
+            byteCount += inLen;
+            totalBytes += inLen;
+            numPackets++;
             
+//              UInt16* theSeqNumP = (UInt16*)inPacket->packetData;
+//              UInt16 theSeqNum = ntohs(theSeqNumP[1]);
+//				qtss_printf("Packet %d for time %qd sent at %qd (%d bytes)\n", theSeqNum, inPacket->packetTransmitTime - fSession->GetPlayTime(), inCurrentTime - fSession->GetPlayTime(), inLen);
+        }
+    }   
+        
 #if RTP_PACKET_RESENDER_DEBUGGING
-        if (err != QTSS_NoErr)
-            fResender.logprintf("Flow controlled: %qd Overbuffer window: %d. Cur time %qd\n", theCurrentPacketDelay, fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), theTime);
-        else
-            fResender.logprintf("Sent packet: %d. Overbuffer window: %d Transmit time %qd. Cur time %qd\n", ntohs(theSeqNum[1]), fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), thePacket->packetTransmitTime, theTime);
+    if (err != QTSS_NoErr)
+        fResender.logprintf("Flow controlled: %qd Overbuffer window: %d. Cur time %qd\n", theCurrentPacketDelay, fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), inCurrentTime);
+    else
+        fResender.logprintf("Sent packet: %d. Overbuffer window: %d Transmit time %qd. Cur time %qd\n", ntohs(theSeqNum[1]), fSession->GetOverbufferWindow()->AvailableSpaceInWindow(), inPacket->packetTransmitTime, inCurrentTime);
 #endif
-        //if (err != QTSS_NoErr)
-        //  qtss_printf("flow controlled\n");
-        if ( err == QTSS_NoErr && inLen > 0 )
-        {
-            // Update statistics if we were actually able to send the data (don't
-            // update if the socket is flow controlled or some such thing)
-            
-            fSession->GetOverbufferWindow()->AddPacketToWindow(inLen);
-            fSession->UpdatePacketsSent(1);
-            fSession->UpdateBytesSent(inLen);
-            QTSServerInterface::GetServer()->IncrementTotalRTPBytes(inLen);
-            QTSServerInterface::GetServer()->IncrementTotalPackets();
-            
-            QTSServerInterface::GetServer()->IncrementTotalLate(theCurrentPacketDelay);
-            QTSServerInterface::GetServer()->IncrementTotalQuality(this->GetQualityLevel());
+    //if (err != QTSS_NoErr)
+    //  qtss_printf("flow controlled\n");
+    if ( err == QTSS_NoErr && inLen > 0 )
+    {
+        // Update statistics if we were actually able to send the data (don't
+        // update if the socket is flow controlled or some such thing)
+        
+        fSession->GetOverbufferWindow()->AddPacketToWindow(inLen);
+        fSession->UpdatePacketsSent(1);
+        fSession->UpdateBytesSent(inLen);
+        QTSServerInterface::GetServer()->IncrementTotalRTPBytes(inLen);
+        QTSServerInterface::GetServer()->IncrementTotalPackets();
+        
+        QTSServerInterface::GetServer()->IncrementTotalLate(theCurrentPacketDelay);
+        QTSServerInterface::GetServer()->IncrementTotalQuality(this->GetQualityLevel());
+        this->RecordStat(QTSServerInterface::kSendLatenessHistogram, (theCurrentPacketDelay > 0) ? (UInt32)theCurrentPacketDelay : 0);
 
-            // Record the RTP timestamp for RTCPs
-            UInt32* timeStampP = (UInt32*)(thePacket->packetData);
-            fLastRTPTimestamp = ntohl(timeStampP[1]);
-            
-            //stream statistics
-            fPacketCount++;
-            fByteCount += inLen;
-
-            // Send an RTCP sender report if it's time. Again, we only want to send an
-            // RTCP if the RTP packet was sent sucessfully
-            if ((fSession->GetPlayFlags() & qtssPlayFlagsSendRTCP) &&
-                (theTime > (fLastSenderReportTime + (kSenderReportIntervalInSecs * 1000))))
-            {
-                fLastSenderReportTime = theTime;
-                // CISCO comments
-                // thePacket->packetTransmissionTime is
-                // the expected transmission time, which
-                // is what we should report in RTCP for
-                // synchronization purposes, not theTime,
-                // which is the actual transmission time.
-                this->SendRTCPSR(thePacket->packetTransmitTime);
-            }
-            
+        // Record the RTP timestamp for RTCPs
+        UInt32* timeStampP = (UInt32*)(inPacket->packetData);
+        fLastRTPTimestamp = ntohl(timeStampP[1]);
+        
+        //stream statistics
+        fPacketCount++;
+        fByteCount += inLen;
+
+        // Send an RTCP sender report if it's time. Again, we only want to send an
+        // RTCP if the RTP packet was sent sucessfully
+        if ((fSession->GetPlayFlags() & qtssPlayFlagsSendRTCP) &&
+            (inCurrentTime > (fLastSenderReportTime + (kSenderReportIntervalInSecs * 1000))))
+        {
+            fLastSenderReportTime = inCurrentTime;
+            // CISCO comments
+            // inPacket->packetTransmissionTime is
+            // the expected transmission time, which
+            // is what we should report in RTCP for
+            // synchronization purposes, not inCurrentTime,
+            // which is the actual transmission time.
+            this->SendRTCPSR(inPacket->packetTransmitTime);
         }
-    }
-    else
-    {   fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
-        return QTSS_BadArgument;//qtssWriteFlagsIsRTCP or qtssWriteFlagsIsRTP wasn't specified
+        
     }
     
-    if (outLenWritten != NULL)
-        *outLenWritten = inLen;
+    return err;
+}
+
+QTSS_Error  RTPStream::WritePackets(QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets,
+                                    UInt32* outNumPacketsWritten, QTSS_WriteFlags inFlags)
+{
+    Assert(fSession != NULL);
+    *outNumPacketsWritten = 0;
+    if (!(inFlags & qtssWriteFlagsIsRTP))
+        return QTSS_BadArgument;
+    if (!fSession->GetSessionMutex()->TryLock())
+        return EAGAIN;
+
+    QTSS_Error err = QTSS_NoErr;
+    SInt64 theTime = OS::Milliseconds();
+    
+    //
+    // Empty the overbuffer window
+    fSession->GetOverbufferWindow()->EmptyOutWindow(theTime);
+
+    //
+    // Update the bit rate value
+    fSession->UpdateCurrentBitRate(theTime);
+    
+    //
+    // Is this the first write in a write burst?
+    if (inFlags & qtssWriteFlagsWriteBurstBegin)
+        fSession->GetOverbufferWindow()->MarkBeginningOfWriteBurst();
+    
+    for ( ; *outNumPacketsWritten < inNumPackets; (*outNumPacketsWritten)++)
+    {
+        QTSS_PacketStruct* thePacket = &inPackets[*outNumPacketsWritten];
+        UInt32 theLenWritten = 0;
+        
+        thePacket->suggestedWakeupTime = -1;
+        err = this->WriteRTPPacket(thePacket, inPacketLens[*outNumPacketsWritten], &theLenWritten, inFlags, theTime);
+        if (err != QTSS_NoErr)
+            break;
+    }
         
     fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
     return err;
 }
 
 
-
 // SendRTCPSR is called by the session as well as the strem
 // SendRTCPSR must be called from a fSession mutex protected caller
 void RTPStream::SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye)
@@ -1125,11 +1224,12 @@ void RTPStream::SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye)
         // pretty much ok.
     UInt32 payloadByteCount = fByteCount - (12 * fPacketCount);
         
+    SInt64 theNTPTime = fSession->GetNTPPlayTime() + OS::TimeMilli_To_Fixed64Secs(inTime - fSession->GetPlayTime());
+        
     RTCPSRPacket* theSR = fSession->GetSRPacket();
     theSR->SetSSRC(fSsrc);
     theSR->SetClientSSRC(fClientSSRC);
-    theSR->SetNTPTimestamp(fSession->GetNTPPlayTime() +
-                            OS::TimeMilli_To_Fixed64Secs(inTime - fSession->GetPlayTime()));
+    theSR->SetNTPTimestamp(theNTPTime);
     theSR->SetRTPTimestamp(fLastRTPTimestamp);
     theSR->SetPacketCount(fPacketCount);
     theSR->SetByteCount(payloadByteCount);
@@ -1154,7 +1254,17 @@ void RTPStream::SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye)
     }
     
     if (err == QTSS_NoErr)
+    {
         PrintPacketPrefEnabled((char *) theSR->GetSRPacket(), thePacketLen, (SInt32) RTPStream::rtcpSR); // if we are flow controlled this packet is not sent
+
+        //
+        // Remember when this SR went out, so we can get the round trip time from
+        // the receiver report that refers to it. The SR's timestamp is the expected
+        // transmit time of the last packet, which may be well ahead of now.
+        fSenderReportNTPTimes[fNextSenderReportIndex] = (UInt32)((theNTPTime >> 16) & 0xFFFFFFFF);
+        fSenderReportSendTimes[fNextSenderReportIndex] = OS::Milliseconds();
+        fNextSenderReportIndex = (fNextSenderReportIndex + 1) % kNumSenderReportTimes;
+    }
 }
 
 
@@ -1225,6 +1335,14 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
                 fFractionLostPackets = receiverPacket.GetCumulativeFractionLostPackets();
                 fJitter = receiverPacket.GetCumulativeJitter();
                 
+                // The fraction lost is out of 256, the jitter is in RTP timestamp units
+                if (receiverPacket.GetReportCount() > 0)
+                {
+                    this->RecordStat(QTSServerInterface::kPacketLossHistogram, (fFractionLostPackets * 100) / 256);
+                    if (fTimescale > 0)
+                        this->RecordStat(QTSServerInterface::kJitterHistogram, (UInt32)(((UInt64)fJitter * 1000) / fTimescale));
+                }
+                
                 UInt32 curTotalLostPackets = receiverPacket.GetCumulativeTotalLostPackets();
                 
                 // Workaround for client problem.  Sometimes it appears to report a bogus lost packet count.
@@ -1251,6 +1369,33 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
                     fPacketCountInRTCPInterval = fPacketCount - fLastPacketCount;
                     fLastPacketCount = fPacketCount;
                 }
+                
+                //
+                // If the client has heard one of our sender reports, its report block
+                // tells us the round trip time: now, less when that SR went out, less
+                // how long the client held on to it. The LSR has to match one of our
+                // SRs, so we don't need to check the block's SSRC as well.
+                for (int theReportNum = 0; theReportNum < receiverPacket.GetReportCount(); theReportNum++)
+                {
+                    UInt32 theLastSR = receiverPacket.GetLastSenderReportTime(theReportNum);
+                    if (theLastSR == 0)
+                        continue;
+
+                    for (UInt32 srIndex = 0; srIndex < kNumSenderReportTimes; srIndex++)
+                    {
+                        if ((fSenderReportNTPTimes[srIndex] != theLastSR) || (fSenderReportSendTimes[srIndex] == 0))
+                            continue;
+                        
+                        SInt64 theDelay = ((SInt64)receiverPacket.GetLastSenderReportDelay(theReportNum) * 1000) >> 16;
+                        SInt64 theRoundTripTime = curTime - fSenderReportSendTimes[srIndex] - theDelay;
+                        if (theRoundTripTime >= 0) // ignore a client that says it held the SR longer than it could have
+                        {
+                            fRoundTripTime = (theRoundTripTime > 0) ? (UInt32)theRoundTripTime : 1;
+                            this->RecordStat(QTSServerInterface::kRoundTripTimeHistogram, fRoundTripTime);
+                        }
+                        break;
+                    }
+                }
 
 #ifdef DEBUG_RTCP_PACKETS
                 receiverPacket.Dump();
@@ -1342,6 +1487,23 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
             }
             break;
             
+            case RTCPPacket::kRTPFeedbackPacketType:
+            {
+                //
+                // We don't resend packets for plain UDP streams, but a generic NACK
+                // still tells us how many packets the client missed. Modules see the
+                // total in qtssRTPStrTotalNACKedPackets.
+                RTCPNACKPacket theNACKPacket;
+                if (theNACKPacket.ParseNACKPacket((UInt8*)currentPtr.Ptr, currentPtr.Len))
+                {
+                    fTotalNACKedPackets += theNACKPacket.GetNumLostPackets();
+#ifdef DEBUG_RTCP_PACKETS
+                    theNACKPacket.Dump();
+#endif
+                }
+            }
+            break;
+            
             case RTCPPacket::kSDESPacketType:
             {
 #ifdef DEBUG_RTCP_PACKETS
@@ -87,6 +87,18 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         virtual QTSS_Error  Write(void* inBuffer, UInt32 inLen,
                                         UInt32* outLenWritten, QTSS_WriteFlags inFlags);
         
+        // Writes inNumPackets RTP packets as if by one Write each, but takes the
+        // session lock and updates the overbuffer window once for all of them.
+        // Stops at the first packet Write would have refused, and returns what
+        // Write would have for it. *outNumPacketsWritten is how many went.
+        virtual QTSS_Error  WritePackets(QTSS_PacketStruct* inPackets, UInt32* inPacketLens, UInt32 inNumPackets,
+                                        UInt32* outNumPacketsWritten, QTSS_WriteFlags inFlags);
+        
+        // RTP packets written over UDP with qtssWriteFlagsBufferData may be held on
+        // the socket's send queue until Flush is called, so they can go out together.
+        virtual QTSS_Error  Flush();
+        
+
         
         //UTILITY FUNCTIONS:
         //These are not necessary to call and do not manipulate the state of the
@@ -134,6 +146,12 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
 		void EnableSSRC() { fEnableSSRC = true; }
 		void DisableSSRC() { fEnableSSRC = false; }
 		
+        //
+        // Adds this stream's distribution of one of the QTSServerInterface::k...Histogram
+        // statistics to ioHistogram
+        void AddToHistogram(UInt32 inHistogram, OSHistogram* ioHistogram)
+                                { ioHistogram->Add(&fHistograms[inHistogram]); }
+		
     private:
         
         enum
@@ -143,6 +161,7 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
             kDefaultPayloadBufSize      = 32,
             kSenderReportIntervalInSecs = 7,
             kNumPrebuiltChNums          = 10,
+            kNumSenderReportTimes       = 4     // sender reports we remember, for matching receiver reports to
         };
     
         SInt64 fLastQualityChange;
@@ -177,6 +196,12 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         UInt32      fPacketCountInRTCPInterval;
         UInt32      fByteCount;
         
+        // When our last few sender reports went out, and the middle 32 bits of
+        // their NTP timestamps, which is what a receiver report's LSR holds
+        UInt32      fSenderReportNTPTimes[kNumSenderReportTimes];
+        SInt64      fSenderReportSendTimes[kNumSenderReportTimes];
+        UInt32      fNextSenderReportIndex;
+        
         // DICTIONARY ATTRIBUTES
         
         //Module assigns a streamID to this object
@@ -229,6 +254,13 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         UInt16      fExpectedFrameRate;
         UInt16      fAudioDryCount;
         UInt32      fClientSSRC;
+        UInt32      fRoundTripTime;
+        UInt32      fTotalNACKedPackets;
+        
+        // Distributions of send lateness and of what the receiver reports say.
+        // Only written with the session mutex held.
+        OSHistogram fHistograms[QTSServerInterface::kNumRTPHistograms];
+        char        fHistogramSummaries[QTSServerInterface::kNumRTPHistograms][OSHistogram::kSummaryBufferSize];
         
         Bool16      fIsTCP;
         QTSS_RTPTransportType   fTransportType;
@@ -286,10 +318,31 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         // acutally write the data out that way
         QTSS_Error  InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel );
 
+        // The RTP half of Write, called with the session lock held
+        QTSS_Error  WriteRTPPacket(QTSS_PacketStruct* inPacket, UInt32 inLen, UInt32* outLenWritten, UInt32 inFlags,
+                                    const SInt64& inCurrentTime);
+
         // implements the ReliableRTP protocol
-        QTSS_Error  ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt64& curPacketDelay);
+        QTSS_Error  ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt64& curPacketDelay, OSSharedBuffer* inSharedBuffer);
 
         void        SetTCPThinningParams();
+        
+        void        RecordStat(UInt32 inHistogram, UInt32 inValue)
+                        {
+                            fHistograms[inHistogram].Record(inValue);
+                            QTSServerInterface::GetServer()->RecordRTPStat(inHistogram, inValue);
+                        }
+        
+        // Param retrieval functions
+        static void* GetHistogramSummary(QTSSDictionary* inStream, UInt32 inHistogram, UInt32* outLen);
+        static void* SendLatenessHistogram(QTSSDictionary* inStream, UInt32* outLen)
+                        { return GetHistogramSummary(inStream, QTSServerInterface::kSendLatenessHistogram, outLen); }
+        static void* JitterHistogram(QTSSDictionary* inStream, UInt32* outLen)
+                        { return GetHistogramSummary(inStream, QTSServerInterface::kJitterHistogram, outLen); }
+        static void* RoundTripTimeHistogram(QTSSDictionary* inStream, UInt32* outLen)
+                        { return GetHistogramSummary(inStream, QTSServerInterface::kRoundTripTimeHistogram, outLen); }
+        static void* PacketLossHistogram(QTSSDictionary* inStream, UInt32* outLen)
+                        { return GetHistogramSummary(inStream, QTSServerInterface::kPacketLossHistogram, outLen); }
         QTSS_Error  TCPWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, UInt32 inFlags);
 
         static QTSSAttrInfoDict::AttrInfo   sAttributes[];
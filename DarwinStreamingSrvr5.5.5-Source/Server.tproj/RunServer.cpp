@@ -42,6 +42,8 @@
 #include "SocketUtils.h"
 #include "ev.h"
 #include "OSArrayObjectDeleter.h"
+#include "OSFileBlockCache.h"
+#include "OSAsyncFileReader.h"
 #include "Task.h"
 #include "IdleTask.h"
 #include "TimeoutTask.h"
@@ -172,6 +174,11 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
         if (numThreads == 0)
             numThreads = 1;
 
+        TaskThreadPool::SetWorkStealing((numThreads > 1) && sServer->GetPrefs()->GetTaskThreadWorkStealing());
+        TaskThreadPool::SetUseTimingWheel(sServer->GetPrefs()->GetTaskTimingWheel());
+        OSFileBlockCache::Initialize((UInt64)sServer->GetPrefs()->GetFileBlockCacheSizeInMB() * 1024 * 1024);
+        OSAsyncFileReader::Initialize(sServer->GetPrefs()->GetNumAsyncFileReadThreads());
+
 		/* ָ̳߳߳ */
         TaskThreadPool::AddThreads(numThreads);
 		
@@ -179,6 +186,19 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
         qtss_printf("Number of task threads: %lu\n",numThreads);
     #endif
 
+        // Event threads beyond the first get event queues of their own, and sockets
+        // opened from now on are spread across them by file descriptor. The RTSP
+        // listeners, already open by now, stay on the first event thread.
+        UInt32 numEventThreads = sServer->GetPrefs()->GetNumEventThreads();
+        if (numEventThreads == 0)
+            numEventThreads = OS::GetNumProcessors(); // 1 event thread per processor
+        if (numEventThreads > 1)
+            numEventThreads = Socket::AddEventThreads(numEventThreads - 1);
+            
+    #if DEBUG
+        qtss_printf("Number of event threads: %lu\n",numEventThreads);
+    #endif
+
     	/* ʼʱ */
         // Start up the server's global tasks, and start listening
         TimeoutTask::Initialize();     // The TimeoutTask mechanism is task based,
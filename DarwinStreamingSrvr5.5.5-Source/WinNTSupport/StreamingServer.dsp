@@ -257,6 +257,10 @@ SOURCE=..\APIModules\QTSSFileModule\QTSSFileModule.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\APIModules\QTSSFileModule\SDPCache.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\APIModules\QTSSFlowControlModule\QTSSFlowControlModule.cpp
 
 !IF  "$(CFG)" == "StreamingServer - Win32 Debug"
@@ -389,6 +393,10 @@ SOURCE=..\Server.tproj\RTPBandwidthTracker.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\Server.tproj\RTPCongestionController.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\Server.tproj\RTPPacketResender.cpp
 # End Source File
 # Begin Source File